@@ -968,6 +968,25 @@ void os_set_time_offset(long offset)
 		       ENV_TIME_OFFSET);
 }
 
+int os_thread_start(ulong *tidp, void *(*fn)(void *arg), void *arg)
+{
+	pthread_t tid;
+
+	if (pthread_create(&tid, NULL, fn, arg))
+		return -EAGAIN;
+	*tidp = (ulong)tid;
+
+	return 0;
+}
+
+int os_thread_join(ulong tid)
+{
+	if (pthread_join((pthread_t)tid, NULL))
+		return -ESRCH;
+
+	return 0;
+}
+
 void os_localtime(struct rtc_time *rt)
 {
 	time_t t = time(NULL);
@@ -61,6 +61,20 @@ int sandbox_eth_recv_arp_req(struct udevice *dev);
  */
 int sandbox_eth_recv_ping_req(struct udevice *dev);
 
+/*
+ * sandbox_eth_recv_packet()
+ *
+ * Inject a packet, which is dropped if all receive buffers are in use, as a
+ * controller would
+ *
+ * @dev: device that received the packet
+ * @packet: the packet
+ * @len: length of the packet
+ * Return: 0 if injected, -EOVERFLOW if dropped
+ */
+int sandbox_eth_recv_packet(struct udevice *dev, const void *packet,
+			    unsigned int len);
+
 /**
  * A packet handler
  *
@@ -71,6 +85,16 @@ int sandbox_eth_recv_ping_req(struct udevice *dev);
 typedef int sandbox_eth_tx_hand_f(struct udevice *dev, void *pkt,
 				   unsigned int len);
 
+/**
+ * A poll handler, called whenever the driver is polled for a received packet
+ *
+ * dev - device pointer
+ */
+typedef void sandbox_eth_poll_hand_f(struct udevice *dev);
+
+/* Buffers lent for payloads which are taken ahead, see eth_rx_take() */
+#define SANDBOX_ETH_LENT	4
+
 /**
  * struct eth_sandbox_priv - memory for sandbox mock driver
  *
@@ -81,7 +105,12 @@ typedef int sandbox_eth_tx_hand_f(struct udevice *dev, void *pkt,
  * recv_packet_length - lengths of the packet returned as received
  * recv_packets - number of packets returned
  * tx_handler - function to generate responses to sent packets
+ * poll_handler - function to inject packets when polled, or NULL
  * priv - a pointer to some structure a test may want to keep track of
+ * lent - buffers taken for payloads, as a controller does a few packets ahead
+ * lent_count - number of them
+ * rx_dropped - packets dropped since the stack last asked
+ * mcast_hwaddr - MAC address of the multicast group joined, or zero
  */
 struct eth_sandbox_priv {
 	uchar fake_host_hwaddr[ARP_HLEN];
@@ -91,7 +120,12 @@ struct eth_sandbox_priv {
 	int recv_packet_length[PKTBUFSRX];
 	int recv_packets;
 	sandbox_eth_tx_hand_f *tx_handler;
+	sandbox_eth_poll_hand_f *poll_handler;
 	void *priv;
+	void *lent[SANDBOX_ETH_LENT];
+	int lent_count;
+	ulong rx_dropped;
+	uchar mcast_hwaddr[ARP_HLEN];
 };
 
 /*
@@ -101,6 +135,13 @@ struct eth_sandbox_priv {
  */
 void sandbox_eth_set_tx_handler(int index, sandbox_eth_tx_hand_f *handler);
 
+/*
+ * Set poll handler
+ *
+ * handler - The func ptr to call when polled for a packet, or NULL for none
+ */
+void sandbox_eth_set_poll_handler(int index, sandbox_eth_poll_hand_f *handler);
+
 /*
  * Set priv ptr
  *
@@ -192,14 +192,57 @@ static inline void _outsw(volatile u16 *port, const void *buf, int ns)
 
 static inline void memset_io(volatile void *addr, unsigned char val, int count)
 {
+	while (count--)
+		writeb(val, addr++);
 }
 
 static inline void memcpy_fromio(void *dst, const volatile void *src, int count)
 {
+	u8 *p = dst;
+
+	while (count--)
+		*p++ = readb(src++);
 }
 
 static inline void memcpy_toio(volatile void *dst, const void *src, int count)
 {
+	const u8 *p = src;
+
+	while (count--)
+		writeb(*p++, dst++);
+}
+
+/* Transfer to and from a FIFO register */
+static inline void readsb(const volatile void *addr, void *buf, int count)
+{
+	u8 *p = buf;
+
+	while (count--)
+		*p++ = readb(addr);
+}
+
+static inline void readsl(const volatile void *addr, void *buf, int count)
+{
+	u32 *p = buf;
+
+	while (count--)
+		*p++ = readl(addr);
+}
+
+static inline void writesb(volatile void *addr, const void *buf, int count)
+{
+	const u8 *p = buf;
+
+	while (count--)
+		writeb(*p++, addr);
+}
+
+static inline void writesl(volatile void *addr, const void *buf, int count)
+{
+	const u32 *p = buf;
+
+	while (count--)
+		writel(*p++, addr);
 }
 
 #define insw(port, buf, ns)		_insw((u16 *)port, buf, ns)
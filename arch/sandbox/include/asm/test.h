@@ -240,6 +240,38 @@ uint sandbox_spi_get_speed(struct udevice *dev);
  */
 uint sandbox_spi_get_mode(struct udevice *dev);
 
+/**
+ * sandbox_spi_set_tap() - Set the read-capture tap of a sandbox spi bus
+ *
+ * @dev: SPI bus to update
+ * @tap: Tap to use for following transfers
+ */
+void sandbox_spi_set_tap(struct udevice *dev, uint tap);
+
+/**
+ * sandbox_spi_set_tap_window() - Set the taps which read data correctly
+ *
+ * When enabled, data read while the tap is outside @lo..@hi, or any window
+ * added by sandbox_spi_add_tap_window(), is shifted by one bit, so that a
+ * tap scan has something to find. Taps from 32 on never read correctly.
+ *
+ * @dev: SPI bus to update
+ * @enable: true to check the tap on each transfer, false to ignore it
+ * @lo: First good tap
+ * @hi: Last good tap
+ */
+void sandbox_spi_set_tap_window(struct udevice *dev, bool enable, uint lo,
+				uint hi);
+
+/**
+ * sandbox_spi_add_tap_window() - Add another window of taps which read data
+ *
+ * @dev: SPI bus to update
+ * @lo: First good tap
+ * @hi: Last good tap
+ */
+void sandbox_spi_add_tap_window(struct udevice *dev, uint lo, uint hi);
+
 /**
  * sandbox_get_pch_spi_protect() - Get the PCI SPI protection status
  *
@@ -382,4 +414,113 @@ bool sandbox_sf_bootdev_enabled(void);
  */
 void sandbox_sf_set_enable_bootdevs(bool enable);
 
+struct sdm_stream;
+
+/* Flags for sandbox_sdm_mb_init() */
+enum {
+	/* Complete every command in flight at once, newest first */
+	SANDBOX_SDM_MB_REORDER	= 1 << 0,
+	/* Behave like ATF, which refuses commands once it is full */
+	SANDBOX_SDM_MB_SMC	= 1 << 1,
+};
+
+/**
+ * struct sandbox_sdm_mb_stats - what the SDM mailbox emulator saw
+ *
+ * @cmds:	Number of RECONFIG_DATA commands accepted
+ * @max_inflight: Highest number of commands in flight at once
+ * @inflight:	Number of commands never responded to
+ * @bytes:	Number of bytes consumed
+ * @crc:	CRC32 of the bytes consumed, in order
+ * @bad_id:	Commands sent with an invalid ID or one already in flight
+ * @overflow:	Commands sent while the SDM was full
+ * @bad_len:	Commands with no data or more than the maximum chunk size
+ * @overwritten: Commands whose data changed before the SDM consumed it
+ */
+struct sandbox_sdm_mb_stats {
+	u32 cmds;
+	u32 max_inflight;
+	u32 inflight;
+	ulong bytes;
+	u32 crc;
+	u32 bad_id;
+	u32 overflow;
+	u32 bad_len;
+	u32 overwritten;
+};
+
+/**
+ * sandbox_sdm_mb_init() - attach the SDM mailbox emulator to a transfer
+ *
+ * This sets up the ops, @xfer_max and @chunk of @s as the RECONFIG command
+ * would, and resets the statistics.
+ *
+ * @s:		Transfer to attach to
+ * @xfer_max:	Number of commands the emulated SDM accepts at once
+ * @chunk:	Maximum number of bytes per command
+ * @latency:	Number of response polls before the SDM consumes a command
+ * @flags:	SANDBOX_SDM_MB_... flags
+ */
+void sandbox_sdm_mb_init(struct sdm_stream *s, u32 xfer_max, u32 chunk,
+			 int latency, uint flags);
+
+/**
+ * sandbox_sdm_mb_fail() - make a command fail
+ *
+ * @cmd:	Number of the command to fail, counting from 1, or 0 for none
+ * @status:	Error code to return in its response
+ */
+void sandbox_sdm_mb_fail(int cmd, u32 status);
+
+/**
+ * sandbox_sdm_mb_fail_reap() - make collecting a response fail once
+ *
+ * @reap:	Number of the response poll to fail, counting from 1, or 0
+ *		for none
+ * @err:	-ve error to return from that poll
+ */
+void sandbox_sdm_mb_fail_reap(int reap, int err);
+
+/**
+ * sandbox_sdm_mb_get_stats() - read back what the emulator saw
+ *
+ * @stats:	Returns the statistics since sandbox_sdm_mb_init()
+ */
+void sandbox_sdm_mb_get_stats(struct sandbox_sdm_mb_stats *stats);
+
+/**
+ * sandbox_nvme_set_latency() - set the time taken by each I/O command
+ *
+ * @dev:	sandbox_nvme device
+ * @latency_us:	Time before the completion of each command is posted
+ */
+void sandbox_nvme_set_latency(struct udevice *dev, ulong latency_us);
+
+/**
+ * sandbox_nvme_get_stats() - read back the I/O commands the emulator saw
+ *
+ * @dev:		sandbox_nvme device
+ * @cmdsp:		Returns the number of I/O commands carried out
+ * @max_inflightp:	Returns the most I/O commands in flight at once
+ */
+void sandbox_nvme_get_stats(struct udevice *dev, uint *cmdsp,
+			    uint *max_inflightp);
+
+/**
+ * sandbox_mmc_get_cmd_count() - count the commands seen by an MMC emulator
+ *
+ * @dev:	mmc_sandbox device
+ * @cmdidx:	Command index, e.g. MMC_CMD_STOP_TRANSMISSION
+ * Return: number of times the command was received since probe
+ */
+uint sandbox_mmc_get_cmd_count(struct udevice *dev, uint cmdidx);
+
+/**
+ * sandbox_mmc_fail_read() - make multiple-block reads of an MMC emulator fail
+ *
+ * @dev:	mmc_sandbox device
+ * @fail:	true to fail CMD18 with -EIO, false to complete it again
+ */
+void sandbox_mmc_fail_read(struct udevice *dev, bool fail);
+
 #endif
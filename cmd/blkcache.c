@@ -7,22 +7,51 @@
 #include <command.h>
 #include <config.h>
 #include <common.h>
+#include <blk.h>
 #include <malloc.h>
 #include <part.h>
 
 static int blkc_show(struct cmd_tbl *cmdtp, int flag,
 		     int argc, char *const argv[])
 {
+	struct block_cache_dev_stats ds;
 	struct block_cache_stats stats;
+	int i;
+
 	blkcache_stats(&stats);
 
 	printf("hits: %u\n"
+	       "partial hits: %u\n"
 	       "misses: %u\n"
 	       "entries: %u\n"
+	       "bytes: %lu\n"
 	       "max blocks/entry: %u\n"
-	       "max cache entries: %u\n",
-	       stats.hits, stats.misses, stats.entries,
-	       stats.max_blocks_per_entry, stats.max_entries);
+	       "max cache entries: %u\n"
+	       "max bytes: %lu\n"
+	       "read-ahead blocks: %u\n"
+	       "blocks read ahead: %lu\n"
+	       "write-back: %s\n"
+	       "cached writes: %u\n"
+	       "write-back requests: %u\n"
+	       "dirty blocks: %lu\n",
+	       stats.hits, stats.partial, stats.misses, stats.entries,
+	       stats.bytes, stats.max_blocks_per_entry, stats.max_entries,
+	       stats.max_bytes, stats.readahead, stats.ra_blocks,
+	       stats.writeback ? "on" : "off", stats.writes, stats.flushes,
+	       stats.dirty);
+
+	for (i = 0; !blkcache_dev_stats(i, &ds); i++) {
+		if (!i)
+			printf("\n%-10s %8s %8s %8s %8s %10s %8s %8s %8s\n",
+			       "device", "hits", "partial", "misses",
+			       "entries", "blocks", "ahead", "writes",
+			       "dirty");
+		printf("%-6s %3d %8u %8u %8u %8u %10lu %8lu %8u %8lu\n",
+		       blk_get_uclass_name(ds.iftype), ds.devnum, ds.hits,
+		       ds.partial, ds.misses, ds.entries, ds.blocks,
+		       ds.ra_blocks, ds.writes, ds.dirty);
+	}
+
 	return 0;
 }
 
@@ -35,15 +64,78 @@ static int blkc_configure(struct cmd_tbl *cmdtp, int flag,
 
 	blocks_per_entry = simple_strtoul(argv[1], 0, 0);
 	max_entries = simple_strtoul(argv[2], 0, 0);
-	blkcache_configure(blocks_per_entry, max_entries);
+	if (blkcache_configure(blocks_per_entry, max_entries))
+		return CMD_RET_FAILURE;
 	printf("changed to max of %u entries of %u blocks each\n",
 	       max_entries, blocks_per_entry);
 	return 0;
 }
 
+static int blkc_size(struct cmd_tbl *cmdtp, int flag,
+		     int argc, char *const argv[])
+{
+	ulong bytes;
+
+	if (argc != 2)
+		return CMD_RET_USAGE;
+
+	bytes = simple_strtoul(argv[1], 0, 0);
+	if (blkcache_configure_size(bytes))
+		return CMD_RET_FAILURE;
+	printf("changed to max of %lu bytes\n", bytes);
+	return 0;
+}
+
+static int blkc_readahead(struct cmd_tbl *cmdtp, int flag,
+			  int argc, char *const argv[])
+{
+	unsigned blocks;
+
+	if (argc != 2)
+		return CMD_RET_USAGE;
+
+	blocks = simple_strtoul(argv[1], 0, 0);
+	blkcache_configure_readahead(blocks);
+	printf("changed to read ahead %u blocks\n", blocks);
+	return 0;
+}
+
+static int blkc_writeback(struct cmd_tbl *cmdtp, int flag,
+			  int argc, char *const argv[])
+{
+	bool enable;
+
+	if (argc != 2)
+		return CMD_RET_USAGE;
+
+	if (!strcmp(argv[1], "on"))
+		enable = true;
+	else if (!strcmp(argv[1], "off"))
+		enable = false;
+	else
+		return CMD_RET_USAGE;
+
+	if (blkcache_configure_writeback(enable))
+		return CMD_RET_FAILURE;
+	printf("write-back %s\n", argv[1]);
+	return 0;
+}
+
+static int blkc_flush(struct cmd_tbl *cmdtp, int flag,
+		      int argc, char *const argv[])
+{
+	if (blkcache_flush(-1, 0))
+		return CMD_RET_FAILURE;
+	return 0;
+}
+
 static struct cmd_tbl cmd_blkc_sub[] = {
 	U_BOOT_CMD_MKENT(show, 0, 0, blkc_show, "", ""),
 	U_BOOT_CMD_MKENT(configure, 3, 0, blkc_configure, "", ""),
+	U_BOOT_CMD_MKENT(size, 2, 0, blkc_size, "", ""),
+	U_BOOT_CMD_MKENT(readahead, 2, 0, blkc_readahead, "", ""),
+	U_BOOT_CMD_MKENT(writeback, 2, 0, blkc_writeback, "", ""),
+	U_BOOT_CMD_MKENT(flush, 1, 0, blkc_flush, "", ""),
 };
 
 static __maybe_unused void blkc_reloc(void)
@@ -85,4 +177,8 @@ U_BOOT_CMD(
 	"show - show and reset statistics\n"
 	"blkcache configure <blocks> <entries> "
 	"- set max blocks per entry and max cache entries\n"
+	"blkcache size <bytes> - set max bytes of cached data\n"
+	"blkcache readahead <blocks> - set blocks to read ahead, 0 for none\n"
+	"blkcache writeback on|off - keep small writes in the cache\n"
+	"blkcache flush - write cached writes to the devices\n"
 );
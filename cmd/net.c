@@ -16,11 +16,15 @@
 #include <env.h>
 #include <image.h>
 #include <log.h>
+#include <mtd.h>
 #include <net.h>
 #include <net6.h>
+#include <part.h>
 #include <net/udp.h>
+#include <net/sink.h>
 #include <net/sntp.h>
 #include <net/ncsi.h>
+#include <linux/err.h>
 
 static int netboot_common(enum proto_t, struct cmd_tbl *, int, char * const []);
 
@@ -200,12 +204,103 @@ static int do_wget(struct cmd_tbl *cmdtp, int flag, int argc, char * const argv[
 	return netboot_common(WGET, cmdtp, argc, argv);
 }
 
+#if IS_ENABLED(CONFIG_IPV6)
+U_BOOT_CMD(
+	wget,   4,      1,      do_wget,
+	"boot image via network using HTTP protocol\n"
+	"To use IPv6 add -ipv6 parameter or use IPv6 hostIPaddr framed "
+	"with [] brackets",
+	"[loadAddress] [[hostIPaddr:]path and image name] [" USE_IP6_CMD_PARAM "]"
+);
+#else
 U_BOOT_CMD(
 	wget,   3,      1,      do_wget,
 	"boot image via network using HTTP protocol",
 	"[loadAddress] [[hostIPaddr:]path and image name]"
 );
 #endif
+#endif
+
+#if defined(CONFIG_CMD_NETSINK)
+static int do_netsink(struct cmd_tbl *cmdtp, int flag, int argc,
+		      char *const argv[])
+{
+	struct disk_partition info;
+	struct blk_desc *desc;
+	enum net_sink_type type;
+	struct mtd_info *mtd;
+	lbaint_t blk = 0;
+	u64 off = 0;
+	int ret;
+
+	if (argc < 2) {
+		net_sink_show();
+		return CMD_RET_SUCCESS;
+	}
+
+	if (!strcmp(argv[1], "off")) {
+		net_sink_release();
+		return CMD_RET_SUCCESS;
+	} else if (!strcmp(argv[1], "mtd") && IS_ENABLED(CONFIG_MTD)) {
+		if (argc < 3 || argc > 4)
+			return CMD_RET_USAGE;
+		if (argc > 3)
+			off = simple_strtoull(argv[3], NULL, 16);
+		mtd_probe_devices();
+		mtd = get_mtd_device_nm(argv[2]);
+		if (IS_ERR_OR_NULL(mtd)) {
+			printf("MTD device %s not found\n", argv[2]);
+			return CMD_RET_FAILURE;
+		}
+		ret = net_sink_mtd(mtd, off);
+		if (ret)
+			put_mtd_device(mtd);
+	} else {
+		if (!strcmp(argv[1], "blk"))
+			type = NET_SINK_BLK;
+		else if (!strcmp(argv[1], "gz") && IS_ENABLED(CONFIG_GZIP))
+			type = NET_SINK_GZIP;
+		else if (!strcmp(argv[1], "sparse"))
+			type = NET_SINK_SPARSE;
+		else
+			return CMD_RET_USAGE;
+		if (argc < 4 || argc > 5 || (type == NET_SINK_SPARSE && argc > 4))
+			return CMD_RET_USAGE;
+		if (argc > 4)
+			blk = simple_strtoul(argv[4], NULL, 16);
+
+		if (blk_get_device_part_str(argv[2], argv[3], &desc, &info,
+					    1) < 0)
+			return CMD_RET_FAILURE;
+		if (blk >= info.size) {
+			printf("Block " LBAF " past the end of the partition\n",
+			       blk);
+			return CMD_RET_FAILURE;
+		}
+		ret = net_sink_blk(type, desc, info.start + blk,
+				   info.size - blk);
+	}
+
+	if (ret) {
+		printf("Cannot write files to storage (err=%d)\n", ret);
+		return CMD_RET_FAILURE;
+	}
+	net_sink_show();
+
+	return CMD_RET_SUCCESS;
+}
+
+U_BOOT_CMD(
+	netsink,	5,	1,	do_netsink,
+	"write the next file loaded over the network to storage",
+	"blk <interface> <dev[:part]> [blk#] - write it to a block device\n"
+	"netsink gz <interface> <dev[:part]> [blk#] - decompress it first\n"
+	"netsink sparse <interface> <dev[:part]> - unpack an Android sparse image\n"
+	"netsink mtd <name> [off] - write it to an MTD device, erasing it\n"
+	"netsink off - load files into memory again\n"
+	"netsink - show where the next file goes"
+);
+#endif
 
 static void netboot_update_env(void)
 {
@@ -691,8 +786,28 @@ static int do_net_list(struct cmd_tbl *cmdtp, int flag, int argc, char *const ar
 	return CMD_RET_SUCCESS;
 }
 
+static int do_net_stats(struct cmd_tbl *cmdtp, int flag, int argc, char *const argv[])
+{
+	struct eth_stats stats;
+	struct udevice *dev;
+	struct uclass *uc;
+
+	uclass_id_foreach_dev(UCLASS_ETH, dev, uc) {
+		if (eth_get_stats(dev, &stats))
+			continue;
+		printf("eth%d : %s\n", dev_seq(dev), dev->name);
+		printf("  rx: %lu packets, %llu bytes, %lu errors, %lu dropped, %lu overruns\n",
+		       stats.rx_packets, stats.rx_bytes, stats.rx_errors,
+		       stats.rx_dropped, stats.rx_overruns);
+		printf("  tx: %lu packets, %llu bytes, %lu errors\n",
+		       stats.tx_packets, stats.tx_bytes, stats.tx_errors);
+	}
+	return CMD_RET_SUCCESS;
+}
+
 static struct cmd_tbl cmd_net[] = {
 	U_BOOT_CMD_MKENT(list, 1, 0, do_net_list, "", ""),
+	U_BOOT_CMD_MKENT(stats, 1, 0, do_net_stats, "", ""),
 };
 
 static int do_net(struct cmd_tbl *cmdtp, int flag, int argc, char *const argv[])
@@ -717,6 +832,7 @@ U_BOOT_CMD(
 	net, 2, 1, do_net,
 	"NET sub-system",
 	"list - list available devices\n"
+	"net stats - show statistics of the devices in use\n"
 );
 
 #if defined(CONFIG_CMD_NCSI)
@@ -41,6 +41,9 @@ const char *const type_name[] = {
 
 	/* main loop events */
 	"main_loop",
+
+	/* lmb hooks */
+	"lmb_reserve",
 };
 
 _Static_assert(ARRAY_SIZE(type_name) == EVT_COUNT, "event type_name size");
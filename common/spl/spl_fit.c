@@ -8,8 +8,10 @@
 #include <errno.h>
 #include <fpga.h>
 #include <gzip.h>
+#include <hash.h>
 #include <image.h>
 #include <log.h>
+#include <malloc.h>
 #include <memalign.h>
 #include <mapmem.h>
 #include <spl.h>
@@ -17,6 +19,7 @@
 #include <asm/cache.h>
 #include <asm/global_data.h>
 #include <linux/libfdt.h>
+#include <u-boot/zlib.h>
 
 DECLARE_GLOBAL_DATA_PTR;
 
@@ -206,6 +209,293 @@ static int get_aligned_image_size(struct spl_load_info *info, int data_size,
 	return (data_size + info->bl_len - 1) / info->bl_len;
 }
 
+#if CONFIG_IS_ENABLED(LOAD_FIT_STREAM)
+/* Maximum number of hash nodes checked while an image is read */
+#define SPL_FIT_STREAM_MAX_HASHES	4
+
+/**
+ * struct spl_fit_stream - an image being read, hashed and copied in chunks
+ *
+ * @fit:	Pointer to the FIT blob
+ * @node:	Offset of the image node
+ * @algo:	Algorithm of each hash node being checked
+ * @hash_ctx:	Progressive hash context for each entry in @algo, NULL once
+ *		the context has been freed
+ * @hash_node:	Offset of each hash node being checked
+ * @nr_hashes:	Number of hash nodes being checked
+ * @zs:		Inflate state, for gzip images
+ * @zs_end:	The end of the compressed stream has been reached
+ */
+struct spl_fit_stream {
+	const void *fit;
+	int node;
+	struct hash_algo *algo[SPL_FIT_STREAM_MAX_HASHES];
+	void *hash_ctx[SPL_FIT_STREAM_MAX_HASHES];
+	int hash_node[SPL_FIT_STREAM_MAX_HASHES];
+	int nr_hashes;
+	z_stream zs;
+	bool zs_end;
+};
+
+/*
+ * Start a progressive hash for each hash node of the image. Signatures are
+ * checked over the whole image at once, so images which have them, or which
+ * a required key in the control FDT applies to, are not streamed.
+ */
+static int spl_fit_stream_hash_init(struct spl_fit_stream *st)
+{
+	const void *key_blob = gd_fdt_blob();
+	const char *algo_name, *required;
+	struct hash_algo *algo;
+	int noffset, key_node, ignore;
+
+	if (!CONFIG_IS_ENABLED(FIT_SIGNATURE))
+		return 0;
+
+	key_node = fdt_subnode_offset(key_blob, 0, FIT_SIG_NODENAME);
+	if (key_node >= 0) {
+		fdt_for_each_subnode(noffset, key_blob, key_node) {
+			required = fdt_getprop(key_blob, noffset,
+					       FIT_KEY_REQUIRED, NULL);
+			if (required && !strcmp(required, "image"))
+				return -ENOTSUPP;
+		}
+	}
+
+	fdt_for_each_subnode(noffset, st->fit, st->node) {
+		const char *name = fit_get_name(st->fit, noffset, NULL);
+
+		if (!strncmp(name, FIT_SIG_NODENAME, strlen(FIT_SIG_NODENAME)))
+			return -ENOTSUPP;
+		if (strncmp(name, FIT_HASH_NODENAME, strlen(FIT_HASH_NODENAME)))
+			continue;
+
+		/* Leave anything unusual to fit_image_verify_with_data() */
+		if (fit_image_hash_get_algo(st->fit, noffset, &algo_name))
+			return -ENOTSUPP;
+		fit_image_hash_get_ignore(st->fit, noffset, &ignore);
+		if (ignore)
+			continue;
+		if (st->nr_hashes == SPL_FIT_STREAM_MAX_HASHES ||
+		    hash_progressive_lookup_algo(algo_name, &algo) ||
+		    algo->hash_init(algo, &st->hash_ctx[st->nr_hashes]))
+			return -ENOTSUPP;
+		st->algo[st->nr_hashes] = algo;
+		st->hash_node[st->nr_hashes++] = noffset;
+	}
+
+	return 0;
+}
+
+static int spl_fit_stream_hash_update(struct spl_fit_stream *st,
+				      const void *data, size_t size,
+				      bool is_last)
+{
+	int i;
+
+	for (i = 0; i < st->nr_hashes; i++) {
+		if (st->algo[i]->hash_update(st->algo[i], st->hash_ctx[i], data,
+					     size, is_last)) {
+			/* The context is already freed */
+			st->hash_ctx[i] = NULL;
+			return -EIO;
+		}
+	}
+
+	return 0;
+}
+
+/* Free the hash contexts, comparing the results if @check is set */
+static int spl_fit_stream_hash_finish(struct spl_fit_stream *st, bool check)
+{
+	ALLOC_CACHE_ALIGN_BUFFER(uint8_t, value, FIT_MAX_HASH_LEN);
+	uint8_t *fit_value;
+	int fit_value_len;
+	int i, r, ret = 0;
+
+	for (i = 0; i < st->nr_hashes; i++) {
+		struct hash_algo *algo = st->algo[i];
+
+		if (!st->hash_ctx[i])
+			continue;
+		r = algo->hash_finish(algo, st->hash_ctx[i], value,
+				      FIT_MAX_HASH_LEN);
+		st->hash_ctx[i] = NULL;
+		if (r) {
+			ret = -EIO;
+			continue;
+		}
+		if (!check)
+			continue;
+
+		printf("%s", algo->name);
+		if (fit_image_hash_get_value(st->fit, st->hash_node[i],
+					     &fit_value, &fit_value_len) ||
+		    fit_value_len != algo->digest_size ||
+		    memcmp(value, fit_value, fit_value_len)) {
+			printf(" error!\nBad hash value for '%s' hash node in '%s' image node\n",
+			       fit_get_name(st->fit, st->hash_node[i], NULL),
+			       fit_get_name(st->fit, st->node, NULL));
+			ret = -EPERM;
+		} else {
+			puts("+ ");
+		}
+	}
+
+	return ret;
+}
+
+static int spl_fit_stream_inflate(struct spl_fit_stream *st, const void *data,
+				  size_t size)
+{
+	int r;
+
+	st->zs.next_in = (void *)data;	/* cast away const */
+	st->zs.avail_in = size;
+	while (st->zs.avail_in && !st->zs_end) {
+		r = inflate(&st->zs, Z_NO_FLUSH);
+		if (r == Z_STREAM_END) {
+			/* Anything left is the gzip trailer */
+			st->zs_end = true;
+		} else if (r != Z_OK) {
+			printf("Error: inflate() returned %d\n", r);
+			return -EIO;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * spl_fit_stream_image() - load external image data a chunk at a time
+ *
+ * Each chunk is read into a small buffer, fed to the hashes of the image
+ * and then copied or inflated to its load address while it is still in the
+ * cache. This saves the separate passes over the whole image for hashing
+ * and decompression, and the compressed image is never staged in memory.
+ *
+ * @info:	Device to load data from
+ * @sector:	Sector holding the start of the image data
+ * @overhead:	Offset of the image data in that sector
+ * @fit:	Pointer to the FIT blob
+ * @node:	Offset of the image node
+ * @length:	Size of the image data
+ * @gzip:	The image data is gzip-compressed
+ * @load_ptr:	Where to put the image
+ * @sizep:	Returns the size of the loaded image
+ * Return:	0 on success, -ENOTSUPP if the image must be loaded in one go,
+ *		or other negative error number
+ */
+static int spl_fit_stream_image(struct spl_load_info *info, ulong sector,
+				int overhead, const void *fit, int node,
+				size_t length, bool gzip, void *load_ptr,
+				size_t *sizep)
+{
+	struct spl_fit_stream st = { .fit = fit, .node = node };
+	int bl_len = info->filename ? 1 : info->bl_len;
+	ulong count, nr_sectors;
+	size_t left = length, size;
+	void *buf, *dst = load_ptr;
+	const void *data;
+	int hdr, ret;
+
+	count = max(CONFIG_SPL_LOAD_FIT_STREAM_BUF_SZ / bl_len, 1);
+	buf = malloc_cache_aligned(count * bl_len);
+	if (!buf) {
+		debug("%s: No memory for chunk buffer\n", __func__);
+		return -ENOTSUPP;
+	}
+
+	ret = spl_fit_stream_hash_init(&st);
+	if (ret)
+		goto out;
+
+	if (gzip) {
+		st.zs.zalloc = gzalloc;
+		st.zs.zfree = gzfree;
+		if (inflateInit2(&st.zs, -MAX_WBITS) != Z_OK) {
+			ret = -ENOMEM;
+			goto out;
+		}
+		st.zs.next_out = load_ptr;
+		st.zs.avail_out = CONFIG_SYS_BOOTM_LEN;
+	}
+
+	while (left) {
+		nr_sectors = min_t(ulong, count,
+				   DIV_ROUND_UP(left + overhead, bl_len));
+		if (info->read(info, sector, nr_sectors, buf) != nr_sectors) {
+			ret = -EIO;
+			break;
+		}
+		sector += nr_sectors;
+		data = buf + overhead;
+		size = min_t(size_t, nr_sectors * bl_len - overhead, left);
+		overhead = 0;
+		left -= size;
+
+		ret = spl_fit_stream_hash_update(&st, data, size, !left);
+		if (ret)
+			break;
+
+		if (!gzip) {
+			memcpy(dst, data, size);
+			dst += size;
+			continue;
+		}
+
+		/* The gzip header must be in the first chunk */
+		if (left + size == length) {
+			hdr = gzip_parse_header(data, size);
+			if (hdr < 0) {
+				ret = -EIO;
+				break;
+			}
+			data += hdr;
+			size -= hdr;
+		}
+		ret = spl_fit_stream_inflate(&st, data, size);
+		if (ret)
+			break;
+	}
+
+	if (gzip) {
+		if (!ret && !st.zs_end) {
+			puts("Error: gzip data is truncated\n");
+			ret = -EIO;
+		}
+		*sizep = st.zs.total_out;
+		inflateEnd(&st.zs);
+		if (ret)
+			puts("Uncompressing error\n");
+	} else {
+		*sizep = length;
+	}
+
+	if (!ret && CONFIG_IS_ENABLED(FIT_SIGNATURE)) {
+		printf("## Checking hash(es) for Image %s ... ",
+		       fit_get_name(fit, node, NULL));
+		ret = spl_fit_stream_hash_finish(&st, true);
+		if (!ret)
+			puts("OK\n");
+	}
+
+out:
+	spl_fit_stream_hash_finish(&st, false);
+	free(buf);
+
+	return ret;
+}
+#else
+static int spl_fit_stream_image(struct spl_load_info *info, ulong sector,
+				int overhead, const void *fit, int node,
+				size_t length, bool gzip, void *load_ptr,
+				size_t *sizep)
+{
+	return -ENOTSUPP;
+}
+#endif
+
 /**
  * spl_load_fit_image(): load the image described in a certain FIT node
  * @info:	points to information about the device to load data from
@@ -237,6 +527,7 @@ static int spl_load_fit_image(struct spl_load_info *info, ulong sector,
 	const void *data;
 	const void *fit = ctx->fit;
 	bool external_data = false;
+	int ret;
 
 	if (IS_ENABLED(CONFIG_SPL_FPGA) ||
 	    (IS_ENABLED(CONFIG_SPL_OS_BOOT) && IS_ENABLED(CONFIG_SPL_GZIP))) {
@@ -281,6 +572,22 @@ static int spl_load_fit_image(struct spl_load_info *info, ulong sector,
 			return 0;
 		}
 
+		if (CONFIG_IS_ENABLED(LOAD_FIT_STREAM)) {
+			ret = spl_fit_stream_image(info,
+					sector + get_aligned_image_offset(info, offset),
+					get_aligned_image_overhead(info, offset),
+					fit, node, len,
+					IS_ENABLED(CONFIG_SPL_GZIP) &&
+					image_comp == IH_COMP_GZIP,
+					map_sysmem(load_addr, 0), &length);
+			if (!ret)
+				goto done;
+			if (ret != -ENOTSUPP)
+				return ret;
+			debug("Loading %s in one go\n",
+			      fit_get_name(fit, node, NULL));
+		}
+
 		src_ptr = map_sysmem(ALIGN(load_addr, ARCH_DMA_MINALIGN), len);
 		length = len;
 
@@ -330,6 +637,7 @@ static int spl_load_fit_image(struct spl_load_info *info, ulong sector,
 		memcpy(load_ptr, src, length);
 	}
 
+done:
 	if (image_info) {
 		ulong entry_point;
 
@@ -16,6 +16,7 @@
 #include <vsprintf.h>
 #include <dm/device-internal.h>
 #include <dm/lists.h>
+#include <linux/err.h>
 
 int part_create_block_devices(struct udevice *blk_dev)
 {
@@ -91,14 +92,7 @@ static ulong part_blk_read(struct udevice *dev, lbaint_t start,
 static ulong part_blk_write(struct udevice *dev, lbaint_t start,
 			    lbaint_t blkcnt, const void *buffer)
 {
-	struct udevice *parent;
 	struct disk_part *part;
-	const struct blk_ops *ops;
-
-	parent = dev_get_parent(dev);
-	ops = blk_get_ops(parent);
-	if (!ops->write)
-		return -ENOSYS;
 
 	part = dev_get_uclass_plat(dev);
 	if (start >= part->gpt_part_info.size)
@@ -108,20 +102,13 @@ static ulong part_blk_write(struct udevice *dev, lbaint_t start,
 		blkcnt = part->gpt_part_info.size - start;
 	start += part->gpt_part_info.start;
 
-	return ops->write(parent, start, blkcnt, buffer);
+	return blk_write(dev_get_parent(dev), start, blkcnt, buffer);
 }
 
 static ulong part_blk_erase(struct udevice *dev, lbaint_t start,
 			    lbaint_t blkcnt)
 {
-	struct udevice *parent;
 	struct disk_part *part;
-	const struct blk_ops *ops;
-
-	parent = dev_get_parent(dev);
-	ops = blk_get_ops(parent);
-	if (!ops->erase)
-		return -ENOSYS;
 
 	part = dev_get_uclass_plat(dev);
 	if (start >= part->gpt_part_info.size)
@@ -131,7 +118,7 @@ static ulong part_blk_erase(struct udevice *dev, lbaint_t start,
 		blkcnt = part->gpt_part_info.size - start;
 	start += part->gpt_part_info.start;
 
-	return ops->erase(parent, start, blkcnt);
+	return blk_erase(dev_get_parent(dev), start, blkcnt);
 }
 
 static const struct blk_ops blk_part_ops = {
@@ -175,7 +162,7 @@ unsigned long disk_blk_read(struct udevice *dev, lbaint_t start,
 	const struct blk_ops *ops;
 	struct disk_part *part;
 	lbaint_t start_in_disk;
-	ulong blks_read;
+	ulong blks_read, cached;
 
 	desc = dev_get_blk(dev);
 	if (!desc)
@@ -191,15 +178,22 @@ unsigned long disk_blk_read(struct udevice *dev, lbaint_t start,
 		start_in_disk += part->gpt_part_info.start;
 	}
 
-	if (blkcache_read(desc->uclass_id, desc->devnum, start_in_disk, blkcnt,
-			  desc->blksz, buffer))
+	cached = blkcache_read(desc->uclass_id, desc->devnum, start_in_disk,
+			       blkcnt, desc->blksz, buffer);
+	if (cached == blkcnt)
 		return blkcnt;
+	start += cached;
+	start_in_disk += cached;
+	blkcnt -= cached;
+	buffer += cached * desc->blksz;
 	blks_read = ops->read(dev, start, blkcnt, buffer);
+	if (IS_ERR_VALUE(blks_read))
+		return blks_read;
 	if (blks_read == blkcnt)
 		blkcache_fill(desc->uclass_id, desc->devnum, start_in_disk,
 			      blkcnt, desc->blksz, buffer);
 
-	return blks_read;
+	return cached + blks_read;
 }
 
 unsigned long disk_blk_write(struct udevice *dev, lbaint_t start,
@@ -207,6 +201,9 @@ unsigned long disk_blk_write(struct udevice *dev, lbaint_t start,
 {
 	struct blk_desc *desc;
 	const struct blk_ops *ops;
+	struct disk_part *part;
+	lbaint_t start_in_disk;
+	int ret;
 
 	desc = dev_get_blk(dev);
 	if (!desc)
@@ -216,7 +213,15 @@ unsigned long disk_blk_write(struct udevice *dev, lbaint_t start,
 	if (!ops->write)
 		return -ENOSYS;
 
-	blkcache_invalidate(desc->uclass_id, desc->devnum);
+	start_in_disk = start;
+	if (device_get_uclass_id(dev) == UCLASS_PARTITION) {
+		part = dev_get_uclass_plat(dev);
+		start_in_disk += part->gpt_part_info.start;
+	}
+	ret = blkcache_discard(desc->uclass_id, desc->devnum, start_in_disk,
+			       blkcnt);
+	if (ret)
+		return ret;
 
 	return ops->write(dev, start, blkcnt, buffer);
 }
@@ -226,6 +231,9 @@ unsigned long disk_blk_erase(struct udevice *dev, lbaint_t start,
 {
 	struct blk_desc *desc;
 	const struct blk_ops *ops;
+	struct disk_part *part;
+	lbaint_t start_in_disk;
+	int ret;
 
 	desc = dev_get_blk(dev);
 	if (!desc)
@@ -235,7 +243,15 @@ unsigned long disk_blk_erase(struct udevice *dev, lbaint_t start,
 	if (!ops->erase)
 		return -ENOSYS;
 
-	blkcache_invalidate(desc->uclass_id, desc->devnum);
+	start_in_disk = start;
+	if (device_get_uclass_id(dev) == UCLASS_PARTITION) {
+		part = dev_get_uclass_plat(dev);
+		start_in_disk += part->gpt_part_info.start;
+	}
+	ret = blkcache_discard(desc->uclass_id, desc->devnum, start_in_disk,
+			       blkcnt);
+	if (ret)
+		return ret;
 
 	return ops->erase(dev, start, blkcnt);
 }
@@ -227,6 +227,8 @@ void part_init(struct blk_desc *dev_desc)
 	struct part_driver *entry;
 
 	blkcache_invalidate(dev_desc->uclass_id, dev_desc->devnum);
+	/* The medium may have been changed elsewhere since it was last seen */
+	dev_desc->write_gen++;
 
 	dev_desc->part_type = PART_TYPE_UNKNOWN;
 	for (entry = drv; entry != drv + n_ents; entry++) {
@@ -8,15 +8,26 @@
 
 #include <common.h>
 #include <blk.h>
+#include <cyclic.h>
 #include <dm.h>
 #include <log.h>
 #include <malloc.h>
+#include <memalign.h>
 #include <part.h>
 #include <dm/device-internal.h>
 #include <dm/lists.h>
 #include <dm/uclass-internal.h>
 #include <linux/err.h>
 
+/**
+ * struct blk_uc_priv - uclass-private data for a block device
+ *
+ * @queue: Asynchronous requests submitted and not yet complete, oldest first
+ */
+struct blk_uc_priv {
+	struct list_head queue;
+};
+
 static struct {
 	enum uclass_id id;
 	const char *name;
@@ -357,12 +368,18 @@ ulong blk_write_devnum(enum uclass_id uclass_id, int devnum, lbaint_t start,
 int blk_select_hwpart(struct udevice *dev, int hwpart)
 {
 	const struct blk_ops *ops = blk_get_ops(dev);
+	int ret;
 
 	if (!ops)
 		return -ENOSYS;
 	if (!ops->select_hwpart)
 		return 0;
 
+	/* cached writes belong to the current hardware partition */
+	ret = blk_flush(dev);
+	if (ret)
+		return ret;
+
 	return ops->select_hwpart(dev, hwpart);
 }
 
@@ -444,24 +461,56 @@ int blk_get_device(int uclass_id, int devnum, struct udevice **devp)
 	return device_probe(*devp);
 }
 
+/* Read blocks following a sequential read into the block cache */
+static void blk_readahead(struct udevice *dev, lbaint_t start,
+			  lbaint_t blkcnt)
+{
+	struct blk_desc *desc = dev_get_uclass_plat(dev);
+	const struct blk_ops *ops = blk_get_ops(dev);
+	lbaint_t ra_start, ra_cnt;
+	void *buf;
+
+	ra_cnt = blkcache_readahead(desc->uclass_id, desc->devnum, start,
+				    blkcnt, &ra_start);
+	if (!ra_cnt || ra_start >= desc->lba)
+		return;
+	ra_cnt = min(ra_cnt, desc->lba - ra_start);
+
+	buf = malloc_cache_aligned(ra_cnt * desc->blksz);
+	if (!buf)
+		return;
+	if (ops->read(dev, ra_start, ra_cnt, buf) == ra_cnt)
+		blkcache_fill_ahead(desc->uclass_id, desc->devnum, ra_start,
+				    ra_cnt, desc->blksz, buf);
+	free(buf);
+}
+
 long blk_read(struct udevice *dev, lbaint_t start, lbaint_t blkcnt, void *buf)
 {
 	struct blk_desc *desc = dev_get_uclass_plat(dev);
 	const struct blk_ops *ops = blk_get_ops(dev);
-	ulong blks_read;
+	ulong blks_read, cached;
 
 	if (!ops->read)
 		return -ENOSYS;
 
-	if (blkcache_read(desc->uclass_id, desc->devnum,
-			  start, blkcnt, desc->blksz, buf))
-		return blkcnt;
-	blks_read = ops->read(dev, start, blkcnt, buf);
-	if (blks_read == blkcnt)
-		blkcache_fill(desc->uclass_id, desc->devnum, start, blkcnt,
-			      desc->blksz, buf);
+	cached = blkcache_read(desc->uclass_id, desc->devnum,
+			       start, blkcnt, desc->blksz, buf);
+	if (cached < blkcnt) {
+		/* only read the part which is not in the cache */
+		blks_read = ops->read(dev, start + cached, blkcnt - cached,
+				      buf + cached * desc->blksz);
+		if (IS_ERR_VALUE(blks_read))
+			return blks_read;
+		if (blks_read != blkcnt - cached)
+			return cached + blks_read;
+		blkcache_fill(desc->uclass_id, desc->devnum, start + cached,
+			      blkcnt - cached, desc->blksz,
+			      buf + cached * desc->blksz);
+	}
+	blk_readahead(dev, start, blkcnt);
 
-	return blks_read;
+	return blkcnt;
 }
 
 long blk_write(struct udevice *dev, lbaint_t start, lbaint_t blkcnt,
@@ -469,11 +518,18 @@ long blk_write(struct udevice *dev, lbaint_t start, lbaint_t blkcnt,
 {
 	struct blk_desc *desc = dev_get_uclass_plat(dev);
 	const struct blk_ops *ops = blk_get_ops(dev);
+	int ret;
 
 	if (!ops->write)
 		return -ENOSYS;
 
-	blkcache_invalidate(desc->uclass_id, desc->devnum);
+	desc->write_gen++;
+	ret = blkcache_write(desc->uclass_id, desc->devnum, start, blkcnt,
+			     desc->blksz, buf);
+	if (ret < 0)
+		return ret;
+	if (ret)
+		return blkcnt;
 
 	return ops->write(dev, start, blkcnt, buf);
 }
@@ -482,15 +538,127 @@ long blk_erase(struct udevice *dev, lbaint_t start, lbaint_t blkcnt)
 {
 	struct blk_desc *desc = dev_get_uclass_plat(dev);
 	const struct blk_ops *ops = blk_get_ops(dev);
+	int ret;
 
 	if (!ops->erase)
 		return -ENOSYS;
 
-	blkcache_invalidate(desc->uclass_id, desc->devnum);
+	desc->write_gen++;
+	ret = blkcache_discard(desc->uclass_id, desc->devnum, start, blkcnt);
+	if (ret)
+		return ret;
 
 	return ops->erase(dev, start, blkcnt);
 }
 
+int blk_flush(struct udevice *dev)
+{
+	struct blk_desc *desc = dev_get_uclass_plat(dev);
+
+	return blkcache_flush(desc->uclass_id, desc->devnum);
+}
+
+int blk_submit(struct udevice *dev, struct blk_req *req)
+{
+	struct blk_desc *desc = dev_get_uclass_plat(dev);
+	struct blk_uc_priv *uc_priv = dev_get_uclass_priv(dev);
+	const struct blk_ops *ops = blk_get_ops(dev);
+	int ret;
+
+	if (req->op == BLK_REQ_READ ? !ops->read : !ops->write)
+		return -ENOSYS;
+
+	INIT_LIST_HEAD(&req->sibling);
+	req->done = false;
+	if (!CONFIG_IS_ENABLED(BLK_ASYNC) || !ops->submit) {
+		if (req->op == BLK_REQ_READ)
+			req->result = blk_read(dev, req->start, req->blkcnt,
+					       req->buffer);
+		else
+			req->result = blk_write(dev, req->start, req->blkcnt,
+						req->buffer);
+		req->done = true;
+
+		return 0;
+	}
+
+	/* the device must not see stale data, nor the cache keep it */
+	if (req->op == BLK_REQ_WRITE) {
+		desc->write_gen++;
+		ret = blkcache_discard(desc->uclass_id, desc->devnum,
+				       req->start, req->blkcnt);
+	} else {
+		ret = blkcache_flush(desc->uclass_id, desc->devnum);
+	}
+	if (ret)
+		return ret;
+
+	while ((ret = ops->submit(dev, req)) == -EBUSY) {
+		ret = ops->poll(dev);
+		if (ret)
+			return ret;
+		schedule();
+	}
+	if (ret)
+		return ret;
+	if (!req->done)
+		list_add_tail(&req->sibling, &uc_priv->queue);
+
+	return 0;
+}
+
+int blk_poll(struct udevice *dev)
+{
+	struct blk_uc_priv *uc_priv = dev_get_uclass_priv(dev);
+	const struct blk_ops *ops = blk_get_ops(dev);
+	struct list_head *pos;
+	int ret, count = 0;
+
+	if (!CONFIG_IS_ENABLED(BLK_ASYNC) || !ops->poll || !uc_priv ||
+	    list_empty(&uc_priv->queue))
+		return 0;
+
+	ret = ops->poll(dev);
+	if (ret)
+		return ret;
+	list_for_each(pos, &uc_priv->queue)
+		count++;
+
+	return count;
+}
+
+long blk_wait(struct udevice *dev, struct blk_req *req)
+{
+	int ret;
+
+	while (!req->done) {
+		ret = blk_poll(dev);
+		if (ret < 0)
+			return ret;
+		/* it is not in the queue, so will never complete */
+		if (!ret && !req->done)
+			return -EINVAL;
+		schedule();
+	}
+
+	return req->result;
+}
+
+void blk_req_done(struct blk_req *req, long result)
+{
+	list_del_init(&req->sibling);
+	req->result = result;
+	req->done = true;
+}
+
+struct blk_req *blk_first_req(struct udevice *dev)
+{
+	struct blk_uc_priv *uc_priv = dev_get_uclass_priv(dev);
+
+	return list_first_entry_or_null(&uc_priv->queue, struct blk_req,
+					sibling);
+}
+
 ulong blk_dread(struct blk_desc *desc, lbaint_t start, lbaint_t blkcnt,
 		void *buffer)
 {
@@ -508,6 +676,11 @@ ulong blk_derase(struct blk_desc *desc, lbaint_t start, lbaint_t blkcnt)
 	return blk_erase(desc->bdev, start, blkcnt);
 }
 
+int blk_dflush(struct blk_desc *desc)
+{
+	return blk_flush(desc->bdev);
+}
+
 int blk_find_from_parent(struct udevice *parent, struct udevice **devp)
 {
 	struct udevice *dev;
@@ -768,6 +941,10 @@ int blk_unbind_all(int uclass_id)
 
 static int blk_post_probe(struct udevice *dev)
 {
+	struct blk_uc_priv *uc_priv = dev_get_uclass_priv(dev);
+
+	INIT_LIST_HEAD(&uc_priv->queue);
+
 	if (CONFIG_IS_ENABLED(PARTITIONS) && blk_enabled()) {
 		struct blk_desc *desc = dev_get_uclass_plat(dev);
 
@@ -781,9 +958,32 @@ static int blk_post_probe(struct udevice *dev)
 	return 0;
 }
 
+static int blk_pre_remove(struct udevice *dev)
+{
+	struct blk_uc_priv *uc_priv = dev_get_uclass_priv(dev);
+	struct blk_desc *desc = dev_get_uclass_plat(dev);
+	struct blk_req *req, *next;
+	int ret;
+
+	/* keep the device, and its dirty blocks, if they cannot be written */
+	ret = blkcache_flush(desc->uclass_id, desc->devnum);
+	if (ret)
+		return ret;
+
+	/* nothing is left to complete the requests still queued */
+	list_for_each_entry_safe(req, next, &uc_priv->queue, sibling)
+		blk_req_done(req, -ENODEV);
+
+	blkcache_invalidate(desc->uclass_id, desc->devnum);
+
+	return 0;
+}
+
 UCLASS_DRIVER(blk) = {
 	.id		= UCLASS_BLK,
 	.name		= "blk",
 	.post_probe	= blk_post_probe,
+	.pre_remove	= blk_pre_remove,
+	.per_device_auto	= sizeof(struct blk_uc_priv),
 	.per_device_plat_auto	= sizeof(struct blk_desc),
 };
@@ -6,10 +6,13 @@
  */
 #include <common.h>
 #include <blk.h>
+#include <div64.h>
 #include <log.h>
 #include <malloc.h>
+#include <memalign.h>
 #include <part.h>
 #include <asm/global_data.h>
+#include <dm/device.h>
 #include <linux/ctype.h>
 #include <linux/list.h>
 
@@ -17,21 +20,60 @@
 DECLARE_GLOBAL_DATA_PTR;
 #endif
 
+/*
+ * The cache is made of nodes, each covering one LBA bucket of
+ * max_blocks_per_entry blocks aligned to a multiple of that size. A node
+ * holds a single contiguous run of valid blocks within its bucket, so
+ * adjacent small reads are merged into the same node. Nodes are found
+ * through a hash of (iftype, devnum, bucket) and kept on an LRU list for
+ * eviction once either the entry or the byte budget is exhausted.
+ *
+ * In write-back mode small writes are absorbed into the cache and the
+ * node records the range of dirty blocks. Dirty blocks are written to the
+ * device when evicted, when a read needs them from the device and on
+ * blkcache_flush(), with adjacent dirty nodes merged into a single write.
+ */
+#define BLKCACHE_HASH_BITS	6
+#define BLKCACHE_HASH_SIZE	(1 << BLKCACHE_HASH_BITS)
+#define BLKCACHE_MAX_DEVS	8
+/* back-to-back reads needed before reading ahead */
+#define BLKCACHE_SEQ_READS	2
+/* maximum number of blocks in a single write-back request */
+#define BLKCACHE_FLUSH_MAX	256
+
 struct block_cache_node {
 	struct list_head lh;
+	struct hlist_node hash;
 	int iftype;
 	int devnum;
+	lbaint_t bucket;
 	lbaint_t start;
 	lbaint_t blkcnt;
+	lbaint_t dirty_start;
+	lbaint_t dirty_cnt;
 	unsigned long blksz;
+	size_t size;
 	char *cache;
 };
 
+struct block_cache_dev {
+	struct block_cache_dev_stats stats;
+	unsigned int dirty;	/* number of dirty nodes */
+	unsigned int seq;	/* number of back-to-back sequential reads */
+	lbaint_t next;		/* block following the last read */
+	lbaint_t ra_end;	/* block following the data read ahead */
+};
+
 static LIST_HEAD(block_cache);
+static struct hlist_head block_cache_hash[BLKCACHE_HASH_SIZE];
+static struct block_cache_dev cache_devs[BLKCACHE_MAX_DEVS];
 
 static struct block_cache_stats _stats = {
 	.max_blocks_per_entry = 8,
-	.max_entries = 32
+	.max_entries = 128,
+	.max_bytes = CONFIG_BLOCK_CACHE_SIZE,
+	.readahead = CONFIG_BLOCK_CACHE_READAHEAD,
+	.writeback = IS_ENABLED(CONFIG_BLOCK_CACHE_WRITEBACK),
 };
 
 #ifdef CONFIG_NEEDS_MANUAL_RELOC
@@ -46,142 +88,760 @@ int blkcache_init(void)
 }
 #endif
 
-static struct block_cache_node *cache_find(int iftype, int devnum,
-					   lbaint_t start, lbaint_t blkcnt,
-					   unsigned long blksz)
+static struct hlist_head *cache_chain(int iftype, int devnum, lbaint_t bucket)
+{
+	u64 key = bucket;
+	u32 hash;
+
+	hash = (u32)key ^ (u32)(key >> 32) ^ ((u32)devnum << 16) ^ iftype;
+	hash *= 0x61c88647;
+
+	return &block_cache_hash[hash >> (32 - BLKCACHE_HASH_BITS)];
+}
+
+static struct block_cache_dev *cache_dev(int iftype, int devnum)
+{
+	struct block_cache_dev *free = NULL;
+	int i;
+
+	for (i = 0; i < BLKCACHE_MAX_DEVS; i++) {
+		struct block_cache_dev *cd = &cache_devs[i];
+
+		if (!cd->stats.used) {
+			if (!free)
+				free = cd;
+			continue;
+		}
+		if (cd->stats.iftype == iftype && cd->stats.devnum == devnum)
+			return cd;
+	}
+	if (free) {
+		memset(free, '\0', sizeof(*free));
+		free->stats.used = true;
+		free->stats.iftype = iftype;
+		free->stats.devnum = devnum;
+	}
+
+	return free;
+}
+
+static struct block_cache_node *cache_lookup(int iftype, int devnum,
+					     lbaint_t bucket,
+					     unsigned long blksz)
 {
 	struct block_cache_node *node;
 
-	list_for_each_entry(node, &block_cache, lh)
+	hlist_for_each_entry(node, cache_chain(iftype, devnum, bucket), hash)
 		if ((node->iftype == iftype) &&
 		    (node->devnum == devnum) &&
-		    (node->blksz == blksz) &&
-		    (node->start <= start) &&
-		    (node->start + node->blkcnt >= start + blkcnt)) {
-			if (block_cache.next != &node->lh) {
-				/* maintain MRU ordering */
-				list_del(&node->lh);
-				list_add(&node->lh, &block_cache);
-			}
+		    (node->bucket == bucket) &&
+		    (node->blksz == blksz))
+			return node;
+	return NULL;
+}
+
+static struct block_cache_node *cache_find(int iftype, int devnum,
+					   lbaint_t bucket,
+					   unsigned long blksz)
+{
+	struct block_cache_node *node;
+
+	node = cache_lookup(iftype, devnum, bucket, blksz);
+	if (node && block_cache.next != &node->lh) {
+		/* maintain MRU ordering */
+		list_del(&node->lh);
+		list_add(&node->lh, &block_cache);
+	}
+
+	return node;
+}
+
+static void cache_set_clean(struct block_cache_node *node)
+{
+	struct block_cache_dev *cd;
+
+	if (!node->dirty_cnt)
+		return;
+
+	_stats.dirty -= node->dirty_cnt;
+	cd = cache_dev(node->iftype, node->devnum);
+	if (cd) {
+		cd->stats.dirty -= node->dirty_cnt;
+		cd->dirty--;
+	}
+	node->dirty_cnt = 0;
+}
+
+static void cache_set_dirty(struct block_cache_node *node, lbaint_t start,
+			    lbaint_t blkcnt)
+{
+	struct block_cache_dev *cd = cache_dev(node->iftype, node->devnum);
+	lbaint_t end = start + blkcnt;
+	lbaint_t old = node->dirty_cnt;
+
+	if (old) {
+		end = max(end, node->dirty_start + old);
+		start = min(start, node->dirty_start);
+	} else if (cd) {
+		cd->dirty++;
+	}
+	node->dirty_start = start;
+	node->dirty_cnt = end - start;
+
+	_stats.dirty += node->dirty_cnt - old;
+	if (cd)
+		cd->stats.dirty += node->dirty_cnt - old;
+}
+
+static char *cache_data(struct block_cache_node *node, lbaint_t blk)
+{
+	lbaint_t first = node->bucket * _stats.max_blocks_per_entry;
+
+	return node->cache + (blk - first) * node->blksz;
+}
+
+/* Get the node holding the dirty blocks just before those of @node */
+static struct block_cache_node *cache_dirty_prev(struct block_cache_node *node)
+{
+	unsigned int nblks = _stats.max_blocks_per_entry;
+	struct block_cache_node *prev;
+
+	if (!node->bucket || node->dirty_start != node->bucket * nblks)
+		return NULL;
+
+	prev = cache_lookup(node->iftype, node->devnum, node->bucket - 1,
+			    node->blksz);
+	if (!prev || !prev->dirty_cnt ||
+	    prev->dirty_start + prev->dirty_cnt != node->dirty_start)
+		return NULL;
+
+	return prev;
+}
+
+/* Get the node holding the dirty blocks just after those of @node */
+static struct block_cache_node *cache_dirty_next(struct block_cache_node *node)
+{
+	unsigned int nblks = _stats.max_blocks_per_entry;
+	lbaint_t end = node->dirty_start + node->dirty_cnt;
+	struct block_cache_node *next;
+
+	if (end != (node->bucket + 1) * nblks)
+		return NULL;
+
+	next = cache_lookup(node->iftype, node->devnum, node->bucket + 1,
+			    node->blksz);
+	if (!next || !next->dirty_cnt || next->dirty_start != end)
+		return NULL;
+
+	return next;
+}
+
+static int cache_write(struct block_cache_node *node, lbaint_t start,
+		       lbaint_t blkcnt, const void *buffer)
+{
+	const struct blk_ops *ops;
+	struct block_cache_dev *cd;
+	struct udevice *dev;
+	int ret;
+
+	ret = blk_find_device(node->iftype, node->devnum, &dev);
+	if (ret)
+		return ret;
+	ops = blk_get_ops(dev);
+	if (!ops->write)
+		return -ENOSYS;
+
+	debug("flush: start " LBAF ", count " LBAFU "\n", start, blkcnt);
+	if (ops->write(dev, start, blkcnt, buffer) != blkcnt)
+		return -EIO;
+
+	++_stats.flushes;
+	cd = cache_dev(node->iftype, node->devnum);
+	if (cd)
+		++cd->stats.flushes;
+
+	return 0;
+}
+
+/*
+ * Write the dirty blocks of @node to the device, together with those of
+ * the nodes which directly precede or follow it, and mark them clean.
+ */
+static int cache_flush_node(struct block_cache_node *node)
+{
+	struct block_cache_node *first, *n, *prev, *next;
+	lbaint_t start, blkcnt;
+	unsigned long blksz = node->blksz;
+	char *buf;
+	int ret;
+
+	if (!node->dirty_cnt)
+		return 0;
+
+	for (first = node; (prev = cache_dirty_prev(first)); first = prev)
+		;
+
+	start = first->dirty_start;
+	blkcnt = first->dirty_cnt;
+	for (n = cache_dirty_next(first);
+	     n && blkcnt + n->dirty_cnt <= BLKCACHE_FLUSH_MAX;
+	     n = cache_dirty_next(n))
+		blkcnt += n->dirty_cnt;
+
+	if (blkcnt == first->dirty_cnt) {
+		ret = cache_write(first, start, blkcnt,
+				  cache_data(first, start));
+		if (ret)
+			return ret;
+		cache_set_clean(first);
+
+		return first == node ? 0 : cache_flush_node(node);
+	}
+
+	buf = malloc_cache_aligned(blkcnt * blksz);
+	if (!buf) {
+		/* write the nodes one at a time */
+		for (n = first; n != node; n = next) {
+			next = cache_dirty_next(n);
+			ret = cache_write(n, n->dirty_start, n->dirty_cnt,
+					  cache_data(n, n->dirty_start));
+			if (ret)
+				return ret;
+			cache_set_clean(n);
+		}
+		ret = cache_write(node, node->dirty_start, node->dirty_cnt,
+				  cache_data(node, node->dirty_start));
+		if (!ret)
+			cache_set_clean(node);
+
+		return ret;
+	}
+
+	for (n = first; n && n->dirty_start < start + blkcnt;
+	     n = cache_dirty_next(n))
+		memcpy(buf + (n->dirty_start - start) * blksz,
+		       cache_data(n, n->dirty_start), n->dirty_cnt * blksz);
+	ret = cache_write(first, start, blkcnt, buf);
+	free(buf);
+	if (ret)
+		return ret;
+
+	for (n = first; n && n->dirty_start < start + blkcnt; n = next) {
+		next = cache_dirty_next(n);
+		cache_set_clean(n);
+	}
+
+	/* @node may be beyond the largest request */
+	return cache_flush_node(node);
+}
+
+/*
+ * Write back dirty blocks of a device which overlap a range, so that the
+ * range can be read from, or written to, the device directly.
+ */
+static int cache_flush_range(int iftype, int devnum, lbaint_t start,
+			     lbaint_t blkcnt)
+{
+	struct block_cache_node *node, *n;
+	struct block_cache_dev *cd;
+	int ret, err = 0;
+
+	cd = cache_dev(iftype, devnum);
+	if (cd && !cd->dirty)
+		return 0;
+
+	list_for_each_entry_safe(node, n, &block_cache, lh) {
+		if (!node->dirty_cnt || node->iftype != iftype ||
+		    node->devnum != devnum ||
+		    node->dirty_start >= start + blkcnt ||
+		    node->dirty_start + node->dirty_cnt <= start)
+			continue;
+		ret = cache_flush_node(node);
+		if (ret) {
+			log_err("blkcache: write-back failed (err=%d)\n", ret);
+			err = ret;
+		}
+	}
+
+	return err;
+}
+
+static void cache_drop(struct block_cache_node *node)
+{
+	struct block_cache_dev *cd;
+
+	debug("drop: start " LBAF ", count " LBAFU "\n",
+	      node->start, node->blkcnt);
+	cache_set_clean(node);
+	list_del(&node->lh);
+	hlist_del(&node->hash);
+	_stats.entries--;
+	_stats.bytes -= node->size;
+	cd = cache_dev(node->iftype, node->devnum);
+	if (cd && cd->stats.entries)
+		cd->stats.entries--;
+}
+
+/*
+ * Find the least-recently-used node which can be dropped, writing back its
+ * dirty blocks first. Nodes whose blocks cannot be written stay dirty.
+ */
+static struct block_cache_node *cache_evict(void)
+{
+	struct block_cache_node *node;
+	int ret;
+
+	list_for_each_entry_reverse(node, &block_cache, lh) {
+		ret = cache_flush_node(node);
+		if (!ret)
 			return node;
+		log_err("blkcache: keeping dirty blocks (err=%d)\n", ret);
+	}
+
+	return NULL;
+}
+
+/*
+ * Get a node with @size bytes of cache, evicting least-recently-used nodes
+ * until the new one fits in the budget. The node is not on any list.
+ */
+static struct block_cache_node *cache_alloc(size_t size)
+{
+	struct block_cache_node *node = NULL, *old;
+
+	if (size > _stats.max_bytes)
+		return NULL;
+
+	while (_stats.entries >= _stats.max_entries ||
+	       _stats.bytes + size > _stats.max_bytes) {
+		old = cache_evict();
+		if (node) {
+			free(node->cache);
+			free(node);
 		}
+		node = old;
+		if (!node)
+			return NULL;
+		cache_drop(node);
+	}
+
+	if (node && node->size != size) {
+		free(node->cache);
+		node->cache = NULL;
+	} else if (!node) {
+		node = malloc(sizeof(*node));
+		if (!node)
+			return NULL;
+		node->cache = NULL;
+	}
+
+	if (!node->cache) {
+		node->cache = malloc_cache_aligned(size);
+		if (!node->cache) {
+			free(node);
+			return NULL;
+		}
+	}
+	node->size = size;
+	node->dirty_cnt = 0;
+
+	return node;
+}
+
+/*
+ * Copy blocks into the cache, merging them with the blocks already cached
+ * in the same buckets, and mark them dirty if requested.
+ */
+static int cache_insert(int iftype, int devnum, lbaint_t start,
+			lbaint_t blkcnt, unsigned long blksz,
+			const void *buffer, bool dirty)
+{
+	unsigned int nblks = _stats.max_blocks_per_entry;
+	struct block_cache_node *node;
+	struct block_cache_dev *cd;
+	lbaint_t done;
+	int ret;
+
+	for (done = 0; done < blkcnt;) {
+		lbaint_t blk = start + done;
+		lbaint_t bucket = lldiv(blk, nblks);
+		lbaint_t first = bucket * nblks;
+		lbaint_t count = min(first + nblks - blk, blkcnt - done);
+		lbaint_t end = blk + count;
+
+		node = cache_find(iftype, devnum, bucket, blksz);
+		if (node) {
+			lbaint_t node_end = node->start + node->blkcnt;
+
+			/* merge with the cached run if they touch */
+			if (blk <= node_end && end >= node->start) {
+				node->start = min(node->start, blk);
+				end = max(node_end, end);
+			} else {
+				/* the dirty blocks are about to be replaced */
+				ret = cache_flush_node(node);
+				if (ret)
+					return ret;
+				node->start = blk;
+			}
+			node->blkcnt = end - node->start;
+		} else {
+			node = cache_alloc(nblks * blksz);
+			if (!node)
+				return -ENOMEM;
+
+			node->iftype = iftype;
+			node->devnum = devnum;
+			node->bucket = bucket;
+			node->start = blk;
+			node->blkcnt = count;
+			node->blksz = blksz;
+			list_add(&node->lh, &block_cache);
+			hlist_add_head(&node->hash,
+				       cache_chain(iftype, devnum, bucket));
+			_stats.entries++;
+			_stats.bytes += node->size;
+			cd = cache_dev(iftype, devnum);
+			if (cd)
+				cd->stats.entries++;
+		}
+
+		if (dirty) {
+			cache_set_dirty(node, blk, count);
+		} else if (node->dirty_cnt) {
+			/* never replace dirty blocks with older data */
+			ret = cache_flush_node(node);
+			if (ret)
+				return ret;
+		}
+		memcpy(cache_data(node, blk), buffer + done * blksz,
+		       count * blksz);
+		done += count;
+	}
+
 	return 0;
 }
 
-int blkcache_read(int iftype, int devnum,
-		  lbaint_t start, lbaint_t blkcnt,
-		  unsigned long blksz, void *buffer)
+/*
+ * Drop the cached blocks of a device which overlap a range, writing back
+ * the dirty blocks of the dropped nodes first. A node whose dirty blocks
+ * cannot be written is kept, and the error returned.
+ */
+static int cache_discard(int iftype, int devnum, lbaint_t start,
+			 lbaint_t blkcnt)
+{
+	struct block_cache_node *node, *n;
+	int ret, err = 0;
+
+	list_for_each_entry_safe(node, n, &block_cache, lh) {
+		if (node->iftype != iftype || node->devnum != devnum ||
+		    node->start >= start + blkcnt ||
+		    node->start + node->blkcnt <= start)
+			continue;
+		ret = cache_flush_node(node);
+		if (ret) {
+			log_err("blkcache: write-back failed (err=%d)\n", ret);
+			err = ret;
+			continue;
+		}
+		cache_drop(node);
+		free(node->cache);
+		free(node);
+	}
+
+	return err;
+}
+
+lbaint_t blkcache_read(int iftype, int devnum,
+		       lbaint_t start, lbaint_t blkcnt,
+		       unsigned long blksz, void *buffer)
 {
-	struct block_cache_node *node = cache_find(iftype, devnum, start,
-						   blkcnt, blksz);
-	if (node) {
-		const char *src = node->cache + (start - node->start) * blksz;
-		memcpy(buffer, src, blksz * blkcnt);
+	unsigned int nblks = _stats.max_blocks_per_entry;
+	struct block_cache_node *node;
+	struct block_cache_dev *cd;
+	lbaint_t done = 0;
+
+	while (nblks && done < blkcnt) {
+		lbaint_t blk = start + done;
+		lbaint_t count;
+
+		node = cache_find(iftype, devnum, lldiv(blk, nblks), blksz);
+		if (!node || blk < node->start ||
+		    blk >= node->start + node->blkcnt)
+			break;
+
+		count = min(node->start + node->blkcnt - blk, blkcnt - done);
+		memcpy(buffer + done * blksz, cache_data(node, blk),
+		       count * blksz);
+		done += count;
+	}
+
+	cd = cache_dev(iftype, devnum);
+	if (done == blkcnt) {
 		debug("hit: start " LBAF ", count " LBAFU "\n",
 		      start, blkcnt);
 		++_stats.hits;
-		return 1;
+		if (cd)
+			++cd->stats.hits;
+	} else {
+		if (done) {
+			debug("partial: start " LBAF ", count " LBAFU
+			      ", cached " LBAFU "\n", start, blkcnt, done);
+			++_stats.partial;
+			if (cd)
+				++cd->stats.partial;
+		} else {
+			debug("miss: start " LBAF ", count " LBAFU "\n",
+			      start, blkcnt);
+			++_stats.misses;
+			if (cd)
+				++cd->stats.misses;
+		}
+		/* the caller reads the rest from the device */
+		cache_flush_range(iftype, devnum, start + done,
+				  blkcnt - done);
 	}
+	if (cd)
+		cd->stats.blocks += done;
 
-	debug("miss: start " LBAF ", count " LBAFU "\n",
-	      start, blkcnt);
-	++_stats.misses;
-	return 0;
+	return done;
 }
 
 void blkcache_fill(int iftype, int devnum,
 		   lbaint_t start, lbaint_t blkcnt,
 		   unsigned long blksz, void const *buffer)
 {
-	lbaint_t bytes;
-	struct block_cache_node *node;
-
 	/* don't cache big stuff */
 	if (blkcnt > _stats.max_blocks_per_entry)
 		return;
 
-	if (_stats.max_entries == 0)
+	if (_stats.max_entries == 0 || _stats.max_bytes == 0)
 		return;
 
-	bytes = blksz * blkcnt;
-	if (_stats.max_entries <= _stats.entries) {
-		/* pop LRU */
-		node = (struct block_cache_node *)block_cache.prev;
-		list_del(&node->lh);
-		_stats.entries--;
-		debug("drop: start " LBAF ", count " LBAFU "\n",
-		      node->start, node->blkcnt);
-		if (node->blkcnt * node->blksz < bytes) {
-			free(node->cache);
-			node->cache = 0;
-		}
+	debug("fill: start " LBAF ", count " LBAFU "\n",
+	      start, blkcnt);
+
+	cache_insert(iftype, devnum, start, blkcnt, blksz, buffer, false);
+}
+
+lbaint_t blkcache_readahead(int iftype, int devnum,
+			    lbaint_t start, lbaint_t blkcnt,
+			    lbaint_t *startp)
+{
+	lbaint_t end = start + blkcnt;
+	struct block_cache_dev *cd;
+	lbaint_t count;
+
+	if (!_stats.readahead || !_stats.max_entries || !_stats.max_bytes)
+		return 0;
+
+	cd = cache_dev(iftype, devnum);
+	if (!cd)
+		return 0;
+
+	/* big reads do not benefit, and would not be cached anyway */
+	if (start != cd->next || blkcnt > _stats.max_blocks_per_entry) {
+		cd->seq = 0;
+		cd->ra_end = 0;
 	} else {
-		node = malloc(sizeof(*node));
-		if (!node)
-			return;
-		node->cache = 0;
+		cd->seq++;
 	}
+	cd->next = end;
+	if (cd->seq < BLKCACHE_SEQ_READS)
+		return 0;
 
-	if (!node->cache) {
-		node->cache = malloc(bytes);
-		if (!node->cache) {
-			free(node);
-			return;
-		}
+	/* start the next window once half of the current one is used */
+	if (cd->ra_end > end + _stats.readahead / 2)
+		return 0;
+
+	*startp = max(end, cd->ra_end);
+	count = end + _stats.readahead - *startp;
+	cd->ra_end = *startp + count;
+	cache_flush_range(iftype, devnum, *startp, count);
+	debug("read-ahead: start " LBAF ", count " LBAFU "\n",
+	      *startp, count);
+
+	return count;
+}
+
+void blkcache_fill_ahead(int iftype, int devnum,
+			 lbaint_t start, lbaint_t blkcnt,
+			 unsigned long blksz, void const *buffer)
+{
+	struct block_cache_dev *cd;
+
+	if (cache_insert(iftype, devnum, start, blkcnt, blksz, buffer, false))
+		return;
+
+	_stats.ra_blocks += blkcnt;
+	cd = cache_dev(iftype, devnum);
+	if (cd)
+		cd->stats.ra_blocks += blkcnt;
+}
+
+int blkcache_write(int iftype, int devnum,
+		   lbaint_t start, lbaint_t blkcnt,
+		   unsigned long blksz, void const *buffer)
+{
+	struct block_cache_dev *cd;
+
+	if (!_stats.writeback || blkcnt > _stats.max_blocks_per_entry ||
+	    !_stats.max_entries || !_stats.max_bytes ||
+	    cache_insert(iftype, devnum, start, blkcnt, blksz, buffer, true)) {
+		/* the caller writes to the device, so drop our copy */
+		return blkcache_discard(iftype, devnum, start, blkcnt);
 	}
 
-	debug("fill: start " LBAF ", count " LBAFU "\n",
+	debug("write: start " LBAF ", count " LBAFU "\n",
 	      start, blkcnt);
+	++_stats.writes;
+	cd = cache_dev(iftype, devnum);
+	if (cd)
+		++cd->stats.writes;
+
+	return 1;
+}
 
-	node->iftype = iftype;
-	node->devnum = devnum;
-	node->start = start;
-	node->blkcnt = blkcnt;
-	node->blksz = blksz;
-	memcpy(node->cache, buffer, bytes);
-	list_add(&node->lh, &block_cache);
-	_stats.entries++;
+int blkcache_discard(int iftype, int devnum,
+		     lbaint_t start, lbaint_t blkcnt)
+{
+	return cache_discard(iftype, devnum, start, blkcnt);
+}
+
+int blkcache_flush(int iftype, int devnum)
+{
+	struct block_cache_node *node, *n;
+	int ret, err = 0;
+
+	if (!_stats.dirty)
+		return 0;
+
+	list_for_each_entry_safe(node, n, &block_cache, lh) {
+		if (!node->dirty_cnt || (iftype != -1 &&
+		    (node->iftype != iftype || node->devnum != devnum)))
+			continue;
+		ret = cache_flush_node(node);
+		if (ret) {
+			log_err("blkcache: write-back failed (err=%d)\n", ret);
+			err = ret;
+		}
+	}
+
+	return err;
 }
 
 void blkcache_invalidate(int iftype, int devnum)
 {
-	struct list_head *entry, *n;
-	struct block_cache_node *node;
+	struct block_cache_node *node, *n;
 
-	list_for_each_safe(entry, n, &block_cache) {
-		node = (struct block_cache_node *)entry;
+	list_for_each_entry_safe(node, n, &block_cache, lh) {
 		if (iftype == -1 ||
 		    (node->iftype == iftype && node->devnum == devnum)) {
-			list_del(entry);
+			cache_drop(node);
 			free(node->cache);
 			free(node);
-			--_stats.entries;
 		}
 	}
 }
 
-void blkcache_configure(unsigned blocks, unsigned entries)
+int blkcache_configure(unsigned blocks, unsigned entries)
 {
+	int ret;
+
 	/* invalidate cache if there is a change */
 	if ((blocks != _stats.max_blocks_per_entry) ||
-	    (entries != _stats.max_entries))
+	    (entries != _stats.max_entries)) {
+		/* keep the dirty blocks, and the layout they are cached in */
+		ret = blkcache_flush(-1, 0);
+		if (ret)
+			return ret;
 		blkcache_invalidate(-1, 0);
+	}
 
 	_stats.max_blocks_per_entry = blocks;
 	_stats.max_entries = entries;
 
 	_stats.hits = 0;
+	_stats.partial = 0;
 	_stats.misses = 0;
+
+	return 0;
+}
+
+int blkcache_configure_size(ulong bytes)
+{
+	int ret;
+
+	if (bytes != _stats.max_bytes) {
+		ret = blkcache_flush(-1, 0);
+		if (ret)
+			return ret;
+		blkcache_invalidate(-1, 0);
+	}
+
+	_stats.max_bytes = bytes;
+
+	return 0;
+}
+
+void blkcache_configure_readahead(unsigned blocks)
+{
+	int i;
+
+	_stats.readahead = blocks;
+	for (i = 0; i < BLKCACHE_MAX_DEVS; i++)
+		cache_devs[i].seq = 0;
+}
+
+int blkcache_configure_writeback(bool enable)
+{
+	int ret = 0;
+
+	if (!enable)
+		ret = blkcache_flush(-1, 0);
+	_stats.writeback = enable;
+
+	return ret;
 }
 
 void blkcache_stats(struct block_cache_stats *stats)
 {
 	memcpy(stats, &_stats, sizeof(*stats));
 	_stats.hits = 0;
+	_stats.partial = 0;
 	_stats.misses = 0;
+	_stats.ra_blocks = 0;
+	_stats.writes = 0;
+	_stats.flushes = 0;
+}
+
+int blkcache_dev_stats(int index, struct block_cache_dev_stats *stats)
+{
+	struct block_cache_dev_stats *ds;
+	int i;
+
+	for (i = 0; i < BLKCACHE_MAX_DEVS; i++) {
+		ds = &cache_devs[i].stats;
+		if (!ds->used || index--)
+			continue;
+
+		memcpy(stats, ds, sizeof(*stats));
+		ds->hits = 0;
+		ds->partial = 0;
+		ds->misses = 0;
+		ds->blocks = 0;
+		ds->ra_blocks = 0;
+		ds->writes = 0;
+		ds->flushes = 0;
+
+		return 0;
+	}
+
+	return -ENOENT;
 }
 
 void blkcache_free(void)
 {
 	blkcache_invalidate(-1, 0);
+	memset(cache_devs, '\0', sizeof(cache_devs));
 }
@@ -56,9 +56,37 @@ static unsigned long host_block_write(struct udevice *dev,
 	return -EIO;
 }
 
+static int host_block_submit(struct udevice *dev, struct blk_req *req)
+{
+	/* the transfer is left to host_block_poll(), as a device would */
+	return 0;
+}
+
+/* Carry out the oldest queued request, one per call */
+static int host_block_poll(struct udevice *dev)
+{
+	struct blk_req *req = blk_first_req(dev);
+	long ret;
+
+	if (!req)
+		return 0;
+
+	if (req->op == BLK_REQ_READ)
+		ret = host_block_read(dev, req->start, req->blkcnt,
+				      req->buffer);
+	else
+		ret = host_block_write(dev, req->start, req->blkcnt,
+				       req->buffer);
+	blk_req_done(req, ret);
+
+	return 0;
+}
+
 static const struct blk_ops sandbox_host_blk_ops = {
 	.read	= host_block_read,
 	.write	= host_block_write,
+	.submit	= host_block_submit,
+	.poll	= host_block_poll,
 };
 
 U_BOOT_DRIVER(sandbox_host_blk) = {
@@ -16,6 +16,7 @@
 #include <ram.h>
 #include <reset.h>
 #include "sdram_soc64.h"
+#include "sdram_soc64_ecc.h"
 #include <wait_bit.h>
 #include <asm/arch/firewall.h>
 #include <asm/arch/system_manager.h>
@@ -140,25 +141,11 @@ void sdram_clear_mem(phys_addr_t addr, phys_size_t size)
 	}
 }
 
-void sdram_init_ecc_bits(struct bd_info *bd)
+static void sdram_clear_banks(struct bd_info *bd, phys_addr_t start_addr,
+			      phys_size_t size)
 {
-	phys_size_t size, size_init;
-	phys_addr_t start_addr;
+	phys_size_t size_init;
 	int bank = 0;
-	unsigned int start = get_timer(0);
-
-	icache_enable();
-
-	start_addr = bd->bi_dram[0].start;
-	size = bd->bi_dram[0].size;
-
-	/* Initialize small block for page table */
-	memset((void *)start_addr, 0, PGTABLE_SIZE + PGTABLE_OFF);
-	gd->arch.tlb_addr = start_addr + PGTABLE_OFF;
-	gd->arch.tlb_size = PGTABLE_SIZE;
-	start_addr += PGTABLE_SIZE + PGTABLE_OFF;
-	size -= (PGTABLE_OFF + PGTABLE_SIZE);
-	dcache_enable();
 
 	while (1) {
 		while (size) {
@@ -176,6 +163,69 @@ void sdram_init_ecc_bits(struct bd_info *bd)
 		start_addr = bd->bi_dram[bank].start;
 		size = bd->bi_dram[bank].size;
 	}
+}
+
+/*
+ * In lazy mode only clear what SPL and U-Boot need before U-Boot proper
+ * scrubs the rest. sdram_size_check() also reads each 1 GiB chunk at
+ * power-of-two offsets, so give those cachelines valid ECC as well.
+ */
+static void sdram_clear_lazy(struct bd_info *bd, phys_addr_t start_addr)
+{
+	struct sdram_ecc_range win[SDRAM_ECC_LAZY_WINDOWS];
+	phys_addr_t start, end, chunk, off;
+	int bank, i, nr;
+
+	nr = sdram_ecc_lazy_windows(bd->bi_dram[0].start, bd->bi_dram[0].size,
+				    win);
+	for (i = 0; i < nr; i++) {
+		/* The page tables below start_addr are already in use */
+		start = max((phys_addr_t)win[i].start, start_addr);
+		end = win[i].start + win[i].size;
+		if (start < end)
+			sdram_clear_mem(start, end - start);
+	}
+
+	for (bank = 0; bank < CONFIG_NR_DRAM_BANKS; bank++) {
+		end = bd->bi_dram[bank].start + bd->bi_dram[bank].size;
+		for (chunk = bd->bi_dram[bank].start; chunk < end;
+		     chunk += SZ_1G) {
+			for (off = 0; off < min((phys_addr_t)SZ_1G, end - chunk);
+			     off = off ? off << 1 : sizeof(long)) {
+				start = ALIGN_DOWN(chunk + off,
+						   CONFIG_SYS_CACHELINE_SIZE);
+				if (start >= start_addr)
+					sdram_clear_mem(start,
+							CONFIG_SYS_CACHELINE_SIZE);
+			}
+		}
+	}
+}
+
+void sdram_init_ecc_bits(struct bd_info *bd)
+{
+	phys_size_t size;
+	phys_addr_t start_addr;
+	unsigned int start = get_timer(0);
+
+	icache_enable();
+
+	start_addr = bd->bi_dram[0].start;
+	size = bd->bi_dram[0].size;
+
+	/* Initialize small block for page table */
+	memset((void *)start_addr, 0, PGTABLE_SIZE + PGTABLE_OFF);
+	gd->arch.tlb_addr = start_addr + PGTABLE_OFF;
+	gd->arch.tlb_size = PGTABLE_SIZE;
+	start_addr += PGTABLE_SIZE + PGTABLE_OFF;
+	size -= (PGTABLE_OFF + PGTABLE_SIZE);
+	dcache_enable();
+
+	if (IS_ENABLED(CONFIG_ALTERA_SDRAM_ECC_LAZY))
+		sdram_clear_lazy(bd, start_addr);
+	else if (!CONFIG_IS_ENABLED(ALTERA_SDRAM_ECC_PARALLEL) ||
+		 sdram_clear_mem_parallel(bd, start_addr, size))
+		sdram_clear_banks(bd, start_addr, size);
 
 	dcache_disable();
 	icache_disable();
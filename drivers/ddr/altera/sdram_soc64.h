@@ -204,6 +204,21 @@ int emif_reset(struct altera_sdram_plat *plat);
 int poll_hmc_clock_status(void);
 void sdram_clear_mem(phys_addr_t addr, phys_size_t size);
 void sdram_init_ecc_bits(struct bd_info *bd);
+
+/**
+ * sdram_clear_mem_parallel() - clear SDRAM for ECC using all CPU cores
+ *
+ * Bank 0 is taken as @start_addr/@size, the others from @bd. Must be called
+ * at EL3 with the MMU and D-cache enabled.
+ *
+ * @bd:		Board info with the DRAM banks
+ * @start_addr:	Start of bank 0, past the page tables
+ * @size:	Size of bank 0 from @start_addr
+ * Return:	0 if all memory was cleared, -ve on error in which case nothing
+ *		has been cleared
+ */
+int sdram_clear_mem_parallel(struct bd_info *bd, phys_addr_t start_addr,
+			     phys_size_t size);
 void sdram_set_firewall(struct bd_info *bd);
 void sdram_size_check(struct bd_info *bd);
 phys_size_t sdram_calculate_size(struct altera_sdram_plat *plat);
@@ -0,0 +1,137 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Copyright (C) 2024 Intel Corporation <www.intel.com>
+ *
+ */
+
+#include <common.h>
+#include <bootstage.h>
+#include <cpu_func.h>
+#include <cyclic.h>
+#include <div64.h>
+#include <hang.h>
+#include <init.h>
+#include <log.h>
+#include <time.h>
+#include <asm/cache.h>
+#include <asm/io.h>
+#include <asm/system.h>
+#include <linux/sizes.h>
+#include "sdram_soc64.h"
+#include "sdram_soc64_ecc.h"
+
+#define SDRAM_ECC_TIMEOUT_MS	60000
+
+void sdram_ecc_secondary_entry(void);
+
+/* Must live in OCRAM, the SPL BSS is in the SDRAM being cleared */
+struct sdram_ecc_slot sdram_ecc_slots[SDRAM_ECC_MAX_CPUS] __section(".data");
+
+static const char *const sdram_ecc_names[SDRAM_ECC_MAX_CPUS] = {
+	"sdram_ecc_cpu0", "sdram_ecc_cpu1", "sdram_ecc_cpu2", "sdram_ecc_cpu3",
+};
+
+static ulong sdram_ecc_ticks_to_us(u64 ticks)
+{
+	return lldiv(ticks * 1000000, get_tbclk());
+}
+
+static void sdram_ecc_clear_slot(struct sdram_ecc_slot *slot)
+{
+	phys_addr_t start;
+	phys_size_t size, size_init;
+	int i;
+
+	for (i = 0; i < slot->nr_ranges; i++) {
+		start = slot->range[i].start;
+		size = slot->range[i].size;
+		while (size) {
+			size_init = min((phys_addr_t)SZ_1G, (phys_addr_t)size);
+			sdram_clear_mem(start, size_init);
+			size -= size_init;
+			start += size_init;
+			schedule();
+		}
+	}
+}
+
+int sdram_clear_mem_parallel(struct bd_info *bd, phys_addr_t start_addr,
+			     phys_size_t size)
+{
+	struct sdram_ecc_range bank[CONFIG_NR_DRAM_BANKS];
+	struct sdram_ecc_slot *slot = sdram_ecc_slots;
+	u64 mair, tcr, ttbr;
+	ulong start;
+	int cpu, nr_cpus, i;
+
+	if (current_el() != 3)
+		return -EPERM;
+
+	bank[0].start = start_addr;
+	bank[0].size = size;
+	for (i = 1; i < CONFIG_NR_DRAM_BANKS; i++) {
+		bank[i].start = bd->bi_dram[i].start;
+		bank[i].size = bd->bi_dram[i].size;
+	}
+
+	nr_cpus = sdram_ecc_split(bank, CONFIG_NR_DRAM_BANKS, slot,
+				  CONFIG_SPL_ALTERA_SDRAM_ECC_CPUS,
+				  CONFIG_SYS_CACHELINE_SIZE);
+	if (nr_cpus < 0) {
+		debug("SDRAM-ECC: cannot split banks (err=%d)\n", nr_cpus);
+		return nr_cpus;
+	}
+	if (nr_cpus < 2)
+		return -ENODEV;
+
+	asm volatile("mrs %0, mair_el3" : "=r" (mair));
+	asm volatile("mrs %0, tcr_el3" : "=r" (tcr));
+	asm volatile("mrs %0, ttbr0_el3" : "=r" (ttbr));
+	for (cpu = 1; cpu < nr_cpus; cpu++) {
+		slot[cpu].mair = mair;
+		slot[cpu].tcr = tcr;
+		slot[cpu].ttbr = ttbr;
+	}
+
+	/* The secondary cores read their slots with the MMU off */
+	flush_dcache_range((ulong)slot, (ulong)(slot + SDRAM_ECC_MAX_CPUS));
+
+	bootstage_start(BOOTSTAGE_ID_ACCUM_SDRAM_ECC, "sdram_ecc");
+	writeq((u64)&sdram_ecc_secondary_entry, CPU_RELEASE_ADDR);
+	asm volatile("sev");
+
+	slot[0].t_start = get_ticks();
+	sdram_ecc_clear_slot(&slot[0]);
+	slot[0].t_end = get_ticks();
+
+	start = get_timer(0);
+	for (cpu = 1; cpu < nr_cpus; cpu++) {
+		while (1) {
+			invalidate_dcache_range((ulong)&slot[cpu],
+						(ulong)&slot[cpu + 1]);
+			if (slot[cpu].state == SDRAM_ECC_DONE)
+				break;
+			if (get_timer(start) > SDRAM_ECC_TIMEOUT_MS) {
+				printf("SDRAM-ECC: CPU%d did not finish\n", cpu);
+				hang();
+			}
+			schedule();
+		}
+	}
+
+	/* Send the secondary cores back to waiting for ATF */
+	writeq(0, CPU_RELEASE_ADDR);
+	bootstage_accum(BOOTSTAGE_ID_ACCUM_SDRAM_ECC);
+
+	for (cpu = 0; cpu < nr_cpus; cpu++) {
+		bootstage_add_record(BOOTSTAGE_ID_ALLOC, sdram_ecc_names[cpu],
+				     BOOTSTAGEF_ALLOC,
+				     sdram_ecc_ticks_to_us(slot[cpu].t_end));
+		debug("SDRAM-ECC: CPU%d cleared %d range(s) in %lu us\n", cpu,
+		      (int)slot[cpu].nr_ranges,
+		      sdram_ecc_ticks_to_us(slot[cpu].t_end -
+					    slot[cpu].t_start));
+	}
+
+	return 0;
+}
@@ -0,0 +1,216 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Copyright (C) 2024 Intel Corporation <www.intel.com>
+ *
+ * Helpers for the multi-core and lazy SDRAM ECC initialisation. The slot
+ * layout is shared with the secondary core entry code, so the offsets below
+ * must match struct sdram_ecc_slot.
+ */
+
+#ifndef	_SDRAM_SOC64_ECC_H_
+#define	_SDRAM_SOC64_ECC_H_
+
+#define SDRAM_ECC_MAX_CPUS		4
+#define SDRAM_ECC_MAX_RANGES		8
+
+#define SDRAM_ECC_SLOT_SHIFT		8
+#define SDRAM_ECC_SLOT_SIZE		(1 << SDRAM_ECC_SLOT_SHIFT)
+
+#define SDRAM_ECC_SLOT_STATE		0x00
+#define SDRAM_ECC_SLOT_T_START		0x08
+#define SDRAM_ECC_SLOT_T_END		0x10
+#define SDRAM_ECC_SLOT_NR		0x18
+#define SDRAM_ECC_SLOT_MAIR		0x20
+#define SDRAM_ECC_SLOT_TCR		0x28
+#define SDRAM_ECC_SLOT_TTBR		0x30
+#define SDRAM_ECC_SLOT_RANGE		0x40
+
+#define SDRAM_ECC_IDLE			0
+#define SDRAM_ECC_DONE			1
+
+#ifndef __ASSEMBLY__
+
+#include <linux/kernel.h>
+#include <linux/sizes.h>
+#include <linux/types.h>
+
+/**
+ * struct sdram_ecc_range - a cacheline aligned region of SDRAM
+ *
+ * @start:	Physical start address
+ * @size:	Size in bytes
+ */
+struct sdram_ecc_range {
+	u64 start;
+	u64 size;
+};
+
+/**
+ * struct sdram_ecc_slot - work item for one CPU core
+ *
+ * @state:	SDRAM_ECC_IDLE or SDRAM_ECC_DONE
+ * @t_start:	Counter value when the core started clearing
+ * @t_end:	Counter value when the core finished clearing
+ * @nr_ranges:	Number of entries used in @range
+ * @mair:	MAIR_EL3 of the primary core
+ * @tcr:	TCR_EL3 of the primary core
+ * @ttbr:	TTBR0_EL3 of the primary core
+ * @range:	Regions to clear, in ascending address order
+ */
+struct sdram_ecc_slot {
+	u64 state;
+	u64 t_start;
+	u64 t_end;
+	u64 nr_ranges;
+	u64 mair;
+	u64 tcr;
+	u64 ttbr;
+	u64 reserved;
+	struct sdram_ecc_range range[SDRAM_ECC_MAX_RANGES];
+} __aligned(SDRAM_ECC_SLOT_SIZE);
+
+check_member(sdram_ecc_slot, state, SDRAM_ECC_SLOT_STATE);
+check_member(sdram_ecc_slot, t_start, SDRAM_ECC_SLOT_T_START);
+check_member(sdram_ecc_slot, t_end, SDRAM_ECC_SLOT_T_END);
+check_member(sdram_ecc_slot, nr_ranges, SDRAM_ECC_SLOT_NR);
+check_member(sdram_ecc_slot, mair, SDRAM_ECC_SLOT_MAIR);
+check_member(sdram_ecc_slot, tcr, SDRAM_ECC_SLOT_TCR);
+check_member(sdram_ecc_slot, ttbr, SDRAM_ECC_SLOT_TTBR);
+check_member(sdram_ecc_slot, range, SDRAM_ECC_SLOT_RANGE);
+
+/**
+ * sdram_ecc_split() - divide the SDRAM banks between CPU cores
+ *
+ * Every core gets an equal share of the total size, rounded up to @align, and
+ * the last core takes whatever is left. A share may cross a bank boundary, in
+ * which case the core gets one range per bank. Ranges never overlap and
+ * together cover every bank exactly once.
+ *
+ * @bank:	Banks to clear, each aligned to @align
+ * @nr_banks:	Number of entries in @bank
+ * @slot:	Returns the ranges for each core
+ * @nr_cpus:	Number of entries in @slot, at most SDRAM_ECC_MAX_CPUS
+ * @align:	Alignment of every range, must be a power of two
+ * Return:	number of cores with work to do, -EINVAL if a bank is not
+ *		aligned, -E2BIG if a core would need more than
+ *		SDRAM_ECC_MAX_RANGES ranges
+ */
+int sdram_ecc_split(const struct sdram_ecc_range *bank, int nr_banks,
+		    struct sdram_ecc_slot *slot, int nr_cpus, u64 align);
+
+/* Granularity of the lazy scrub, matching the MMU block size */
+#define SDRAM_ECC_LAZY_SHIFT		21
+#define SDRAM_ECC_LAZY_UNIT		(1 << SDRAM_ECC_LAZY_SHIFT)
+#define SDRAM_ECC_LAZY_WINDOWS		4
+
+/**
+ * struct sdram_ecc_map - which blocks of SDRAM have been scrubbed
+ *
+ * The banks are divided into SDRAM_ECC_LAZY_UNIT blocks, numbered from the
+ * start of the first bank. The last block of a bank may be partial.
+ *
+ * @bank:	DRAM banks
+ * @nr_banks:	Number of entries in @bank
+ * @nr_units:	Number of blocks across all banks
+ * @left:	Number of blocks not yet marked
+ * @bits:	One bit per block, set once it is scrubbed
+ */
+struct sdram_ecc_map {
+	const struct sdram_ecc_range *bank;
+	int nr_banks;
+	int nr_units;
+	int left;
+	ulong *bits;
+};
+
+/**
+ * sdram_ecc_map_init() - set up an empty map
+ *
+ * @map:	Map to set up
+ * @bank:	DRAM banks, which must stay valid while @map is used
+ * @nr_banks:	Number of entries in @bank
+ * @bits:	Bitmap of at least BITS_TO_LONGS(@map->nr_units) words, or NULL
+ *		to only count the blocks
+ * Return:	number of blocks
+ */
+int sdram_ecc_map_init(struct sdram_ecc_map *map,
+		       const struct sdram_ecc_range *bank, int nr_banks,
+		       ulong *bits);
+
+/**
+ * sdram_ecc_map_test() - check whether a block is scrubbed
+ *
+ * @map:	Map to check
+ * @unit:	Block number, less than @map->nr_units
+ * Return:	true if the block is marked
+ */
+bool sdram_ecc_map_test(const struct sdram_ecc_map *map, int unit);
+
+/**
+ * sdram_ecc_map_unit() - get the memory covered by a block
+ *
+ * @map:	Map to use
+ * @unit:	Block number, less than @map->nr_units
+ * @r:		Returns the block, clipped to the end of its bank
+ */
+void sdram_ecc_map_unit(const struct sdram_ecc_map *map, int unit,
+			struct sdram_ecc_range *r);
+
+/**
+ * sdram_ecc_map_set() - mark a block as scrubbed
+ *
+ * @map:	Map to update
+ * @unit:	Block number, less than @map->nr_units
+ * Return:	true if the block was not marked before
+ */
+bool sdram_ecc_map_set(struct sdram_ecc_map *map, int unit);
+
+/**
+ * sdram_ecc_map_mark() - mark the blocks covering a region as scrubbed
+ *
+ * Parts of the region outside every bank are ignored.
+ *
+ * @map:	Map to update
+ * @start:	Start of the region
+ * @size:	Size of the region in bytes
+ * @clear:	Called for each block which was not marked before, or NULL
+ * Return:	number of blocks newly marked
+ */
+int sdram_ecc_map_mark(struct sdram_ecc_map *map, u64 start, u64 size,
+		       void (*clear)(const struct sdram_ecc_range *r));
+
+/**
+ * sdram_ecc_map_next() - find the next block still to scrub
+ *
+ * @map:	Map to search
+ * @unit:	Block to start from
+ * Return:	first unmarked block at or after @unit, or @map->nr_units if
+ *		there is none
+ */
+int sdram_ecc_map_next(const struct sdram_ecc_map *map, int unit);
+
+#if IS_ENABLED(CONFIG_ALTERA_SDRAM_ECC_LAZY)
+/**
+ * sdram_ecc_lazy_windows() - regions initialised by SPL in lazy mode
+ *
+ * SPL clears these before U-Boot proper runs and U-Boot proper scrubs the
+ * rest, so both must agree on them. Each window is widened to whole
+ * SDRAM_ECC_LAZY_UNIT blocks and clipped to the first bank.
+ *
+ * @base:	Start of the first DRAM bank
+ * @size:	Size of the first DRAM bank
+ * @win:	Returns up to SDRAM_ECC_LAZY_WINDOWS windows
+ * Return:	number of windows
+ */
+int sdram_ecc_lazy_windows(u64 base, u64 size, struct sdram_ecc_range *win);
+#else
+static inline int sdram_ecc_lazy_windows(u64 base, u64 size,
+					 struct sdram_ecc_range *win)
+{
+	return 0;
+}
+#endif
+
+#endif /* __ASSEMBLY__ */
+
+#endif /* _SDRAM_SOC64_ECC_H_ */
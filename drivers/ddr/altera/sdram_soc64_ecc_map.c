@@ -0,0 +1,149 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Copyright (C) 2024 Intel Corporation <www.intel.com>
+ *
+ * Bookkeeping for the lazy SDRAM ECC scrub: the windows SPL initialises and
+ * the map of blocks U-Boot proper has scrubbed since. This does not touch
+ * the hardware, so the sandbox tests link it as well.
+ */
+
+#include <common.h>
+#include <system-constants.h>
+#include <linux/bitops.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include "sdram_soc64_ecc.h"
+
+static int sdram_ecc_bank_units(const struct sdram_ecc_range *bank)
+{
+	return (bank->size + SDRAM_ECC_LAZY_UNIT - 1) >> SDRAM_ECC_LAZY_SHIFT;
+}
+
+int sdram_ecc_map_init(struct sdram_ecc_map *map,
+		       const struct sdram_ecc_range *bank, int nr_banks,
+		       ulong *bits)
+{
+	int i;
+
+	map->bank = bank;
+	map->nr_banks = nr_banks;
+	map->nr_units = 0;
+	for (i = 0; i < nr_banks; i++)
+		map->nr_units += sdram_ecc_bank_units(&bank[i]);
+	map->left = map->nr_units;
+	map->bits = bits;
+	if (bits)
+		memset(bits, '\0', BITS_TO_LONGS(map->nr_units) *
+		       sizeof(ulong));
+
+	return map->nr_units;
+}
+
+bool sdram_ecc_map_test(const struct sdram_ecc_map *map, int unit)
+{
+	return map->bits[unit / BITS_PER_LONG] & BIT(unit % BITS_PER_LONG);
+}
+
+void sdram_ecc_map_unit(const struct sdram_ecc_map *map, int unit,
+			struct sdram_ecc_range *r)
+{
+	const struct sdram_ecc_range *bank = map->bank;
+	u64 off;
+
+	while (unit >= sdram_ecc_bank_units(bank)) {
+		unit -= sdram_ecc_bank_units(bank);
+		bank++;
+	}
+	off = (u64)unit * SDRAM_ECC_LAZY_UNIT;
+	r->start = bank->start + off;
+	r->size = min((u64)SDRAM_ECC_LAZY_UNIT, bank->size - off);
+}
+
+bool sdram_ecc_map_set(struct sdram_ecc_map *map, int unit)
+{
+	if (sdram_ecc_map_test(map, unit))
+		return false;
+	map->bits[unit / BITS_PER_LONG] |= BIT(unit % BITS_PER_LONG);
+	map->left--;
+
+	return true;
+}
+
+int sdram_ecc_map_mark(struct sdram_ecc_map *map, u64 start, u64 size,
+		       void (*clear)(const struct sdram_ecc_range *r))
+{
+	u64 bstart, bend, end = start + size;
+	int base, first = 0, count = 0, i, unit, last;
+	struct sdram_ecc_range r;
+
+	for (i = 0; i < map->nr_banks; i++) {
+		base = first;
+		first += sdram_ecc_bank_units(&map->bank[i]);
+		bstart = map->bank[i].start;
+		bend = bstart + map->bank[i].size;
+		if (!size || end <= bstart || start >= bend)
+			continue;
+
+		unit = base + ((max(start, bstart) - bstart) >>
+			       SDRAM_ECC_LAZY_SHIFT);
+		last = base + ((min(end, bend) - bstart - 1) >>
+			       SDRAM_ECC_LAZY_SHIFT);
+		for (; unit <= last; unit++) {
+			if (!sdram_ecc_map_set(map, unit))
+				continue;
+			if (clear) {
+				sdram_ecc_map_unit(map, unit, &r);
+				clear(&r);
+			}
+			count++;
+		}
+	}
+
+	return count;
+}
+
+int sdram_ecc_map_next(const struct sdram_ecc_map *map, int unit)
+{
+	for (; unit < map->nr_units; unit++)
+		if (!sdram_ecc_map_test(map, unit))
+			break;
+
+	return unit;
+}
+
+#if IS_ENABLED(CONFIG_ALTERA_SDRAM_ECC_LAZY)
+int sdram_ecc_lazy_windows(u64 base, u64 size, struct sdram_ecc_range *win)
+{
+	u64 end = base + size;
+	int i, nr = 0;
+
+	/* ATF, U-Boot and its FDT, the page tables and the load addresses */
+	win[nr].start = base;
+	win[nr++].size = CONFIG_ALTERA_SDRAM_ECC_LAZY_LOW_SIZE;
+
+	/* Relocated U-Boot with its heap, stack and allocations below it */
+	win[nr].start = size > CONFIG_ALTERA_SDRAM_ECC_LAZY_TOP_SIZE ?
+			end - CONFIG_ALTERA_SDRAM_ECC_LAZY_TOP_SIZE : base;
+	win[nr++].size = CONFIG_ALTERA_SDRAM_ECC_LAZY_TOP_SIZE;
+
+	/* SPL BSS and heap */
+	win[nr].start = CONFIG_SPL_BSS_START_ADDR;
+	win[nr++].size = CONFIG_SPL_BSS_MAX_SIZE;
+#if IS_ENABLED(CONFIG_SYS_SPL_MALLOC)
+	win[nr].start = SYS_SPL_MALLOC_START;
+	win[nr++].size = CONFIG_SYS_SPL_MALLOC_SIZE;
+#endif
+
+	for (i = 0; i < nr; i++) {
+		u64 start = max(rounddown(win[i].start, SDRAM_ECC_LAZY_UNIT),
+				base);
+		u64 stop = min(roundup(win[i].start + win[i].size,
+				       SDRAM_ECC_LAZY_UNIT), end);
+
+		win[i].start = start;
+		win[i].size = stop > start ? stop - start : 0;
+	}
+
+	return nr;
+}
+#endif
@@ -0,0 +1,62 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Copyright (C) 2024 Intel Corporation <www.intel.com>
+ *
+ * Division of the SDRAM between CPU cores for the ECC initialisation. This
+ * does not touch the hardware, so the sandbox tests link it as well.
+ */
+
+#include <common.h>
+#include <div64.h>
+#include <errno.h>
+#include <linux/kernel.h>
+#include "sdram_soc64_ecc.h"
+
+int sdram_ecc_split(const struct sdram_ecc_range *bank, int nr_banks,
+		    struct sdram_ecc_slot *slot, int nr_cpus, u64 align)
+{
+	u64 total = 0, share, left;
+	int cpu = 0, i;
+
+	for (i = 0; i < nr_cpus; i++) {
+		slot[i].state = SDRAM_ECC_IDLE;
+		slot[i].nr_ranges = 0;
+	}
+
+	for (i = 0; i < nr_banks; i++) {
+		if ((bank[i].start | bank[i].size) & (align - 1))
+			return -EINVAL;
+		total += bank[i].size;
+	}
+	if (!total)
+		return 0;
+
+	share = roundup(lldiv(total, nr_cpus), align);
+	left = share;
+
+	for (i = 0; i < nr_banks; i++) {
+		u64 start = bank[i].start;
+		u64 size = bank[i].size;
+
+		while (size) {
+			struct sdram_ecc_slot *s = &slot[cpu];
+			u64 len = cpu == nr_cpus - 1 ? size : min(size, left);
+
+			if (s->nr_ranges == SDRAM_ECC_MAX_RANGES)
+				return -E2BIG;
+			s->range[s->nr_ranges].start = start;
+			s->range[s->nr_ranges].size = len;
+			s->nr_ranges++;
+
+			start += len;
+			size -= len;
+			left -= len;
+			if (!left && cpu < nr_cpus - 1) {
+				cpu++;
+				left = share;
+			}
+		}
+	}
+
+	return slot[cpu].nr_ranges ? cpu + 1 : cpu;
+}
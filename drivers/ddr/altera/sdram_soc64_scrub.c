@@ -0,0 +1,175 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Copyright (C) 2024 Intel Corporation <www.intel.com>
+ *
+ * Background SDRAM ECC scrub for U-Boot proper. In lazy mode SPL only
+ * initialises the windows returned by sdram_ecc_lazy_windows(); the rest of
+ * DRAM is cleared here a block at a time from a cyclic function, and
+ * whatever is left is cleared before anything is loaded.
+ */
+
+#include <common.h>
+#include <cpu_func.h>
+#include <cyclic.h>
+#include <env.h>
+#include <event.h>
+#include <init.h>
+#include <log.h>
+#include <malloc.h>
+#include <time.h>
+#include <asm/global_data.h>
+#include <linux/sizes.h>
+#include "sdram_soc64_ecc.h"
+
+DECLARE_GLOBAL_DATA_PTR;
+
+/* Image load addresses that must be usable before the scrub completes */
+static const char *const sdram_ecc_load_vars[] = {
+	"loadaddr", "kernel_addr_r", "fdt_addr_r", "fdt_addr",
+	"ramdisk_addr_r", "scriptaddr", "pxefile_addr_r", "fdtoverlay_addr_r",
+};
+
+/**
+ * struct sdram_ecc_scrub - state of the background scrub
+ *
+ * @bank:	DRAM banks, as given to @map
+ * @map:	Blocks already cleared
+ * @next:	Block the cyclic function looks at next
+ * @cyclic:	Cyclic function clearing the blocks
+ * @start:	Time the scrub started, in ms
+ */
+struct sdram_ecc_scrub {
+	struct sdram_ecc_range bank[CONFIG_NR_DRAM_BANKS];
+	struct sdram_ecc_map map;
+	int next;
+	struct cyclic_info *cyclic;
+	ulong start;
+};
+
+static struct sdram_ecc_scrub scrub;
+
+static void sdram_ecc_clear(const struct sdram_ecc_range *r)
+{
+	u64 addr;
+
+	/* DC ZVA allocates the lines without reading uninitialised DRAM */
+	for (addr = r->start; addr < r->start + r->size;
+	     addr += CONFIG_SYS_CACHELINE_SIZE)
+		asm volatile("dc zva, %0" : : "r"(addr) : "memory");
+}
+
+/* Clear the next block, returns false once there is nothing left */
+static bool sdram_ecc_scrub_step(void)
+{
+	struct sdram_ecc_range r;
+	int unit;
+
+	unit = sdram_ecc_map_next(&scrub.map, scrub.next);
+	if (unit >= scrub.map.nr_units)
+		return false;
+
+	sdram_ecc_map_unit(&scrub.map, unit, &r);
+	sdram_ecc_clear(&r);
+	sdram_ecc_map_set(&scrub.map, unit);
+	scrub.next = unit + 1;
+
+	return true;
+}
+
+static void sdram_ecc_scrub_cyclic(void *ctx)
+{
+	ulong start = timer_get_us();
+
+	if (!scrub.map.left)
+		return;
+
+	/* Leave half of the cyclic time budget to everything else */
+	while (timer_get_us() - start < CONFIG_CYCLIC_MAX_CPU_TIME_US / 2)
+		if (!sdram_ecc_scrub_step())
+			break;
+}
+
+/* Clear whatever is left, so that all of SDRAM can be used */
+static void sdram_ecc_scrub_wait(void)
+{
+	if (!scrub.map.bits)
+		return;
+
+	if (scrub.cyclic) {
+		cyclic_unregister(scrub.cyclic);
+		scrub.cyclic = NULL;
+	}
+
+	while (sdram_ecc_scrub_step())
+		schedule();
+
+	printf("SDRAM-ECC: Scrub completed in %lu ms\n", get_timer(scrub.start));
+	free(scrub.map.bits);
+	scrub.map.bits = NULL;
+}
+
+/*
+ * The block being cleared is zeroed, so nothing may be loaded into memory
+ * the scrub has not reached yet. bootm, the filesystem load commands, tftp
+ * and loadb all set up an lmb to check their destination before writing to
+ * it, so finish the scrub there. EVT_FT_FIXUP is the backstop for an OS
+ * started without going through an lmb.
+ */
+static int sdram_ecc_scrub_finish(void *ctx, struct event *event)
+{
+	sdram_ecc_scrub_wait();
+
+	return 0;
+}
+EVENT_SPY(EVT_LMB_RESERVE, sdram_ecc_scrub_finish);
+EVENT_SPY(EVT_FT_FIXUP, sdram_ecc_scrub_finish);
+
+static int sdram_ecc_scrub_start(void *ctx, struct event *event)
+{
+	struct sdram_ecc_range win[SDRAM_ECC_LAZY_WINDOWS];
+	int bank, i, nr;
+	ulong *bits;
+	ulong addr;
+
+	scrub.start = get_timer(0);
+	for (bank = 0; bank < CONFIG_NR_DRAM_BANKS; bank++) {
+		scrub.bank[bank].start = gd->bd->bi_dram[bank].start;
+		scrub.bank[bank].size = gd->bd->bi_dram[bank].size;
+	}
+	nr = sdram_ecc_map_init(&scrub.map, scrub.bank, CONFIG_NR_DRAM_BANKS,
+				NULL);
+	scrub.next = 0;
+
+	bits = malloc(BITS_TO_LONGS(nr) * sizeof(ulong));
+	if (!bits) {
+		log_err("SDRAM-ECC: No memory for scrub map\n");
+		return -ENOMEM;
+	}
+	sdram_ecc_map_init(&scrub.map, scrub.bank, CONFIG_NR_DRAM_BANKS, bits);
+
+	nr = sdram_ecc_lazy_windows(scrub.bank[0].start, scrub.bank[0].size,
+				    win);
+	for (i = 0; i < nr; i++)
+		sdram_ecc_map_mark(&scrub.map, win[i].start, win[i].size, NULL);
+
+	/* commands which do not check with the lmb mostly load here */
+	for (i = 0; i < ARRAY_SIZE(sdram_ecc_load_vars); i++) {
+		addr = env_get_hex(sdram_ecc_load_vars[i], 0);
+		if (addr)
+			sdram_ecc_map_mark(&scrub.map, addr,
+					   CONFIG_ALTERA_SDRAM_ECC_LAZY_LOAD_SIZE,
+					   sdram_ecc_clear);
+	}
+
+	scrub.cyclic = cyclic_register(sdram_ecc_scrub_cyclic,
+				       CONFIG_CYCLIC_MAX_CPU_TIME_US,
+				       "sdram_ecc_scrub", NULL);
+	if (!scrub.cyclic)
+		return sdram_ecc_scrub_finish(ctx, event);
+
+	printf("SDRAM-ECC: Scrubbing %llu MiB in background\n",
+	       ((u64)scrub.map.left * SDRAM_ECC_LAZY_UNIT) >> 20);
+
+	return 0;
+}
+EVENT_SPY(EVT_MAIN_LOOP, sdram_ecc_scrub_start);
@@ -27,6 +27,8 @@ static const struct altera_fpga {
 	int			(*load)(Altera_desc *, const void *, size_t);
 	int			(*dump)(Altera_desc *, const void *, size_t);
 	int			(*info)(Altera_desc *);
+	int			(*loadfs)(Altera_desc *, const void *, size_t,
+					  fpga_fs_info *);
 } altera_fpga[] = {
 #if defined(CONFIG_FPGA_ACEX1K)
 	{ Altera_ACEX1K, "ACEX1K", ACEX1K_load, ACEX1K_dump, ACEX1K_info },
@@ -47,7 +49,11 @@ static const struct altera_fpga {
 #endif
 #if defined(CONFIG_FPGA_INTEL_SDM_MAILBOX)
 	{ Intel_FPGA_SDM_Mailbox, "Intel SDM Mailbox", intel_sdm_mb_load, NULL,
-	  NULL },
+	  NULL,
+#if defined(CONFIG_CMD_FPGA_LOADFS) && !defined(CONFIG_SPL_BUILD)
+	  intel_sdm_mb_loadfs
+#endif
+	},
 #endif
 };
 
@@ -150,6 +156,25 @@ int altera_load(Altera_desc *desc, const void *buf, size_t bsize)
 	return 0;
 }
 
+#if defined(CONFIG_CMD_FPGA_LOADFS)
+int altera_loadfs(Altera_desc *desc, const void *buf, size_t bsize,
+		  fpga_fs_info *fpga_fsinfo)
+{
+	const struct altera_fpga *fpga = altera_desc_to_fpga(desc, __func__);
+
+	if (!fpga)
+		return FPGA_FAIL;
+
+	if (!fpga->loadfs) {
+		printf("%s: Missing loadfs operation\n", __func__);
+		return FPGA_FAIL;
+	}
+
+	log_debug("Launching the %s Loader...\n", fpga->name);
+	return fpga->loadfs(desc, buf, bsize, fpga_fsinfo);
+}
+#endif
+
 int altera_dump(Altera_desc *desc, const void *buf, size_t bsize)
 {
 	const struct altera_fpga *fpga = altera_desc_to_fpga(desc, __func__);
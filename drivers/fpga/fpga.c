@@ -203,6 +203,14 @@ int fpga_fsload(int devnum, const void *buf, size_t size,
 						fpga_fsinfo);
 #else
 			fpga_no_sup((char *)__func__, "Xilinx devices");
+#endif
+			break;
+		case fpga_altera:
+#if defined(CONFIG_FPGA_ALTERA)
+			ret_val = altera_loadfs(desc->devdesc, buf, size,
+						fpga_fsinfo);
+#else
+			fpga_no_sup((char *)__func__, "Altera devices");
 #endif
 			break;
 		default:
@@ -5,7 +5,10 @@
 
 #include <common.h>
 #include <altera.h>
+#include <fs.h>
+#include <intel_sdm_stream.h>
 #include <log.h>
+#include <mapmem.h>
 #include <watchdog.h>
 #include <asm/arch/mailbox_s10.h>
 #include <asm/arch/smc_api.h>
@@ -22,6 +25,7 @@
 
 #define BITSTREAM_CHUNK_SIZE				0xFFFF0
 #define RECONFIG_STATUS_POLL_RETRY_MAX			100
+#define RECONFIG_DATA_POLL_DELAY_US			20000
 
 /*
  * Polling the FPGA configuration status.
@@ -53,80 +57,103 @@ static int reconfig_status_polling_resp(void)
 	return -ETIMEDOUT;
 }
 
-static int send_bitstream(const void *rbf_data, size_t rbf_size)
+/**
+ * struct sdm_smc_xfer - RECONFIG_DATA commands passed through ATF
+ *
+ * ATF reports completed commands by the address of their data, so keep the
+ * address of each command ID and queue the completions ATF returns at once.
+ *
+ * @addr:	Address of the data sent with each command ID
+ * @done:	Addresses of completed commands not yet reported
+ * @nr_done:	Number of entries in @done
+ * @next:	Next entry in @done to report
+ */
+struct sdm_smc_xfer {
+	u64 addr[SDM_STREAM_ID_MAX + 1];
+	u64 done[3];
+	int nr_done;
+	int next;
+};
+
+static int sdm_smc_submit(struct sdm_stream *s, u8 id, const void *data,
+			  u32 len)
 {
-	int i;
-	u64 res_buf[3];
+	struct sdm_smc_xfer *xfer = s->priv;
 	u64 args[2];
-	u32 xfer_count = 0;
-	int ret, wr_ret = 0, retry = 0;
-	size_t buf_size = (rbf_size > BITSTREAM_CHUNK_SIZE) ?
-				BITSTREAM_CHUNK_SIZE : rbf_size;
-
-	while (rbf_size || xfer_count) {
-		if (!wr_ret && rbf_size) {
-			args[0] = (u64)rbf_data;
-			args[1] = buf_size;
-			wr_ret = invoke_smc(INTEL_SIP_SMC_FPGA_CONFIG_WRITE,
-					    args, 2, NULL, 0);
-
-			debug("wr_ret = %d, rbf_data = %p, buf_size = %08lx\n",
-			      wr_ret, rbf_data, buf_size);
-
-			if (wr_ret != INTEL_SIP_SMC_STATUS_OK &&
-			    wr_ret != INTEL_SIP_SMC_STATUS_BUSY)
-				continue;
-
-			rbf_size -= buf_size;
-			rbf_data += buf_size;
-
-			if (buf_size >= rbf_size)
-				buf_size = rbf_size;
-
-			xfer_count++;
-			puts(".");
-		} else {
-			ret = invoke_smc(
-				INTEL_SIP_SMC_FPGA_CONFIG_COMPLETED_WRITE,
-				NULL, 0, res_buf, ARRAY_SIZE(res_buf));
-			if (!ret) {
-				for (i = 0; i < ARRAY_SIZE(res_buf); i++) {
-					if (!res_buf[i])
-						break;
-					xfer_count--;
-					wr_ret = 0;
-					retry = 0;
-				}
-			} else if (ret !=
-				   INTEL_SIP_SMC_STATUS_BUSY)
-				return ret;
-			else if (!xfer_count)
-				return INTEL_SIP_SMC_STATUS_ERROR;
-
-			if (++retry >= RECONFIG_STATUS_POLL_RETRY_MAX)
-				return -ETIMEDOUT;
-
-			udelay(20000);
+	int ret;
+
+	flush_dcache_range((unsigned long)data, (unsigned long)(data + len));
+
+	args[0] = (u64)data;
+	args[1] = len;
+	ret = invoke_smc(INTEL_SIP_SMC_FPGA_CONFIG_WRITE, args, 2, NULL, 0);
+
+	debug("wr_ret = %d, rbf_data = %p, buf_size = %08x\n", ret, data, len);
+
+	if (ret != INTEL_SIP_SMC_STATUS_OK && ret != INTEL_SIP_SMC_STATUS_BUSY)
+		return -EAGAIN;
+
+	xfer->addr[id] = (u64)data;
+	puts(".");
+
+	return ret == INTEL_SIP_SMC_STATUS_BUSY ? SDM_STREAM_FULL : 0;
+}
+
+static int sdm_smc_reap(struct sdm_stream *s, u32 *status)
+{
+	struct sdm_smc_xfer *xfer = s->priv;
+	u64 addr;
+	int i, ret;
+
+	if (xfer->next == xfer->nr_done) {
+		xfer->next = 0;
+		xfer->nr_done = 0;
+		ret = invoke_smc(INTEL_SIP_SMC_FPGA_CONFIG_COMPLETED_WRITE,
+				 NULL, 0, xfer->done, ARRAY_SIZE(xfer->done));
+		if (ret == INTEL_SIP_SMC_STATUS_BUSY) {
+			udelay(RECONFIG_DATA_POLL_DELAY_US);
+			return 0;
+		}
+		if (ret) {
+			debug("COMPLETED_WRITE error: %d\n", ret);
+			return -EIO;
+		}
+		while (xfer->nr_done < ARRAY_SIZE(xfer->done) &&
+		       xfer->done[xfer->nr_done])
+			xfer->nr_done++;
+		if (!xfer->nr_done)
+			return 0;
+	}
+
+	addr = xfer->done[xfer->next++];
+	*status = 0;
+	for (i = 1; i <= SDM_STREAM_ID_MAX; i++) {
+		if (xfer->addr[i] == addr) {
+			xfer->addr[i] = 0;
+			return i;
 		}
-		schedule();
 	}
 
 	return 0;
 }
 
+static const struct sdm_stream_ops sdm_smc_ops = {
+	.submit	= sdm_smc_submit,
+	.reap	= sdm_smc_reap,
+};
+
 /*
- * This is the interface used by FPGA driver.
+ * Run a full reconfiguration, with the bitstream sent by the transfer @s.
  * Return 0 for success, non-zero for error.
  */
-int intel_sdm_mb_load(Altera_desc *desc, const void *rbf_data, size_t rbf_size)
+static int reconfig_stream(struct sdm_stream *s)
 {
+	struct sdm_smc_xfer xfer = { };
 	int ret;
 	u64 arg = 1;
 
 	debug("Invoking FPGA_CONFIG_START...\n");
 
-	flush_dcache_range((unsigned long)rbf_data, (unsigned long)(rbf_data + rbf_size));
-
 	ret = invoke_smc(INTEL_SIP_SMC_FPGA_CONFIG_START, &arg, 1, NULL, 0);
 
 	if (ret) {
@@ -134,7 +161,14 @@ int intel_sdm_mb_load(Altera_desc *desc, const void *rbf_data, size_t rbf_size)
 		return ret;
 	}
 
-	ret = send_bitstream(rbf_data, rbf_size);
+	s->ops = &sdm_smc_ops;
+	s->priv = &xfer;
+	s->xfer_max = SDM_STREAM_ID_MAX;
+	s->chunk = s->chunk ? min_t(u32, s->chunk, BITSTREAM_CHUNK_SIZE) :
+		   BITSTREAM_CHUNK_SIZE;
+	s->timeout_ms = RECONFIG_STATUS_POLL_RETRY_MAX *
+			RECONFIG_DATA_POLL_DELAY_US / 1000;
+	ret = sdm_stream_send(s);
 	if (ret) {
 		puts("Error sending bitstream!\n");
 		return ret;
@@ -156,7 +190,6 @@ int intel_sdm_mb_load(Altera_desc *desc, const void *rbf_data, size_t rbf_size)
 }
 
 #else
-
 static const struct mbox_cfgstat_state {
 	int			err_no;
 	const char		*error_name;
@@ -191,51 +224,6 @@ static const char *mbox_cfgstat_to_str(int err)
 	return mbox_cfgstat_state[MBOX_CFGSTAT_MAX - 1].error_name;
 }
 
-/*
- * Add the ongoing transaction's command ID into pending list and return
- * the command ID for next transfer.
- */
-static u8 add_transfer(u32 *xfer_pending_list, size_t list_size, u8 id)
-{
-	int i;
-
-	for (i = 0; i < list_size; i++) {
-		if (xfer_pending_list[i])
-			continue;
-		xfer_pending_list[i] = id;
-		debug("ID(%d) added to transaction pending list\n", id);
-		/*
-		 * Increment command ID for next transaction.
-		 * Valid command ID (4 bits) is from 1 to 15.
-		 */
-		id = (id % 15) + 1;
-		break;
-	}
-
-	return id;
-}
-
-/*
- * Check whether response ID match the command ID in the transfer
- * pending list. If a match is found in the transfer pending list,
- * it clears the transfer pending list and return the matched
- * command ID.
- */
-static int get_and_clr_transfer(u32 *xfer_pending_list, size_t list_size,
-				u8 id)
-{
-	int i;
-
-	for (i = 0; i < list_size; i++) {
-		if (id != xfer_pending_list[i])
-			continue;
-		xfer_pending_list[i] = 0;
-		return id;
-	}
-
-	return 0;
-}
-
 /*
  * Polling the FPGA configuration status.
  * Return 0 for success, non-zero for error.
@@ -310,104 +298,89 @@ static u32 get_resp_hdr(u32 *r_index, u32 *w_index, u32 *resp_count,
 	return mbox_hdr;
 }
 
+/**
+ * struct sdm_mb_resp - responses read from the mailbox but not yet handled
+ *
+ * @buf:	Circular buffer of response words
+ * @rindex:	Index of the next word to handle
+ * @windex:	Index to store the next word read at
+ * @count:	Number of words in @buf
+ */
+struct sdm_mb_resp {
+	u32 buf[MBOX_RESP_BUFFER_SIZE];
+	u32 rindex;
+	u32 windex;
+	u32 count;
+};
+
 /* Send bit stream data to SDM via RECONFIG_DATA mailbox command */
-static int send_reconfig_data(const void *rbf_data, size_t rbf_size,
-			      u32 xfer_max, u32 buf_size_max)
+static int sdm_mb_submit(struct sdm_stream *s, u8 id, const void *data,
+			 u32 len)
 {
-	u32 response_buffer[MBOX_RESP_BUFFER_SIZE];
-	u32 xfer_pending[MBOX_RESP_BUFFER_SIZE];
-	u32 resp_rindex = 0;
-	u32 resp_windex = 0;
-	u32 resp_count = 0;
-	u32 xfer_count = 0;
-	int resp_err = 0;
-	u8 cmd_id = 1;
 	u32 args[3];
 	int ret;
 
-	debug("SDM xfer_max = %d\n", xfer_max);
-	debug("SDM buf_size_max = %x\n\n", buf_size_max);
-
-	memset(xfer_pending, 0, sizeof(xfer_pending));
-
-	while (rbf_size || xfer_count) {
-		if (!resp_err && rbf_size && xfer_count < xfer_max) {
-			args[0] = MBOX_ARG_DESC_COUNT(1);
-			args[1] = (u64)rbf_data;
-			if (rbf_size >= buf_size_max) {
-				args[2] = buf_size_max;
-				rbf_size -= buf_size_max;
-				rbf_data += buf_size_max;
-			} else {
-				args[2] = (u64)rbf_size;
-				rbf_size = 0;
-			}
-
-			resp_err = mbox_send_cmd_only(cmd_id, MBOX_RECONFIG_DATA,
-						 MBOX_CMD_INDIRECT, 3, args);
-			if (!resp_err) {
-				xfer_count++;
-				cmd_id = add_transfer(xfer_pending,
-						      MBOX_RESP_BUFFER_SIZE,
-						      cmd_id);
-			}
-			puts(".");
-		} else {
-			u32 resp_hdr = get_resp_hdr(&resp_rindex, &resp_windex,
-						    &resp_count,
-						    response_buffer,
-						    MBOX_RESP_BUFFER_SIZE,
-						    MBOX_CLIENT_ID_UBOOT);
-
-			/*
-			 * If no valid response header found or
-			 * non-zero length from RECONFIG_DATA
-			 */
-			if (!resp_hdr || MBOX_RESP_LEN_GET(resp_hdr))
-				continue;
-
-			/* Check for response's status */
-			if (!resp_err) {
-				resp_err = MBOX_RESP_ERR_GET(resp_hdr);
-				debug("Response error code: %08x\n", resp_err);
-			}
-
-			ret = get_and_clr_transfer(xfer_pending,
-						   MBOX_RESP_BUFFER_SIZE,
-						   MBOX_RESP_ID_GET(resp_hdr));
-			if (ret) {
-				/* Claim and reuse the ID */
-				cmd_id = (u8)ret;
-				xfer_count--;
-			}
-
-			if (resp_err && !xfer_count)
-				return resp_err;
-		}
-		schedule();
-	}
+	flush_dcache_range((unsigned long)data, (unsigned long)(data + len));
 
-	return 0;
+	args[0] = MBOX_ARG_DESC_COUNT(1);
+	args[1] = (u64)data;
+	args[2] = len;
+	ret = mbox_send_cmd_only(id, MBOX_RECONFIG_DATA, MBOX_CMD_INDIRECT, 3,
+				 args);
+	puts(".");
+
+	return ret;
+}
+
+static int sdm_mb_reap(struct sdm_stream *s, u32 *status)
+{
+	struct sdm_mb_resp *resp = s->priv;
+	u32 resp_hdr;
+
+	resp_hdr = get_resp_hdr(&resp->rindex, &resp->windex, &resp->count,
+				resp->buf, MBOX_RESP_BUFFER_SIZE,
+				MBOX_CLIENT_ID_UBOOT);
+
+	/*
+	 * If no valid response header found or
+	 * non-zero length from RECONFIG_DATA
+	 */
+	if (!resp_hdr || MBOX_RESP_LEN_GET(resp_hdr))
+		return 0;
+
+	*status = MBOX_RESP_ERR_GET(resp_hdr);
+
+	return MBOX_RESP_ID_GET(resp_hdr);
 }
 
+static const struct sdm_stream_ops sdm_mb_ops = {
+	.submit	= sdm_mb_submit,
+	.reap	= sdm_mb_reap,
+};
+
 /*
- * This is the interface used by FPGA driver.
+ * Run a full reconfiguration, with the bitstream sent by the transfer @s.
  * Return 0 for success, non-zero for error.
  */
-int intel_sdm_mb_load(Altera_desc *desc, const void *rbf_data, size_t rbf_size)
+static int reconfig_stream(struct sdm_stream *s)
 {
+	struct sdm_mb_resp resp = { };
+	const void *end;
 	int ret;
 	u32 resp_len = 2;
 	u32 resp_buf[2];
 
-	flush_dcache_range((unsigned long)rbf_data, (unsigned long)(rbf_data + rbf_size));
+	if (s->read)
+		end = s->buf[s->nr_bufs - 1] + s->chunk;
+	else
+		end = s->data + s->size;
 
 	/*
 	 * Don't start the FPGA reconfiguration if bitstream location exceed the
 	 * PSI BE 512MB address window and SMMU is not setup for PSI BE address
 	 * translation.
 	 */
-	if (((u64)rbf_data + rbf_size) >= SDM2HPS_PSI_BE_ADDR_END &&
+	if ((u64)end >= SDM2HPS_PSI_BE_ADDR_END &&
 	    !is_smmu_stream_id_enabled(SMMU_SID_SDM2HPS_PSI_BE)) {
 		printf("Failed: Bitstream location must not exceed 0x%08x\n",
 		       SDM2HPS_PSI_BE_ADDR_END);
@@ -422,7 +395,14 @@ int intel_sdm_mb_load(Altera_desc *desc, const void *rbf_data, size_t rbf_size)
 		return ret;
 	}
 
-	ret = send_reconfig_data(rbf_data, rbf_size, resp_buf[0], resp_buf[1]);
+	debug("SDM xfer_max = %d\n", resp_buf[0]);
+	debug("SDM buf_size_max = %x\n\n", resp_buf[1]);
+
+	s->ops = &sdm_mb_ops;
+	s->priv = &resp;
+	s->xfer_max = resp_buf[0];
+	s->chunk = s->chunk ? min(s->chunk, resp_buf[1]) : resp_buf[1];
+	ret = sdm_stream_send(s);
 	if (ret) {
 		printf("RECONFIG_DATA error: %08x, %s\n", ret,
 		       mbox_cfgstat_to_str(ret));
@@ -445,3 +425,68 @@ int intel_sdm_mb_load(Altera_desc *desc, const void *rbf_data, size_t rbf_size)
 	return ret;
 }
 #endif
+
+/*
+ * This is the interface used by FPGA driver.
+ * Return 0 for success, non-zero for error.
+ */
+int intel_sdm_mb_load(Altera_desc *desc, const void *rbf_data, size_t rbf_size)
+{
+	struct sdm_stream s = {
+		.data	= rbf_data,
+		.size	= rbf_size,
+	};
+
+	return reconfig_stream(&s);
+}
+
+#if defined(CONFIG_CMD_FPGA_LOADFS) && !defined(CONFIG_SPL_BUILD)
+static int sdm_stream_fs_read(struct sdm_stream *s, void *buf, ulong offset,
+			      u32 len)
+{
+	fpga_fs_info *fsinfo = s->src;
+	loff_t actread;
+
+	if (fs_set_blk_dev(fsinfo->interface, fsinfo->dev_part,
+			   fsinfo->fstype))
+		return -ENODEV;
+
+	if (fs_read(fsinfo->filename, map_to_sysmem(buf), offset, len,
+		    &actread) < 0)
+		return -EIO;
+
+	return actread;
+}
+
+/*
+ * Stream a bitstream from a filesystem to the SDM. Chunks of
+ * fsinfo->blocksize bytes are read into CONFIG_FPGA_INTEL_SDM_STREAM_BUFS
+ * buffers at @buf, each sent as soon as it has been read, so only that much
+ * memory is used whatever the size of the bitstream.
+ * Return 0 for success, non-zero for error.
+ */
+int intel_sdm_mb_loadfs(Altera_desc *desc, const void *buf, size_t bsize,
+			fpga_fs_info *fsinfo)
+{
+	struct sdm_stream s = {
+		.read	 = sdm_stream_fs_read,
+		.src	 = fsinfo,
+		.size	 = bsize,
+		.chunk	 = fsinfo->blocksize,
+		.nr_bufs = CONFIG_FPGA_INTEL_SDM_STREAM_BUFS,
+	};
+	int i;
+
+	if (!fsinfo->blocksize ||
+	    !IS_ALIGNED((ulong)buf | fsinfo->blocksize, ARCH_DMA_MINALIGN)) {
+		printf("Buffer and block size must be aligned to %d bytes\n",
+		       ARCH_DMA_MINALIGN);
+		return -EINVAL;
+	}
+
+	for (i = 0; i < s.nr_bufs; i++)
+		s.buf[i] = (void *)buf + i * fsinfo->blocksize;
+
+	return reconfig_stream(&s);
+}
+#endif
@@ -0,0 +1,165 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Copyright (C) 2024 Intel Corporation <www.intel.com>
+ */
+
+#define LOG_CATEGORY UCLASS_FPGA
+
+#include <common.h>
+#include <cyclic.h>
+#include <errno.h>
+#include <intel_sdm_stream.h>
+#include <log.h>
+#include <time.h>
+#include <linux/bitops.h>
+#include <linux/kernel.h>
+
+/* Marks a command ID which is not in flight */
+#define SDM_STREAM_IDLE		-1
+
+/* Find a command ID which is not in flight, starting at @id */
+static u8 sdm_stream_get_id(const s8 *xfer_buf, u8 id)
+{
+	int i;
+
+	for (i = 0; i < SDM_STREAM_ID_MAX; i++) {
+		if (xfer_buf[id] == SDM_STREAM_IDLE)
+			return id;
+		id = (id % SDM_STREAM_ID_MAX) + 1;
+	}
+
+	return 0;
+}
+
+static int sdm_stream_get_buf(const struct sdm_stream *s, u32 buf_busy)
+{
+	int i;
+
+	for (i = 0; i < s->nr_bufs; i++) {
+		if (!(buf_busy & BIT(i)))
+			return i;
+	}
+
+	return -ENOBUFS;
+}
+
+int sdm_stream_send(struct sdm_stream *s)
+{
+	/* Buffer and length of the command with each ID, index 0 is unused */
+	s8 xfer_buf[SDM_STREAM_ID_MAX + 1];
+	u32 xfer_len[SDM_STREAM_ID_MAX + 1];
+	/* A chunk which has been read but was not accepted by the SDM yet */
+	const void *staged_data = NULL;
+	u32 staged_len = 0;
+	int staged_buf = 0;
+	u32 buf_busy = 0, inflight = 0, xfer_max, status;
+	ulong offset = 0, start;
+	bool eof = false, full = false;
+	int err = 0, ret;
+	u8 cmd_id = 1, id;
+
+	xfer_max = min_t(u32, s->xfer_max, SDM_STREAM_ID_MAX);
+	if (s->read)
+		xfer_max = min_t(u32, xfer_max, s->nr_bufs);
+	if (!xfer_max || !s->chunk || s->nr_bufs > SDM_STREAM_BUFS_MAX)
+		return -EINVAL;
+
+	log_debug("SDM xfer_max = %d, chunk = %x, %d buffer(s)\n", xfer_max,
+		  s->chunk, s->read ? s->nr_bufs : 0);
+
+	memset(xfer_buf, SDM_STREAM_IDLE, sizeof(xfer_buf));
+	s->xfers = 0;
+	s->bytes = 0;
+	s->max_inflight = 0;
+	start = get_timer(0);
+
+	while ((!err && (staged_data || (!eof && offset < s->size))) ||
+	       inflight) {
+		if (!err && !full && inflight < xfer_max &&
+		    (staged_data || (!eof && offset < s->size))) {
+			if (!staged_data) {
+				staged_len = min_t(ulong, s->chunk,
+						   s->size - offset);
+				if (s->read) {
+					staged_buf = sdm_stream_get_buf(s,
+									buf_busy);
+					ret = s->read(s, s->buf[staged_buf],
+						      offset, staged_len);
+					if (ret <= 0) {
+						/* A short file ends the bitstream */
+						if (ret < 0)
+							err = ret;
+						eof = true;
+						continue;
+					}
+					staged_len = ret;
+					staged_data = s->buf[staged_buf];
+				} else {
+					staged_data = s->data + offset;
+				}
+				offset += staged_len;
+			}
+
+			id = sdm_stream_get_id(xfer_buf, cmd_id);
+			ret = s->ops->submit(s, id, staged_data, staged_len);
+			if (ret == -EAGAIN) {
+				/* Try again once a command completes */
+				if (!inflight)
+					err = -EIO;
+				full = true;
+				continue;
+			}
+			if (ret < 0) {
+				err = ret;
+				continue;
+			}
+
+			xfer_buf[id] = staged_buf;
+			xfer_len[id] = staged_len;
+			if (s->read)
+				buf_busy |= BIT(staged_buf);
+			staged_data = NULL;
+			inflight++;
+			s->max_inflight = max(s->max_inflight, inflight);
+			full = ret == SDM_STREAM_FULL;
+			cmd_id = (id % SDM_STREAM_ID_MAX) + 1;
+			start = get_timer(0);
+		} else {
+			ret = s->ops->reap(s, &status);
+			if (ret < 0) {
+				if (!err)
+					err = ret;
+				/* Nothing would end the wait for the others */
+				if (!s->timeout_ms)
+					return err;
+				ret = 0;
+			}
+
+			if (!ret) {
+				if (s->timeout_ms &&
+				    get_timer(start) > s->timeout_ms)
+					return -ETIMEDOUT;
+			} else if (ret > SDM_STREAM_ID_MAX ||
+				   xfer_buf[ret] == SDM_STREAM_IDLE) {
+				log_debug("Response for unknown ID %d\n", ret);
+			} else {
+				if (status && !err) {
+					err = status;
+					log_debug("Response error code: %08x\n",
+						  err);
+				}
+				if (s->read)
+					buf_busy &= ~BIT(xfer_buf[ret]);
+				xfer_buf[ret] = SDM_STREAM_IDLE;
+				inflight--;
+				s->xfers++;
+				s->bytes += xfer_len[ret];
+				full = false;
+				start = get_timer(0);
+			}
+		}
+		schedule();
+	}
+
+	return err;
+}
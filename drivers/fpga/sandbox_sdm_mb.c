@@ -0,0 +1,198 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Copyright (C) 2024 Intel Corporation <www.intel.com>
+ *
+ * Emulation of the SDM mailbox RECONFIG_DATA command for sandbox. Commands
+ * are consumed in the order they were sent, one every few response polls,
+ * and their data is checked to be unchanged until then.
+ */
+
+#define LOG_CATEGORY UCLASS_FPGA
+
+#include <common.h>
+#include <errno.h>
+#include <intel_sdm_stream.h>
+#include <log.h>
+#include <asm/test.h>
+#include <u-boot/crc.h>
+
+/**
+ * struct sandbox_sdm_mb_cmd - a RECONFIG_DATA command in flight
+ *
+ * @data:	Data sent with the command
+ * @len:	Number of bytes at @data
+ * @crc:	CRC32 of the data when the command was sent
+ * @seq:	Order in which the command was sent, counting from 1
+ * @status:	Error code to return in the response
+ * @busy:	The command is in flight
+ * @consumed:	The SDM has consumed the data, the response is pending
+ */
+struct sandbox_sdm_mb_cmd {
+	const void *data;
+	u32 len;
+	u32 crc;
+	u32 seq;
+	u32 status;
+	bool busy;
+	bool consumed;
+};
+
+static struct sandbox_sdm_mb {
+	struct sandbox_sdm_mb_cmd cmd[SDM_STREAM_ID_MAX + 1];
+	u32 xfer_max;
+	u32 chunk;
+	int latency;
+	uint flags;
+	u32 fail_cmd;
+	u32 fail_status;
+	int reaps;
+	int fail_reap;
+	int fail_reap_err;
+	int polls;
+	u8 resp[SDM_STREAM_ID_MAX];
+	int nr_resp;
+	struct sandbox_sdm_mb_stats stats;
+} sdm;
+
+static int sandbox_sdm_mb_submit(struct sdm_stream *s, u8 id,
+				 const void *data, u32 len)
+{
+	struct sandbox_sdm_mb_cmd *cmd;
+
+	if (sdm.stats.inflight >= sdm.xfer_max) {
+		if (sdm.flags & SANDBOX_SDM_MB_SMC)
+			return -EAGAIN;
+		log_debug("ID %d sent while full\n", id);
+		sdm.stats.overflow++;
+	}
+
+	if (!id || id > SDM_STREAM_ID_MAX || sdm.cmd[id].busy) {
+		log_debug("ID %d is not free\n", id);
+		sdm.stats.bad_id++;
+		return -EINVAL;
+	}
+
+	if (!len || len > sdm.chunk) {
+		log_debug("ID %d has bad length %x\n", id, len);
+		sdm.stats.bad_len++;
+	}
+
+	cmd = &sdm.cmd[id];
+	cmd->data = data;
+	cmd->len = len;
+	cmd->crc = crc32(0, data, len);
+	cmd->seq = ++sdm.stats.cmds;
+	cmd->status = cmd->seq == sdm.fail_cmd ? sdm.fail_status : 0;
+	cmd->busy = true;
+	cmd->consumed = false;
+	sdm.stats.inflight++;
+	sdm.stats.max_inflight = max(sdm.stats.max_inflight,
+				     sdm.stats.inflight);
+
+	if ((sdm.flags & SANDBOX_SDM_MB_SMC) &&
+	    sdm.stats.inflight == sdm.xfer_max)
+		return SDM_STREAM_FULL;
+
+	return 0;
+}
+
+/* Find the oldest command which has not been consumed yet */
+static int sandbox_sdm_mb_oldest(void)
+{
+	int id, oldest = 0;
+
+	for (id = 1; id <= SDM_STREAM_ID_MAX; id++) {
+		struct sandbox_sdm_mb_cmd *cmd = &sdm.cmd[id];
+
+		if (cmd->busy && !cmd->consumed &&
+		    (!oldest || cmd->seq < sdm.cmd[oldest].seq))
+			oldest = id;
+	}
+
+	return oldest;
+}
+
+static void sandbox_sdm_mb_consume(int id)
+{
+	struct sandbox_sdm_mb_cmd *cmd = &sdm.cmd[id];
+
+	if (crc32(0, cmd->data, cmd->len) != cmd->crc) {
+		log_debug("ID %d data changed while in flight\n", id);
+		sdm.stats.overwritten++;
+	}
+	sdm.stats.crc = crc32(sdm.stats.crc, cmd->data, cmd->len);
+	sdm.stats.bytes += cmd->len;
+	cmd->consumed = true;
+	sdm.resp[sdm.nr_resp++] = id;
+}
+
+static int sandbox_sdm_mb_reap(struct sdm_stream *s, u32 *status)
+{
+	int id;
+
+	if (++sdm.reaps == sdm.fail_reap)
+		return sdm.fail_reap_err;
+
+	if (!sdm.nr_resp && ++sdm.polls >= sdm.latency) {
+		while ((id = sandbox_sdm_mb_oldest())) {
+			sandbox_sdm_mb_consume(id);
+			if (!(sdm.flags & SANDBOX_SDM_MB_REORDER))
+				break;
+		}
+		sdm.polls = 0;
+	}
+
+	if (!sdm.nr_resp)
+		return 0;
+
+	if (sdm.flags & SANDBOX_SDM_MB_REORDER) {
+		id = sdm.resp[--sdm.nr_resp];
+	} else {
+		id = sdm.resp[0];
+		memmove(sdm.resp, sdm.resp + 1, --sdm.nr_resp);
+	}
+
+	sdm.cmd[id].busy = false;
+	sdm.stats.inflight--;
+	*status = sdm.cmd[id].status;
+
+	return id;
+}
+
+static const struct sdm_stream_ops sandbox_sdm_mb_ops = {
+	.submit	= sandbox_sdm_mb_submit,
+	.reap	= sandbox_sdm_mb_reap,
+};
+
+void sandbox_sdm_mb_init(struct sdm_stream *s, u32 xfer_max, u32 chunk,
+			 int latency, uint flags)
+{
+	memset(&sdm, '\0', sizeof(sdm));
+	sdm.xfer_max = xfer_max;
+	sdm.chunk = chunk;
+	sdm.latency = latency;
+	sdm.flags = flags;
+
+	s->ops = &sandbox_sdm_mb_ops;
+	s->priv = &sdm;
+	s->xfer_max = flags & SANDBOX_SDM_MB_SMC ? SDM_STREAM_ID_MAX : xfer_max;
+	s->chunk = s->chunk ? min(s->chunk, chunk) : chunk;
+}
+
+void sandbox_sdm_mb_fail(int cmd, u32 status)
+{
+	sdm.fail_cmd = cmd;
+	sdm.fail_status = status;
+}
+
+void sandbox_sdm_mb_fail_reap(int reap, int err)
+{
+	sdm.reaps = 0;
+	sdm.fail_reap = reap;
+	sdm.fail_reap_err = err;
+}
+
+void sandbox_sdm_mb_get_stats(struct sandbox_sdm_mb_stats *stats)
+{
+	*stats = sdm.stats;
+}
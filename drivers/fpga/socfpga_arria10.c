@@ -39,6 +39,14 @@
  */
 #define MAX_FIRST_LOAD_SIZE	0x2000
 
+/* When two DDR buffers are in use, the next chunk is read in slices of this
+ * size and a slice of the previous chunk is written to the FPGA manager data
+ * port before each of them, so the configuration FIFO keeps draining while
+ * the storage read is in progress. A multiple of MAX_FIRST_LOAD_SIZE keeps
+ * the reads cluster aligned.
+ */
+#define LOADFS_SLICE_SIZE	0x10000
+
 DECLARE_GLOBAL_DATA_PTR;
 
 static const struct socfpga_fpga_manager *fpga_manager_base =
@@ -770,6 +778,58 @@ static int subsequent_loading_rbf_to_buffer(struct udevice *dev,
 	return 0;
 }
 
+static int overlapped_loading_rbf_to_buffer(struct udevice *dev,
+					struct fpga_loadfs_info *fpga_loadfs,
+					u32 *buffer, size_t *buffer_bsize,
+					u32 drain, size_t drain_bsize)
+{
+	u8 *buffer_p = (u8 *)*buffer;
+	const u8 *drain_p = (const u8 *)drain;
+	size_t size, slice, done = 0, sent = 0;
+	int ret;
+
+	if (fpga_loadfs->remaining > *buffer_bsize) {
+		size = *buffer_bsize;
+		fpga_loadfs->remaining -= size;
+	} else {
+		size = fpga_loadfs->remaining;
+		fpga_loadfs->remaining = 0;
+	}
+
+	while (done < size) {
+		/* Feed the data port before the read so its FIFO stays busy */
+		slice = min_t(size_t, drain_bsize - sent, LOADFS_SLICE_SIZE);
+		if (slice) {
+			fpgamgr_program_write(drain_p + sent, slice);
+			sent += slice;
+		}
+
+		slice = min_t(size_t, size - done, LOADFS_SLICE_SIZE);
+		ret = request_firmware_into_buf(dev,
+						fpga_loadfs->fpga_fsinfo->filename,
+						buffer_p + done, slice,
+						fpga_loadfs->offset + done);
+		if (ret < 0) {
+			debug("FPGA: Failed to read bitstream from flash.\n");
+			return -ENOENT;
+		}
+		done += slice;
+
+		schedule();
+	}
+
+	/* The last chunk is shorter than the one before it */
+	if (sent < drain_bsize)
+		fpgamgr_program_write(drain_p + sent, drain_bsize - sent);
+
+	/* Update next reading bitstream offset */
+	fpga_loadfs->offset += size;
+
+	*buffer_bsize = size;
+
+	return 0;
+}
+
 int socfpga_loadfs(fpga_fs_info *fpga_fsinfo, const void *buf, size_t bsize,
 			u32 offset)
 {
@@ -780,6 +840,9 @@ int socfpga_loadfs(fpga_fs_info *fpga_fsinfo, const void *buf, size_t bsize,
 	size_t buffer_sizebytes = bsize;
 	size_t buffer_sizebytes_ori = bsize;
 	size_t total_sizeof_image = 0;
+	size_t drain_sizebytes;
+	u32 drain, tmp;
+	ulong start;
 	ofnode node;
 
 	node = get_fpga_mgr_ofnode(ofnode_null());
@@ -798,6 +861,7 @@ int socfpga_loadfs(fpga_fs_info *fpga_fsinfo, const void *buf, size_t bsize,
 	fpga_loadfs.offset = offset;
 
 	printf("FPGA: Checking FPGA configuration setting ...\n");
+	start = get_timer(0);
 
 	/*
 	 * Note: Both buffer and buffer_sizebytes values can be altered by
@@ -835,12 +899,43 @@ int socfpga_loadfs(fpga_fs_info *fpga_fsinfo, const void *buf, size_t bsize,
 		}
 	}
 
-	/* Transfer bitstream to FPGA Manager */
-	fpgamgr_program_write((void *)buffer, buffer_sizebytes);
+	drain = buffer;
+	drain_sizebytes = buffer_sizebytes;
 
-	total_sizeof_image += buffer_sizebytes;
+	/*
+	 * When the DDR load area holds at least two chunks, ping-pong between
+	 * them: the next chunk is read into one while the other drains to the
+	 * FPGA Manager. The OCRAM buffer only ever holds a single chunk.
+	 */
+	if (buffer_sizebytes_ori == DDR_BUFFER_SIZE &&
+	    fpga_loadfs.remaining + buffer_sizebytes >= 2 * DDR_BUFFER_SIZE) {
+		buffer += DDR_BUFFER_SIZE;
+
+		while (fpga_loadfs.remaining) {
+			ret = overlapped_loading_rbf_to_buffer(dev,
+							&fpga_loadfs,
+							&buffer,
+							&buffer_sizebytes_ori,
+							drain,
+							drain_sizebytes);
+			if (ret)
+				return ret;
+
+			total_sizeof_image += drain_sizebytes;
+
+			tmp = drain;
+			drain = buffer;
+			buffer = tmp;
+			drain_sizebytes = buffer_sizebytes_ori;
+		}
+	}
 
 	while (fpga_loadfs.remaining) {
+		/* Transfer data to FPGA Manager */
+		fpgamgr_program_write((void *)drain, drain_sizebytes);
+
+		total_sizeof_image += drain_sizebytes;
+
 		ret = subsequent_loading_rbf_to_buffer(dev,
 							&fpga_loadfs,
 							&buffer,
@@ -849,20 +944,25 @@ int socfpga_loadfs(fpga_fs_info *fpga_fsinfo, const void *buf, size_t bsize,
 		if (ret)
 			return ret;
 
-		/* Transfer data to FPGA Manager */
-		fpgamgr_program_write((void *)buffer,
-					buffer_sizebytes_ori);
-
-		total_sizeof_image += buffer_sizebytes_ori;
+		drain = buffer;
+		drain_sizebytes = buffer_sizebytes_ori;
 
 		schedule();
 	}
+
+	/* Transfer the last chunk to FPGA Manager */
+	fpgamgr_program_write((void *)drain, drain_sizebytes);
+
+	total_sizeof_image += drain_sizebytes;
+
 	wait_for_fifo_empty();
 
 	if (fpga_loadfs.rbfinfo.section == periph_section) {
 		if (fpgamgr_wait_early_user_mode() != -ETIMEDOUT) {
 			config_pins(gd->fdt_blob, "shared");
 			puts("FPGA: Early Release Succeeded.\n");
+			debug("FPGA: Early Release after %lu ms.\n",
+			      get_timer(start));
 		} else {
 			debug("FPGA: Failed to see Early Release.\n");
 			return -EIO;
@@ -886,6 +986,7 @@ int socfpga_loadfs(fpga_fs_info *fpga_fsinfo, const void *buf, size_t bsize,
 
 		config_pins(gd->fdt_blob, "fpga");
 		puts("FPGA: Enter user mode.\n");
+		debug("FPGA: User mode after %lu ms.\n", get_timer(start));
 	} else {
 		debug("FPGA: Config Error: Unsupported bitstream type.\n");
 		return -ENOEXEC;
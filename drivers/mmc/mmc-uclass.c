@@ -53,9 +53,42 @@ static int dm_mmc_send_cmd(struct udevice *dev, struct mmc_cmd *cmd,
 
 int mmc_send_cmd(struct mmc *mmc, struct mmc_cmd *cmd, struct mmc_data *data)
 {
+#if CONFIG_IS_ENABLED(BLK_ASYNC)
+	/* the card takes no other command until the read in flight is over */
+	if (mmc->async_cur)
+		mmc_bdrain(mmc);
+#endif
 	return dm_mmc_send_cmd(mmc->dev, cmd, data);
 }
 
+#if CONFIG_IS_ENABLED(BLK_ASYNC)
+int mmc_send_cmd_start(struct mmc *mmc, struct mmc_cmd *cmd,
+		       struct mmc_data *data)
+{
+	struct dm_mmc_ops *ops = mmc_get_ops(mmc->dev);
+	int ret;
+
+	if (!ops->send_cmd_start || !ops->send_cmd_poll)
+		return dm_mmc_send_cmd(mmc->dev, cmd, data);
+
+	mmmc_trace_before_send(mmc, cmd);
+	ret = ops->send_cmd_start(mmc->dev, cmd, data);
+	mmmc_trace_after_send(mmc, cmd, ret);
+
+	return ret;
+}
+
+int mmc_send_cmd_poll(struct mmc *mmc, struct mmc_data *data)
+{
+	struct dm_mmc_ops *ops = mmc_get_ops(mmc->dev);
+
+	if (!ops->send_cmd_start || !ops->send_cmd_poll)
+		return 0;
+
+	return ops->send_cmd_poll(mmc->dev, data);
+}
+#endif
+
 static int dm_mmc_set_ios(struct udevice *dev)
 {
 	struct dm_mmc_ops *ops = mmc_get_ops(dev);
@@ -471,8 +504,11 @@ static int mmc_select_hwpart(struct udevice *bdev, int hwpart)
 		return -EMEDIUMTYPE;
 
 	ret = mmc_switch_part(mmc, hwpart);
-	if (!ret)
+	if (!ret) {
 		blkcache_invalidate(desc->uclass_id, desc->devnum);
+		/* Another hardware partition has other contents */
+		desc->write_gen++;
+	}
 
 	return ret;
 }
@@ -507,14 +543,25 @@ static int mmc_blk_probe(struct udevice *dev)
 
 #if CONFIG_IS_ENABLED(MMC_UHS_SUPPORT) || \
     CONFIG_IS_ENABLED(MMC_HS200_SUPPORT) || \
-    CONFIG_IS_ENABLED(MMC_HS400_SUPPORT)
+    CONFIG_IS_ENABLED(MMC_HS400_SUPPORT) || \
+    CONFIG_IS_ENABLED(BLK_ASYNC)
 static int mmc_blk_remove(struct udevice *dev)
 {
 	struct udevice *mmc_dev = dev_get_parent(dev);
 	struct mmc_uclass_priv *upriv = dev_get_uclass_priv(mmc_dev);
 	struct mmc *mmc = upriv->mmc;
 
-	return mmc_deinit(mmc);
+#if CONFIG_IS_ENABLED(BLK_ASYNC)
+	/* the request has gone but the host may still be filling its buffer */
+	if (mmc->async_cur)
+		mmc_bfinish(mmc);
+#endif
+	if (CONFIG_IS_ENABLED(MMC_UHS_SUPPORT) ||
+	    CONFIG_IS_ENABLED(MMC_HS200_SUPPORT) ||
+	    CONFIG_IS_ENABLED(MMC_HS400_SUPPORT))
+		return mmc_deinit(mmc);
+
+	return 0;
 }
 #endif
 
@@ -525,6 +572,10 @@ static const struct blk_ops mmc_blk_ops = {
 	.erase	= mmc_berase,
 #endif
 	.select_hwpart	= mmc_select_hwpart,
+#if CONFIG_IS_ENABLED(BLK_ASYNC)
+	.submit	= mmc_bsubmit,
+	.poll	= mmc_bpoll,
+#endif
 };
 
 U_BOOT_DRIVER(mmc_blk) = {
@@ -534,7 +585,8 @@ U_BOOT_DRIVER(mmc_blk) = {
 	.probe		= mmc_blk_probe,
 #if CONFIG_IS_ENABLED(MMC_UHS_SUPPORT) || \
     CONFIG_IS_ENABLED(MMC_HS200_SUPPORT) || \
-    CONFIG_IS_ENABLED(MMC_HS400_SUPPORT)
+    CONFIG_IS_ENABLED(MMC_HS400_SUPPORT) || \
+    CONFIG_IS_ENABLED(BLK_ASYNC)
 	.remove		= mmc_blk_remove,
 	.flags		= DM_FLAG_OS_PREPARE,
 #endif
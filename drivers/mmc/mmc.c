@@ -399,12 +399,52 @@ int mmc_send_tuning(struct mmc *mmc, u32 opcode, int *cmd_error)
 }
 #endif
 
+/*
+ * Check whether multiple-block reads can announce their length with CMD23,
+ * which saves sending CMD12 and waiting for the card after each one
+ */
+static bool mmc_can_cmd23(struct mmc *mmc)
+{
+	if (!(mmc->cfg->host_caps & MMC_CAP_CMD23) || mmc_host_is_spi(mmc))
+		return false;
+	if (IS_SD(mmc))
+		return mmc->scr[0] & SD_SCR_CMD23_SUPPORT;
+
+	return mmc->version >= MMC_VERSION_3;
+}
+
+static int mmc_stop_read(struct mmc *mmc)
+{
+	struct mmc_cmd cmd;
+	int err;
+
+	cmd.cmdidx = MMC_CMD_STOP_TRANSMISSION;
+	cmd.cmdarg = 0;
+	cmd.resp_type = MMC_RSP_R1b;
+	err = mmc_send_cmd(mmc, &cmd, NULL);
+#if !defined(CONFIG_SPL_BUILD) || defined(CONFIG_SPL_LIBCOMMON_SUPPORT)
+	if (err)
+		pr_err("mmc fail to send stop cmd\n");
+#endif
+
+	return err;
+}
+
 static int mmc_read_blocks(struct mmc *mmc, void *dst, lbaint_t start,
 			   lbaint_t blkcnt)
 {
+	bool sbc = blkcnt > 1 && mmc_can_cmd23(mmc);
 	struct mmc_cmd cmd;
 	struct mmc_data data;
 
+	if (sbc) {
+		cmd.cmdidx = MMC_CMD_SET_BLOCK_COUNT;
+		cmd.cmdarg = blkcnt;
+		cmd.resp_type = MMC_RSP_R1;
+		if (mmc_send_cmd(mmc, &cmd, NULL))
+			return 0;
+	}
+
 	if (blkcnt > 1)
 		cmd.cmdidx = MMC_CMD_READ_MULTIPLE_BLOCK;
 	else
@@ -422,19 +462,19 @@ static int mmc_read_blocks(struct mmc *mmc, void *dst, lbaint_t start,
 	data.blocksize = mmc->read_bl_len;
 	data.flags = MMC_DATA_READ;
 
-	if (mmc_send_cmd(mmc, &cmd, &data))
+	if (mmc_send_cmd(mmc, &cmd, &data)) {
+		/*
+		 * After an error the card may still be sending the blocks
+		 * announced by CMD23, so stop it to get back to transfer state
+		 */
+		if (sbc)
+			mmc_stop_read(mmc);
 		return 0;
+	}
 
-	if (blkcnt > 1) {
-		cmd.cmdidx = MMC_CMD_STOP_TRANSMISSION;
-		cmd.cmdarg = 0;
-		cmd.resp_type = MMC_RSP_R1b;
-		if (mmc_send_cmd(mmc, &cmd, NULL)) {
-#if !defined(CONFIG_SPL_BUILD) || defined(CONFIG_SPL_LIBCOMMON_SUPPORT)
-			pr_err("mmc fail to send stop cmd\n");
-#endif
+	if (blkcnt > 1 && !sbc) {
+		if (mmc_stop_read(mmc))
 			return 0;
-		}
 	}
 
 	return blkcnt;
@@ -494,6 +534,9 @@ ulong mmc_bread(struct blk_desc *block_dev, lbaint_t start, lbaint_t blkcnt,
 	}
 
 	b_max = mmc_get_b_max(mmc, dst, blkcnt);
+	/* CMD23 carries a 16-bit block count */
+	if (mmc_can_cmd23(mmc))
+		b_max = min(b_max, 0xffffU);
 
 	do {
 		cur = (blocks_todo > b_max) ? b_max : blocks_todo;
@@ -509,6 +552,200 @@ ulong mmc_bread(struct blk_desc *block_dev, lbaint_t start, lbaint_t blkcnt,
 	return blkcnt;
 }
 
+#if CONFIG_IS_ENABLED(DM_MMC) && CONFIG_IS_ENABLED(BLK_ASYNC)
+/*
+ * Start the next chunk of a queued read, leaving the host to move the data.
+ * req->priv counts the blocks already read.
+ */
+static int mmc_bstart(struct blk_desc *block_dev, struct mmc *mmc,
+		      struct blk_req *req)
+{
+	struct mmc_data *data = &mmc->async_data;
+	lbaint_t start = req->start + req->priv;
+	lbaint_t todo = req->blkcnt - req->priv;
+	void *dst = req->buffer + req->priv * mmc->read_bl_len;
+	struct mmc_cmd cmd;
+	lbaint_t cur;
+	uint b_max;
+	int err;
+
+	err = blk_dselect_hwpart(block_dev, block_dev->hwpart);
+	if (err < 0)
+		return err;
+
+	if (req->start + req->blkcnt > block_dev->lba)
+		return -EINVAL;
+
+	if (mmc_set_blocklen(mmc, mmc->read_bl_len))
+		return -EIO;
+
+	b_max = mmc_get_b_max(mmc, dst, todo);
+	/* CMD23 carries a 16-bit block count */
+	if (mmc_can_cmd23(mmc))
+		b_max = min(b_max, 0xffffU);
+	cur = min_t(lbaint_t, todo, b_max);
+
+	mmc->async_sbc = cur > 1 && mmc_can_cmd23(mmc);
+	if (mmc->async_sbc) {
+		cmd.cmdidx = MMC_CMD_SET_BLOCK_COUNT;
+		cmd.cmdarg = cur;
+		cmd.resp_type = MMC_RSP_R1;
+		err = mmc_send_cmd(mmc, &cmd, NULL);
+		if (err)
+			return err;
+	}
+
+	if (cur > 1)
+		cmd.cmdidx = MMC_CMD_READ_MULTIPLE_BLOCK;
+	else
+		cmd.cmdidx = MMC_CMD_READ_SINGLE_BLOCK;
+
+	if (mmc->high_capacity)
+		cmd.cmdarg = start;
+	else
+		cmd.cmdarg = start * mmc->read_bl_len;
+
+	cmd.resp_type = MMC_RSP_R1;
+
+	data->dest = dst;
+	data->blocks = cur;
+	data->blocksize = mmc->read_bl_len;
+	data->flags = MMC_DATA_READ;
+
+	err = mmc_send_cmd_start(mmc, &cmd, data);
+	if (err) {
+		if (mmc->async_sbc)
+			mmc_stop_read(mmc);
+		return err;
+	}
+	mmc->async_cur = cur;
+
+	return 0;
+}
+
+/* Tidy up once the host has finished the read in flight, with result @err */
+static int mmc_bend(struct mmc *mmc, int err)
+{
+	lbaint_t cur = mmc->async_cur;
+
+	/* the card may take commands again */
+	mmc->async_cur = 0;
+	if (err ? mmc->async_sbc : cur > 1 && !mmc->async_sbc) {
+		if (mmc_stop_read(mmc) && !err)
+			err = -EIO;
+	}
+
+	return err;
+}
+
+int mmc_bfinish(struct mmc *mmc)
+{
+	int err;
+
+	while ((err = mmc_send_cmd_poll(mmc, &mmc->async_data)) == -EBUSY)
+		schedule();
+
+	return mmc_bend(mmc, err);
+}
+
+/* Start the oldest queued read, failing those which cannot be started */
+static void mmc_bstart_next(struct udevice *dev, struct mmc *mmc)
+{
+	struct blk_desc *block_dev = dev_get_uclass_plat(dev);
+	struct blk_req *req;
+	int err;
+
+	while ((req = blk_first_req(dev))) {
+		err = mmc_bstart(block_dev, mmc, req);
+		if (!err)
+			return;
+		blk_req_done(req, err);
+	}
+}
+
+int mmc_bsubmit(struct udevice *dev, struct blk_req *req)
+{
+	struct blk_desc *block_dev = dev_get_uclass_plat(dev);
+	struct mmc *mmc = find_mmc_device(block_dev->devnum);
+	int err;
+
+	if (!mmc)
+		return -ENODEV;
+
+	/* the card is busy programming until a write is over anyway */
+	if (req->op == BLK_REQ_WRITE) {
+		if (mmc->async_cur)
+			return -EBUSY;
+		blk_req_done(req, mmc_bwrite(dev, req->start, req->blkcnt,
+					     req->buffer));
+		return 0;
+	}
+
+	req->priv = 0;
+	if (!req->blkcnt) {
+		blk_req_done(req, 0);
+		return 0;
+	}
+
+	/* mmc_bpoll() starts it when the reads before it are done */
+	if (mmc->async_cur)
+		return 0;
+
+	err = mmc_bstart(block_dev, mmc, req);
+	if (err)
+		blk_req_done(req, err);
+
+	return 0;
+}
+
+int mmc_bpoll(struct udevice *dev)
+{
+	struct blk_desc *block_dev = dev_get_uclass_plat(dev);
+	struct mmc *mmc = find_mmc_device(block_dev->devnum);
+	struct blk_req *req = blk_first_req(dev);
+	lbaint_t cur;
+	int err;
+
+	if (!mmc)
+		return -ENODEV;
+	if (!mmc->async_cur)
+		return 0;
+
+	err = mmc_send_cmd_poll(mmc, &mmc->async_data);
+	if (err == -EBUSY)
+		return 0;
+
+	cur = mmc->async_cur;
+	err = mmc_bend(mmc, err);
+	if (req) {
+		req->priv += cur;
+		if (err) {
+			blk_req_done(req, err);
+		} else if (req->priv == req->blkcnt) {
+			blk_req_done(req, req->blkcnt);
+		} else {
+			err = mmc_bstart(block_dev, mmc, req);
+			if (!err)
+				return 0;
+			blk_req_done(req, err);
+		}
+	}
+	mmc_bstart_next(dev, mmc);
+
+	return 0;
+}
+
+void mmc_bdrain(struct mmc *mmc)
+{
+	struct blk_desc *block_dev = mmc_get_blk_desc(mmc);
+
+	while (mmc->async_cur) {
+		mmc_bpoll(block_dev->bdev);
+		schedule();
+	}
+}
+#endif
+
 static int mmc_go_idle(struct mmc *mmc)
 {
 	struct mmc_cmd cmd;
@@ -25,6 +25,18 @@ ulong mmc_bread(struct blk_desc *block_dev, lbaint_t start, lbaint_t blkcnt,
 		void *dst);
 #endif
 
+#if CONFIG_IS_ENABLED(BLK_ASYNC)
+int mmc_bsubmit(struct udevice *dev, struct blk_req *req);
+int mmc_bpoll(struct udevice *dev);
+/* wait for the reads queued on @mmc, so that it can take another command */
+void mmc_bdrain(struct mmc *mmc);
+/* wait for the read in flight on @mmc, whose request has gone */
+int mmc_bfinish(struct mmc *mmc);
+int mmc_send_cmd_start(struct mmc *mmc, struct mmc_cmd *cmd,
+		       struct mmc_data *data);
+int mmc_send_cmd_poll(struct mmc *mmc, struct mmc_data *data);
+#endif
+
 #if CONFIG_IS_ENABLED(MMC_WRITE)
 
 #if CONFIG_IS_ENABLED(BLK)
@@ -31,6 +31,12 @@ struct sandbox_mmc_priv {
 	char *buf;
 	int csize;	/* CSIZE value to report */
 	int size;
+	uint sbc;	/* block count set by CMD23, or 0 */
+	uint cmd_count[64];
+	bool fail_read;	/* fail multiple-block reads with -EIO */
+	bool start_only;	/* leave the data of a read until it is polled */
+	struct mmc_data *pending;	/* read left by send_cmd_start() */
+	ulong pending_blk;	/* first block of that read */
 };
 
 /**
@@ -44,7 +50,10 @@ static int sandbox_mmc_send_cmd(struct udevice *dev, struct mmc_cmd *cmd,
 {
 	struct sandbox_mmc_priv *priv = dev_get_priv(dev);
 	static ulong erase_start, erase_end;
+	uint sbc = priv->sbc;
 
+	priv->cmd_count[cmd->cmdidx & 0x3f]++;
+	priv->sbc = 0;
 	switch (cmd->cmdidx) {
 	case MMC_CMD_ALL_SEND_CID:
 		memset(cmd->response, '\0', sizeof(cmd->response));
@@ -78,8 +87,21 @@ static int sandbox_mmc_send_cmd(struct udevice *dev, struct mmc_cmd *cmd,
 			resp[4] = (cmd->cmdarg & 0xF) << 24;
 		break;
 	}
+	case MMC_CMD_SET_BLOCK_COUNT:
+		priv->sbc = cmd->cmdarg & 0xffff;
+		break;
 	case MMC_CMD_READ_SINGLE_BLOCK:
 	case MMC_CMD_READ_MULTIPLE_BLOCK:
+		if (sbc && sbc != data->blocks)
+			return -EIO;
+		if (priv->fail_read &&
+		    cmd->cmdidx == MMC_CMD_READ_MULTIPLE_BLOCK)
+			return -EIO;
+		if (priv->start_only) {
+			priv->pending = data;
+			priv->pending_blk = cmd->cmdarg;
+			break;
+		}
 		memcpy(data->dest, &priv->buf[cmd->cmdarg * data->blocksize],
 		       data->blocks * data->blocksize);
 		break;
@@ -118,7 +140,8 @@ static int sandbox_mmc_send_cmd(struct udevice *dev, struct mmc_cmd *cmd,
 	case SD_CMD_APP_SEND_SCR: {
 		u32 *scr = (u32 *)data->dest;
 
-		scr[0] = cpu_to_be32(2 << 24 | 1 << 15);  /* SD version 3 */
+		/* SD version 3, with CMD23 */
+		scr[0] = cpu_to_be32(2 << 24 | 1 << 15 | SD_SCR_CMD23_SUPPORT);
 		break;
 	}
 	default:
@@ -129,6 +152,51 @@ static int sandbox_mmc_send_cmd(struct udevice *dev, struct mmc_cmd *cmd,
 	return 0;
 }
 
+uint sandbox_mmc_get_cmd_count(struct udevice *dev, uint cmdidx)
+{
+	struct sandbox_mmc_priv *priv = dev_get_priv(dev);
+
+	return priv->cmd_count[cmdidx & 0x3f];
+}
+
+void sandbox_mmc_fail_read(struct udevice *dev, bool fail)
+{
+	struct sandbox_mmc_priv *priv = dev_get_priv(dev);
+
+	priv->fail_read = fail;
+}
+
+#if CONFIG_IS_ENABLED(BLK_ASYNC)
+static int sandbox_mmc_send_cmd_start(struct udevice *dev,
+				      struct mmc_cmd *cmd,
+				      struct mmc_data *data)
+{
+	struct sandbox_mmc_priv *priv = dev_get_priv(dev);
+	int ret;
+
+	priv->start_only = true;
+	ret = sandbox_mmc_send_cmd(dev, cmd, data);
+	priv->start_only = false;
+
+	return ret;
+}
+
+/* The data of a read only arrives once it is polled */
+static int sandbox_mmc_send_cmd_poll(struct udevice *dev,
+				     struct mmc_data *data)
+{
+	struct sandbox_mmc_priv *priv = dev_get_priv(dev);
+
+	if (priv->pending != data)
+		return 0;
+	memcpy(data->dest, &priv->buf[priv->pending_blk * data->blocksize],
+	       data->blocks * data->blocksize);
+	priv->pending = NULL;
+
+	return 0;
+}
+#endif
+
 static int sandbox_mmc_set_ios(struct udevice *dev)
 {
 	return 0;
@@ -143,6 +211,10 @@ static const struct dm_mmc_ops sandbox_mmc_ops = {
 	.send_cmd = sandbox_mmc_send_cmd,
 	.set_ios = sandbox_mmc_set_ios,
 	.get_cd = sandbox_mmc_get_cd,
+#if CONFIG_IS_ENABLED(BLK_ASYNC)
+	.send_cmd_start = sandbox_mmc_send_cmd_start,
+	.send_cmd_poll = sandbox_mmc_send_cmd_poll,
+#endif
 };
 
 static int sandbox_mmc_of_to_plat(struct udevice *dev)
@@ -213,7 +285,8 @@ static int sandbox_mmc_bind(struct udevice *dev)
 	struct mmc_config *cfg = &plat->cfg;
 
 	cfg->name = dev->name;
-	cfg->host_caps = MMC_MODE_HS_52MHz | MMC_MODE_HS | MMC_MODE_8BIT;
+	cfg->host_caps = MMC_MODE_HS_52MHz | MMC_MODE_HS | MMC_MODE_8BIT |
+			 MMC_CAP_CMD23;
 	cfg->voltages = MMC_VDD_165_195 | MMC_VDD_32_33 | MMC_VDD_33_34;
 	cfg->f_min = 1000000;
 	cfg->f_max = 52000000;
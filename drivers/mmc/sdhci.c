@@ -22,6 +22,9 @@
 #include <phys2bus.h>
 #include <power/regulator.h>
 
+/* Size of the bounce buffer for DMA to buffers the host cannot use */
+#define SDHCI_ALIGN_BUFFER_SIZE		(512 * 1024)
+
 static void sdhci_reset(struct sdhci_host *host, u8 mask)
 {
 	unsigned long timeout;
@@ -71,6 +74,26 @@ static void sdhci_transfer_pio(struct sdhci_host *host, struct mmc_data *data)
 }
 
 #if (CONFIG_IS_ENABLED(MMC_SDHCI_SDMA) || CONFIG_IS_ENABLED(MMC_SDHCI_ADMA))
+/*
+ * Check whether a transfer must go through the bounce buffer. Besides the
+ * SDMA restrictions, this covers reads into a buffer which does not start
+ * on a cache line, since invalidating it would lose the data next to it.
+ */
+static bool sdhci_need_bounce(struct sdhci_host *host, struct mmc_data *data,
+			      void *buf, int trans_bytes)
+{
+	if (host->flags & USE_SDMA &&
+	    (host->force_align_buffer ||
+	     (host->quirks & SDHCI_QUIRK_32BIT_DMA_ADDR &&
+	      ((unsigned long)buf & 0x7) != 0x0)))
+		return true;
+
+	return data->flags == MMC_DATA_READ && host->align_buffer &&
+	       !host->force_align_buffer &&
+	       !IS_ALIGNED((ulong)buf, ARCH_DMA_MINALIGN) &&
+	       trans_bytes <= SDHCI_ALIGN_BUFFER_SIZE;
+}
+
 static void sdhci_prepare_dma(struct sdhci_host *host, struct mmc_data *data,
 			      int *is_aligned, int trans_bytes)
 {
@@ -91,10 +114,7 @@ static void sdhci_prepare_dma(struct sdhci_host *host, struct mmc_data *data,
 		ctrl |= SDHCI_CTRL_ADMA32;
 	sdhci_writeb(host, ctrl, SDHCI_HOST_CONTROL);
 
-	if (host->flags & USE_SDMA &&
-	    (host->force_align_buffer ||
-	     (host->quirks & SDHCI_QUIRK_32BIT_DMA_ADDR &&
-	      ((unsigned long)buf & 0x7) != 0x0))) {
+	if (sdhci_need_bounce(host, data, buf, trans_bytes)) {
 		*is_aligned = 0;
 		if (data->flags != MMC_DATA_READ)
 			memcpy(host->align_buffer, buf, trans_bytes);
@@ -185,6 +205,75 @@ static int sdhci_transfer_data(struct sdhci_host *host, struct mmc_data *data)
 	return 0;
 }
 
+#if CONFIG_IS_ENABLED(BLK_ASYNC)
+#define SDHCI_DATA_TIMEOUT			10000
+
+/*
+ * Check on a DMA transfer left running by sdhci_send_command_common(),
+ * without waiting for it
+ */
+static int sdhci_poll_data(struct sdhci_host *host, struct mmc_data *data)
+{
+	dma_addr_t start_addr;
+	unsigned int stat;
+
+	stat = sdhci_readl(host, SDHCI_INT_STATUS);
+	if (stat & SDHCI_INT_ERROR) {
+		pr_debug("%s: Error detected in status(0x%X)!\n",
+			 __func__, stat);
+		return -EIO;
+	}
+	if (stat & SDHCI_INT_DMA_END && !(stat & SDHCI_INT_DATA_END)) {
+		sdhci_writel(host, SDHCI_INT_DMA_END, SDHCI_INT_STATUS);
+		if (host->flags & USE_SDMA) {
+			host->bg_addr &= ~(SDHCI_DEFAULT_BOUNDARY_SIZE - 1);
+			host->bg_addr += SDHCI_DEFAULT_BOUNDARY_SIZE;
+			start_addr = dev_phys_to_bus(mmc_to_dev(host->mmc),
+						     host->bg_addr);
+			sdhci_writel(host, start_addr, SDHCI_DMA_ADDRESS);
+		}
+	}
+	if (!(stat & SDHCI_INT_DATA_END)) {
+		if (get_timer(host->bg_start) < SDHCI_DATA_TIMEOUT)
+			return -EBUSY;
+		printf("%s: Transfer data timeout\n", __func__);
+		return -ETIMEDOUT;
+	}
+
+#if (CONFIG_IS_ENABLED(MMC_SDHCI_SDMA) || CONFIG_IS_ENABLED(MMC_SDHCI_ADMA))
+	dma_unmap_single(host->start_addr, data->blocks * data->blocksize,
+			 mmc_get_dma_dir(data));
+#endif
+
+	return 0;
+}
+#endif
+
+/* Finish a command, once its data is transferred or has failed with @ret */
+static int sdhci_end_command(struct sdhci_host *host, struct mmc_data *data,
+			     int ret, int is_aligned, int trans_bytes)
+{
+	unsigned int stat;
+
+	if (host->quirks & SDHCI_QUIRK_WAIT_SEND_CMD)
+		udelay(1000);
+
+	stat = sdhci_readl(host, SDHCI_INT_STATUS);
+	sdhci_writel(host, SDHCI_INT_ALL_MASK, SDHCI_INT_STATUS);
+	if (!ret) {
+		if (!is_aligned && data->flags == MMC_DATA_READ)
+			memcpy(data->dest, host->align_buffer, trans_bytes);
+		return 0;
+	}
+
+	sdhci_reset(host, SDHCI_RESET_CMD);
+	sdhci_reset(host, SDHCI_RESET_DATA);
+	if (stat & SDHCI_INT_TIMEOUT)
+		return -ETIMEDOUT;
+	else
+		return -ECOMM;
+}
+
 /*
  * No command will be sent by driver if card is busy, so driver must wait
  * for card ready state.
@@ -196,17 +285,13 @@ static int sdhci_transfer_data(struct sdhci_host *host, struct mmc_data *data)
 #define SDHCI_CMD_DEFAULT_TIMEOUT		100
 #define SDHCI_READ_STATUS_TIMEOUT		1000
 
-#ifdef CONFIG_DM_MMC
-static int sdhci_send_command(struct udevice *dev, struct mmc_cmd *cmd,
-			      struct mmc_data *data)
-{
-	struct mmc *mmc = mmc_get_mmc_dev(dev);
-
-#else
-static int sdhci_send_command(struct mmc *mmc, struct mmc_cmd *cmd,
-			      struct mmc_data *data)
+/*
+ * Send a command. With @background, a DMA transfer which needs no bounce
+ * buffer is left running for sdhci_poll_data() to finish.
+ */
+static int sdhci_send_command_common(struct mmc *mmc, struct mmc_cmd *cmd,
+				     struct mmc_data *data, bool background)
 {
-#endif
 	struct sdhci_host *host = mmc->priv;
 	unsigned int stat = 0;
 	int ret = 0;
@@ -322,28 +407,62 @@ static int sdhci_send_command(struct mmc *mmc, struct mmc_cmd *cmd,
 	} else
 		ret = -1;
 
+#if CONFIG_IS_ENABLED(BLK_ASYNC)
+	if (!ret && data && background && is_aligned &&
+	    host->flags & USE_DMA) {
+		host->bg_data = data;
+		host->bg_addr = host->start_addr;
+		host->bg_start = get_timer(0);
+		return 0;
+	}
+#endif
 	if (!ret && data)
 		ret = sdhci_transfer_data(host, data);
 
-	if (host->quirks & SDHCI_QUIRK_WAIT_SEND_CMD)
-		udelay(1000);
+	return sdhci_end_command(host, data, ret, is_aligned, trans_bytes);
+}
 
-	stat = sdhci_readl(host, SDHCI_INT_STATUS);
-	sdhci_writel(host, SDHCI_INT_ALL_MASK, SDHCI_INT_STATUS);
-	if (!ret) {
-		if ((host->quirks & SDHCI_QUIRK_32BIT_DMA_ADDR) &&
-				!is_aligned && (data->flags == MMC_DATA_READ))
-			memcpy(data->dest, host->align_buffer, trans_bytes);
+#ifdef CONFIG_DM_MMC
+static int sdhci_send_command(struct udevice *dev, struct mmc_cmd *cmd,
+			      struct mmc_data *data)
+{
+	return sdhci_send_command_common(mmc_get_mmc_dev(dev), cmd, data,
+					 false);
+}
+
+#if CONFIG_IS_ENABLED(BLK_ASYNC)
+static int sdhci_send_cmd_start(struct udevice *dev, struct mmc_cmd *cmd,
+				struct mmc_data *data)
+{
+	return sdhci_send_command_common(mmc_get_mmc_dev(dev), cmd, data,
+					 true);
+}
+
+static int sdhci_send_cmd_poll(struct udevice *dev, struct mmc_data *data)
+{
+	struct mmc *mmc = mmc_get_mmc_dev(dev);
+	struct sdhci_host *host = mmc->priv;
+	int ret;
+
+	/* the transfer was over before sdhci_send_cmd_start() returned */
+	if (host->bg_data != data)
 		return 0;
-	}
 
-	sdhci_reset(host, SDHCI_RESET_CMD);
-	sdhci_reset(host, SDHCI_RESET_DATA);
-	if (stat & SDHCI_INT_TIMEOUT)
-		return -ETIMEDOUT;
-	else
-		return -ECOMM;
+	ret = sdhci_poll_data(host, data);
+	if (ret == -EBUSY)
+		return ret;
+	host->bg_data = NULL;
+
+	return sdhci_end_command(host, data, ret, 1, 0);
+}
+#endif
+#else
+static int sdhci_send_command(struct mmc *mmc, struct mmc_cmd *cmd,
+			      struct mmc_data *data)
+{
+	return sdhci_send_command_common(mmc, cmd, data, false);
 }
+#endif
 
 #if defined(CONFIG_DM_MMC) && defined(MMC_SUPPORTS_TUNING)
 static int sdhci_execute_tuning(struct udevice *dev, uint opcode)
@@ -729,8 +848,9 @@ static int sdhci_init(struct mmc *mmc)
 	 */
 	host->force_align_buffer = true;
 #else
-	if (host->quirks & SDHCI_QUIRK_32BIT_DMA_ADDR) {
-		host->align_buffer = memalign(8, 512 * 1024);
+	if (host->quirks & SDHCI_QUIRK_32BIT_DMA_ADDR && !host->align_buffer) {
+		host->align_buffer = memalign(ARCH_DMA_MINALIGN,
+					      SDHCI_ALIGN_BUFFER_SIZE);
 		if (!host->align_buffer) {
 			printf("%s: Aligned buffer alloc failed!!!\n",
 			       __func__);
@@ -753,6 +873,28 @@ static int sdhci_init(struct mmc *mmc)
 	return 0;
 }
 
+/*
+ * Limit reads into buffers which need bouncing to the size of the bounce
+ * buffer, which is allocated on first use and then kept
+ */
+static int sdhci_get_b_max_common(struct mmc *mmc, void *dst)
+{
+	struct sdhci_host *host = mmc->priv;
+
+	if (!(host->flags & USE_DMA) || host->force_align_buffer ||
+	    IS_ALIGNED((ulong)dst, ARCH_DMA_MINALIGN))
+		return mmc->cfg->b_max;
+
+	if (!host->align_buffer)
+		host->align_buffer = memalign(ARCH_DMA_MINALIGN,
+					      SDHCI_ALIGN_BUFFER_SIZE);
+	if (!host->align_buffer)
+		return mmc->cfg->b_max;
+
+	return min_t(uint, mmc->cfg->b_max,
+		     SDHCI_ALIGN_BUFFER_SIZE / mmc->read_bl_len);
+}
+
 #ifdef CONFIG_DM_MMC
 int sdhci_probe(struct udevice *dev)
 {
@@ -775,6 +917,11 @@ static int sdhci_deferred_probe(struct udevice *dev)
 	return 0;
 }
 
+static int sdhci_get_b_max(struct udevice *dev, void *dst, lbaint_t blkcnt)
+{
+	return sdhci_get_b_max_common(mmc_get_mmc_dev(dev), dst);
+}
+
 static int sdhci_get_cd(struct udevice *dev)
 {
 	struct mmc *mmc = mmc_get_mmc_dev(dev);
@@ -848,13 +995,24 @@ const struct dm_mmc_ops sdhci_ops = {
 	.wait_dat0	= sdhci_wait_dat0,
 #if CONFIG_IS_ENABLED(MMC_HS400_ES_SUPPORT)
 	.set_enhanced_strobe = sdhci_set_enhanced_strobe,
+#endif
+	.get_b_max	= sdhci_get_b_max,
+#if CONFIG_IS_ENABLED(BLK_ASYNC)
+	.send_cmd_start	= sdhci_send_cmd_start,
+	.send_cmd_poll	= sdhci_send_cmd_poll,
 #endif
 };
 #else
+static int sdhci_get_b_max(struct mmc *mmc, void *dst, lbaint_t blkcnt)
+{
+	return sdhci_get_b_max_common(mmc, dst);
+}
+
 static const struct mmc_ops sdhci_ops = {
 	.send_cmd	= sdhci_send_command,
 	.set_ios	= sdhci_set_ios,
 	.init		= sdhci_init,
+	.get_b_max	= sdhci_get_b_max,
 };
 #endif
 
@@ -1007,6 +1165,14 @@ int sdhci_setup_cfg(struct mmc_config *cfg, struct sdhci_host *host,
 	if (caps_1 & SDHCI_SUPPORT_DDR50)
 		cfg->host_caps |= MMC_CAP(UHS_DDR50);
 
+	/*
+	 * CMD12 is only sent on request, so CMD23 can replace it. Leave it to
+	 * version 3.00 hosts, which know about CMD23, unless quirked off.
+	 */
+	if (SDHCI_GET_VERSION(host) >= SDHCI_SPEC_300 &&
+	    !(host->quirks & SDHCI_QUIRK_NO_CMD23))
+		cfg->host_caps |= MMC_CAP_CMD23;
+
 	if (host->host_caps)
 		cfg->host_caps |= host->host_caps;
 
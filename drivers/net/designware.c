@@ -654,6 +654,32 @@ int designware_eth_write_hwaddr(struct udevice *dev)
 	return _dw_write_hwaddr(priv, pdata->enetaddr);
 }
 
+static int designware_eth_mcast(struct udevice *dev, const u8 *enetaddr,
+				int join)
+{
+	struct dw_eth_dev *priv = dev_get_priv(dev);
+
+	/* Only one group is joined at a time, so take all multicast frames */
+	if (join)
+		setbits_le32(&priv->mac_regs_p->framefilt, PASSALLMULTICAST);
+	else
+		clrbits_le32(&priv->mac_regs_p->framefilt, PASSALLMULTICAST);
+
+	return 0;
+}
+
+static void designware_eth_get_stats(struct udevice *dev,
+				     struct eth_stats *stats)
+{
+	struct dw_eth_dev *priv = dev_get_priv(dev);
+	u32 val;
+
+	/* The counters are cleared on read */
+	val = readl(&priv->dma_regs_p->missedframes);
+	stats->rx_dropped += (val >> MISSEDFRAMES_SHIFT) & MISSEDFRAMES_MASK;
+	stats->rx_overruns += (val >> FIFOOVERFLOW_SHIFT) & FIFOOVERFLOW_MASK;
+}
+
 static int designware_eth_bind(struct udevice *dev)
 {
 	if (IS_ENABLED(CONFIG_PCI)) {
@@ -804,7 +830,9 @@ const struct eth_ops designware_eth_ops = {
 	.recv			= designware_eth_recv,
 	.free_pkt		= designware_eth_free_pkt,
 	.stop			= designware_eth_stop,
+	.mcast			= designware_eth_mcast,
 	.write_hwaddr		= designware_eth_write_hwaddr,
+	.get_stats		= designware_eth_get_stats,
 };
 
 int designware_eth_of_to_plat(struct udevice *dev)
@@ -15,7 +15,7 @@
 #endif
 
 #define CFG_TX_DESCR_NUM	16
-#define CFG_RX_DESCR_NUM	16
+#define CFG_RX_DESCR_NUM	CONFIG_ETH_DESIGNWARE_RX_DESCRIPTORS
 #define CFG_ETH_BUFSIZE	2048
 #define TX_TOTAL_BUFSIZE	(CFG_ETH_BUFSIZE * CFG_TX_DESCR_NUM)
 #define RX_TOTAL_BUFSIZE	(CFG_ETH_BUFSIZE * CFG_RX_DESCR_NUM)
@@ -49,6 +49,9 @@ struct eth_mac_regs {
 #define RXENABLE		(1 << 2)
 #define TXENABLE		(1 << 3)
 
+/* Frame filter register definitions */
+#define PASSALLMULTICAST	(1 << 4)
+
 /* MII address register definitions */
 #define MII_BUSY		(1 << 0)
 #define MII_WRITE		(1 << 1)
@@ -74,7 +77,8 @@ struct eth_dma_regs {
 	u32 status;		/* 0x14 */
 	u32 opmode;		/* 0x18 */
 	u32 intenable;		/* 0x1c */
-	u32 reserved1[2];
+	u32 missedframes;	/* 0x20 */
+	u32 reserved1;
 	u32 axibus;		/* 0x28 */
 	u32 reserved2[7];
 	u32 currhosttxdesc;	/* 0x48 */
@@ -108,6 +112,12 @@ struct eth_dma_regs {
 #define TXSECONDFRAME		(1 << 2)
 #define RXSTART			(1 << 1)
 
+/* Missed frame and buffer overflow counter definitions */
+#define MISSEDFRAMES_SHIFT	0
+#define MISSEDFRAMES_MASK	0xffff
+#define FIFOOVERFLOW_SHIFT	17
+#define FIFOOVERFLOW_MASK	0x7ff
+
 /* Descriptior related definitions */
 #define MAC_MAX_FRAME_SZ	(1600)
 
@@ -977,6 +977,18 @@ static int eqos_start(struct udevice *dev)
 			EQOS_MAC_CONFIGURATION_CST |
 			EQOS_MAC_CONFIGURATION_ACS);
 
+	/* Have the checksums of TCP and UDP packets worked out by the MAC */
+	val = readl(&eqos->mac_regs->hw_feature0);
+	if (val & EQOS_MAC_HW_FEATURE0_RXCOESEL)
+		setbits_le32(&eqos->mac_regs->configuration,
+			     EQOS_MAC_CONFIGURATION_IPC);
+	else
+		clrbits_le32(&eqos->mac_regs->configuration,
+			     EQOS_MAC_CONFIGURATION_IPC);
+	eqos->tx_csum = val & EQOS_MAC_HW_FEATURE0_TXCOESEL;
+	eth_set_csum(dev, (eqos->tx_csum ? ETH_CSUM_TX : 0) |
+		     (val & EQOS_MAC_HW_FEATURE0_RXCOESEL ? ETH_CSUM_RX : 0));
+
 	eqos_write_hwaddr(dev);
 
 	/* Configure DMA */
@@ -1168,6 +1180,8 @@ static int eqos_send(struct udevice *dev, void *packet, int length)
 	 */
 	mb();
 	tx_desc->des3 = EQOS_DESC3_OWN | EQOS_DESC3_FD | EQOS_DESC3_LD | length;
+	if (eqos->tx_csum)
+		tx_desc->des3 |= EQOS_DESC3_CIC_FULL;
 	eqos->config->ops->eqos_flush_desc(tx_desc);
 
 	writel((ulong)eqos_get_desc(eqos, eqos->tx_desc_idx, false),
@@ -1189,6 +1203,7 @@ static int eqos_recv(struct udevice *dev, int flags, uchar **packetp)
 {
 	struct eqos_priv *eqos = dev_get_priv(dev);
 	struct eqos_desc *rx_desc;
+	u32 des1, pt;
 	int length;
 
 	debug("%s(dev=%p, flags=%x):\n", __func__, dev, flags);
@@ -1205,6 +1220,15 @@ static int eqos_recv(struct udevice *dev, int flags, uchar **packetp)
 	length = rx_desc->des3 & 0x7fff;
 	debug("%s: *packetp=%p, length=%d\n", __func__, *packetp, length);
 
+	/* The MAC found the checksums of a TCP or UDP packet good */
+	des1 = rx_desc->des1;
+	pt = des1 & EQOS_DESC1_PT_MASK;
+	if ((rx_desc->des3 & EQOS_DESC3_RS1V) &&
+	    (des1 & (EQOS_DESC1_IPV4 | EQOS_DESC1_IPV6)) &&
+	    !(des1 & (EQOS_DESC1_IPHE | EQOS_DESC1_IPCB | EQOS_DESC1_IPCE)) &&
+	    (pt == EQOS_DESC1_PT_UDP || pt == EQOS_DESC1_PT_TCP))
+		eth_rx_csum_ok(dev);
+
 	eqos->config->ops->eqos_inval_buffer(*packetp, length);
 
 	return length;
@@ -1260,6 +1284,18 @@ static int eqos_free_pkt(struct udevice *dev, uchar *packet, int length)
 	return 0;
 }
 
+static void eqos_get_stats(struct udevice *dev, struct eth_stats *stats)
+{
+	struct eqos_priv *eqos = dev_get_priv(dev);
+	u32 val;
+
+	/* The counters are cleared on read */
+	val = readl(&eqos->mtl_regs->rxq0_missed_pkt_overflow_cnt);
+	stats->rx_dropped += (val >> EQOS_MTL_RXQ0_MISSED_PKT_MISPKTCNT_SHIFT) &
+			     EQOS_MTL_RXQ0_MISSED_PKT_MISPKTCNT_MASK;
+	stats->rx_overruns += val & EQOS_MTL_RXQ0_MISSED_PKT_OVFPKTCNT_MASK;
+}
+
 static int eqos_probe_resources_core(struct udevice *dev)
 {
 	struct eqos_priv *eqos = dev_get_priv(dev);
@@ -1639,6 +1675,7 @@ static const struct eth_ops eqos_ops = {
 	.free_pkt = eqos_free_pkt,
 	.write_hwaddr = eqos_write_hwaddr,
 	.read_rom_hwaddr	= eqos_read_rom_hwaddr,
+	.get_stats = eqos_get_stats,
 };
 
 static struct eqos_ops eqos_tegra186_ops = {
@@ -35,6 +35,7 @@ struct eqos_mac_regs {
 	u32 address0_low;				/* 0x304 */
 };
 
+#define EQOS_MAC_CONFIGURATION_IPC			BIT(27)
 #define EQOS_MAC_CONFIGURATION_GPSLCE			BIT(23)
 #define EQOS_MAC_CONFIGURATION_CST			BIT(21)
 #define EQOS_MAC_CONFIGURATION_ACS			BIT(20)
@@ -66,6 +67,8 @@ struct eqos_mac_regs {
 #define EQOS_MAC_RXQ_CTRL2_PSRQ0_SHIFT			0
 #define EQOS_MAC_RXQ_CTRL2_PSRQ0_MASK			0xff
 
+#define EQOS_MAC_HW_FEATURE0_RXCOESEL			BIT(16)
+#define EQOS_MAC_HW_FEATURE0_TXCOESEL			BIT(14)
 #define EQOS_MAC_HW_FEATURE0_MMCSEL_SHIFT		8
 #define EQOS_MAC_HW_FEATURE0_HDSEL_SHIFT		2
 #define EQOS_MAC_HW_FEATURE0_GMIISEL_SHIFT		1
@@ -102,7 +105,7 @@ struct eqos_mtl_regs {
 	u32 txq0_quantum_weight;			/* 0xd18 */
 	u32 unused_d1c[(0xd30 - 0xd1c) / 4];	/* 0xd1c */
 	u32 rxq0_operation_mode;			/* 0xd30 */
-	u32 unused_d34;				/* 0xd34 */
+	u32 rxq0_missed_pkt_overflow_cnt;		/* 0xd34 */
 	u32 rxq0_debug;				/* 0xd38 */
 };
 
@@ -127,6 +130,10 @@ struct eqos_mtl_regs {
 #define EQOS_MTL_RXQ0_OPERATION_MODE_EHFC		BIT(7)
 #define EQOS_MTL_RXQ0_OPERATION_MODE_RSF		BIT(5)
 
+#define EQOS_MTL_RXQ0_MISSED_PKT_MISPKTCNT_SHIFT	16
+#define EQOS_MTL_RXQ0_MISSED_PKT_MISPKTCNT_MASK		0x7ff
+#define EQOS_MTL_RXQ0_MISSED_PKT_OVFPKTCNT_MASK		0x7ff
+
 #define EQOS_MTL_RXQ0_DEBUG_PRXQ_SHIFT			16
 #define EQOS_MTL_RXQ0_DEBUG_PRXQ_MASK			0x7fff
 #define EQOS_MTL_RXQ0_DEBUG_RXQSTS_SHIFT		4
@@ -194,7 +201,7 @@ struct eqos_tegra186_regs {
 
 /* Descriptors */
 #define EQOS_DESCRIPTORS_TX	4
-#define EQOS_DESCRIPTORS_RX	4
+#define EQOS_DESCRIPTORS_RX	CONFIG_DWC_ETH_QOS_RX_DESCRIPTORS
 #define EQOS_DESCRIPTORS_NUM	(EQOS_DESCRIPTORS_TX + EQOS_DESCRIPTORS_RX)
 #define EQOS_BUFFER_ALIGN	ARCH_DMA_MINALIGN
 #define EQOS_MAX_PACKET_SIZE	ALIGN(1568, ARCH_DMA_MINALIGN)
@@ -210,7 +217,19 @@ struct eqos_desc {
 #define EQOS_DESC3_OWN		BIT(31)
 #define EQOS_DESC3_FD		BIT(29)
 #define EQOS_DESC3_LD		BIT(28)
+#define EQOS_DESC3_RS1V		BIT(26)
 #define EQOS_DESC3_BUF1V	BIT(24)
+#define EQOS_DESC3_CIC_FULL	(3 << 16)
+
+/* RX write-back, valid with EQOS_DESC3_RS1V */
+#define EQOS_DESC1_IPCE		BIT(7)
+#define EQOS_DESC1_IPCB		BIT(6)
+#define EQOS_DESC1_IPV6		BIT(5)
+#define EQOS_DESC1_IPV4		BIT(4)
+#define EQOS_DESC1_IPHE		BIT(3)
+#define EQOS_DESC1_PT_MASK	GENMASK(2, 0)
+#define EQOS_DESC1_PT_UDP	1
+#define EQOS_DESC1_PT_TCP	2
 
 #define EQOS_AXI_WIDTH_32	4
 #define EQOS_AXI_WIDTH_64	8
@@ -277,6 +296,7 @@ struct eqos_priv {
 	bool started;
 	bool reg_access_ok;
 	bool clk_ck_enabled;
+	bool tx_csum;
 	unsigned int tx_fifo_sz, rx_fifo_sz;
 	u32 reset_delays[3];
 };
@@ -438,6 +438,69 @@ static int xgmac_get_phy_addr(struct xgmac_priv *priv, struct udevice *dev)
 	return reg;
 }
 
+/*
+ * Return the buffer for the payload of RX descriptor idx once split from its
+ * headers: one lent by the protocol if any, see eth_rx_take(), else the one
+ * right after the room for the headers in our own buffer.
+ */
+static u32 xgmac_rx_payload_buf(struct udevice *dev, int idx)
+{
+	struct xgmac_priv *xgmac = dev_get_priv(dev);
+	void *buf;
+
+	if (!xgmac->sph)
+		return 0;
+
+	buf = eth_rx_take(dev, XGMAC_MAX_PACKET_SIZE);
+	xgmac->rx_lent[idx] = buf;
+	/* Like our own buffers, lent ones must be in the low 4 GiB */
+	if (buf && !upper_32_bits((ulong)buf)) {
+		xgmac->config->ops->xgmac_flush_buffer(buf,
+						       XGMAC_MAX_PACKET_SIZE);
+		return (u32)(ulong)buf;
+	}
+
+	return (u32)(ulong)(xgmac->rx_dma_buf + idx * XGMAC_RX_BUF_SIZE +
+			    XGMAC_SPH_HEAD);
+}
+
+/*
+ * Complete a packet received with split headers, of which length is the
+ * size. Returns the size of the packet at *packetp, which is only the
+ * headers if the payload went to a lent buffer.
+ */
+static int xgmac_rx_split(struct udevice *dev, struct xgmac_desc *rx_desc,
+			  uchar **packetp, int length)
+{
+	struct xgmac_priv *xgmac = dev_get_priv(dev);
+	void *lent = xgmac->rx_lent[xgmac->rx_desc_idx];
+	uchar *buf = *packetp;
+	int hdr_len = 0;
+
+	xgmac->rx_lent[xgmac->rx_desc_idx] = NULL;
+	if (rx_desc->des3 & XGMAC_RDES3_L34T_MASK)
+		hdr_len = rx_desc->des2 & XGMAC_RDES2_HL_MASK;
+	if (!hdr_len || hdr_len >= length) {
+		if (lent)
+			eth_rx_give(dev, lent, 0);
+		return length;
+	}
+
+	if (lent && !upper_32_bits((ulong)lent)) {
+		xgmac->config->ops->xgmac_inval_buffer(lent, length - hdr_len);
+		eth_rx_give(dev, lent, length - hdr_len);
+		return hdr_len;
+	}
+	if (lent)
+		eth_rx_give(dev, lent, 0);
+
+	/* Put the headers back in front of the payload */
+	*packetp = buf + XGMAC_SPH_HEAD - hdr_len;
+	memmove(*packetp, buf, hdr_len);
+
+	return length;
+}
+
 static int xgmac_start(struct udevice *dev)
 {
 	struct xgmac_priv *xgmac = dev_get_priv(dev);
@@ -610,6 +673,18 @@ static int xgmac_start(struct udevice *dev)
 		     XGMAC_MAC_CONF_ACS |
 		     XGMAC_MAC_CONF_CST);
 
+	/* Have the checksums of TCP and UDP packets worked out by the MAC */
+	val = readl(&xgmac->mac_regs->hw_feature0);
+	if (val & XGMAC_MAC_HW_FEATURE0_RXCOESEL)
+		setbits_le32(&xgmac->mac_regs->rx_configuration,
+			     XGMAC_MAC_CONF_IPC);
+	else
+		clrbits_le32(&xgmac->mac_regs->rx_configuration,
+			     XGMAC_MAC_CONF_IPC);
+	xgmac->tx_csum = val & XGMAC_MAC_HW_FEATURE0_TXCOESEL;
+	eth_set_csum(dev, (xgmac->tx_csum ? ETH_CSUM_TX : 0) |
+		     (val & XGMAC_MAC_HW_FEATURE0_RXCOESEL ? ETH_CSUM_RX : 0));
+
 	ret = xgmac_write_hwaddr(dev);
 	if (ret < 0) {
 		pr_err("xgmac_write_hwaddr() failed: %d\n", ret);
@@ -633,6 +708,20 @@ static int xgmac_start(struct udevice *dev)
 			XGMAC_MAX_PACKET_SIZE <<
 			XGMAC_DMA_CH0_RX_CONTROL_RBSZ_SHIFT);
 
+	/* Split the headers of TCP and UDP packets from their payload */
+	xgmac->sph = IS_ENABLED(CONFIG_NET_RX_LEND) &&
+		     (readl(&xgmac->mac_regs->hw_feature1) &
+		      XGMAC_MAC_HW_FEATURE1_SPHEN);
+	if (xgmac->sph) {
+		clrsetbits_le32(&xgmac->mac_regs->rx_configuration,
+				XGMAC_MAC_CONF_HDSMS_MASK <<
+				XGMAC_MAC_CONF_HDSMS_SHIFT,
+				XGMAC_MAC_CONF_HDSMS_256 <<
+				XGMAC_MAC_CONF_HDSMS_SHIFT);
+		setbits_le32(&xgmac->dma_regs->ch0_control,
+			     XGMAC_DMA_CH0_CONTROL_SPH);
+	}
+
 	desc_pad = (xgmac->desc_size - sizeof(struct xgmac_desc)) /
 		    xgmac->config->axi_bus_width;
 
@@ -676,7 +765,7 @@ static int xgmac_start(struct udevice *dev)
 	/* Set up descriptors */
 
 	memset(xgmac->tx_descs, 0, xgmac->desc_size * XGMAC_DESCRIPTORS_TX);
-	memset(xgmac->rx_descs, 0, xgmac->desc_size * XGMAC_DESCRIPTORS_RX);
+	memset(xgmac->rx_descs, 0, xgmac->desc_size * xgmac->rx_desc_num);
 
 	for (i = 0; i < XGMAC_DESCRIPTORS_TX; i++) {
 		tx_desc = (struct xgmac_desc *)xgmac_get_desc(xgmac, i, false);
@@ -684,18 +773,19 @@ static int xgmac_start(struct udevice *dev)
 		xgmac->config->ops->xgmac_flush_desc(tx_desc);
 	}
 
-	for (i = 0; i < XGMAC_DESCRIPTORS_RX; i++) {
+	for (i = 0; i < xgmac->rx_desc_num; i++) {
 		rx_desc = (struct xgmac_desc *)xgmac_get_desc(xgmac, i, true);
 
 		rx_desc->des0 = (uintptr_t)(xgmac->rx_dma_buf +
-					    (i * XGMAC_MAX_PACKET_SIZE));
+					    (i * XGMAC_RX_BUF_SIZE));
+		rx_desc->des2 = xgmac_rx_payload_buf(dev, i);
 		rx_desc->des3 = XGMAC_DESC3_OWN;
 		/* Flush the cache to the memory */
 		mb();
 		xgmac->config->ops->xgmac_flush_desc(rx_desc);
 		xgmac->config->ops->xgmac_inval_buffer(xgmac->rx_dma_buf +
-						       (i * XGMAC_MAX_PACKET_SIZE),
-						       XGMAC_MAX_PACKET_SIZE);
+						       (i * XGMAC_RX_BUF_SIZE),
+						       XGMAC_RX_BUF_SIZE);
 	}
 
 	writel(0, &xgmac->dma_regs->ch0_txdesc_list_haddress);
@@ -706,7 +796,7 @@ static int xgmac_start(struct udevice *dev)
 	writel(0, &xgmac->dma_regs->ch0_rxdesc_list_haddress);
 	writel((ulong)xgmac_get_desc(xgmac, 0, true),
 	       &xgmac->dma_regs->ch0_rxdesc_list_address);
-	writel(XGMAC_DESCRIPTORS_RX - 1,
+	writel(xgmac->rx_desc_num - 1,
 	       &xgmac->dma_regs->ch0_rxdesc_ring_length);
 
 	/* Enable everything */
@@ -726,7 +816,7 @@ static int xgmac_start(struct udevice *dev)
 	 * that's not distinguishable from none of the descriptors being
 	 * available.
 	 */
-	last_rx_desc = (ulong)xgmac_get_desc(xgmac, XGMAC_DESCRIPTORS_RX - 1, true);
+	last_rx_desc = (ulong)xgmac_get_desc(xgmac, xgmac->rx_desc_num - 1, true);
 	writel(last_rx_desc, &xgmac->dma_regs->ch0_rxdesc_tail_pointer);
 
 	xgmac->started = true;
@@ -838,6 +928,8 @@ static int xgmac_send(struct udevice *dev, void *packet, int length)
 	 */
 	mb();
 	tx_desc->des3 = XGMAC_DESC3_OWN | XGMAC_DESC3_FD | XGMAC_DESC3_LD | length;
+	if (xgmac->tx_csum)
+		tx_desc->des3 |= XGMAC_TDES3_CIC_FULL;
 	xgmac->config->ops->xgmac_flush_desc(tx_desc);
 
 	writel((ulong)xgmac_get_desc(xgmac, xgmac->tx_desc_idx, false),
@@ -860,6 +952,7 @@ static int xgmac_recv(struct udevice *dev, int flags, uchar **packetp)
 	struct xgmac_priv *xgmac = dev_get_priv(dev);
 	struct xgmac_desc *rx_desc;
 	int length;
+	u32 l34t;
 
 	debug("%s(dev=%p, flags=0x%x):\n", __func__, dev, flags);
 
@@ -871,11 +964,22 @@ static int xgmac_recv(struct udevice *dev, int flags, uchar **packetp)
 	}
 
 	*packetp = xgmac->rx_dma_buf +
-		   (xgmac->rx_desc_idx * XGMAC_MAX_PACKET_SIZE);
+		   (xgmac->rx_desc_idx * XGMAC_RX_BUF_SIZE);
 	length = rx_desc->des3 & XGMAC_RDES3_PKT_LENGTH_MASK;
 	debug("%s: *packetp=%p, length=%d\n", __func__, *packetp, length);
 
-	xgmac->config->ops->xgmac_inval_buffer(*packetp, length);
+	/* The MAC found the checksums of a TCP or UDP packet good */
+	l34t = (rx_desc->des3 & XGMAC_RDES3_L34T_MASK) >> XGMAC_RDES3_L34T_SHIFT;
+	if (!(rx_desc->des3 & XGMAC_RDES3_ES) &&
+	    (l34t == XGMAC_RDES3_L34T_IP4TCP || l34t == XGMAC_RDES3_L34T_IP4UDP ||
+	     l34t == XGMAC_RDES3_L34T_IP6TCP || l34t == XGMAC_RDES3_L34T_IP6UDP))
+		eth_rx_csum_ok(dev);
+
+	xgmac->config->ops->xgmac_inval_buffer(*packetp, XGMAC_SPH_HEAD +
+					       length);
+	if (xgmac->sph)
+		length = xgmac_rx_split(dev, rx_desc, packetp, length);
+	xgmac->rx_packet = *packetp;
 
 	return length;
 }
@@ -889,8 +993,7 @@ static int xgmac_free_pkt(struct udevice *dev, uchar *packet, int length)
 
 	debug("%s(packet=%p, length=%d)\n", __func__, packet, length);
 
-	packet_expected = xgmac->rx_dma_buf +
-			  (xgmac->rx_desc_idx * XGMAC_MAX_PACKET_SIZE);
+	packet_expected = xgmac->rx_packet;
 	if (packet != packet_expected) {
 		debug("%s: Unexpected packet (expected %p)\n", __func__,
 		      packet_expected);
@@ -910,9 +1013,9 @@ static int xgmac_free_pkt(struct udevice *dev, uchar *packet, int length)
 			xgmac->config->ops->xgmac_flush_desc(rx_desc);
 			xgmac->config->ops->xgmac_inval_buffer(packet, length);
 			rx_desc->des0 = (u32)(ulong)(xgmac->rx_dma_buf +
-					     (idx * XGMAC_MAX_PACKET_SIZE));
+					     (idx * XGMAC_RX_BUF_SIZE));
 			rx_desc->des1 = 0;
-			rx_desc->des2 = 0;
+			rx_desc->des2 = xgmac_rx_payload_buf(dev, idx);
 			/*
 			 * Make sure that if HW sees the _OWN write below,
 			 * it will see all the writes to the rest of the
@@ -926,11 +1029,29 @@ static int xgmac_free_pkt(struct udevice *dev, uchar *packet, int length)
 	}
 
 	xgmac->rx_desc_idx++;
-	xgmac->rx_desc_idx %= XGMAC_DESCRIPTORS_RX;
+	xgmac->rx_desc_idx %= xgmac->rx_desc_num;
 
 	return 0;
 }
 
+static int xgmac_mcast(struct udevice *dev, const u8 *enetaddr, int join)
+{
+	/* The MAC is promiscuous, see xgmac_start(), so there is nothing to do */
+	return 0;
+}
+
+static void xgmac_get_stats(struct udevice *dev, struct eth_stats *stats)
+{
+	struct xgmac_priv *xgmac = dev_get_priv(dev);
+	u32 val;
+
+	/* The counters are cleared on read */
+	val = readl(&xgmac->mtl_regs->rxq0_missed_pkt_overflow_cnt);
+	stats->rx_dropped += (val >> XGMAC_MTL_RXQ0_MISSED_PKT_MISPKTCNT_SHIFT) &
+			     XGMAC_MTL_RXQ0_MISSED_PKT_MISPKTCNT_MASK;
+	stats->rx_overruns += val & XGMAC_MTL_RXQ0_MISSED_PKT_OVFPKTCNT_MASK;
+}
+
 static int xgmac_probe_resources_core(struct udevice *dev)
 {
 	struct xgmac_priv *xgmac = dev_get_priv(dev);
@@ -955,6 +1076,20 @@ static int xgmac_probe_resources_core(struct udevice *dev)
 	}
 	xgmac->desc_per_cacheline = ARCH_DMA_MINALIGN / xgmac->desc_size;
 
+	/*
+	 * A deeper ring lets the hardware keep receiving during bursts while
+	 * U-Boot is busy elsewhere. Whole cachelines of descriptors are
+	 * handed back to the hardware, so round to those.
+	 */
+	xgmac->rx_desc_num = dev_read_u32_default(dev, "u-boot,rx-descriptors",
+						  XGMAC_DESCRIPTORS_RX);
+	xgmac->rx_desc_num = clamp_t(unsigned int, xgmac->rx_desc_num,
+				     XGMAC_DESCRIPTORS_RX_MIN,
+				     XGMAC_DESCRIPTORS_RX_MAX);
+	xgmac->rx_desc_num = ALIGN(xgmac->rx_desc_num,
+				   xgmac->desc_per_cacheline);
+	debug("%s: rx_desc_num=%u\n", __func__, xgmac->rx_desc_num);
+
 	xgmac->tx_descs = xgmac_alloc_descs(xgmac, XGMAC_DESCRIPTORS_TX);
 	if (!xgmac->tx_descs) {
 		debug("%s: xgmac_alloc_descs(tx) failed\n", __func__);
@@ -962,7 +1097,7 @@ static int xgmac_probe_resources_core(struct udevice *dev)
 		goto err;
 	}
 
-	xgmac->rx_descs = xgmac_alloc_descs(xgmac, XGMAC_DESCRIPTORS_RX);
+	xgmac->rx_descs = xgmac_alloc_descs(xgmac, xgmac->rx_desc_num);
 	if (!xgmac->rx_descs) {
 		debug("%s: xgmac_alloc_descs(rx) failed\n", __func__);
 		ret = -ENOMEM;
@@ -977,7 +1112,8 @@ static int xgmac_probe_resources_core(struct udevice *dev)
 	}
 	debug("%s: tx_dma_buf=%p\n", __func__, xgmac->tx_dma_buf);
 
-	xgmac->rx_dma_buf = memalign(XGMAC_BUFFER_ALIGN, XGMAC_RX_BUFFER_SIZE);
+	xgmac->rx_dma_buf = memalign(XGMAC_BUFFER_ALIGN,
+				     xgmac->rx_desc_num * XGMAC_RX_BUF_SIZE);
 	if (!xgmac->rx_dma_buf) {
 		debug("%s: memalign(rx_dma_buf) failed\n", __func__);
 		ret = -ENOMEM;
@@ -993,12 +1129,23 @@ static int xgmac_probe_resources_core(struct udevice *dev)
 	}
 	debug("%s: rx_pkt=%p\n", __func__, xgmac->rx_pkt);
 
+	if (IS_ENABLED(CONFIG_NET_RX_LEND)) {
+		xgmac->rx_lent = calloc(xgmac->rx_desc_num, sizeof(void *));
+		if (!xgmac->rx_lent) {
+			debug("%s: calloc(rx_lent) failed\n", __func__);
+			ret = -ENOMEM;
+			goto err_free_rx_pkt;
+		}
+	}
+
 	xgmac->config->ops->xgmac_inval_buffer(xgmac->rx_dma_buf,
-			XGMAC_MAX_PACKET_SIZE * XGMAC_DESCRIPTORS_RX);
+			xgmac->rx_desc_num * XGMAC_RX_BUF_SIZE);
 
 	debug("%s: OK\n", __func__);
 	return 0;
 
+err_free_rx_pkt:
+	free(xgmac->rx_pkt);
 err_free_rx_dma_buf:
 	free(xgmac->rx_dma_buf);
 err_free_tx_dma_buf:
@@ -1019,6 +1166,7 @@ static int xgmac_remove_resources_core(struct udevice *dev)
 
 	debug("%s(dev=%p):\n", __func__, dev);
 
+	free(xgmac->rx_lent);
 	free(xgmac->rx_pkt);
 	free(xgmac->rx_dma_buf);
 	free(xgmac->tx_dma_buf);
@@ -1144,6 +1292,8 @@ static const struct eth_ops xgmac_ops = {
 	.free_pkt = xgmac_free_pkt,
 	.write_hwaddr = xgmac_write_hwaddr,
 	.read_rom_hwaddr = xgmac_read_rom_hwaddr,
+	.mcast = xgmac_mcast,
+	.get_stats = xgmac_get_stats,
 };
 
 static const struct udevice_id xgmac_ids[] = {
@@ -58,6 +58,10 @@ struct xgmac_mac_regs {
 #define XGMAC_MAC_CONF_SS_2_10M_MII		7
 
 #define XGMAC_MAC_CONF_JD			BIT(16)
+#define XGMAC_MAC_CONF_HDSMS_SHIFT		12
+#define XGMAC_MAC_CONF_HDSMS_MASK		GENMASK(2, 0)
+#define XGMAC_MAC_CONF_HDSMS_256		2
+#define XGMAC_MAC_CONF_IPC			BIT(9)
 #define XGMAC_MAC_CONF_JE			BIT(8)
 #define XGMAC_MAC_CONF_WD			BIT(7)
 #define XGMAC_MAC_CONF_GPSLCE			BIT(6)
@@ -87,6 +91,10 @@ struct xgmac_mac_regs {
 #define XGMAC_MAC_RXQ_CTRL2_PSRQ0_SHIFT		0
 #define XGMAC_MAC_RXQ_CTRL2_PSRQ0_MASK		GENMASK(7, 0)
 
+#define XGMAC_MAC_HW_FEATURE0_RXCOESEL		BIT(16)
+#define XGMAC_MAC_HW_FEATURE0_TXCOESEL		BIT(14)
+
+#define XGMAC_MAC_HW_FEATURE1_SPHEN		BIT(28)
 #define XGMAC_MAC_HW_FEATURE1_TXFIFOSIZE_SHIFT	6
 #define XGMAC_MAC_HW_FEATURE1_TXFIFOSIZE_MASK	GENMASK(4, 0)
 #define XGMAC_MAC_HW_FEATURE1_RXFIFOSIZE_SHIFT	0
@@ -131,7 +139,7 @@ struct xgmac_mtl_regs {
 	u32 txq0_quantum_weight;		/* 0x1118 */
 	u32 unused_111c[(0x1140 - 0x111c) / 4];	/* 0x111c */
 	u32 rxq0_operation_mode;		/* 0x1140 */
-	u32 unused_1144;			/* 0x1144 */
+	u32 rxq0_missed_pkt_overflow_cnt;	/* 0x1144 */
 	u32 rxq0_debug;				/* 0x1148 */
 };
 
@@ -152,6 +160,10 @@ struct xgmac_mtl_regs {
 #define XGMAC_MTL_RXQ0_OPERATION_MODE_EHFC		BIT(7)
 #define XGMAC_MTL_RXQ0_OPERATION_MODE_RSF		BIT(5)
 
+#define XGMAC_MTL_RXQ0_MISSED_PKT_MISPKTCNT_SHIFT	16
+#define XGMAC_MTL_RXQ0_MISSED_PKT_MISPKTCNT_MASK	GENMASK(10, 0)
+#define XGMAC_MTL_RXQ0_MISSED_PKT_OVFPKTCNT_MASK	GENMASK(10, 0)
+
 #define XGMAC_MTL_RXQ0_DEBUG_PRXQ_SHIFT			16
 #define XGMAC_MTL_RXQ0_DEBUG_PRXQ_MASK			GENMASK(14, 0)
 #define XGMAC_MTL_RXQ0_DEBUG_RXQSTS_SHIFT		4
@@ -196,6 +208,7 @@ struct xgmac_dma_regs {
 #define XGMAC_DMA_SYSBUS_MODE_BLEN4			BIT(1)
 #define XGMAC_DMA_SYSBUS_MODE_UNDEF			BIT(0)
 
+#define XGMAC_DMA_CH0_CONTROL_SPH			BIT(24)
 #define XGMAC_DMA_CH0_CONTROL_DSL_SHIFT			18
 #define XGMAC_DMA_CH0_CONTROL_PBLX8			BIT(16)
 
@@ -212,11 +225,23 @@ struct xgmac_dma_regs {
 
 /* Descriptors */
 #define XGMAC_DESCRIPTORS_TX		8
-#define XGMAC_DESCRIPTORS_RX		8
+#define XGMAC_DESCRIPTORS_RX		CONFIG_DWC_ETH_XGMAC_RX_DESCRIPTORS
+#define XGMAC_DESCRIPTORS_RX_MIN	8
+#define XGMAC_DESCRIPTORS_RX_MAX	1024
 #define XGMAC_BUFFER_ALIGN		ARCH_DMA_MINALIGN
 #define XGMAC_MAX_PACKET_SIZE		ALIGN(1568, ARCH_DMA_MINALIGN)
-#define XGMAC_RX_BUFFER_SIZE		(XGMAC_DESCRIPTORS_RX * XGMAC_MAX_PACKET_SIZE)
-
+/* Room for the headers of a packet split from its payload */
+#define XGMAC_SPH_HEAD			(IS_ENABLED(CONFIG_NET_RX_LEND) ? 256 : 0)
+#define XGMAC_RX_BUF_SIZE		(XGMAC_SPH_HEAD + XGMAC_MAX_PACKET_SIZE)
+
+#define XGMAC_RDES2_HL_MASK		GENMASK(9, 0)
+#define XGMAC_RDES3_L34T_MASK		GENMASK(23, 20)
+#define XGMAC_RDES3_L34T_SHIFT		20
+#define XGMAC_RDES3_L34T_IP4TCP		0x1
+#define XGMAC_RDES3_L34T_IP4UDP		0x2
+#define XGMAC_RDES3_L34T_IP6TCP		0x9
+#define XGMAC_RDES3_L34T_IP6UDP		0xa
+#define XGMAC_RDES3_ES			BIT(15)
 #define XGMAC_RDES3_PKT_LENGTH_MASK	GENMASK(13, 0)
 
 struct xgmac_desc {
@@ -229,6 +254,7 @@ struct xgmac_desc {
 #define XGMAC_DESC3_OWN		BIT(31)
 #define XGMAC_DESC3_FD		BIT(29)
 #define XGMAC_DESC3_LD		BIT(28)
+#define XGMAC_TDES3_CIC_FULL	(3 << 16)
 
 #define XGMAC_AXI_WIDTH_32	4
 #define XGMAC_AXI_WIDTH_64	8
@@ -279,11 +305,16 @@ struct xgmac_priv {
 	void *tx_descs;
 	void *rx_descs;
 	int tx_desc_idx, rx_desc_idx;
+	unsigned int rx_desc_num;
 	unsigned int desc_size;
 	unsigned int desc_per_cacheline;
 	void *tx_dma_buf;
 	void *rx_dma_buf;
 	void *rx_pkt;
+	void *rx_packet;
+	void **rx_lent;
+	bool sph;
+	bool tx_csum;
 	bool started;
 	bool reg_access_ok;
 	bool clk_ck_enabled;
@@ -11,6 +11,7 @@
 #include <log.h>
 #include <malloc.h>
 #include <net.h>
+#include <net/tcp.h>
 #include <asm/eth.h>
 #include <asm/global_data.h>
 #include <asm/test.h>
@@ -254,6 +255,30 @@ int sandbox_eth_recv_ping_req(struct udevice *dev)
 	return 0;
 }
 
+/*
+ * sandbox_eth_recv_packet()
+ *
+ * Inject a packet, which is dropped if all receive buffers are in use
+ *
+ * returns 0 if injected, -EOVERFLOW if not
+ */
+int sandbox_eth_recv_packet(struct udevice *dev, const void *packet,
+			    unsigned int len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+
+	if (priv->recv_packets >= PKTBUFSRX) {
+		priv->rx_dropped++;
+		return -EOVERFLOW;
+	}
+
+	memcpy(priv->recv_packet_buffer[priv->recv_packets], packet, len);
+	priv->recv_packet_length[priv->recv_packets] = len;
+	++priv->recv_packets;
+
+	return 0;
+}
+
 /*
  * sb_default_handler()
  *
@@ -300,6 +325,29 @@ void sandbox_eth_set_tx_handler(int index, sandbox_eth_tx_hand_f *handler)
 		priv->tx_handler = sb_default_handler;
 }
 
+/*
+ * sandbox_eth_set_poll_handler()
+ *
+ * Set a function to call whenever the driver is polled for a received packet,
+ *	so that a test can inject packets which are not a response to a send
+ *
+ * index - interface to set the handler for
+ * handler - The func ptr to call when polled, or NULL for none
+ */
+void sandbox_eth_set_poll_handler(int index, sandbox_eth_poll_hand_f *handler)
+{
+	struct udevice *dev;
+	struct eth_sandbox_priv *priv;
+	int ret;
+
+	ret = uclass_get_device(UCLASS_ETH, index, &dev);
+	if (ret)
+		return;
+
+	priv = dev_get_priv(dev);
+	priv->poll_handler = handler;
+}
+
 /*
  * Set priv ptr
  *
@@ -331,6 +379,7 @@ static int sb_eth_start(struct udevice *dev)
 		priv->recv_packet_buffer[i] = net_rx_packets[i];
 		priv->recv_packet_length[i] = 0;
 	}
+	priv->lent_count = 0;
 
 	return 0;
 }
@@ -347,6 +396,57 @@ static int sb_eth_send(struct udevice *dev, void *packet, int length)
 	return priv->tx_handler(dev, packet, length);
 }
 
+/*
+ * sb_eth_split()
+ *
+ * Act like a controller putting the payloads of TCP and UDP packets apart
+ * from their headers, in buffers lent by eth_rx_lend()
+ *
+ * packet - the packet received
+ * len - its length
+ * Return: length of what is left of it
+ */
+static int sb_eth_split(struct udevice *dev, uchar *packet, int len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct ethernet_hdr *eth = (struct ethernet_hdr *)packet;
+	struct ip_tcp_hdr *ip = (void *)packet + ETHER_HDR_SIZE;
+	int hdr_len = 0;
+	void *buf;
+
+	while (priv->lent_count < SANDBOX_ETH_LENT) {
+		buf = eth_rx_take(dev, PKTSIZE);
+		if (!buf)
+			break;
+		priv->lent[priv->lent_count++] = buf;
+	}
+	if (!priv->lent_count)
+		return len;
+
+	buf = priv->lent[0];
+	priv->lent_count--;
+	memmove(priv->lent, priv->lent + 1, priv->lent_count * sizeof(buf));
+
+	if (len > ETHER_HDR_SIZE + IP_TCP_HDR_SIZE &&
+	    eth->et_protlen == htons(PROT_IP) &&
+	    !(ip->ip_off & htons(IP_OFFS | IP_FLAGS_MFRAG))) {
+		if (ip->ip_p == IPPROTO_UDP)
+			hdr_len = ETHER_HDR_SIZE + IP_UDP_HDR_SIZE;
+		else if (ip->ip_p == IPPROTO_TCP)
+			hdr_len = ETHER_HDR_SIZE + IP_HDR_SIZE +
+				  (ip->tcp_hlen >> 2);
+	}
+	if (!hdr_len || hdr_len >= len) {
+		eth_rx_give(dev, buf, 0);
+		return len;
+	}
+
+	memcpy(buf, packet + hdr_len, len - hdr_len);
+	eth_rx_give(dev, buf, len - hdr_len);
+
+	return hdr_len;
+}
+
 static int sb_eth_recv(struct udevice *dev, int flags, uchar **packetp)
 {
 	struct eth_sandbox_priv *priv = dev_get_priv(dev);
@@ -356,12 +456,18 @@ static int sb_eth_recv(struct udevice *dev, int flags, uchar **packetp)
 		skip_timeout = false;
 	}
 
+	if (priv->poll_handler)
+		priv->poll_handler(dev);
+
 	if (priv->recv_packets) {
 		int lcl_recv_packet_length = priv->recv_packet_length[0];
 
 		debug("eth_sandbox: received packet[%d], %d waiting\n",
 		      lcl_recv_packet_length, priv->recv_packets - 1);
 		*packetp = priv->recv_packet_buffer[0];
+		if (IS_ENABLED(CONFIG_NET_RX_LEND))
+			lcl_recv_packet_length = sb_eth_split(dev, *packetp,
+							      lcl_recv_packet_length);
 		return lcl_recv_packet_length;
 	}
 	return 0;
@@ -389,7 +495,10 @@ static int sb_eth_free_pkt(struct udevice *dev, uchar *packet, int length)
 
 static void sb_eth_stop(struct udevice *dev)
 {
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+
 	debug("eth_sandbox: Stop\n");
+	priv->lent_count = 0;
 }
 
 static int sb_eth_write_hwaddr(struct udevice *dev)
@@ -403,13 +512,37 @@ static int sb_eth_write_hwaddr(struct udevice *dev)
 	return 0;
 }
 
+static int sb_eth_mcast(struct udevice *dev, const u8 *enetaddr, int join)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+
+	debug("eth_sandbox %s: %s %pM\n", dev->name, join ? "Join" : "Leave",
+	      enetaddr);
+	if (join)
+		memcpy(priv->mcast_hwaddr, enetaddr, ARP_HLEN);
+	else
+		memset(priv->mcast_hwaddr, '\0', ARP_HLEN);
+
+	return 0;
+}
+
+static void sb_eth_get_stats(struct udevice *dev, struct eth_stats *stats)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+
+	stats->rx_dropped += priv->rx_dropped;
+	priv->rx_dropped = 0;
+}
+
 static const struct eth_ops sb_eth_ops = {
 	.start			= sb_eth_start,
 	.send			= sb_eth_send,
 	.recv			= sb_eth_recv,
 	.free_pkt		= sb_eth_free_pkt,
 	.stop			= sb_eth_stop,
+	.mcast			= sb_eth_mcast,
 	.write_hwaddr		= sb_eth_write_hwaddr,
+	.get_stats		= sb_eth_get_stats,
 };
 
 static int sb_eth_remove(struct udevice *dev)
@@ -18,7 +18,7 @@
 #include <linux/compat.h>
 #include "nvme.h"
 
-#define NVME_Q_DEPTH		2
+#define NVME_Q_DEPTH		CONFIG_NVME_QUEUE_DEPTH
 #define NVME_AQ_DEPTH		2
 #define NVME_SQ_SIZE(depth)	(depth * sizeof(struct nvme_command))
 #define NVME_CQ_SIZE(depth)	(depth * sizeof(struct nvme_completion))
@@ -26,7 +26,17 @@
 				      ARCH_DMA_MINALIGN)
 #define ADMIN_TIMEOUT		60
 #define IO_TIMEOUT		30
-#define MAX_PRP_POOL		512
+/* Largest transfer of one command, which bounds the PRP list of a slot */
+#define NVME_MAX_XFER_SHIFT	20
+
+/* Let controllers which need the CPU to run, such as the emulator, do so */
+static void nvme_poll_ctrl(struct nvme_dev *dev)
+{
+	struct nvme_ops *ops = (struct nvme_ops *)dev->udev->driver->ops;
+
+	if (ops && ops->poll)
+		ops->poll(dev);
+}
 
 static int nvme_wait_csts(struct nvme_dev *dev, u32 mask, u32 val)
 {
@@ -38,6 +48,7 @@ static int nvme_wait_csts(struct nvme_dev *dev, u32 mask, u32 val)
 
 	start = get_timer(0);
 	while (get_timer(start) < timeout) {
+		nvme_poll_ctrl(dev);
 		if ((readl(&dev->bar->csts) & mask) == val)
 			return 0;
 	}
@@ -45,22 +56,30 @@ static int nvme_wait_csts(struct nvme_dev *dev, u32 mask, u32 val)
 	return -ETIME;
 }
 
-static int nvme_setup_prps(struct nvme_dev *dev, u64 *prp2,
-			   int total_len, u64 dma_addr)
+/**
+ * nvme_setup_prps() - set up the PRP entries of an I/O command
+ *
+ * @dev:	NVMe device
+ * @prp2:	Returns the second PRP entry of the command
+ * @slot:	I/O slot of the command, whose PRP list is used if needed
+ * @total_len:	Number of bytes to transfer
+ * @dma_addr:	Address of the data
+ */
+static void nvme_setup_prps(struct nvme_dev *dev, u64 *prp2, int slot,
+			    int total_len, u64 dma_addr)
 {
 	u32 page_size = dev->page_size;
 	int offset = dma_addr & (page_size - 1);
-	u64 *prp_pool;
+	u32 prps_per_page = page_size >> 3;
+	u64 *prp_list, *prp_pool;
 	int length = total_len;
 	int i, nprps;
-	u32 prps_per_page = page_size >> 3;
-	u32 num_pages;
 
 	length -= (page_size - offset);
 
 	if (length <= 0) {
 		*prp2 = 0;
-		return 0;
+		return;
 	}
 
 	if (length)
@@ -68,45 +87,28 @@ static int nvme_setup_prps(struct nvme_dev *dev, u64 *prp2,
 
 	if (length <= page_size) {
 		*prp2 = dma_addr;
-		return 0;
+		return;
 	}
 
 	nprps = DIV_ROUND_UP(length, page_size);
-	num_pages = DIV_ROUND_UP(nprps - 1, prps_per_page - 1);
-
-	if (nprps > dev->prp_entry_num) {
-		free(dev->prp_pool);
-		/*
-		 * Always increase in increments of pages.  It doesn't waste
-		 * much memory and reduces the number of allocations.
-		 */
-		dev->prp_pool = memalign(page_size, num_pages * page_size);
-		if (!dev->prp_pool) {
-			printf("Error: malloc prp_pool fail\n");
-			return -ENOMEM;
-		}
-		dev->prp_entry_num = num_pages * (prps_per_page - 1) + 1;
-	}
-
-	prp_pool = dev->prp_pool;
+	prp_list = dev->prp_pool + slot * dev->prp_pages * prps_per_page;
+	prp_pool = prp_list;
 	i = 0;
 	while (nprps) {
 		if ((i == (prps_per_page - 1)) && nprps > 1) {
 			*(prp_pool + i) = cpu_to_le64((ulong)prp_pool +
 					page_size);
 			i = 0;
-			prp_pool += page_size;
+			prp_pool += prps_per_page;
 		}
 		*(prp_pool + i++) = cpu_to_le64(dma_addr);
 		dma_addr += page_size;
 		nprps--;
 	}
-	*prp2 = (ulong)dev->prp_pool;
-
-	flush_dcache_range((ulong)dev->prp_pool, (ulong)dev->prp_pool +
-			   num_pages * page_size);
+	*prp2 = (ulong)prp_list;
 
-	return 0;
+	flush_dcache_range((ulong)prp_list, (ulong)prp_list +
+			   dev->prp_pages * page_size);
 }
 
 static __le16 nvme_get_cmd_id(void)
@@ -176,6 +178,7 @@ static int nvme_submit_sync_cmd(struct nvme_queue *nvmeq,
 	start_time = timer_get_us();
 
 	for (;;) {
+		nvme_poll_ctrl(nvmeq->dev);
 		status = nvme_read_completion_status(nvmeq, head);
 		if ((status & 0x01) == phase)
 			break;
@@ -632,7 +635,8 @@ static int nvme_get_info_from_identify(struct nvme_dev *dev)
 	memcpy(dev->model, ctrl->mn, sizeof(ctrl->mn));
 	memcpy(dev->firmware_rev, ctrl->fr, sizeof(ctrl->fr));
 	if (ctrl->mdts)
-		dev->max_transfer_shift = (ctrl->mdts + shift);
+		dev->max_transfer_shift = min(ctrl->mdts + shift,
+					      NVME_MAX_XFER_SHIFT);
 	else {
 		/*
 		 * Maximum Data Transfer Size (MDTS) field indicates the maximum
@@ -659,6 +663,35 @@ static int nvme_get_info_from_identify(struct nvme_dev *dev)
 	return 0;
 }
 
+/*
+ * Allocate the state of the I/O commands which may be in flight, with a
+ * PRP list for each
+ */
+static int nvme_alloc_io(struct nvme_dev *dev)
+{
+	struct nvme_ops *ops = (struct nvme_ops *)dev->udev->driver->ops;
+	u32 nprps = (1 << dev->max_transfer_shift) / dev->page_size;
+	u32 prps_per_page = dev->page_size >> 3;
+
+	/* a controller-specific submission takes one command at a time */
+	if (ops && ops->submit_cmd)
+		dev->io_slots = 1;
+	else	/* a queue is full when one entry is left */
+		dev->io_slots = dev->q_depth - 1;
+
+	dev->prp_pages = max(DIV_ROUND_UP(nprps, prps_per_page - 1), 1U);
+	dev->prp_pool = memalign(dev->page_size,
+				 dev->io_slots * dev->prp_pages * dev->page_size);
+	dev->io = calloc(dev->io_slots, sizeof(*dev->io));
+	if (!dev->prp_pool || !dev->io) {
+		free(dev->prp_pool);
+		free(dev->io);
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
 int nvme_get_namespace_id(struct udevice *udev, u32 *ns_id, u8 *eui64)
 {
 	struct nvme_ns *ns = dev_get_priv(udev);
@@ -728,65 +761,214 @@ static int nvme_blk_probe(struct udevice *udev)
 	return 0;
 }
 
-static ulong nvme_blk_rw(struct udevice *udev, lbaint_t blknr,
-			 lbaint_t blkcnt, void *buffer, bool read)
+/* Complete @req, which is over */
+static void nvme_io_finish(struct nvme_ns *ns, struct blk_req *req)
 {
-	struct nvme_ns *ns = dev_get_priv(udev);
-	struct nvme_dev *dev = ns->dev;
-	struct nvme_command c;
-	struct blk_desc *desc = dev_get_uclass_plat(udev);
-	int status;
-	u64 prp2;
-	u64 total_len = blkcnt << desc->log2blksz;
-	u64 temp_len = total_len;
-	uintptr_t temp_buffer = (uintptr_t)buffer;
-
-	u64 slba = blknr;
-	u16 lbas = 1 << (dev->max_transfer_shift - ns->lba_shift);
-	u64 total_lbas = blkcnt;
-
-	flush_dcache_range((unsigned long)buffer,
-			   (unsigned long)buffer + total_len);
-
-	c.rw.opcode = read ? nvme_cmd_read : nvme_cmd_write;
-	c.rw.flags = 0;
-	c.rw.nsid = cpu_to_le32(ns->ns_id);
-	c.rw.control = 0;
-	c.rw.dsmgmt = 0;
-	c.rw.reftag = 0;
-	c.rw.apptag = 0;
-	c.rw.appmask = 0;
-	c.rw.metadata = 0;
-
-	while (total_lbas) {
-		if (total_lbas < lbas) {
-			lbas = (u16)total_lbas;
-			total_lbas = 0;
-		} else {
-			total_lbas -= lbas;
-		}
+	long result = req->result;
+
+	if (req->op == BLK_REQ_READ)
+		invalidate_dcache_range((ulong)req->buffer, (ulong)req->buffer +
+					(req->blkcnt << ns->lba_shift));
+	if (!result && req->blkcnt)
+		result = -EIO;
+	blk_req_done(req, result);
+}
+
+/* Complete @req if it is fully submitted and none of it is in flight */
+static void nvme_io_check(struct nvme_dev *dev, struct nvme_ns *ns,
+			  struct blk_req *req)
+{
+	int i;
+
+	if (req == dev->io_issuing)
+		return;
+	for (i = 0; i < dev->io_slots; i++) {
+		if (dev->io[i].req == req)
+			return;
+	}
 
-		if (nvme_setup_prps(dev, &prp2,
-				    lbas << ns->lba_shift, temp_buffer))
-			return -EIO;
-		c.rw.slba = cpu_to_le64(slba);
-		slba += lbas;
+	nvme_io_finish(ns, req);
+}
+
+/*
+ * Submit commands for the request being issued while there are free
+ * slots. While a request is pending, @priv counts the blocks submitted
+ * and @result the blocks before the first failed command.
+ */
+static void nvme_io_issue(struct nvme_dev *dev)
+{
+	struct nvme_queue *nvmeq = dev->queues[NVME_IO_Q];
+	struct blk_req *req = dev->io_issuing;
+	struct nvme_ns *ns = dev->io_ns;
+	u16 max_lbas = 1 << (dev->max_transfer_shift - ns->lba_shift);
+	struct nvme_command c;
+	int slot = 0;
+
+	while (req->priv < req->blkcnt && req->result == req->blkcnt &&
+	       dev->io_busy < dev->io_slots) {
+		lbaint_t off = req->priv;
+		u16 lbas = min_t(lbaint_t, req->blkcnt - off, max_lbas);
+		uintptr_t buf = (uintptr_t)req->buffer + (off << ns->lba_shift);
+		struct nvme_io *io;
+		u64 prp2;
+
+		while (dev->io[slot].busy)
+			slot++;
+		io = &dev->io[slot];
+		nvme_setup_prps(dev, &prp2, slot, lbas << ns->lba_shift, buf);
+
+		memset(&c, 0, sizeof(c));
+		c.rw.opcode = req->op == BLK_REQ_READ ? nvme_cmd_read :
+			nvme_cmd_write;
+		c.rw.command_id = cpu_to_le16(slot);
+		c.rw.nsid = cpu_to_le32(ns->ns_id);
+		c.rw.slba = cpu_to_le64(req->start + off);
 		c.rw.length = cpu_to_le16(lbas - 1);
-		c.rw.prp1 = cpu_to_le64(temp_buffer);
+		c.rw.prp1 = cpu_to_le64(buf);
 		c.rw.prp2 = cpu_to_le64(prp2);
-		status = nvme_submit_sync_cmd(dev->queues[NVME_IO_Q],
-				&c, NULL, IO_TIMEOUT);
-		if (status)
+
+		if (!dev->io_busy)
+			dev->io_time = timer_get_us();
+		io->busy = true;
+		io->req = req;
+		io->ns = ns;
+		io->off = off;
+		io->lbas = lbas;
+		io->sq_idx = nvmeq->sq_tail;
+		dev->io_busy++;
+		req->priv += lbas;
+		nvme_submit_cmd(nvmeq, &c);
+	}
+
+	if (req->priv == req->blkcnt || req->result != req->blkcnt) {
+		dev->io_issuing = NULL;
+		nvme_io_check(dev, ns, req);
+	}
+}
+
+/* Start a request, or return -EBUSY if another is still being issued */
+static int nvme_io_start(struct nvme_ns *ns, struct blk_req *req)
+{
+	struct nvme_dev *dev = ns->dev;
+
+	if (dev->io_issuing)
+		return -EBUSY;
+
+	flush_dcache_range((ulong)req->buffer, (ulong)req->buffer +
+			   (req->blkcnt << ns->lba_shift));
+	req->priv = 0;
+	req->result = req->blkcnt;
+	dev->io_issuing = req;
+	dev->io_ns = ns;
+	nvme_io_issue(dev);
+
+	return 0;
+}
+
+/* Fail all requests in flight, leaving their slots to the controller */
+static void nvme_io_abandon(struct nvme_dev *dev)
+{
+	int i;
+
+	for (i = 0; i < dev->io_slots; i++) {
+		struct nvme_io *io = &dev->io[i];
+
+		if (io->req) {
+			blk_req_done(io->req, -ETIMEDOUT);
+			io->req = NULL;
+		}
+	}
+	if (dev->io_issuing) {
+		blk_req_done(dev->io_issuing, -ETIMEDOUT);
+		dev->io_issuing = NULL;
+	}
+}
+
+/*
+ * Reap all completed I/O commands, with a single doorbell write for the
+ * batch, then use the free slots for the request being issued.
+ */
+static int nvme_io_poll(struct nvme_dev *dev)
+{
+	struct nvme_ops *ops = (struct nvme_ops *)dev->udev->driver->ops;
+	struct nvme_queue *nvmeq = dev->queues[NVME_IO_Q];
+	u16 head = nvmeq->cq_head;
+	u16 phase = nvmeq->cq_phase;
+	int reaped = 0;
+
+	nvme_poll_ctrl(dev);
+	while (dev->io_busy) {
+		u16 status = nvme_read_completion_status(nvmeq, head);
+		struct blk_req *req;
+		struct nvme_io *io;
+		u16 slot;
+
+		if ((status & 0x01) != phase)
 			break;
-		temp_len -= (u32)lbas << ns->lba_shift;
-		temp_buffer += lbas << ns->lba_shift;
+		slot = le16_to_cpu(readw(&nvmeq->cqes[head].command_id));
+		if (++head == nvmeq->q_depth) {
+			head = 0;
+			phase = !phase;
+		}
+		reaped++;
+		if (slot >= dev->io_slots || !dev->io[slot].busy)
+			continue;
+
+		io = &dev->io[slot];
+		if (ops && ops->complete_cmd)
+			ops->complete_cmd(nvmeq, &nvmeq->sq_cmds[io->sq_idx]);
+		io->busy = false;
+		dev->io_busy--;
+		req = io->req;
+		if (!req)
+			continue;
+		io->req = NULL;
+		status >>= 1;
+		if (status) {
+			printf("ERROR: status = %x, lba = " LBAFU "\n", status,
+			       req->start + io->off);
+			req->result = min_t(long, req->result, io->off);
+		}
+		nvme_io_check(dev, io->ns, req);
+	}
+
+	if (reaped) {
+		writel(head, nvmeq->q_db + dev->db_stride);
+		nvmeq->cq_head = head;
+		nvmeq->cq_phase = phase;
+		dev->io_time = timer_get_us();
+	}
+	if (dev->io_issuing)
+		nvme_io_issue(dev);
+
+	if (dev->io_busy &&
+	    timer_get_us() - dev->io_time >= IO_TIMEOUT * 100000) {
+		nvme_io_abandon(dev);
+		return -ETIMEDOUT;
 	}
 
-	if (read)
-		invalidate_dcache_range((unsigned long)buffer,
-					(unsigned long)buffer + total_len);
+	return 0;
+}
 
-	return (total_len - temp_len) >> desc->log2blksz;
+static ulong nvme_blk_rw(struct udevice *udev, lbaint_t blknr,
+			 lbaint_t blkcnt, void *buffer, bool read)
+{
+	struct nvme_ns *ns = dev_get_priv(udev);
+	struct nvme_dev *dev = ns->dev;
+	struct blk_req req = {
+		.op = read ? BLK_REQ_READ : BLK_REQ_WRITE,
+		.start = blknr,
+		.blkcnt = blkcnt,
+		.buffer = buffer,
+	};
+
+	INIT_LIST_HEAD(&req.sibling);
+	while (nvme_io_start(ns, &req) == -EBUSY)
+		nvme_io_poll(dev);
+	while (!req.done)
+		nvme_io_poll(dev);
+
+	return req.result < 0 ? 0 : req.result;
 }
 
 static ulong nvme_blk_read(struct udevice *udev, lbaint_t blknr,
@@ -801,9 +983,23 @@ static ulong nvme_blk_write(struct udevice *udev, lbaint_t blknr,
 	return nvme_blk_rw(udev, blknr, blkcnt, (void *)buffer, false);
 }
 
+static int nvme_blk_submit(struct udevice *udev, struct blk_req *req)
+{
+	return nvme_io_start(dev_get_priv(udev), req);
+}
+
+static int nvme_blk_poll(struct udevice *udev)
+{
+	struct nvme_ns *ns = dev_get_priv(udev);
+
+	return nvme_io_poll(ns->dev);
+}
+
 static const struct blk_ops nvme_blk_ops = {
 	.read	= nvme_blk_read,
 	.write	= nvme_blk_write,
+	.submit	= nvme_blk_submit,
+	.poll	= nvme_blk_poll,
 };
 
 U_BOOT_DRIVER(nvme_blk) = {
@@ -845,20 +1041,19 @@ int nvme_init(struct udevice *udev)
 	if (ret)
 		goto free_queue;
 
-	/* Allocate after the page size is known */
-	ndev->prp_pool = memalign(ndev->page_size, MAX_PRP_POOL);
-	if (!ndev->prp_pool) {
-		ret = -ENOMEM;
-		printf("Error: %s: Out of memory!\n", udev->name);
-		goto free_nvme;
-	}
-	ndev->prp_entry_num = MAX_PRP_POOL >> 3;
-
 	ret = nvme_setup_io_queues(ndev);
 	if (ret)
 		goto free_queue;
 
-	nvme_get_info_from_identify(ndev);
+	ret = nvme_get_info_from_identify(ndev);
+	if (ret)
+		goto free_queue;
+
+	ret = nvme_alloc_io(ndev);
+	if (ret) {
+		printf("Error: %s: Out of memory!\n", udev->name);
+		goto free_queue;
+	}
 
 	/* Create a blk device for each namespace */
 
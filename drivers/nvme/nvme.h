@@ -7,6 +7,7 @@
 #ifndef __DRIVER_NVME_H__
 #define __DRIVER_NVME_H__
 
+#include <blk.h>
 #include <asm/io.h>
 
 struct nvme_id_power_state {
@@ -618,9 +619,34 @@ struct nvme_dev {
 	u32 stripe_size;
 	u32 page_size;
 	u8 vwc;
-	u64 *prp_pool;
-	u32 prp_entry_num;
+	u64 *prp_pool;		/* PRP lists, prp_pages pages per I/O slot */
+	u32 prp_pages;
 	u32 nn;
+	struct nvme_io *io;	/* I/O commands, indexed by command ID */
+	u16 io_slots;		/* I/O commands which may be in flight */
+	u16 io_busy;		/* I/O commands in flight */
+	ulong io_time;		/* timer_get_us() of the last I/O progress */
+	struct blk_req *io_issuing;	/* request not fully submitted yet */
+	struct nvme_ns *io_ns;		/* namespace of io_issuing */
+};
+
+/**
+ * struct nvme_io - An I/O command in flight
+ *
+ * @busy: true if the slot holds a command which has not completed
+ * @req: Block request the command is part of, or NULL if that was abandoned
+ * @ns: Namespace the command is for
+ * @off: Offset of the first block of the command within @req
+ * @lbas: Number of blocks the command transfers
+ * @sq_idx: Submission queue entry the command was written to
+ */
+struct nvme_io {
+	bool busy;
+	struct blk_req *req;
+	struct nvme_ns *ns;
+	lbaint_t off;
+	u16 lbas;
+	u16 sq_idx;
 };
 
 /* Admin queue and a single I/O queue. */
@@ -689,6 +715,16 @@ struct nvme_ops {
 	 * @cmd:   NVM Express command
 	 */
 	void (*complete_cmd)(struct nvme_queue *nvmeq, struct nvme_command *cmd);
+	/**
+	 * poll - Let the controller make progress
+	 *
+	 * This is called while waiting for the controller, for controllers
+	 * which need the CPU to run, such as the sandbox emulator. It is
+	 * not needed for hardware.
+	 *
+	 * @dev:   NVM Express device
+	 */
+	void (*poll)(struct nvme_dev *dev);
 };
 
 /**
@@ -0,0 +1,370 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Emulator of an NVMe controller for sandbox, backed by a RAM disk
+ *
+ * The controller runs when the driver polls it. Commands are carried out
+ * as soon as they are fetched, but I/O commands are only reported complete
+ * after a configurable latency, so that tests can tell whether the driver
+ * keeps several commands in flight.
+ */
+
+#include <common.h>
+#include <dm.h>
+#include <malloc.h>
+#include <time.h>
+#include <asm/test.h>
+#include "nvme.h"
+
+#define SB_NVME_LBA_SHIFT	9
+#define SB_NVME_BLKS		0x2000		/* 4 MiB */
+#define SB_NVME_MDTS		5		/* 128 KiB per command */
+#define SB_NVME_MQES		1023
+#define SB_NVME_MAX_CMDS	1024
+#define SB_NVME_DBS		4096		/* offset of the doorbells */
+#define SB_NVME_BAR_SIZE	(SB_NVME_DBS + NVME_Q_NUM * 2 * sizeof(u32))
+
+/**
+ * struct sb_nvme_queue - A queue pair as seen by the controller
+ *
+ * @sq: Submission queue, or NULL if it does not exist
+ * @cq: Completion queue, or NULL if it does not exist
+ * @depth: Number of entries of each queue
+ * @sq_head: Next submission queue entry to fetch
+ * @cq_tail: Next completion queue entry to fill
+ * @phase: Phase tag of the completions being posted
+ */
+struct sb_nvme_queue {
+	struct nvme_command *sq;
+	struct nvme_completion *cq;
+	u16 depth;
+	u16 sq_head;
+	u16 cq_tail;
+	u8 phase;
+};
+
+/**
+ * struct sb_nvme_cmd - A command carried out but not yet reported complete
+ *
+ * @qid: Queue the command was fetched from
+ * @command_id: ID of the command
+ * @status: Status code to report
+ * @result: Command-specific result to report
+ * @due: timer_get_us() from which the completion may be posted
+ */
+struct sb_nvme_cmd {
+	u16 qid;
+	u16 command_id;
+	u16 status;
+	u32 result;
+	ulong due;
+};
+
+/**
+ * struct sandbox_nvme_priv - Private data of the emulator
+ *
+ * @ndev: NVMe device used by the driver, which must come first
+ * @bar: Controller registers, followed by the doorbells
+ * @disk: Contents of the namespace
+ * @queues: Queue pairs created by the driver
+ * @cmds: Commands waiting for their completion to be posted
+ * @num_cmds: Number of entries in @cmds
+ * @latency_us: Time taken by each I/O command
+ * @io_cmds: Number of I/O commands carried out
+ * @max_inflight: Most I/O commands in flight at once
+ */
+struct sandbox_nvme_priv {
+	struct nvme_dev ndev;
+	struct nvme_bar *bar;
+	u8 *disk;
+	struct sb_nvme_queue queues[NVME_Q_NUM];
+	struct sb_nvme_cmd cmds[SB_NVME_MAX_CMDS];
+	int num_cmds;
+	ulong latency_us;
+	uint io_cmds;
+	uint max_inflight;
+};
+
+static u32 *sb_nvme_db(struct sandbox_nvme_priv *priv, int qid, bool cq)
+{
+	return (void *)priv->bar + SB_NVME_DBS + (qid * 2 + cq) * sizeof(u32);
+}
+
+static u16 sb_nvme_admin(struct sandbox_nvme_priv *priv,
+			 struct nvme_command *cmd, u32 *result)
+{
+	struct sb_nvme_queue *q;
+	void *buf;
+	u16 qid;
+
+	switch (cmd->common.opcode) {
+	case nvme_admin_identify:
+		/* the driver always passes a page-aligned page */
+		buf = (void *)(uintptr_t)le64_to_cpu(cmd->identify.prp1);
+		memset(buf, '\0', priv->ndev.page_size);
+		if (le32_to_cpu(cmd->identify.cns) == 1) {
+			struct nvme_id_ctrl *ctrl = buf;
+
+			memcpy(ctrl->sn, "SB0001", 6);
+			memcpy(ctrl->mn, "Sandbox NVMe", 12);
+			memcpy(ctrl->fr, "1.0", 3);
+			ctrl->mdts = SB_NVME_MDTS;
+			ctrl->nn = cpu_to_le32(1);
+		} else {
+			struct nvme_id_ns *id = buf;
+
+			if (le32_to_cpu(cmd->identify.nsid) != 1)
+				return NVME_SC_INVALID_NS;
+			id->nsze = cpu_to_le64(SB_NVME_BLKS);
+			id->ncap = id->nsze;
+			id->lbaf[0].ds = SB_NVME_LBA_SHIFT;
+		}
+		return NVME_SC_SUCCESS;
+	case nvme_admin_get_features:
+	case nvme_admin_set_features:
+		/* one I/O queue pair, nothing else to report */
+		*result = 0;
+		return NVME_SC_SUCCESS;
+	case nvme_admin_create_cq:
+		qid = le16_to_cpu(cmd->create_cq.cqid);
+		if (!qid || qid >= NVME_Q_NUM)
+			return NVME_SC_QID_INVALID;
+		q = &priv->queues[qid];
+		q->cq = (void *)(uintptr_t)le64_to_cpu(cmd->create_cq.prp1);
+		q->depth = le16_to_cpu(cmd->create_cq.qsize) + 1;
+		q->cq_tail = 0;
+		q->phase = 1;
+		return NVME_SC_SUCCESS;
+	case nvme_admin_create_sq:
+		qid = le16_to_cpu(cmd->create_sq.sqid);
+		if (!qid || qid >= NVME_Q_NUM || !priv->queues[qid].cq)
+			return NVME_SC_QID_INVALID;
+		q = &priv->queues[qid];
+		q->sq = (void *)(uintptr_t)le64_to_cpu(cmd->create_sq.prp1);
+		q->sq_head = 0;
+		return NVME_SC_SUCCESS;
+	case nvme_admin_delete_sq:
+	case nvme_admin_delete_cq:
+		qid = le16_to_cpu(cmd->delete_queue.qid);
+		if (!qid || qid >= NVME_Q_NUM)
+			return NVME_SC_QID_INVALID;
+		q = &priv->queues[qid];
+		if (cmd->common.opcode == nvme_admin_delete_sq)
+			q->sq = NULL;
+		else
+			q->cq = NULL;
+		return NVME_SC_SUCCESS;
+	default:
+		return NVME_SC_INVALID_OPCODE;
+	}
+}
+
+/* Copy the data of a read or write, following its PRP entries */
+static u16 sb_nvme_rw(struct sandbox_nvme_priv *priv, struct nvme_command *cmd)
+{
+	struct nvme_rw_command *rw = &cmd->rw;
+	u32 page_size = priv->ndev.page_size;
+	u32 prps_per_page = page_size >> 3;
+	u64 slba = le64_to_cpu(rw->slba);
+	uint blks = le16_to_cpu(rw->length) + 1;
+	uint len = blks << SB_NVME_LBA_SHIFT;
+	u64 addr = le64_to_cpu(rw->prp1);
+	u64 *list = NULL;
+	u8 *disk;
+	int i = 0;
+
+	if (rw->opcode != nvme_cmd_read && rw->opcode != nvme_cmd_write)
+		return NVME_SC_INVALID_OPCODE;
+	if (le32_to_cpu(rw->nsid) != 1)
+		return NVME_SC_INVALID_NS;
+	if (slba + blks > SB_NVME_BLKS)
+		return NVME_SC_LBA_RANGE;
+	if (len > page_size << SB_NVME_MDTS)
+		return NVME_SC_INVALID_FIELD;
+
+	disk = priv->disk + (slba << SB_NVME_LBA_SHIFT);
+	for (;;) {
+		uint chunk = min(len, page_size - (uint)(addr & (page_size - 1)));
+		void *mem = (void *)(uintptr_t)addr;
+
+		if (rw->opcode == nvme_cmd_read)
+			memcpy(mem, disk, chunk);
+		else
+			memcpy(disk, mem, chunk);
+		disk += chunk;
+		len -= chunk;
+		if (!len)
+			break;
+
+		/* PRP2 is the second page, or a list of the following ones */
+		if (!list && len <= page_size) {
+			addr = le64_to_cpu(rw->prp2);
+			continue;
+		}
+		if (!list)
+			list = (u64 *)(uintptr_t)le64_to_cpu(rw->prp2);
+		if (i == prps_per_page - 1 && len > page_size) {
+			list = (u64 *)(uintptr_t)le64_to_cpu(list[i]);
+			i = 0;
+		}
+		addr = le64_to_cpu(list[i++]);
+	}
+
+	return NVME_SC_SUCCESS;
+}
+
+static void sb_nvme_exec(struct sandbox_nvme_priv *priv, u16 qid,
+			 struct nvme_command *cmd)
+{
+	struct sb_nvme_cmd *pend = &priv->cmds[priv->num_cmds++];
+	uint inflight = 0;
+	int i;
+
+	pend->qid = qid;
+	pend->command_id = cmd->common.command_id;
+	pend->result = 0;
+	pend->due = timer_get_us();
+	if (qid == NVME_ADMIN_Q) {
+		pend->status = sb_nvme_admin(priv, cmd, &pend->result);
+		return;
+	}
+
+	pend->status = sb_nvme_rw(priv, cmd);
+	pend->due += priv->latency_us;
+	priv->io_cmds++;
+	for (i = 0; i < priv->num_cmds; i++) {
+		if (priv->cmds[i].qid != NVME_ADMIN_Q)
+			inflight++;
+	}
+	priv->max_inflight = max(priv->max_inflight, inflight);
+}
+
+/* Post the completions which are due, while there is room for them */
+static void sb_nvme_complete(struct sandbox_nvme_priv *priv)
+{
+	ulong now = timer_get_us();
+	int i, left = 0;
+
+	for (i = 0; i < priv->num_cmds; i++) {
+		struct sb_nvme_cmd *pend = &priv->cmds[i];
+		struct sb_nvme_queue *q = &priv->queues[pend->qid];
+		struct nvme_completion *cqe;
+
+		if (!q->cq)
+			continue;
+		if ((long)(now - pend->due) < 0 ||
+		    (q->cq_tail + 1) % q->depth == *sb_nvme_db(priv, pend->qid,
+							       true)) {
+			priv->cmds[left++] = *pend;
+			continue;
+		}
+
+		cqe = &q->cq[q->cq_tail];
+		cqe->result = cpu_to_le32(pend->result);
+		cqe->sq_head = cpu_to_le16(q->sq_head);
+		cqe->sq_id = cpu_to_le16(pend->qid);
+		cqe->command_id = pend->command_id;
+		cqe->status = cpu_to_le16(pend->status << 1 | q->phase);
+		if (++q->cq_tail == q->depth) {
+			q->cq_tail = 0;
+			q->phase = !q->phase;
+		}
+	}
+	priv->num_cmds = left;
+}
+
+static void sandbox_nvme_poll(struct nvme_dev *ndev)
+{
+	struct sandbox_nvme_priv *priv =
+		container_of(ndev, struct sandbox_nvme_priv, ndev);
+	struct nvme_bar *bar = priv->bar;
+	int qid;
+
+	if (!(bar->cc & NVME_CC_ENABLE)) {
+		bar->csts = 0;
+		memset(priv->queues, '\0', sizeof(priv->queues));
+		priv->num_cmds = 0;
+		return;
+	}
+
+	if (!(bar->csts & NVME_CSTS_RDY)) {
+		struct sb_nvme_queue *q = &priv->queues[NVME_ADMIN_Q];
+
+		q->sq = (void *)(uintptr_t)bar->asq;
+		q->cq = (void *)(uintptr_t)bar->acq;
+		q->depth = (bar->aqa & 0xfff) + 1;
+		q->phase = 1;
+		bar->csts |= NVME_CSTS_RDY;
+	}
+	if (bar->cc & NVME_CC_SHN_MASK)
+		bar->csts |= NVME_CSTS_SHST_CMPLT;
+
+	for (qid = 0; qid < NVME_Q_NUM; qid++) {
+		struct sb_nvme_queue *q = &priv->queues[qid];
+
+		while (q->sq && q->sq_head != *sb_nvme_db(priv, qid, false) &&
+		       priv->num_cmds < SB_NVME_MAX_CMDS) {
+			sb_nvme_exec(priv, qid, &q->sq[q->sq_head]);
+			if (++q->sq_head == q->depth)
+				q->sq_head = 0;
+		}
+	}
+	sb_nvme_complete(priv);
+}
+
+void sandbox_nvme_set_latency(struct udevice *dev, ulong latency_us)
+{
+	struct sandbox_nvme_priv *priv = dev_get_priv(dev);
+
+	priv->latency_us = latency_us;
+}
+
+void sandbox_nvme_get_stats(struct udevice *dev, uint *cmdsp,
+			    uint *max_inflightp)
+{
+	struct sandbox_nvme_priv *priv = dev_get_priv(dev);
+
+	*cmdsp = priv->io_cmds;
+	*max_inflightp = priv->max_inflight;
+}
+
+static int sandbox_nvme_probe(struct udevice *dev)
+{
+	struct sandbox_nvme_priv *priv = dev_get_priv(dev);
+
+	priv->bar = memalign(SB_NVME_DBS, SB_NVME_BAR_SIZE);
+	priv->disk = calloc(SB_NVME_BLKS, 1 << SB_NVME_LBA_SHIFT);
+	if (!priv->bar || !priv->disk)
+		return -ENOMEM;
+	memset(priv->bar, '\0', SB_NVME_BAR_SIZE);
+
+	/* 500ms timeout, no doorbell stride, 4KiB pages */
+	priv->bar->cap = SB_NVME_MQES | 1ULL << 24;
+	strcpy(priv->ndev.vendor, "sandbox");
+	priv->ndev.bar = priv->bar;
+
+	return nvme_init(dev);
+}
+
+static int sandbox_nvme_remove(struct udevice *dev)
+{
+	struct sandbox_nvme_priv *priv = dev_get_priv(dev);
+
+	nvme_shutdown(dev);
+	free(priv->disk);
+	free(priv->bar);
+
+	return 0;
+}
+
+static const struct nvme_ops sandbox_nvme_ops = {
+	.poll	= sandbox_nvme_poll,
+};
+
+U_BOOT_DRIVER(sandbox_nvme) = {
+	.name		= "sandbox_nvme",
+	.id		= UCLASS_NVME,
+	.probe		= sandbox_nvme_probe,
+	.remove		= sandbox_nvme_remove,
+	.ops		= &sandbox_nvme_ops,
+	.priv_auto	= sizeof(struct sandbox_nvme_priv),
+};
@@ -31,6 +31,7 @@
 
 /* Quirks */
 #define CQSPI_DISABLE_STIG_MODE		BIT(0)
+#define CQSPI_DTR_USE_DQS		BIT(1)
 
 __weak int cadence_qspi_apb_dma_read(struct cadence_spi_priv *priv,
 				     const struct spi_mem_op *op)
@@ -75,79 +76,82 @@ static int cadence_spi_read_id(struct cadence_spi_priv *priv, u8 len,
 	return err;
 }
 
-/* Calibration sequence to determine the read data capture delay register */
-static int spi_calibration(struct udevice *bus, uint hz)
+static int cadence_spi_set_tap(struct udevice *bus, uint tap)
 {
 	struct cadence_spi_priv *priv = dev_get_priv(bus);
-	void *base = priv->regbase;
-	unsigned int idcode = 0, temp = 0;
-	int err = 0, i, range_lo = -1, range_hi = -1;
 
-	/* start with slowest clock (1 MHz) */
-	cadence_spi_write_speed(bus, 1000000);
+	/* this leaves the controller disabled */
+	cadence_qspi_apb_readdata_capture(priv->regbase, 1, tap);
+	cadence_qspi_apb_controller_enable(priv->regbase);
 
-	/* configure the read data capture delay register to 0 */
-	cadence_qspi_apb_readdata_capture(base, 1, 0);
+	return 0;
+}
 
-	/* Enable QSPI */
-	cadence_qspi_apb_controller_enable(base);
+static int cadence_spi_read_pattern(struct udevice *bus, u8 *buf, uint len)
+{
+	return cadence_spi_read_id(dev_get_priv(bus), len, buf);
+}
+
+/* Calibration sequence to determine the read data capture delay register */
+static int spi_calibration(struct udevice *bus, uint hz)
+{
+	struct cadence_spi_priv *priv = dev_get_priv(bus);
+	int cs = spi_chip_select(bus);
+	u8 idcode[3], temp[3];
+	struct spi_tap_scan scan = {
+		.taps = CQSPI_READ_CAPTURE_MAX_DELAY,
+		.set_tap = cadence_spi_set_tap,
+		.read = cadence_spi_read_pattern,
+		.pattern = idcode,
+		.len = sizeof(idcode),
+	};
+	int err, tap, range_lo, range_hi;
+
+	/* start with slowest clock (1 MHz) and a read delay of 0 */
+	cadence_spi_write_speed(bus, 1000000);
+	cadence_spi_set_tap(bus, 0);
 
 	/* read the ID which will be our golden value */
-	err = cadence_spi_read_id(priv, 3, (u8 *)&idcode);
+	err = cadence_spi_read_id(priv, sizeof(idcode), idcode);
 	if (err) {
 		puts("SF: Calibration failed (read)\n");
 		return err;
 	}
 
-	/* use back the intended clock and find low range */
+	/* use back the intended clock */
 	cadence_spi_write_speed(bus, hz);
-	for (i = 0; i < CQSPI_READ_CAPTURE_MAX_DELAY; i++) {
-		/* Disable QSPI */
-		cadence_qspi_apb_controller_disable(base);
-
-		/* reconfigure the read data capture delay register */
-		cadence_qspi_apb_readdata_capture(base, 1, i);
-
-		/* Enable back QSPI */
-		cadence_qspi_apb_controller_enable(base);
-
-		/* issue a RDID to get the ID value */
-		err = cadence_spi_read_id(priv, 3, (u8 *)&temp);
-		if (err) {
-			puts("SF: Calibration failed (read)\n");
-			return err;
-		}
 
-		/* search for range lo */
-		if (range_lo == -1 && temp == idcode) {
-			range_lo = i;
-			continue;
+	/* a delay found on an earlier boot only needs a single check */
+	tap = spi_tap_cache_get(bus, hz, cs, idcode, sizeof(idcode));
+	if (tap >= 0 && tap < CQSPI_READ_CAPTURE_MAX_DELAY) {
+		cadence_spi_set_tap(bus, tap);
+		err = cadence_spi_read_id(priv, sizeof(temp), temp);
+		if (!err && !memcmp(temp, idcode, sizeof(idcode))) {
+			debug("SF: Read data capture delay %i from cache\n",
+			      tap);
+			goto done;
 		}
-
-		/* search for range hi */
-		if (range_lo != -1 && temp != idcode) {
-			range_hi = i - 1;
-			break;
-		}
-		range_hi = i;
 	}
 
-	if (range_lo == -1) {
+	tap = spi_scan_taps(bus, &scan, &range_lo, &range_hi);
+	if (tap == -ENOENT) {
 		puts("SF: Calibration failed (low range)\n");
-		return err;
+		return tap;
+	} else if (tap < 0) {
+		puts("SF: Calibration failed (read)\n");
+		return tap;
 	}
-
-	/* Disable QSPI for subsequent initialization */
-	cadence_qspi_apb_controller_disable(base);
-
-	/* configure the final value for read data capture delay register */
-	cadence_qspi_apb_readdata_capture(base, 1, (range_hi + range_lo) / 2);
 	debug("SF: Read data capture delay calibrated to %i (%i - %i)\n",
-	      (range_hi + range_lo) / 2, range_lo, range_hi);
+	      tap, range_lo, range_hi);
+	spi_tap_cache_set(bus, hz, cs, idcode, sizeof(idcode), tap);
+
+done:
+	/* configure the final value, leaving QSPI disabled */
+	cadence_qspi_apb_readdata_capture(priv->regbase, 1, tap);
 
 	/* just to ensure we do once only when speed or chip select change */
 	priv->qspi_calibrated_hz = hz;
-	priv->qspi_calibrated_cs = spi_chip_select(bus);
+	priv->qspi_calibrated_cs = cs;
 
 	return 0;
 }
@@ -218,6 +222,7 @@ static int cadence_spi_probe(struct udevice *bus)
 	priv->tchsh_ns		= plat->tchsh_ns;
 	priv->tslch_ns		= plat->tslch_ns;
 	priv->quirks		= plat->quirks;
+	priv->use_dqs		= !!(priv->quirks & CQSPI_DTR_USE_DQS);
 
 	if (IS_ENABLED(CONFIG_ZYNQMP_FIRMWARE))
 		xilinx_pm_request(PM_REQUEST_NODE, PM_DEV_OSPI,
@@ -386,6 +391,58 @@ static bool cadence_spi_mem_supports_op(struct spi_slave *slave,
 		return spi_mem_default_supports_op(slave, op);
 }
 
+static int cadence_spi_dirmap_create(struct spi_mem_dirmap_desc *desc)
+{
+	struct udevice *bus = desc->slave->dev->parent;
+	struct cadence_spi_priv *priv = dev_get_priv(bus);
+
+	/*
+	 * Only reads are mapped: writes need the controller to poll the flash
+	 * for completion, which the indirect path already does. Versal has
+	 * its own DMA for indirect reads, which is used instead.
+	 */
+	if (desc->info.op_tmpl.data.dir != SPI_MEM_DATA_IN ||
+	    !priv->use_dac_mode || priv->is_dma)
+		return -EOPNOTSUPP;
+
+	if (!cadence_spi_mem_supports_op(desc->slave, &desc->info.op_tmpl))
+		return -EOPNOTSUPP;
+
+	return 0;
+}
+
+static ssize_t cadence_spi_dirmap_read(struct spi_mem_dirmap_desc *desc,
+				       u64 offs, size_t len, void *buf)
+{
+	struct spi_slave *spi = desc->slave;
+	struct udevice *bus = spi->dev->parent;
+	struct cadence_spi_priv *priv = dev_get_priv(bus);
+	struct spi_mem_op op = desc->info.op_tmpl;
+	int err;
+
+	op.addr.val = desc->info.offset + offs;
+	op.data.buf.in = buf;
+	op.data.nbytes = len;
+
+	/* Beyond the AHB window the indirect controller has to be used */
+	if (op.addr.val >= priv->ahbsize) {
+		err = cadence_spi_mem_exec_op(spi, &op);
+
+		return err ? err : len;
+	}
+	op.data.nbytes = min_t(u64, len, priv->ahbsize - op.addr.val);
+
+	cadence_qspi_apb_chipselect(priv->regbase, spi_chip_select(spi->dev),
+				    priv->is_decoded_cs);
+	err = cadence_qspi_apb_read_setup(priv, &op);
+	if (!err)
+		err = cadence_qspi_apb_direct_read_execute(priv, &op);
+	if (err)
+		return err;
+
+	return op.data.nbytes;
+}
+
 static int cadence_spi_of_to_plat(struct udevice *bus)
 {
 	struct cadence_spi_plat *plat = dev_get_plat(bus);
@@ -449,6 +506,8 @@ static int cadence_spi_of_to_plat(struct udevice *bus)
 static const struct spi_controller_mem_ops cadence_spi_mem_ops = {
 	.exec_op = cadence_spi_mem_exec_op,
 	.supports_op = cadence_spi_mem_supports_op,
+	.dirmap_create = cadence_spi_dirmap_create,
+	.dirmap_read = cadence_spi_dirmap_read,
 };
 
 static const struct dm_spi_ops cadence_spi_ops = {
@@ -462,7 +521,7 @@ static const struct dm_spi_ops cadence_spi_ops = {
 };
 
 static const struct cqspi_driver_platdata cdns_qspi = {
-	.quirks = CQSPI_DISABLE_STIG_MODE,
+	.quirks = CQSPI_DISABLE_STIG_MODE | CQSPI_DTR_USE_DQS,
 };
 
 static const struct udevice_id cadence_spi_ids[] = {
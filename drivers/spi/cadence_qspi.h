@@ -29,6 +29,9 @@
 
 #define CQSPI_STIG_DATA_LEN_MAX                 8
 
+/* Direct reads shorter than this are copied by the CPU rather than DMA */
+#define CQSPI_DMA_MIN_LEN                       256
+
 #define CQSPI_DUMMY_CLKS_PER_BYTE               8
 #define CQSPI_DUMMY_BYTES_MAX                   4
 #define CQSPI_DUMMY_CLKS_MAX                    31
@@ -256,6 +259,7 @@ struct cadence_spi_priv {
 	bool		is_decoded_cs;
 	bool		use_dac_mode;
 	bool		is_dma;
+	bool		use_dqs;
 
 	/* Transaction protocol parameters. */
 	u8		inst_width;
@@ -288,6 +292,8 @@ int cadence_qspi_apb_read_setup(struct cadence_spi_priv *priv,
 				const struct spi_mem_op *op);
 int cadence_qspi_apb_read_execute(struct cadence_spi_priv *priv,
 				  const struct spi_mem_op *op);
+int cadence_qspi_apb_direct_read_execute(struct cadence_spi_priv *priv,
+					 const struct spi_mem_op *op);
 int cadence_qspi_apb_write_setup(struct cadence_spi_priv *priv,
 				 const struct spi_mem_op *op);
 int cadence_qspi_apb_write_execute(struct cadence_spi_priv *priv,
@@ -27,6 +27,7 @@
 
 #include <common.h>
 #include <log.h>
+#include <asm/cache.h>
 #include <asm/io.h>
 #include <dma.h>
 #include <linux/bitops.h>
@@ -115,6 +116,31 @@ static int cadence_qspi_buswidth_to_inst_type(u8 buswidth)
 	}
 }
 
+/*
+ * Octal DTR reads are sampled on the data strobe driven by the flash, as the
+ * window of each half-cycle is too narrow for the read-capture delay alone.
+ * The register may only change while the controller is disabled.
+ */
+static void cadence_qspi_set_dqs(struct cadence_spi_priv *priv)
+{
+	bool dqs = priv->use_dqs && priv->dtr &&
+		   priv->data_width == CQSPI_INST_TYPE_OCTAL;
+	unsigned int reg;
+
+	reg = readl(priv->regbase + CQSPI_REG_RD_DATA_CAPTURE);
+	if (!!(reg & CQSPI_REG_READCAPTURE_DQS_ENABLE) == dqs)
+		return;
+
+	if (dqs)
+		reg |= CQSPI_REG_READCAPTURE_DQS_ENABLE;
+	else
+		reg &= ~CQSPI_REG_READCAPTURE_DQS_ENABLE;
+
+	cadence_qspi_apb_controller_disable(priv->regbase);
+	writel(reg, priv->regbase + CQSPI_REG_RD_DATA_CAPTURE);
+	cadence_qspi_apb_controller_enable(priv->regbase);
+}
+
 static int cadence_qspi_set_protocol(struct cadence_spi_priv *priv,
 				     const struct spi_mem_op *op)
 {
@@ -146,6 +172,8 @@ static int cadence_qspi_set_protocol(struct cadence_spi_priv *priv,
 		return ret;
 	priv->data_width = ret;
 
+	cadence_qspi_set_dqs(priv);
+
 	return 0;
 }
 
@@ -763,6 +791,39 @@ failrd:
 	return ret;
 }
 
+/*
+ * Read through the AHB window. The part of the buffer made of whole cache
+ * lines is filled by DMA when a DMA engine is available, so that cache
+ * maintenance cannot corrupt the data around the buffer. The CPU copies
+ * the ends, and everything if DMA fails.
+ */
+int cadence_qspi_apb_direct_read_execute(struct cadence_spi_priv *priv,
+					 const struct spi_mem_op *op)
+{
+	void *src = priv->ahbbase + op->addr.val;
+	u8 *buf = op->data.buf.in;
+	size_t len = op->data.nbytes;
+	size_t head, dma_len = 0;
+
+	cadence_qspi_apb_enable_linear_mode(true);
+
+	head = ALIGN((uintptr_t)buf, ARCH_DMA_MINALIGN) - (uintptr_t)buf;
+	if (len >= CQSPI_DMA_MIN_LEN && len > head)
+		dma_len = rounddown(len - head, ARCH_DMA_MINALIGN);
+	if (dma_len && dma_memcpy(buf + head, src + head, dma_len) >= 0) {
+		memcpy_fromio(buf, src, head);
+		memcpy_fromio(buf + head + dma_len, src + head + dma_len,
+			      len - head - dma_len);
+	} else {
+		memcpy_fromio(buf, src, len);
+	}
+
+	if (!cadence_qspi_wait_idle(priv->regbase))
+		return -EIO;
+
+	return 0;
+}
+
 int cadence_qspi_apb_read_execute(struct cadence_spi_priv *priv,
 				  const struct spi_mem_op *op)
 {
@@ -770,17 +831,10 @@ int cadence_qspi_apb_read_execute(struct cadence_spi_priv *priv,
 	void *buf = op->data.buf.in;
 	size_t len = op->data.nbytes;
 
-	cadence_qspi_apb_enable_linear_mode(true);
+	if (priv->use_dac_mode && (from + len <= priv->ahbsize))
+		return cadence_qspi_apb_direct_read_execute(priv, op);
 
-	if (priv->use_dac_mode && (from + len < priv->ahbsize)) {
-		if (len < 256 ||
-		    dma_memcpy(buf, priv->ahbbase + from, len) < 0) {
-			memcpy_fromio(buf, priv->ahbbase + from, len);
-		}
-		if (!cadence_qspi_wait_idle(priv->regbase))
-			return -EIO;
-		return 0;
-	}
+	cadence_qspi_apb_enable_linear_mode(true);
 
 	return cadence_qspi_apb_indirect_read_execute(priv, len, buf);
 }
@@ -35,10 +35,16 @@
  *
  * @speed:	Current bus speed.
  * @mode:	Current bus mode.
+ * @tap:	Current read-capture tap, set by sandbox_spi_set_tap()
+ * @tap_good:	Taps which sample read data correctly, one bit per tap
+ * @tap_check:	true to corrupt read data when @tap is not in @tap_good
  */
 struct sandbox_spi_priv {
 	uint speed;
 	uint mode;
+	uint tap;
+	u32 tap_good;
+	bool tap_check;
 };
 
 __weak int sandbox_spi_get_emul(struct sandbox_state *state,
@@ -62,10 +68,36 @@ uint sandbox_spi_get_mode(struct udevice *dev)
 	return priv->mode;
 }
 
+void sandbox_spi_set_tap(struct udevice *dev, uint tap)
+{
+	struct sandbox_spi_priv *priv = dev_get_priv(dev);
+
+	priv->tap = tap;
+}
+
+void sandbox_spi_add_tap_window(struct udevice *dev, uint lo, uint hi)
+{
+	struct sandbox_spi_priv *priv = dev_get_priv(dev);
+
+	for (; lo <= hi && lo < 32; lo++)
+		priv->tap_good |= BIT(lo);
+}
+
+void sandbox_spi_set_tap_window(struct udevice *dev, bool enable, uint lo,
+				uint hi)
+{
+	struct sandbox_spi_priv *priv = dev_get_priv(dev);
+
+	priv->tap_check = enable;
+	priv->tap_good = 0;
+	sandbox_spi_add_tap_window(dev, lo, hi);
+}
+
 static int sandbox_spi_xfer(struct udevice *slave, unsigned int bitlen,
 			    const void *dout, void *din, unsigned long flags)
 {
 	struct udevice *bus = slave->parent;
+	struct sandbox_spi_priv *priv = dev_get_priv(bus);
 	struct sandbox_state *state = state_get_current();
 	struct dm_spi_emul_ops *ops;
 	struct udevice *emul;
@@ -104,6 +136,19 @@ static int sandbox_spi_xfer(struct udevice *slave, unsigned int bitlen,
 	ops = spi_emul_get_ops(emul);
 	ret = ops->xfer(emul, bitlen, dout, din, flags);
 
+	/*
+	 * A tap outside the windows samples each bit one cycle late, as a real
+	 * controller would with too much read-capture delay
+	 */
+	if (!ret && din && priv->tap_check &&
+	    (priv->tap >= 32 || !(priv->tap_good & BIT(priv->tap)))) {
+		u8 *rx = din;
+
+		for (i = bytes - 1; i > 0; i--)
+			rx[i] = rx[i] >> 1 | rx[i - 1] << 7;
+		rx[0] >>= 1;
+	}
+
 	log_content("sandbox_spi: xfer: got back %i (that's %s)\n rx:",
 		    ret, ret ? "bad" : "good");
 	if (din) {
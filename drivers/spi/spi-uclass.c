@@ -7,7 +7,9 @@
 
 #include <common.h>
 #include <dm.h>
+#include <env.h>
 #include <errno.h>
+#include <hexdump.h>
 #include <log.h>
 #include <malloc.h>
 #include <spi.h>
@@ -333,6 +335,108 @@ int spi_cs_info(struct udevice *bus, uint cs, struct spi_cs_info *info)
 	return ret == -ENODEV ? 0 : ret;
 }
 
+int spi_scan_taps(struct udevice *dev, const struct spi_tap_scan *scan,
+		  int *lop, int *hip)
+{
+	int lo = -1, best_lo = -1, best_hi = -1;
+	u8 buf[SPI_TAP_SCAN_MAX_LEN];
+	bool pass;
+	int tap, ret;
+
+	if (scan->len > sizeof(buf))
+		return -E2BIG;
+
+	/* one extra step past the last tap closes a window that reaches it */
+	for (tap = 0; tap <= (int)scan->taps; tap++) {
+		pass = false;
+		if (tap < (int)scan->taps) {
+			ret = scan->set_tap(dev, tap);
+			if (ret)
+				return ret;
+			ret = scan->read(dev, buf, scan->len);
+			if (ret)
+				return ret;
+			pass = !memcmp(buf, scan->pattern, scan->len);
+		}
+
+		if (pass && lo == -1) {
+			lo = tap;
+		} else if (!pass && lo != -1) {
+			if (best_lo == -1 || tap - 1 - lo > best_hi - best_lo) {
+				best_lo = lo;
+				best_hi = tap - 1;
+			}
+			lo = -1;
+		}
+	}
+	if (best_lo == -1)
+		return -ENOENT;
+
+	log_debug("%s: taps %d-%d pass\n", dev->name, best_lo, best_hi);
+	if (lop)
+		*lop = best_lo;
+	if (hip)
+		*hip = best_hi;
+
+	return (best_lo + best_hi) / 2;
+}
+
+/*
+ * The cache entry is "<hz>,<cs>,<pattern in hex>:<tap>"; everything before
+ * the colon must match for the tap to be used
+ */
+static int spi_tap_cache_key(struct udevice *bus, uint hz, uint cs,
+			     const u8 *pattern, uint len, char *name,
+			     char *key, int size)
+{
+	char *p;
+
+	if (len > SPI_TAP_SCAN_MAX_LEN)
+		return -E2BIG;
+	snprintf(name, 20, "spi%d_rddelay", dev_seq(bus));
+	p = key + snprintf(key, size, "%u,%u,", hz, cs);
+	p = bin2hex(p, pattern, len);
+	*p = '\0';
+
+	return p - key;
+}
+
+int spi_tap_cache_get(struct udevice *bus, uint hz, uint cs,
+		      const u8 *pattern, uint len)
+{
+	char name[20], key[32 + SPI_TAP_SCAN_MAX_LEN * 2];
+	const char *val;
+	int key_len;
+
+	if (!CONFIG_IS_ENABLED(SPI_TAP_CACHE))
+		return -ENOENT;
+	key_len = spi_tap_cache_key(bus, hz, cs, pattern, len, name, key,
+				    sizeof(key));
+	if (key_len < 0)
+		return -ENOENT;
+	val = env_get(name);
+	if (!val || strncmp(val, key, key_len) || val[key_len] != ':')
+		return -ENOENT;
+
+	return simple_strtoul(val + key_len + 1, NULL, 10);
+}
+
+void spi_tap_cache_set(struct udevice *bus, uint hz, uint cs,
+		       const u8 *pattern, uint len, uint tap)
+{
+	char name[20], val[40 + SPI_TAP_SCAN_MAX_LEN * 2];
+	int key_len;
+
+	if (!CONFIG_IS_ENABLED(SPI_TAP_CACHE))
+		return;
+	key_len = spi_tap_cache_key(bus, hz, cs, pattern, len, name, val,
+				    sizeof(val));
+	if (key_len < 0)
+		return;
+	snprintf(val + key_len, sizeof(val) - key_len, ":%u", tap);
+	env_set(name, val);
+}
+
 int spi_find_bus_and_cs(int busnum, int cs, struct udevice **busp,
 			struct udevice **devp)
 {
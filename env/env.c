@@ -5,6 +5,7 @@
  */
 
 #include <common.h>
+#include <blk.h>
 #include <env.h>
 #include <env_internal.h>
 #include <log.h>
@@ -296,6 +297,8 @@ int env_save(void)
 		}
 
 		ret = drv->save();
+		if (!ret)
+			ret = blkcache_flush(-1, 0);
 		if (ret)
 			printf("Failed (%d)\n", ret);
 		else
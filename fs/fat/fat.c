@@ -22,6 +22,8 @@
 #include <asm/cache.h>
 #include <linux/compiler.h>
 #include <linux/ctype.h>
+#include <linux/math64.h>
+#include <u-boot/crc.h>
 
 /*
  * Convert a string to lowercase.  Converts at most 'len' characters,
@@ -38,6 +40,8 @@ static void downcase(char *str, size_t len)
 
 static struct blk_desc *cur_dev;
 static struct disk_partition cur_part_info;
+/* CRC32 of the boot sector, tells apart media in the same device */
+static u32 cur_bs_crc;
 
 #define DOS_BOOT_MAGIC_OFFSET	0x1fe
 #define DOS_FS_TYPE_OFFSET	0x36
@@ -70,6 +74,8 @@ int fat_set_blk_dev(struct blk_desc *dev_desc, struct disk_partition *info)
 		cur_dev = NULL;
 		return -1;
 	}
+	if (CONFIG_IS_ENABLED(FS_FAT_EXTENT_CACHE))
+		cur_bs_crc = crc32(0, buffer, dev_desc->blksz);
 
 	/* Check if it's actually a DOS volume */
 	if (memcmp(buffer + DOS_BOOT_MAGIC_OFFSET, "\x55\xAA", 2)) {
@@ -304,6 +310,217 @@ get_cluster(fsdata *mydata, __u32 clustnum, __u8 *buffer, unsigned long size)
 	return 0;
 }
 
+/* Number of files whose cluster chains are cached */
+#define FAT_EXTENT_CACHE_FILES	4
+
+/**
+ * struct fat_extent - run of consecutive clusters in a cluster chain
+ *
+ * @start:	First cluster of the run
+ * @count:	Number of clusters in the run
+ */
+struct fat_extent {
+	__u32 start;
+	__u32 count;
+};
+
+/**
+ * struct fat_extent_map - cluster chain of a file as runs of clusters
+ *
+ * @dev:	Block device the filesystem is on
+ * @part_start:	First block of the partition
+ * @bs_crc:	CRC32 of the boot sector of the filesystem
+ * @write_gen:	&blk_desc.write_gen of @dev when the chain was walked
+ * @start:	First cluster of the file, 0 if the entry is unused
+ * @nr_clust:	Number of clusters in the chain
+ * @ext:	Runs making up the chain
+ * @nr_ext:	Number of runs in @ext
+ * @max_ext:	Number of runs allocated at @ext
+ * @last_used:	Value of fat_extent_clock when the map was last used
+ */
+struct fat_extent_map {
+	struct blk_desc *dev;
+	lbaint_t part_start;
+	u32 bs_crc;
+	ulong write_gen;
+	__u32 start;
+	__u32 nr_clust;
+	struct fat_extent *ext;
+	int nr_ext;
+	int max_ext;
+	uint last_used;
+};
+
+static struct fat_extent_map fat_extent_cache[FAT_EXTENT_CACHE_FILES];
+static uint fat_extent_clock;
+/* Cluster read when a read starts within one, allocated once and kept */
+static __u8 *fat_extent_bounce;
+
+/* Walk the cluster chain of a file, merging consecutive clusters into runs */
+static int fat_extent_walk(fsdata *mydata, struct fat_extent_map *map)
+{
+	struct fat_extent *ext = NULL;
+	__u32 clust = map->start;
+	__u32 i;
+
+	map->nr_ext = 0;
+	for (i = 0; i < map->nr_clust; i++) {
+		if (i)
+			clust = get_fatent(mydata, clust);
+		if (CHECK_CLUST(clust, mydata->fatsize)) {
+			debug("curclust: 0x%x\n", clust);
+			printf("Invalid FAT entry\n");
+			return -1;
+		}
+
+		if (ext && ext->start + ext->count == clust) {
+			ext->count++;
+			continue;
+		}
+
+		if (map->nr_ext == map->max_ext) {
+			int max_ext = map->max_ext ? map->max_ext * 2 : 16;
+
+			ext = realloc(map->ext, max_ext * sizeof(*ext));
+			if (!ext) {
+				debug("Error: allocating extents\n");
+				return -1;
+			}
+			map->ext = ext;
+			map->max_ext = max_ext;
+		}
+		ext = &map->ext[map->nr_ext++];
+		ext->start = clust;
+		ext->count = 1;
+	}
+
+	debug("FAT: %u clusters from 0x%x in %d run(s)\n", map->nr_clust,
+	      map->start, map->nr_ext);
+
+	return 0;
+}
+
+/**
+ * fat_extent_get() - get the cluster chain of a file
+ *
+ * Looks the chain up in the cache, or walks it and caches it in place of
+ * the entry used least recently. An entry only matches if nothing has been
+ * written to the device since it was walked.
+ *
+ * @mydata:	file system description
+ * @dentptr:	directory entry of the file
+ * Return:	cluster chain, or NULL on error
+ */
+static struct fat_extent_map *fat_extent_get(fsdata *mydata,
+					     dir_entry *dentptr)
+{
+	unsigned int bytesperclust = mydata->clust_size * mydata->sect_size;
+	__u32 filesize = FAT2CPU32(dentptr->size);
+	__u32 start = START(dentptr);
+	__u32 nr_clust;
+	struct fat_extent_map *map, *victim = fat_extent_cache;
+
+	nr_clust = filesize / bytesperclust + !!(filesize % bytesperclust);
+	for (map = fat_extent_cache;
+	     map < fat_extent_cache + FAT_EXTENT_CACHE_FILES; map++) {
+		if (map->start == start && map->nr_clust == nr_clust &&
+		    map->dev == cur_dev &&
+		    map->part_start == cur_part_info.start &&
+		    map->bs_crc == cur_bs_crc &&
+		    map->write_gen == cur_dev->write_gen) {
+			map->last_used = ++fat_extent_clock;
+			return map;
+		}
+		if (map->last_used < victim->last_used)
+			victim = map;
+	}
+
+	map = victim;
+	map->dev = cur_dev;
+	map->part_start = cur_part_info.start;
+	map->bs_crc = cur_bs_crc;
+	map->write_gen = cur_dev->write_gen;
+	map->start = start;
+	map->nr_clust = nr_clust;
+	map->last_used = ++fat_extent_clock;
+	if (fat_extent_walk(mydata, map)) {
+		map->start = 0;
+		map->last_used = 0;
+		return NULL;
+	}
+
+	return map;
+}
+
+/**
+ * fat_extent_read() - read from a file using its cached cluster chain
+ *
+ * @mydata:	file system description
+ * @map:	cluster chain of the file
+ * @pos:	position from where to read
+ * @buffer:	buffer into which to read
+ * @endpos:	position at which to stop reading
+ * @gotsize:	number of bytes actually read
+ * Return:	-1 on error, otherwise 0
+ */
+static int fat_extent_read(fsdata *mydata, struct fat_extent_map *map,
+			   loff_t pos, __u8 *buffer, loff_t endpos,
+			   loff_t *gotsize)
+{
+	unsigned int bytesperclust = mydata->clust_size * mydata->sect_size;
+	loff_t ext_pos = 0, ext_end, actsize;
+	__u32 clust, offset;
+	int i = 0;
+
+	while (pos < endpos) {
+		if (i == map->nr_ext) {
+			printf("Invalid FAT entry\n");
+			return -1;
+		}
+		ext_end = ext_pos + (loff_t)map->ext[i].count * bytesperclust;
+		if (pos >= ext_end) {
+			ext_pos = ext_end;
+			i++;
+			continue;
+		}
+
+		clust = map->ext[i].start +
+			div_u64_rem(pos - ext_pos, bytesperclust, &offset);
+		if (offset) {
+			/* Read the first cluster and skip the start of it */
+			actsize = min(endpos - (pos - offset),
+				      (loff_t)bytesperclust);
+			if (!fat_extent_bounce)
+				fat_extent_bounce =
+					malloc_cache_aligned(MAX_CLUSTSIZE);
+			if (!fat_extent_bounce) {
+				debug("Error: allocating buffer\n");
+				return -1;
+			}
+
+			if (get_cluster(mydata, clust, fat_extent_bounce,
+					actsize)) {
+				printf("Error reading cluster\n");
+				return -1;
+			}
+			actsize -= offset;
+			memcpy(buffer, fat_extent_bounce + offset, actsize);
+		} else {
+			/* The rest of the run in a single read */
+			actsize = min(ext_end, endpos) - pos;
+			if (get_cluster(mydata, clust, buffer, actsize)) {
+				printf("Error reading cluster\n");
+				return -1;
+			}
+		}
+		*gotsize += actsize;
+		buffer += actsize;
+		pos += actsize;
+	}
+
+	return 0;
+}
+
 /**
  * get_contents() - read from file
  *
@@ -341,6 +558,16 @@ static int get_contents(fsdata *mydata, dir_entry *dentptr, loff_t pos,
 
 	debug("%llu bytes\n", filesize);
 
+	if (CONFIG_IS_ENABLED(FS_FAT_EXTENT_CACHE)) {
+		struct fat_extent_map *map = fat_extent_get(mydata, dentptr);
+
+		if (!map)
+			return -1;
+
+		return fat_extent_read(mydata, map, pos, buffer, filesize,
+				       gotsize);
+	}
+
 	actsize = bytesperclust;
 
 	/* go to cluster at pos */
@@ -5,6 +5,7 @@
 
 #define LOG_CATEGORY LOGC_CORE
 
+#include <blk.h>
 #include <command.h>
 #include <config.h>
 #include <display_options.h>
@@ -491,6 +492,10 @@ void fs_close(void)
 
 	info->close();
 
+	/* write back blocks cached while updating the filesystem */
+	if (fs_dev_desc)
+		blkcache_flush(fs_dev_desc->uclass_id, fs_dev_desc->devnum);
+
 	fs_type = FS_TYPE_ANY;
 }
 
@@ -26,6 +26,164 @@
 
 static struct squashfs_ctxt ctxt;
 
+/* Number of fragment table metadata blocks kept in the cache */
+#define SQFS_CACHE_META_BLOCKS	4
+
+#if CONFIG_IS_ENABLED(FS_SQUASHFS_CACHE)
+#define SQFS_CACHE_FRAG_BLOCKS	CONFIG_FS_SQUASHFS_FRAG_CACHE_BLOCKS
+#else
+#define SQFS_CACHE_FRAG_BLOCKS	1
+#endif
+
+/**
+ * struct sqfs_tables - decompressed inode and directory tables
+ *
+ * The tables are shared by the cache and by every directory stream opened
+ * while they were current, and freed once the last of these lets go.
+ *
+ * @refcount:		Number of users
+ * @inode_table:	Decompressed inode table
+ * @dir_table:		Decompressed directory table
+ * @pos_list:		End of each directory table metadata block
+ * @metablks_count:	Number of directory table metadata blocks
+ */
+struct sqfs_tables {
+	int refcount;
+	unsigned char *inode_table;
+	unsigned char *dir_table;
+	u32 *pos_list;
+	int metablks_count;
+};
+
+/**
+ * struct sqfs_cache_block - decompressed block kept in the cache
+ *
+ * @start:	Position of the block on the disk
+ * @data:	Decompressed block, NULL if the slot is unused
+ * @len:	Number of bytes at @data
+ * @last_used:	Value of &sqfs_cache.clock when the block was last used
+ */
+struct sqfs_cache_block {
+	u64 start;
+	void *data;
+	unsigned long len;
+	uint last_used;
+};
+
+/**
+ * struct sqfs_cache - metadata kept from one command to the next
+ *
+ * The filesystem is probed and closed around every command, so the cache
+ * is tied to the filesystem it was filled from instead, and dropped when
+ * a different one is probed or the device has been written to.
+ *
+ * @dev:	Block device the filesystem is on
+ * @part_start:	First block of the partition
+ * @write_gen:	&blk_desc.write_gen of @dev when the cache was filled
+ * @sblk:	Superblock of the filesystem
+ * @tables:	Inode and directory tables, NULL until first needed
+ * @frag_index:	Fragment index table, NULL until first needed
+ * @meta:	Fragment table metadata blocks
+ * @frag:	Fragment blocks
+ * @clock:	Counter used to find the least recently used block
+ */
+static struct sqfs_cache {
+	struct blk_desc *dev;
+	lbaint_t part_start;
+	ulong write_gen;
+	struct squashfs_super_block sblk;
+	struct sqfs_tables *tables;
+	void *frag_index;
+	struct sqfs_cache_block meta[SQFS_CACHE_META_BLOCKS];
+	struct sqfs_cache_block frag[SQFS_CACHE_FRAG_BLOCKS];
+	uint clock;
+} cache;
+
+static void sqfs_tables_put(struct sqfs_tables *tables)
+{
+	if (!tables || --tables->refcount)
+		return;
+
+	free(tables->inode_table);
+	free(tables->dir_table);
+	free(tables->pos_list);
+	free(tables);
+}
+
+static void sqfs_cache_drop(void)
+{
+	int i;
+
+	sqfs_tables_put(cache.tables);
+	free(cache.frag_index);
+	for (i = 0; i < SQFS_CACHE_META_BLOCKS; i++)
+		free(cache.meta[i].data);
+	for (i = 0; i < SQFS_CACHE_FRAG_BLOCKS; i++)
+		free(cache.frag[i].data);
+	memset(&cache, '\0', sizeof(cache));
+}
+
+/* Drop the cache unless it was filled from the filesystem just probed */
+static void sqfs_cache_check(void)
+{
+	if (!CONFIG_IS_ENABLED(FS_SQUASHFS_CACHE))
+		return;
+
+	if (cache.dev == ctxt.cur_dev &&
+	    cache.part_start == ctxt.cur_part_info.start &&
+	    cache.write_gen == ctxt.cur_dev->write_gen &&
+	    !memcmp(&cache.sblk, ctxt.sblk, sizeof(cache.sblk)))
+		return;
+
+	sqfs_cache_drop();
+	cache.dev = ctxt.cur_dev;
+	cache.part_start = ctxt.cur_part_info.start;
+	cache.write_gen = ctxt.cur_dev->write_gen;
+	memcpy(&cache.sblk, ctxt.sblk, sizeof(cache.sblk));
+}
+
+static struct sqfs_cache_block *sqfs_cache_find(struct sqfs_cache_block *blks,
+						int count, u64 start)
+{
+	int i;
+
+	for (i = 0; i < count; i++) {
+		if (blks[i].data && blks[i].start == start) {
+			blks[i].last_used = ++cache.clock;
+			return &blks[i];
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Add a block to the cache in place of the least recently used one. Returns
+ * false if the cache is disabled, in which case the caller still owns @data.
+ */
+static bool sqfs_cache_add(struct sqfs_cache_block *blks, int count,
+			   u64 start, void *data, unsigned long len)
+{
+	struct sqfs_cache_block *blk = blks;
+	int i;
+
+	if (!CONFIG_IS_ENABLED(FS_SQUASHFS_CACHE))
+		return false;
+
+	for (i = 1; i < count; i++) {
+		if (blks[i].last_used < blk->last_used)
+			blk = &blks[i];
+	}
+
+	free(blk->data);
+	blk->start = start;
+	blk->data = data;
+	blk->len = len;
+	blk->last_used = ++cache.clock;
+
+	return true;
+}
+
 static int sqfs_disk_read(__u32 block, __u32 nr_blocks, void *buf)
 {
 	ulong ret;
@@ -93,27 +251,19 @@ static int sqfs_calc_n_blks(__le64 start, __le64 end, u64 *offset)
 	return DIV_ROUND_UP(table_size + *offset, ctxt.cur_dev->blksz);
 }
 
-/*
- * Retrieves fragment block entry and returns true if the fragment block is
- * compressed
- */
-static int sqfs_frag_lookup(u32 inode_fragment_index,
-			    struct squashfs_fragment_block_entry *e)
+/* Get the fragment index table, which locates the fragment entries */
+static int sqfs_frag_index(void **indexp, u64 *offsetp)
 {
-	u64 start, end, exp_tbl, n_blks, src_len, table_offset, start_block;
-	unsigned char *metadata_buffer, *metadata, *table;
-	struct squashfs_fragment_block_entry *entries;
 	struct squashfs_super_block *sblk = ctxt.sblk;
-	unsigned long dest_len;
-	int block, offset, ret;
-	u16 header;
-
-	metadata_buffer = NULL;
-	entries = NULL;
-	table = NULL;
+	u64 start, end, exp_tbl, n_blks, table_offset;
+	unsigned char *table;
+	u32 size;
 
-	if (inode_fragment_index >= get_unaligned_le32(&sblk->fragments))
-		return -EINVAL;
+	if (cache.frag_index) {
+		*indexp = cache.frag_index;
+		*offsetp = 0;
+		return 0;
+	}
 
 	start = get_unaligned_le64(&sblk->fragment_table_start);
 	end = get_unaligned_le64(&sblk->id_table_start);
@@ -129,16 +279,60 @@ static int sqfs_frag_lookup(u32 inode_fragment_index,
 
 	/* Allocate a proper sized buffer to store the fragment index table */
 	table = malloc_cache_aligned(n_blks * ctxt.cur_dev->blksz);
-	if (!table) {
-		ret = -ENOMEM;
-		goto out;
-	}
+	if (!table)
+		return -ENOMEM;
 
 	if (sqfs_disk_read(start, n_blks, table) < 0) {
-		ret = -EINVAL;
-		goto out;
+		free(table);
+		return -EINVAL;
+	}
+
+	*indexp = table;
+	*offsetp = table_offset;
+	if (!CONFIG_IS_ENABLED(FS_SQUASHFS_CACHE))
+		return 0;
+
+	/* Keep only the index itself */
+	size = DIV_ROUND_UP(get_unaligned_le32(&sblk->fragments),
+			    SQFS_MAX_ENTRIES) * sizeof(u64);
+	cache.frag_index = malloc(size);
+	if (cache.frag_index) {
+		memcpy(cache.frag_index, table + table_offset, size);
+		*indexp = cache.frag_index;
+		*offsetp = 0;
+		free(table);
 	}
 
+	return 0;
+}
+
+/*
+ * Retrieves fragment block entry and returns true if the fragment block is
+ * compressed
+ */
+static int sqfs_frag_lookup(u32 inode_fragment_index,
+			    struct squashfs_fragment_block_entry *e)
+{
+	u64 start, n_blks, src_len, table_offset, start_block;
+	unsigned char *metadata_buffer, *metadata;
+	struct squashfs_fragment_block_entry *entries;
+	struct squashfs_super_block *sblk = ctxt.sblk;
+	struct sqfs_cache_block *blk;
+	unsigned long dest_len;
+	int block, offset, ret;
+	void *index = NULL;
+	u16 header;
+
+	metadata_buffer = NULL;
+	entries = NULL;
+
+	if (inode_fragment_index >= get_unaligned_le32(&sblk->fragments))
+		return -EINVAL;
+
+	ret = sqfs_frag_index(&index, &table_offset);
+	if (ret)
+		return ret;
+
 	block = SQFS_FRAGMENT_INDEX(inode_fragment_index);
 	offset = SQFS_FRAGMENT_INDEX_OFFSET(inode_fragment_index);
 
@@ -146,8 +340,16 @@ static int sqfs_frag_lookup(u32 inode_fragment_index,
 	 * Get the start offset of the metadata block that contains the right
 	 * fragment block entry
 	 */
-	start_block = get_unaligned_le64(table + table_offset + block *
+	start_block = get_unaligned_le64(index + table_offset + block *
 					 sizeof(u64));
+	if (index != cache.frag_index)
+		free(index);
+
+	blk = sqfs_cache_find(cache.meta, SQFS_CACHE_META_BLOCKS, start_block);
+	if (blk) {
+		*e = ((struct squashfs_fragment_block_entry *)blk->data)[offset];
+		return SQFS_COMPRESSED_BLOCK(e->size);
+	}
 
 	start = start_block / ctxt.cur_dev->blksz;
 	n_blks = sqfs_calc_n_blks(cpu_to_le64(start_block),
@@ -195,10 +397,13 @@ static int sqfs_frag_lookup(u32 inode_fragment_index,
 	*e = entries[offset];
 	ret = SQFS_COMPRESSED_BLOCK(e->size);
 
+	if (sqfs_cache_add(cache.meta, SQFS_CACHE_META_BLOCKS, start_block,
+			   entries, SQFS_METADATA_BLOCK_SIZE))
+		entries = NULL;
+
 out:
 	free(entries);
 	free(metadata_buffer);
-	free(table);
 
 	return ret;
 }
@@ -878,13 +1083,51 @@ out:
 	return metablks_count;
 }
 
+/*
+ * Get the decompressed inode and directory tables, from the cache if they are
+ * there. The caller must release them with sqfs_tables_put().
+ */
+static struct sqfs_tables *sqfs_get_tables(void)
+{
+	struct sqfs_tables *tables = cache.tables;
+
+	if (tables) {
+		tables->refcount++;
+		return tables;
+	}
+
+	tables = calloc(1, sizeof(*tables));
+	if (!tables)
+		return NULL;
+
+	tables->refcount = 1;
+	if (sqfs_read_inode_table(&tables->inode_table))
+		goto err;
+
+	tables->metablks_count = sqfs_read_directory_table(&tables->dir_table,
+							   &tables->pos_list);
+	if (tables->metablks_count < 1)
+		goto err;
+
+	if (CONFIG_IS_ENABLED(FS_SQUASHFS_CACHE)) {
+		tables->refcount++;
+		cache.tables = tables;
+	}
+
+	return tables;
+
+err:
+	sqfs_tables_put(tables);
+
+	return NULL;
+}
+
 int sqfs_opendir(const char *filename, struct fs_dir_stream **dirsp)
 {
-	unsigned char *inode_table = NULL, *dir_table = NULL;
-	int j, token_count = 0, ret = 0, metablks_count;
+	int j, token_count = 0, ret = 0;
 	struct squashfs_dir_stream *dirs;
 	char **token_list = NULL, *path = NULL;
-	u32 *pos_list = NULL;
+	struct sqfs_tables *tables;
 
 	dirs = calloc(1, sizeof(*dirs));
 	if (!dirs)
@@ -897,17 +1140,12 @@ int sqfs_opendir(const char *filename, struct fs_dir_stream **dirsp)
 	dirs->inode_table = NULL;
 	dirs->dir_table = NULL;
 
-	ret = sqfs_read_inode_table(&inode_table);
-	if (ret) {
-		ret = -EINVAL;
-		goto out;
-	}
-
-	metablks_count = sqfs_read_directory_table(&dir_table, &pos_list);
-	if (metablks_count < 1) {
+	tables = sqfs_get_tables();
+	if (!tables) {
 		ret = -EINVAL;
 		goto out;
 	}
+	dirs->tables = tables;
 
 	/* Tokenize filename */
 	token_count = sqfs_count_tokens(filename);
@@ -936,10 +1174,10 @@ int sqfs_opendir(const char *filename, struct fs_dir_stream **dirsp)
 	 * ldir's (extended directory) size is greater than dir, so it works as
 	 * a general solution for the malloc size, since 'i' is a union.
 	 */
-	dirs->inode_table = inode_table;
-	dirs->dir_table = dir_table;
-	ret = sqfs_search_dir(dirs, token_list, token_count, pos_list,
-			      metablks_count);
+	dirs->inode_table = tables->inode_table;
+	dirs->dir_table = tables->dir_table;
+	ret = sqfs_search_dir(dirs, token_list, token_count, tables->pos_list,
+			      tables->metablks_count);
 	if (ret)
 		goto out;
 
@@ -963,10 +1201,10 @@ out:
 	for (j = 0; j < token_count; j++)
 		free(token_list[j]);
 	free(token_list);
-	free(pos_list);
 	free(path);
 	if (ret) {
-		free(inode_table);
+		sqfs_tables_put(dirs->tables);
+		free(dirs->dir_header);
 		free(dirs);
 	}
 
@@ -1108,6 +1346,7 @@ int sqfs_probe(struct blk_desc *fs_dev_desc, struct disk_partition *fs_partition
 	}
 
 	ctxt.sblk = sblk;
+	sqfs_cache_check();
 
 	ret = sqfs_decompressor_init(&ctxt);
 	if (ret) {
@@ -1317,13 +1556,195 @@ static int sqfs_get_lregfile_info(struct squashfs_lreg_inode *lreg,
 	return datablk_count;
 }
 
+/*
+ * Copy @len bytes at @offset into the fragment block described by @e to @buf,
+ * reading and decompressing the block unless it is in the cache
+ */
+static int sqfs_read_fragment(struct squashfs_fragment_block_entry *e,
+			      bool comp, u32 offset, void *buf, u32 len)
+{
+	struct squashfs_super_block *sblk = ctxt.sblk;
+	u64 start, n_blks, table_offset;
+	struct sqfs_cache_block *blk;
+	char *fragment, *block;
+	unsigned long dest_len;
+	u32 table_size;
+	int ret;
+
+	blk = sqfs_cache_find(cache.frag, SQFS_CACHE_FRAG_BLOCKS, e->start);
+	if (blk) {
+		if (offset + len > blk->len)
+			return -EINVAL;
+		memcpy(buf, blk->data + offset, len);
+		return 0;
+	}
+
+	start = lldiv(e->start, ctxt.cur_dev->blksz);
+	table_size = SQFS_BLOCK_SIZE(e->size);
+	table_offset = e->start - (start * ctxt.cur_dev->blksz);
+	n_blks = DIV_ROUND_UP(table_size + table_offset, ctxt.cur_dev->blksz);
+
+	fragment = malloc_cache_aligned(n_blks * ctxt.cur_dev->blksz);
+	if (!fragment)
+		return -ENOMEM;
+
+	dest_len = get_unaligned_le32(&sblk->block_size);
+	block = malloc(dest_len);
+	if (!block) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	ret = sqfs_disk_read(start, n_blks, fragment);
+	if (ret < 0)
+		goto out;
+
+	if (comp) {
+		ret = sqfs_decompress(&ctxt, block, &dest_len,
+				      fragment + table_offset, e->size);
+		if (ret)
+			goto out;
+	} else {
+		dest_len = min_t(unsigned long, dest_len, table_size);
+		memcpy(block, fragment + table_offset, dest_len);
+	}
+
+	if (offset + len > dest_len) {
+		ret = -EINVAL;
+		goto out;
+	}
+	memcpy(buf, block + offset, len);
+	ret = 0;
+
+	/* Files which share the fragment block are likely to be read next */
+	if (sqfs_cache_add(cache.frag, SQFS_CACHE_FRAG_BLOCKS, e->start,
+			   block, dest_len))
+		block = NULL;
+
+out:
+	free(block);
+	free(fragment);
+
+	return ret;
+}
+
+/*
+ * Read the part of the data blocks of a file from @offset to @end to @buf.
+ * Blocks before @offset are skipped without being read. Data blocks follow
+ * each other on the disk, so runs of them are read at once and then
+ * decompressed one by one, straight into @buf where a whole block is wanted.
+ */
+static int sqfs_read_datablocks(struct squashfs_file_info *finfo, int count,
+				u64 offset, u64 end, void *buf, loff_t *actread)
+{
+	u32 bs = get_unaligned_le32(&ctxt.sblk->block_size);
+	u64 pos, start, n_blks, table_offset, blk_start, skip, want, run_len;
+	int j, k, batch, ret = 0;
+	unsigned long dest_len;
+	char *buffer, *data;
+	void *datablock;
+	u32 size;
+
+	j = lldiv(offset, bs);
+	if (j >= count)
+		return 0;
+
+	/* Sparse blocks take no space on the disk */
+	pos = finfo->start;
+	for (k = 0; k < j; k++)
+		pos += SQFS_BLOCK_SIZE(finfo->blk_sizes[k]);
+
+	batch = min(CONFIG_FS_SQUASHFS_READ_BATCH, count - j);
+	buffer = malloc_cache_aligned(batch * bs + ctxt.cur_dev->blksz);
+	if (!buffer && batch > 1) {
+		batch = 1;
+		buffer = malloc_cache_aligned(bs + ctxt.cur_dev->blksz);
+	}
+	datablock = malloc(bs);
+	if (!buffer || !datablock) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	while (j < count && (u64)j * bs < end) {
+		/* Find the run of blocks to read at once */
+		run_len = 0;
+		for (k = j; k < count && k - j < batch && (u64)k * bs < end &&
+		     finfo->blk_sizes[k]; k++)
+			run_len += SQFS_BLOCK_SIZE(finfo->blk_sizes[k]);
+
+		data = NULL;
+		if (run_len) {
+			start = lldiv(pos, ctxt.cur_dev->blksz);
+			table_offset = pos - start * ctxt.cur_dev->blksz;
+			n_blks = DIV_ROUND_UP(table_offset + run_len,
+					      ctxt.cur_dev->blksz);
+			ret = sqfs_disk_read(start, n_blks, buffer);
+			if (ret < 0) {
+				printf("Error: failed to read data blocks.\n");
+				goto out;
+			}
+			ret = 0;
+			data = buffer + table_offset;
+		} else {
+			/* This is a sparse block */
+			k = j + 1;
+		}
+
+		for (; j < k; j++) {
+			size = SQFS_BLOCK_SIZE(finfo->blk_sizes[j]);
+			blk_start = (u64)j * bs;
+			skip = offset > blk_start ? offset - blk_start : 0;
+			want = min_t(u64, bs, end - blk_start) - skip;
+
+			if (!finfo->blk_sizes[j]) {
+				memset(buf + *actread, 0, want);
+			} else if (SQFS_COMPRESSED_BLOCK(finfo->blk_sizes[j])) {
+				dest_len = bs;
+				if (!skip && want == bs) {
+					ret = sqfs_decompress(&ctxt,
+							      buf + *actread,
+							      &dest_len, data,
+							      size);
+				} else {
+					ret = sqfs_decompress(&ctxt, datablock,
+							      &dest_len, data,
+							      size);
+					if (!ret && skip + want > dest_len)
+						ret = -EINVAL;
+					if (!ret)
+						memcpy(buf + *actread,
+						       datablock + skip, want);
+				}
+				if (ret)
+					goto out;
+			} else {
+				if (skip + want > size) {
+					ret = -EINVAL;
+					goto out;
+				}
+				memcpy(buf + *actread, data + skip, want);
+			}
+
+			*actread += want;
+			data += size;
+			pos += size;
+		}
+	}
+
+out:
+	free(datablock);
+	free(buffer);
+
+	return ret;
+}
+
 int sqfs_read(const char *filename, void *buf, loff_t offset, loff_t len,
 	      loff_t *actread)
 {
-	char *dir = NULL, *fragment_block, *datablock = NULL;
-	char *fragment = NULL, *file = NULL, *resolved, *data;
-	u64 start, n_blks, table_size, data_offset, table_offset, sparse_size;
-	int ret, j, i_number, datablk_count = 0;
+	char *dir = NULL, *file = NULL, *resolved;
+	int ret, i_number, datablk_count = 0;
+	u64 frag_start, skip;
 	struct squashfs_super_block *sblk = ctxt.sblk;
 	struct squashfs_fragment_block_entry frag_entry;
 	struct squashfs_file_info finfo = {0};
@@ -1333,20 +1754,11 @@ int sqfs_read(const char *filename, void *buf, loff_t offset, loff_t len,
 	struct squashfs_lreg_inode *lreg;
 	struct squashfs_base_inode *base;
 	struct squashfs_reg_inode *reg;
-	unsigned long dest_len;
 	struct fs_dirent *dent;
 	unsigned char *ipos;
 
 	*actread = 0;
 
-	if (offset) {
-		/*
-		 * TODO: implement reading at an offset in file
-		 */
-		printf("Error: reading at a specific offset in a squashfs file is not supported yet.\n");
-		return -EINVAL;
-	}
-
 	/*
 	 * sqfs_opendir will uncompress inode and directory tables, and will
 	 * return a pointer to the directory that contains the requested file.
@@ -1428,152 +1840,43 @@ int sqfs_read(const char *filename, void *buf, loff_t offset, loff_t len,
 		goto out;
 	}
 
-	/* If the user specifies a length, check its sanity */
+	/* If the user specifies an offset or a length, check their sanity */
+	if (offset > finfo.size) {
+		ret = -EINVAL;
+		goto out;
+	}
+
 	if (len) {
-		if (len > finfo.size) {
+		if (len > finfo.size - offset) {
 			ret = -EINVAL;
 			goto out;
 		}
-
-		finfo.size = len;
 	} else {
-		len = finfo.size;
+		len = finfo.size - offset;
 	}
 
-	if (datablk_count) {
-		data_offset = finfo.start;
-		datablock = malloc(get_unaligned_le32(&sblk->block_size));
-		if (!datablock) {
-			ret = -ENOMEM;
-			goto out;
-		}
-	}
-
-	for (j = 0; j < datablk_count; j++) {
-		char *data_buffer;
-
-		start = lldiv(data_offset, ctxt.cur_dev->blksz);
-		table_size = SQFS_BLOCK_SIZE(finfo.blk_sizes[j]);
-		table_offset = data_offset - (start * ctxt.cur_dev->blksz);
-		n_blks = DIV_ROUND_UP(table_size + table_offset,
-				      ctxt.cur_dev->blksz);
-
-		/* Don't load any data for sparse blocks */
-		if (finfo.blk_sizes[j] == 0) {
-			n_blks = 0;
-			table_offset = 0;
-			data_buffer = NULL;
-			data = NULL;
-		} else {
-			data_buffer = malloc_cache_aligned(n_blks * ctxt.cur_dev->blksz);
-
-			if (!data_buffer) {
-				ret = -ENOMEM;
-				goto out;
-			}
-
-			ret = sqfs_disk_read(start, n_blks, data_buffer);
-			if (ret < 0) {
-				/*
-				 * Possible causes: too many data blocks or too large
-				 * SquashFS block size. Tip: re-compile the SquashFS
-				 * image with mksquashfs's -b <block_size> option.
-				 */
-				printf("Error: too many data blocks to be read.\n");
-				goto out;
-			}
-
-			data = data_buffer + table_offset;
-		}
-
-		/* Load the data */
-		if (finfo.blk_sizes[j] == 0) {
-			/* This is a sparse block */
-			sparse_size = get_unaligned_le32(&sblk->block_size);
-			if ((*actread + sparse_size) > len)
-				sparse_size = len - *actread;
-			memset(buf + *actread, 0, sparse_size);
-			*actread += sparse_size;
-		} else if (SQFS_COMPRESSED_BLOCK(finfo.blk_sizes[j])) {
-			dest_len = get_unaligned_le32(&sblk->block_size);
-			ret = sqfs_decompress(&ctxt, datablock, &dest_len,
-					      data, table_size);
-			if (ret)
-				goto out;
-
-			if ((*actread + dest_len) > len)
-				dest_len = len - *actread;
-			memcpy(buf + *actread, datablock, dest_len);
-			*actread += dest_len;
-		} else {
-			if ((*actread + table_size) > len)
-				table_size = len - *actread;
-			memcpy(buf + *actread, data, table_size);
-			*actread += table_size;
-		}
-
-		data_offset += table_size;
-		free(data_buffer);
-		if (*actread >= len)
-			break;
-	}
+	ret = sqfs_read_datablocks(&finfo, datablk_count, offset, offset + len,
+				   buf, actread);
+	if (ret)
+		goto out;
 
 	/*
-	 * There is no need to continue if the file is not fragmented.
+	 * There is no need to continue if the file is not fragmented, or the
+	 * fragment is not in the requested range.
 	 */
-	if (!finfo.frag) {
-		ret = 0;
-		goto out;
-	}
-
-	start = lldiv(frag_entry.start, ctxt.cur_dev->blksz);
-	table_size = SQFS_BLOCK_SIZE(frag_entry.size);
-	table_offset = frag_entry.start - (start * ctxt.cur_dev->blksz);
-	n_blks = DIV_ROUND_UP(table_size + table_offset, ctxt.cur_dev->blksz);
-
-	fragment = malloc_cache_aligned(n_blks * ctxt.cur_dev->blksz);
-
-	if (!fragment) {
-		ret = -ENOMEM;
+	frag_start = (u64)datablk_count * get_unaligned_le32(&sblk->block_size);
+	if (!finfo.frag || offset + len <= frag_start)
 		goto out;
-	}
 
-	ret = sqfs_disk_read(start, n_blks, fragment);
-	if (ret < 0)
+	skip = offset > frag_start ? offset - frag_start : 0;
+	ret = sqfs_read_fragment(&frag_entry, finfo.comp, finfo.offset + skip,
+				 buf + *actread, offset + len - frag_start - skip);
+	if (ret)
 		goto out;
 
-	/* File compressed and fragmented */
-	if (finfo.frag && finfo.comp) {
-		dest_len = get_unaligned_le32(&sblk->block_size);
-		fragment_block = malloc(dest_len);
-		if (!fragment_block) {
-			ret = -ENOMEM;
-			goto out;
-		}
-
-		ret = sqfs_decompress(&ctxt, fragment_block, &dest_len,
-				      (void *)fragment  + table_offset,
-				      frag_entry.size);
-		if (ret) {
-			free(fragment_block);
-			goto out;
-		}
-
-		memcpy(buf + *actread, &fragment_block[finfo.offset], finfo.size - *actread);
-		*actread = finfo.size;
-
-		free(fragment_block);
-
-	} else if (finfo.frag && !finfo.comp) {
-		fragment_block = (void *)fragment + table_offset;
-
-		memcpy(buf + *actread, &fragment_block[finfo.offset], finfo.size - *actread);
-		*actread = finfo.size;
-	}
+	*actread = len;
 
 out:
-	free(fragment);
-	free(datablock);
 	free(file);
 	free(dir);
 	free(finfo.blk_sizes);
@@ -1725,8 +2028,7 @@ void sqfs_closedir(struct fs_dir_stream *dirs)
 		return;
 
 	sqfs_dirs = (struct squashfs_dir_stream *)dirs;
-	free(sqfs_dirs->inode_table);
-	free(sqfs_dirs->dir_table);
+	sqfs_tables_put(sqfs_dirs->tables);
 	free(sqfs_dirs->dir_header);
 	free(sqfs_dirs);
 }
@@ -249,6 +249,8 @@ struct squashfs_fragment_block_entry {
 	u32 _unused;
 };
 
+struct sqfs_tables;
+
 struct squashfs_dir_stream {
 	struct fs_dir_stream fs_dirs;
 	struct fs_dirent dentp;
@@ -274,10 +276,11 @@ struct squashfs_dir_stream {
 	struct squashfs_ldir_inode i_ldir;
 	/*
 	 * References to the tables' beginnings. They are assigned in
-	 * sqfs_opendir() and freed in sqfs_closedir().
+	 * sqfs_opendir() from 'tables', which is released in sqfs_closedir().
 	 */
 	unsigned char *inode_table;
 	unsigned char *dir_table;
+	struct sqfs_tables *tables;
 };
 
 struct squashfs_file_info {
@@ -87,6 +87,8 @@ typedef struct {
 extern int altera_load(Altera_desc *desc, const void *image, size_t size);
 extern int altera_dump(Altera_desc *desc, const void *buf, size_t bsize);
 extern int altera_info(Altera_desc *desc);
+int altera_loadfs(Altera_desc *desc, const void *buf, size_t bsize,
+		  fpga_fs_info *fpga_fsinfo);
 
 /* Board specific implementation specific function types
  *********************************************************************/
@@ -123,6 +125,8 @@ int stratixv_load(Altera_desc *desc, const void *rbf_data, size_t rbf_size);
 #ifdef CONFIG_FPGA_INTEL_SDM_MAILBOX
 int intel_sdm_mb_load(Altera_desc *desc, const void *rbf_data,
 		      size_t rbf_size);
+int intel_sdm_mb_loadfs(Altera_desc *desc, const void *buf, size_t bsize,
+			fpga_fs_info *fpga_fsinfo);
 #endif
 
 #endif /* _ALTERA_H_ */
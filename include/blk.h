@@ -9,6 +9,7 @@
 
 #include <dm/uclass-id.h>
 #include <efi.h>
+#include <linux/list.h>
 
 #ifdef CONFIG_SYS_64BIT_LBA
 typedef uint64_t lbaint_t;
@@ -76,6 +77,12 @@ struct blk_desc {
 		uint32_t mbr_sig;	/* MBR integer signature */
 		efi_guid_t guid_sig;	/* GPT GUID Signature */
 	};
+	/*
+	 * Incremented on every write or erase, so that users caching data
+	 * read from the device, such as filesystem metadata, can tell that
+	 * it may have changed
+	 */
+	ulong		write_gen;
 #if CONFIG_IS_ENABLED(BLK)
 	/*
 	 * For now we have a few functions which take struct blk_desc as a
@@ -113,6 +120,9 @@ int blkcache_init(void);
 /**
  * blkcache_read() - attempt to read a set of blocks from cache
  *
+ * The longest cached prefix of the request is copied to @buffer, so the
+ * caller only needs to read the remaining blocks from the device.
+ *
  * @param iftype - uclass_id_x for type of device
  * @param dev - device index of particular type
  * @param start - starting block number
@@ -120,11 +130,11 @@ int blkcache_init(void);
  * @param blksz - size in bytes of each block
  * @param buffer - buffer to contain cached data
  *
- * Return: - 1 if block returned from cache, 0 otherwise.
+ * Return: - number of blocks returned from cache, starting at @start
  */
-int blkcache_read(int iftype, int dev,
-		  lbaint_t start, lbaint_t blkcnt,
-		  unsigned long blksz, void *buffer);
+lbaint_t blkcache_read(int iftype, int dev,
+		       lbaint_t start, lbaint_t blkcnt,
+		       unsigned long blksz, void *buffer);
 
 /**
  * blkcache_fill() - make data read from a block device available
@@ -142,10 +152,96 @@ void blkcache_fill(int iftype, int dev,
 		   lbaint_t start, lbaint_t blkcnt,
 		   unsigned long blksz, void const *buffer);
 
+/**
+ * blkcache_readahead() - detect sequential reads and plan a read-ahead
+ *
+ * This is called for every read from a device. Once a few reads follow
+ * each other, it returns the blocks which should be read from the device
+ * and passed to blkcache_fill_ahead(). Dirty blocks in that range are
+ * written back first.
+ *
+ * @param iftype - uclass_id_x for type of device
+ * @param dev - device index of particular type
+ * @param start - starting block number of the read
+ * @param blkcnt - number of blocks read
+ * @param startp - returns the first block to read ahead
+ *
+ * Return: - number of blocks to read ahead, 0 for none
+ */
+lbaint_t blkcache_readahead(int iftype, int dev,
+			    lbaint_t start, lbaint_t blkcnt,
+			    lbaint_t *startp);
+
+/**
+ * blkcache_fill_ahead() - add blocks read ahead to the block cache
+ *
+ * Unlike blkcache_fill() this accepts more than max_blocks_per_entry
+ * blocks.
+ *
+ * @param iftype - uclass_id_x for type of device
+ * @param dev - device index of particular type
+ * @param start - starting block number
+ * @param blkcnt - number of blocks available
+ * @param blksz - size in bytes of each block
+ * @param buffer - buffer containing data to cache
+ */
+void blkcache_fill_ahead(int iftype, int dev,
+			 lbaint_t start, lbaint_t blkcnt,
+			 unsigned long blksz, void const *buffer);
+
+/**
+ * blkcache_write() - pass a write to the block cache
+ *
+ * In write-back mode, small writes are kept in the cache and written to
+ * the device later. Otherwise the cached copy of the blocks is dropped and
+ * the caller must write them to the device.
+ *
+ * @param iftype - uclass_id_x for type of device
+ * @param dev - device index of particular type
+ * @param start - starting block number
+ * @param blkcnt - number of blocks to write
+ * @param blksz - size in bytes of each block
+ * @param buffer - buffer containing data to write
+ *
+ * Return: - 1 if the blocks were stored in the cache, 0 if the caller must
+ *	     write them, -ve if cached dirty blocks could not be written back
+ */
+int blkcache_write(int iftype, int dev,
+		   lbaint_t start, lbaint_t blkcnt,
+		   unsigned long blksz, void const *buffer);
+
+/**
+ * blkcache_discard() - discard the cache for a range of blocks because
+ * they are written or erased on the device
+ *
+ * Dirty blocks of the device which overlap the range are written back
+ * first. If that fails they stay in the cache, and the range must not be
+ * written to the device.
+ *
+ * @param iftype - uclass_id_x for type of device
+ * @param dev - device index of particular type
+ * @param start - starting block number
+ * @param blkcnt - number of blocks
+ * Return: 0 if OK, -ve if dirty blocks could not be written back
+ */
+int blkcache_discard(int iftype, int dev, lbaint_t start, lbaint_t blkcnt);
+
+/**
+ * blkcache_flush() - write dirty blocks back to the device
+ *
+ * @iftype - UCLASS_ID_ for type of device, or -1 for any
+ * @dev - device index of particular type, if @iftype is not -1
+ * Return: 0 if OK, -ve on error
+ */
+int blkcache_flush(int iftype, int dev);
+
 /**
  * blkcache_invalidate() - discard the cache for a set of blocks
  * because of a write or device (re)initialization.
  *
+ * Dirty blocks are dropped, so call blkcache_flush() first if they
+ * should reach the device.
+ *
  * @iftype - UCLASS_ID_ for type of device, or -1 for any
  * @dev - device index of particular type, if @iftype is not -1
  */
@@ -154,20 +250,79 @@ void blkcache_invalidate(int iftype, int dev);
 /**
  * blkcache_configure() - configure block cache
  *
+ * A change empties the cache. It is refused if dirty blocks cannot be
+ * written back first.
+ *
  * @param blocks - maximum blocks per entry
  * @param entries - maximum entries in cache
+ * Return: 0 if OK, -ve on error
+ */
+int blkcache_configure(unsigned blocks, unsigned entries);
+
+/**
+ * blkcache_configure_size() - set the memory budget of the block cache
+ *
+ * Like blkcache_configure(), a change is refused if dirty blocks cannot
+ * be written back.
+ *
+ * @param bytes - maximum number of bytes used for cached data
+ * Return: 0 if OK, -ve on error
+ */
+int blkcache_configure_size(ulong bytes);
+
+/**
+ * blkcache_configure_readahead() - set the size of read-ahead
+ *
+ * @param blocks - number of blocks to read ahead, 0 to disable
  */
-void blkcache_configure(unsigned blocks, unsigned entries);
+void blkcache_configure_readahead(unsigned blocks);
+
+/**
+ * blkcache_configure_writeback() - enable or disable write-back mode
+ *
+ * Dirty blocks are written back when it is disabled.
+ *
+ * @param enable - true to keep small writes in the cache
+ * Return: 0 if OK, -ve on error
+ */
+int blkcache_configure_writeback(bool enable);
 
 /*
  * statistics of the block cache
  */
 struct block_cache_stats {
 	unsigned hits;
+	unsigned partial; /* reads partly served from the cache */
 	unsigned misses;
 	unsigned entries; /* current entry count */
 	unsigned max_blocks_per_entry;
 	unsigned max_entries;
+	ulong bytes; /* current size of cached data */
+	ulong max_bytes;
+	unsigned readahead; /* blocks to read ahead */
+	bool writeback;
+	ulong dirty; /* blocks not yet written to the device */
+	ulong ra_blocks; /* blocks read ahead */
+	unsigned writes; /* writes kept in the cache */
+	unsigned flushes; /* writes of dirty blocks to the device */
+};
+
+/*
+ * per-device statistics of the block cache
+ */
+struct block_cache_dev_stats {
+	bool used;
+	int iftype;
+	int devnum;
+	unsigned hits;
+	unsigned partial;
+	unsigned misses;
+	unsigned entries;
+	ulong blocks; /* blocks returned from the cache */
+	ulong dirty;
+	ulong ra_blocks;
+	unsigned writes;
+	unsigned flushes;
 };
 
 /**
@@ -177,14 +332,23 @@ struct block_cache_stats {
  */
 void blkcache_stats(struct block_cache_stats *stats);
 
+/**
+ * blkcache_dev_stats() - return statistics of one device and reset
+ *
+ * @param index - index of the device, starting at 0
+ * @param stats - statistics are copied here
+ * Return: 0 if OK, -ENOENT if there is no device with that index
+ */
+int blkcache_dev_stats(int index, struct block_cache_dev_stats *stats);
+
 /** blkcache_free() - free all memory allocated to the block cache */
 void blkcache_free(void);
 
 #else
 
-static inline int blkcache_read(int iftype, int dev,
-				lbaint_t start, lbaint_t blkcnt,
-				unsigned long blksz, void *buffer)
+static inline lbaint_t blkcache_read(int iftype, int dev,
+				     lbaint_t start, lbaint_t blkcnt,
+				     unsigned long blksz, void *buffer)
 {
 	return 0;
 }
@@ -193,6 +357,36 @@ static inline void blkcache_fill(int iftype, int dev,
 				 lbaint_t start, lbaint_t blkcnt,
 				 unsigned long blksz, void const *buffer) {}
 
+static inline lbaint_t blkcache_readahead(int iftype, int dev,
+					  lbaint_t start, lbaint_t blkcnt,
+					  lbaint_t *startp)
+{
+	return 0;
+}
+
+static inline void blkcache_fill_ahead(int iftype, int dev,
+				       lbaint_t start, lbaint_t blkcnt,
+				       unsigned long blksz,
+				       void const *buffer) {}
+
+static inline int blkcache_write(int iftype, int dev,
+				 lbaint_t start, lbaint_t blkcnt,
+				 unsigned long blksz, void const *buffer)
+{
+	return 0;
+}
+
+static inline int blkcache_discard(int iftype, int dev, lbaint_t start,
+				   lbaint_t blkcnt)
+{
+	return 0;
+}
+
+static inline int blkcache_flush(int iftype, int dev)
+{
+	return 0;
+}
+
 static inline void blkcache_invalidate(int iftype, int dev) {}
 
 static inline void blkcache_free(void) {}
@@ -202,6 +396,43 @@ static inline void blkcache_free(void) {}
 #if CONFIG_IS_ENABLED(BLK)
 struct udevice;
 
+/**
+ * enum blk_req_op - Operation carried out by an asynchronous block request
+ *
+ * @BLK_REQ_READ: Read blocks into the buffer
+ * @BLK_REQ_WRITE: Write blocks from the buffer
+ */
+enum blk_req_op {
+	BLK_REQ_READ,
+	BLK_REQ_WRITE,
+};
+
+/**
+ * struct blk_req - An asynchronous block request
+ *
+ * The caller fills in @op, @start, @blkcnt and @buffer, passes the request
+ * to blk_submit() and must leave it and the buffer alone until @done is set.
+ *
+ * @op: Operation to carry out
+ * @start: First block to transfer
+ * @blkcnt: Number of blocks to transfer
+ * @buffer: Data to write, or place to put the data read
+ * @result: Number of blocks transferred, or -ve error, once @done is set
+ * @done: true once the request has completed
+ * @priv: For use by the driver while the request is pending
+ * @sibling: Link in the queue of the device while the request is pending
+ */
+struct blk_req {
+	enum blk_req_op op;
+	lbaint_t start;
+	lbaint_t blkcnt;
+	void *buffer;
+	long result;
+	bool done;
+	ulong priv;
+	struct list_head sibling;
+};
+
 /* Operations on block devices */
 struct blk_ops {
 	/**
@@ -260,6 +491,42 @@ struct blk_ops {
 	 * @return 0 if OK, -ve on error
 	 */
 	int (*select_hwpart)(struct udevice *dev, int hwpart);
+
+	/**
+	 * submit() - start an asynchronous request
+	 *
+	 * The driver starts the request, or notes it to be started later, and
+	 * returns without waiting for the transfer. Once the transfer is over,
+	 * from here or from poll(), it calls blk_req_done().
+	 *
+	 * The request is not on the queue of the device yet, so
+	 * blk_first_req() does not return it here. blk_submit() adds it when
+	 * this returns 0 without having completed it, and not at all when this
+	 * returns -EBUSY, as it then polls and submits the request again.
+	 *
+	 * This is optional. Without it, requests are carried out with read()
+	 * and write() as they are submitted.
+	 *
+	 * @dev:	Block device to use
+	 * @req:	Request to start
+	 * @return 0 if OK, -EBUSY if the device cannot take another request
+	 * until one completes, other -ve on error
+	 */
+	int (*submit)(struct udevice *dev, struct blk_req *req);
+
+	/**
+	 * poll() - make progress with the requests in the queue
+	 *
+	 * This checks the device for transfers which are over, calling
+	 * blk_req_done() for each, and starts any queued requests which it
+	 * can. It must not wait for a transfer to finish.
+	 *
+	 * This must be provided if submit() is.
+	 *
+	 * @dev:	Block device to poll
+	 * @return 0 if OK, -ve on error
+	 */
+	int (*poll)(struct udevice *dev);
 };
 
 #define blk_get_ops(dev)	((struct blk_ops *)(dev)->driver->ops)
@@ -276,6 +543,7 @@ unsigned long blk_dwrite(struct blk_desc *block_dev, lbaint_t start,
 			 lbaint_t blkcnt, const void *buffer);
 unsigned long blk_derase(struct blk_desc *block_dev, lbaint_t start,
 			 lbaint_t blkcnt);
+int blk_dflush(struct blk_desc *block_dev);
 
 /**
  * blk_read() - Read from a block device
@@ -314,6 +582,73 @@ long blk_write(struct udevice *dev, lbaint_t start, lbaint_t blkcnt,
  */
 long blk_erase(struct udevice *dev, lbaint_t start, lbaint_t blkcnt);
 
+/**
+ * blk_flush() - Write cached data of a block device to the device
+ *
+ * This writes back blocks held by the block cache in write-back mode.
+ *
+ * @dev: Device to flush
+ * Return: 0 if OK, -ve on error
+ */
+int blk_flush(struct udevice *dev);
+
+/**
+ * blk_submit() - Start an asynchronous block request
+ *
+ * Drivers which cannot run requests in the background carry out the request
+ * before this returns. Otherwise the request is queued on the device and
+ * the caller can do other work until blk_wait() or blk_poll() shows that it
+ * has completed.
+ *
+ * Asynchronous requests bypass the block cache. Data held back by the cache
+ * is written to the device first, and blocks written are dropped from it.
+ *
+ * @dev: Block device to use
+ * @req: Request to start, see struct blk_req
+ * Return: 0 if OK, -ENOSYS if the device does not support @req->op, other
+ * -ve on error
+ */
+int blk_submit(struct udevice *dev, struct blk_req *req);
+
+/**
+ * blk_poll() - Make progress with the asynchronous requests of a device
+ *
+ * @dev: Block device to poll
+ * Return: number of requests still pending, or -ve on error
+ */
+int blk_poll(struct udevice *dev);
+
+/**
+ * blk_wait() - Wait for an asynchronous block request to complete
+ *
+ * @dev: Block device the request was submitted to
+ * @req: Request to wait for
+ * Return: number of blocks transferred (which may be less than
+ * @req->blkcnt), or -ve on error
+ */
+long blk_wait(struct udevice *dev, struct blk_req *req);
+
+/**
+ * blk_req_done() - Complete an asynchronous block request
+ *
+ * This is for use by block drivers. It removes the request from the queue
+ * of the device.
+ *
+ * @req: Request which is over
+ * @result: Number of blocks transferred, or -ve error
+ */
+void blk_req_done(struct blk_req *req, long result);
+
+/**
+ * blk_first_req() - Get the oldest request queued on a device
+ *
+ * This is for use by block drivers.
+ *
+ * @dev: Block device
+ * Return: the request, or NULL if the queue is empty
+ */
+struct blk_req *blk_first_req(struct udevice *dev);
+
 /**
  * blk_find_device() - Find a block device
  *
@@ -504,6 +839,7 @@ struct blk_desc *blk_get_by_device(struct udevice *dev);
 
 #else
 #include <errno.h>
+#include <linux/err.h>
 /*
  * These functions should take struct udevice instead of struct blk_desc,
  * but this is convenient for migration to driver model. Add a 'd' prefix
@@ -513,10 +849,15 @@ struct blk_desc *blk_get_by_device(struct udevice *dev);
 static inline ulong blk_dread(struct blk_desc *block_dev, lbaint_t start,
 			      lbaint_t blkcnt, void *buffer)
 {
-	ulong blks_read;
-	if (blkcache_read(block_dev->uclass_id, block_dev->devnum,
-			  start, blkcnt, block_dev->blksz, buffer))
+	ulong blks_read, cached;
+
+	cached = blkcache_read(block_dev->uclass_id, block_dev->devnum,
+			       start, blkcnt, block_dev->blksz, buffer);
+	if (cached == blkcnt)
 		return blkcnt;
+	start += cached;
+	blkcnt -= cached;
+	buffer += cached * block_dev->blksz;
 
 	/*
 	 * We could check if block_read is NULL and return -ENOSYS. But this
@@ -524,17 +865,20 @@ static inline ulong blk_dread(struct blk_desc *block_dev, lbaint_t start,
 	 * it would be an error to try an operation that does not exist.
 	 */
 	blks_read = block_dev->block_read(block_dev, start, blkcnt, buffer);
+	if (IS_ERR_VALUE(blks_read))
+		return blks_read;
 	if (blks_read == blkcnt)
 		blkcache_fill(block_dev->uclass_id, block_dev->devnum,
 			      start, blkcnt, block_dev->blksz, buffer);
 
-	return blks_read;
+	return cached + blks_read;
 }
 
 static inline ulong blk_dwrite(struct blk_desc *block_dev, lbaint_t start,
 			       lbaint_t blkcnt, const void *buffer)
 {
 	blkcache_invalidate(block_dev->uclass_id, block_dev->devnum);
+	block_dev->write_gen++;
 	return block_dev->block_write(block_dev, start, blkcnt, buffer);
 }
 
@@ -542,6 +886,7 @@ static inline ulong blk_derase(struct blk_desc *block_dev, lbaint_t start,
 			       lbaint_t blkcnt)
 {
 	blkcache_invalidate(block_dev->uclass_id, block_dev->devnum);
+	block_dev->write_gen++;
 	return block_dev->block_erase(block_dev, start, blkcnt);
 }
 
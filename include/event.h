@@ -37,6 +37,9 @@ enum event_t {
 	/* To be called once, before calling main_loop() */
 	EVT_MAIN_LOOP,
 
+	/* An lmb is set up, before anything is loaded into the memory */
+	EVT_LMB_RESERVE,
+
 	EVT_COUNT
 };
 
@@ -69,6 +72,15 @@ union event_data {
 		oftree tree;
 		struct bootm_headers *images;
 	} ft_fixup;
+
+	/**
+	 * struct event_lmb_reserve - lmb set up for a load or boot
+	 *
+	 * @lmb: lmb to add reserved regions to
+	 */
+	struct event_lmb_reserve {
+		struct lmb *lmb;
+	} lmb_reserve;
 };
 
 /**
@@ -0,0 +1,104 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * Copyright (C) 2024 Intel Corporation <www.intel.com>
+ *
+ * Pipelined transfer of a bitstream to the SDM (Secure Device Manager).
+ *
+ * The SDM accepts a bitstream as a sequence of RECONFIG_DATA commands, each
+ * pointing at one chunk in memory, and allows a few of them to be in flight
+ * at once. The engine here keeps that pipeline full. Chunks either come
+ * straight from a bitstream which is already in memory, or are read into a
+ * small ring of buffers by a callback while the SDM is still consuming the
+ * previous chunks, so a bitstream of any size can be loaded from storage
+ * using only the memory of the ring.
+ */
+
+#ifndef _INTEL_SDM_STREAM_H_
+#define _INTEL_SDM_STREAM_H_
+
+#include <linux/types.h>
+
+/* Valid command IDs are 1 to 15 */
+#define SDM_STREAM_ID_MAX	15
+#define SDM_STREAM_BUFS_MAX	SDM_STREAM_ID_MAX
+
+/* Returned by &sdm_stream_ops.submit when no more commands fit for now */
+#define SDM_STREAM_FULL		1
+
+struct sdm_stream;
+
+/**
+ * struct sdm_stream_ops - access to the SDM for the transfer engine
+ *
+ * @submit:	Send one RECONFIG_DATA command with command ID @id for @len
+ *		bytes at @data. Returns 0 if it was accepted, SDM_STREAM_FULL
+ *		if it was accepted but nothing more should be sent until a
+ *		command completes, -EAGAIN if it was not accepted and should
+ *		be sent again once a command completes, or another -ve error
+ * @reap:	Collect the response to one RECONFIG_DATA command. Returns its
+ *		command ID and sets @status to the SDM error code in the
+ *		response, 0 if no response is available yet, or -ve error
+ */
+struct sdm_stream_ops {
+	int (*submit)(struct sdm_stream *s, u8 id, const void *data, u32 len);
+	int (*reap)(struct sdm_stream *s, u32 *status);
+};
+
+/**
+ * struct sdm_stream - one bitstream transfer to the SDM
+ *
+ * @ops:	Access to the SDM
+ * @priv:	Private data for @ops
+ * @read:	Reads @len bytes at @offset into the bitstream to @buf and
+ *		returns the number of bytes read, 0 at the end of the
+ *		bitstream, or -ve error. If NULL the bitstream is at @data.
+ * @src:	Private data for @read
+ * @data:	Bitstream in memory, used when @read is NULL
+ * @size:	Size of the bitstream in bytes
+ * @xfer_max:	Number of commands the SDM accepts at once
+ * @chunk:	Maximum number of bytes per command
+ * @buf:	Ring of @nr_bufs buffers of @chunk bytes each, for @read
+ * @nr_bufs:	Number of buffers in @buf
+ * @timeout_ms:	Time to wait for a response while commands are in flight
+ *
+ * The fields below are filled in by sdm_stream_send():
+ *
+ * @xfers:	Number of commands the SDM completed
+ * @bytes:	Number of bytes in those commands
+ * @max_inflight: Highest number of commands in flight at once
+ */
+struct sdm_stream {
+	const struct sdm_stream_ops *ops;
+	void *priv;
+	int (*read)(struct sdm_stream *s, void *buf, ulong offset, u32 len);
+	void *src;
+	const void *data;
+	ulong size;
+	u32 xfer_max;
+	u32 chunk;
+	void *buf[SDM_STREAM_BUFS_MAX];
+	int nr_bufs;
+	ulong timeout_ms;
+
+	u32 xfers;
+	ulong bytes;
+	u32 max_inflight;
+};
+
+/**
+ * sdm_stream_send() - send a bitstream to the SDM
+ *
+ * Sends RECONFIG_DATA commands until the whole bitstream has been accepted.
+ * Command IDs and ring buffers are only reused once the SDM has responded to
+ * the command that was using them. After an error no further commands are
+ * sent, but the function still waits for the ones in flight to complete,
+ * for at most @timeout_ms between responses. That includes an error from
+ * &sdm_stream_ops.reap, unless @timeout_ms is 0.
+ *
+ * @s:		Transfer to run
+ * Return:	0 if OK, the error code from the first failed SDM response,
+ *		or -ve error
+ */
+int sdm_stream_send(struct sdm_stream *s);
+
+#endif /* _INTEL_SDM_STREAM_H_ */
@@ -74,6 +74,7 @@ struct bd_info;
 #define MMC_CAP_NONREMOVABLE	BIT(14)
 #define MMC_CAP_NEEDS_POLL	BIT(15)
 #define MMC_CAP_CD_ACTIVE_HIGH  BIT(16)
+#define MMC_CAP_CMD23		BIT(17)	/* host can end transfers by CMD23 */
 
 #define MMC_MODE_8BIT		BIT(30)
 #define MMC_MODE_4BIT		BIT(29)
@@ -82,6 +83,7 @@ struct bd_info;
 
 
 #define SD_DATA_4BIT	0x00040000
+#define SD_SCR_CMD23_SUPPORT	0x00000002
 
 #define IS_SD(x)	((x)->version & SD_VERSION_SD)
 #define IS_MMC(x)	((x)->version & MMC_VERSION_MMC)
@@ -542,6 +544,37 @@ struct dm_mmc_ops {
 	 * @return 0 if success, -ve on error
 	 */
 	int (*hs400_prepare_ddr)(struct udevice *dev);
+
+#if CONFIG_IS_ENABLED(BLK_ASYNC)
+	/**
+	 * send_cmd_start() - Send a command and start its data transfer
+	 *
+	 * This works like send_cmd() but may return once the command is
+	 * answered, leaving the data to move in the background until
+	 * send_cmd_poll() reports that it is done. It may also finish the
+	 * transfer before returning, if the host cannot leave it running.
+	 *
+	 * @dev:	Device to receive the command
+	 * @cmd:	Command to send
+	 * @data:	Data to send/receive, which must stay valid until
+	 *		send_cmd_poll() returns something other than -EBUSY
+	 * @return 0 if OK, -ve on error
+	 */
+	int (*send_cmd_start)(struct udevice *dev, struct mmc_cmd *cmd,
+			      struct mmc_data *data);
+
+	/**
+	 * send_cmd_poll() - Check the transfer started by send_cmd_start()
+	 *
+	 * This must not wait for the transfer to finish.
+	 *
+	 * @dev:	Device to check
+	 * @data:	Data passed to send_cmd_start()
+	 * @return 0 if the transfer is done, -EBUSY if it is still running,
+	 * other -ve on error
+	 */
+	int (*send_cmd_poll)(struct udevice *dev, struct mmc_data *data);
+#endif
 };
 
 #define mmc_get_ops(dev)        ((struct dm_mmc_ops *)(dev)->driver->ops)
@@ -723,6 +756,11 @@ struct mmc {
 	struct udevice *vmmc_supply;	/* Main voltage regulator (Vcc)*/
 	struct udevice *vqmmc_supply;	/* IO voltage regulator (Vccq)*/
 #endif
+#if CONFIG_IS_ENABLED(BLK_ASYNC)
+	struct mmc_data async_data;	/* data of the read in flight */
+	lbaint_t async_cur;	/* blocks in flight, 0 if none */
+	bool async_sbc;		/* read in flight was sized by CMD23 */
+#endif
 #endif
 	u8 *ext_csd;
 	u32 cardtype;		/* cardtype read from the MMC */
@@ -91,6 +91,18 @@ int ndisc_receive(struct ethernet_hdr *et, struct ip6_hdr *ip6, int len);
  */
 void ndisc_request(void);
 
+/**
+ * ndisc_lookup() - Look up the MAC address packets to a host are sent to
+ *
+ * This is the address of the host, or of the gateway if it is not on our
+ * subnet, as last learned by ND.
+ *
+ * @dest:	IPv6 address of the host
+ * @enetaddr:	returns the MAC address
+ * Return: 0 if it is known, -ENOENT if ND is needed
+ */
+int ndisc_lookup(struct in6_addr *dest, uchar enetaddr[6]);
+
 /**
  * ndisc_init() - Check ND response timeout
  *
@@ -114,6 +126,11 @@ static inline void ndisc_request(void)
 {
 }
 
+static inline int ndisc_lookup(struct in6_addr *dest, uchar enetaddr[6])
+{
+	return -ENOENT;
+}
+
 static inline int ndisc_timeout_check(void)
 {
 	return 0;
@@ -40,6 +40,8 @@ struct udevice;
 
 /* Number of packets processed together */
 #define ETH_PACKETS_BATCH_RECV	32
+/* Most packets taken from a driver in one go, which is a full ring */
+#define ETH_RX_BATCH_MAX	1024
 
 /* ARP hardware address length */
 #define ARP_HLEN 6
@@ -141,6 +143,29 @@ enum eth_recv_flags {
 	ETH_RECV_CHECK_DEVICE		= 1 << 0,
 };
 
+/**
+ * struct eth_stats - statistics of an Ethernet device
+ *
+ * @rx_packets: Packets received
+ * @rx_bytes: Bytes received
+ * @rx_errors: Packets the driver failed to receive
+ * @rx_dropped: Packets dropped as all receive descriptors were in use
+ * @rx_overruns: Packets dropped as the receive FIFO was full
+ * @tx_packets: Packets sent
+ * @tx_bytes: Bytes sent
+ * @tx_errors: Packets the driver failed to send
+ */
+struct eth_stats {
+	ulong rx_packets;
+	u64 rx_bytes;
+	ulong rx_errors;
+	ulong rx_dropped;
+	ulong rx_overruns;
+	ulong tx_packets;
+	u64 tx_bytes;
+	ulong tx_errors;
+};
+
 /**
  * struct eth_ops - functions of Ethernet MAC controllers
  *
@@ -167,6 +192,8 @@ enum eth_recv_flags {
  *		    to the network stack. This function should fill in the
  *		    eth_pdata::enetaddr field - optional
  * set_promisc: Enable or Disable promiscuous mode
+ * get_stats: Add the packets the hardware dropped since the last call to the
+ *	      counts in "stats" - optional
  */
 struct eth_ops {
 	int (*start)(struct udevice *dev);
@@ -178,6 +205,7 @@ struct eth_ops {
 	int (*write_hwaddr)(struct udevice *dev);
 	int (*read_rom_hwaddr)(struct udevice *dev);
 	int (*set_promisc)(struct udevice *dev, bool enable);
+	void (*get_stats)(struct udevice *dev, struct eth_stats *stats);
 };
 
 #define eth_get_ops(dev) ((struct eth_ops *)(dev)->driver->ops)
@@ -201,6 +229,141 @@ void eth_set_current(void);		/* set nterface to ethcur var */
 
 int eth_get_dev_index(void);		/* get the device index */
 
+/**
+ * eth_get_stats() - get the statistics of an Ethernet device
+ *
+ * @dev: the device, which must be probed
+ * @stats: returns the statistics since it was probed
+ * Return: 0 if OK, -ve on error
+ */
+int eth_get_stats(struct udevice *dev, struct eth_stats *stats);
+
+/**
+ * enum eth_csum - checksums an Ethernet controller works out itself
+ *
+ * @ETH_CSUM_TX: it fills in the TCP and UDP checksums of packets it sends,
+ *		 over IPv4 and IPv6, which the network stack leaves zero
+ * @ETH_CSUM_RX: it checks those of packets it receives, see eth_rx_csum_ok()
+ */
+enum eth_csum {
+	ETH_CSUM_TX	= 1 << 0,
+	ETH_CSUM_RX	= 1 << 1,
+};
+
+/**
+ * eth_set_csum() - tell which checksums a device works out itself
+ *
+ * Drivers call this from start(), once they know what the controller can do.
+ * Nothing is offloaded until they do.
+ *
+ * @dev: the device
+ * @csum: checksums offloaded, a mask of enum eth_csum
+ */
+void eth_set_csum(struct udevice *dev, uint csum);
+
+/**
+ * eth_tx_csum() - check whether the current device fills in checksums
+ *
+ * Return: true if the TCP and UDP checksums of packets sent are left zero
+ */
+bool eth_tx_csum(void);
+
+/**
+ * eth_rx_csum_ok() - vouch for the checksums of a packet received
+ *
+ * Drivers call this from recv() for a TCP or UDP packet whose IP header and
+ * TCP or UDP checksums the controller found good, so that the network stack
+ * does not check them again.
+ *
+ * @dev: device receiving the packet
+ */
+void eth_rx_csum_ok(struct udevice *dev);
+
+/**
+ * struct eth_rx_lend - memory lent to the driver for packet payloads
+ *
+ * @buf: where the payload of the next packet received should go
+ * @step: size of a payload, those of the packets after it go one after the
+ *	  other
+ * @end: end of the memory lent
+ */
+struct eth_rx_lend {
+	void *buf;
+	ulong step;
+	void *end;
+};
+
+#if IS_ENABLED(CONFIG_NET_RX_LEND)
+/**
+ * eth_rx_lend() - lend memory to the current device for packet payloads
+ *
+ * A driver able to put the headers and the payload of a packet apart then
+ * puts payloads straight where @lend says, sparing the protocol a copy. It
+ * is told where the payload of a packet went by net_rx_payload, and must
+ * check that it is where it belongs before using it in place. Buffers the
+ * driver took before keep being used for the packets following.
+ *
+ * @lend: memory to lend, NULL to stop lending more
+ */
+void eth_rx_lend(const struct eth_rx_lend *lend);
+
+/**
+ * eth_rx_lent() - check whether memory is lent to the driver
+ *
+ * Memory the driver holds a lent buffer in, or shares a cache line with one,
+ * must not be written to until the buffer is used.
+ *
+ * @buf: start of the memory
+ * @size: size of the memory
+ * Return: true if any of it is lent
+ */
+bool eth_rx_lent(const void *buf, ulong size);
+
+/**
+ * eth_rx_reclaim() - make sure no lent memory is still held by the driver
+ *
+ * This stops lending, and halts the device if the driver holds lent buffers.
+ */
+void eth_rx_reclaim(void);
+
+/**
+ * eth_rx_take() - take a lent buffer to receive the payload of a packet in
+ *
+ * Drivers call this when they hand a buffer for the payload of a packet to
+ * the controller, and eth_rx_give() once that packet is received, in the same
+ * order. Only payloads of TCP and UDP packets, which are not IP fragments,
+ * may be put apart from the headers.
+ *
+ * @dev: device taking the buffer
+ * @size: most bytes the controller writes to the buffer
+ * Return: buffer, or NULL if none is lent
+ */
+void *eth_rx_take(struct udevice *dev, ulong size);
+
+/**
+ * eth_rx_give() - give back a lent buffer once its packet is received
+ *
+ * @dev: device giving the buffer back
+ * @buf: buffer from eth_rx_take()
+ * @len: length of the payload put in it, 0 if the packet was not split
+ */
+void eth_rx_give(struct udevice *dev, void *buf, int len);
+#else
+static inline void eth_rx_lend(const struct eth_rx_lend *lend) {}
+static inline bool eth_rx_lent(const void *buf, ulong size)
+{
+	return false;
+}
+
+static inline void eth_rx_reclaim(void) {}
+static inline void *eth_rx_take(struct udevice *dev, ulong size)
+{
+	return NULL;
+}
+
+static inline void eth_rx_give(struct udevice *dev, void *buf, int len) {}
+#endif
+
 /**
  * eth_env_set_enetaddr_by_index() - set the MAC address environment variable
  *
@@ -245,6 +408,17 @@ int eth_receive(void *packet, int length); /* Receive a packet*/
 extern void (*push_packet)(void *packet, int length);
 #endif
 int eth_rx(void);			/* Check for received packets */
+
+/**
+ * eth_rx_max() - check for received packets, taking at most @max of them
+ *
+ * Like eth_rx(), for callers that can only hold a few packets at a time,
+ * so that the rest stays with the driver for the next call.
+ *
+ * @max: most packets to take from the driver
+ * Return: 0 if OK, -ve on error
+ */
+int eth_rx_max(int max);
 void eth_halt(void);			/* stop SCC */
 const char *eth_get_name(void);		/* get name of current device */
 int eth_mcast_join(struct in_addr mcast_addr, int join);
@@ -491,10 +665,14 @@ extern u8		net_ethaddr[ARP_HLEN];		/* Our ethernet address */
 extern u8		net_server_ethaddr[ARP_HLEN];	/* Boot server enet address */
 extern struct in_addr	net_ip;		/* Our    IP addr (0 = unknown) */
 extern struct in_addr	net_server_ip;	/* Server IP addr (0 = unknown) */
+extern struct in_addr	net_mcast_addr;	/* Multicast group joined (0 = none) */
 extern uchar		*net_tx_packet;		/* THE transmit packet */
 extern uchar		*net_rx_packets[PKTBUFSRX]; /* Receive packets */
 extern uchar		*net_rx_packet;		/* Current receive packet */
 extern int		net_rx_packet_len;	/* Current rx packet length */
+extern uchar		*net_rx_payload;	/* Its payload, if put apart */
+extern int		net_rx_payload_len;	/* Its payload length */
+extern bool		net_rx_csum_ok;	/* Its checksums were checked */
 extern const u8		net_bcast_ethaddr[ARP_HLEN];	/* Ethernet broadcast address */
 extern const u8		net_null_ethaddr[ARP_HLEN];
 
@@ -664,6 +842,10 @@ int net_send_ip_packet(uchar *ether, struct in_addr dest, int dport, int sport,
  * @tcp_seq_num: TCP sequence number of this transmission
  * @tcp_ack_num: TCP stream acknolegement number
  *
+ * The packet goes to net_server_ip, or to net_server_ip6 if use_ip6 is set.
+ * The payload is put in net_tx_packet first, after room for the headers
+ * which takes tcp_ip_extra() more over IPv6.
+ *
  * Return: 0 on success, other value on failure
  */
 int net_send_tcp_packet(int payload_len, int dport, int sport, u8 action,
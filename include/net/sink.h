@@ -0,0 +1,156 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * Write files loaded over the network straight to storage
+ */
+
+#ifndef __NET_SINK_H__
+#define __NET_SINK_H__
+
+#include <blk.h>
+
+struct hash_algo;
+struct mtd_info;
+
+/**
+ * enum net_sink_type - how the file is written
+ *
+ * @NET_SINK_BLK: as it is, to a block device
+ * @NET_SINK_GZIP: decompressed, to a block device, as gzwrite does
+ * @NET_SINK_SPARSE: an Android sparse image, to a block device
+ * @NET_SINK_MTD: as it is, to an MTD device, erasing it as it goes
+ */
+enum net_sink_type {
+	NET_SINK_BLK,
+	NET_SINK_GZIP,
+	NET_SINK_SPARSE,
+	NET_SINK_MTD,
+};
+
+#if IS_ENABLED(CONFIG_CMD_NETSINK)
+/**
+ * net_sink_blk() - write the next file loaded to a block device
+ *
+ * @type: NET_SINK_BLK, NET_SINK_GZIP or NET_SINK_SPARSE
+ * @desc: block device
+ * @start: first block written to
+ * @count: number of blocks which may be written to
+ * Return: 0 if OK, -ve on error
+ */
+int net_sink_blk(enum net_sink_type type, struct blk_desc *desc,
+		 lbaint_t start, lbaint_t count);
+
+/**
+ * net_sink_mtd() - write the next file loaded to an MTD device
+ *
+ * Erase blocks are erased before they are written to. Bad ones are skipped.
+ *
+ * @mtd: MTD device, which is put once the file is written
+ * @off: offset written to first, which must be that of an erase block
+ * Return: 0 if OK, -ve on error
+ */
+int net_sink_mtd(struct mtd_info *mtd, u64 off);
+
+/**
+ * net_sink_show() - show where the next file loaded goes
+ */
+void net_sink_show(void);
+
+/**
+ * net_sink_release() - load files into memory again
+ */
+void net_sink_release(void);
+
+/**
+ * net_sink_start() - start loading a file
+ *
+ * A protocol loading a file calls this before storing any of it. Starting
+ * again, after a restart of the network loop, keeps what was written.
+ *
+ * Return: true if the file is to be passed to net_sink_write() rather than
+ * stored in memory
+ */
+bool net_sink_start(void);
+
+/**
+ * net_sink_write() - pass on part of the file
+ *
+ * Parts may come in any order, and more than once, within
+ * net_sink_room() bytes of the first one missing. They are written out in
+ * order once enough of them is there.
+ *
+ * @off: offset of @buf in the file
+ * @buf: data
+ * @len: length of @buf
+ * Return: 0 if OK, -ENOSPC if it does not fit, other -ve on error
+ */
+int net_sink_write(u64 off, const void *buf, ulong len);
+
+/**
+ * net_sink_room() - get how far past the first byte missing parts may go
+ *
+ * Return: number of bytes
+ */
+ulong net_sink_room(void);
+
+/**
+ * net_sink_hash() - hash the file as it is written out
+ *
+ * @algo: hash algorithm
+ * Return: 0 if OK, -ve on error
+ */
+int net_sink_hash(struct hash_algo *algo);
+
+/**
+ * net_sink_digest() - write out all of the file and get its hash
+ *
+ * No more of the file may be passed on afterwards.
+ *
+ * @digest: returns the hash
+ * @size: size of @digest, returns the size of the hash
+ * Return: 0 if OK, -ve on error
+ */
+int net_sink_digest(u8 *digest, int *size);
+
+/**
+ * net_sink_end() - finish writing the file, if one was started
+ *
+ * The network loop calls this once it is over. Either way, the next file
+ * is loaded into memory again.
+ *
+ * @ok: the whole file was loaded, else writing it is given up
+ * Return: 0 if OK or none was started, -ve on error
+ */
+int net_sink_end(bool ok);
+#else
+static inline bool net_sink_start(void)
+{
+	return false;
+}
+
+static inline int net_sink_write(u64 off, const void *buf, ulong len)
+{
+	return -ENOSYS;
+}
+
+static inline ulong net_sink_room(void)
+{
+	return 0;
+}
+
+static inline int net_sink_hash(struct hash_algo *algo)
+{
+	return -ENOSYS;
+}
+
+static inline int net_sink_digest(u8 *digest, int *size)
+{
+	return -ENOSYS;
+}
+
+static inline int net_sink_end(bool ok)
+{
+	return 0;
+}
+#endif
+
+#endif /* __NET_SINK_H__ */
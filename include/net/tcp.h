@@ -68,8 +68,8 @@ struct ip_tcp_hdr {
  * TCP header options, Seq, MSS, and SACK
  */
 
-#define TCP_SACK 32			/* Number of packets analyzed   */
-					/* on leading edge of stream    */
+#define TCP_SACK 32			/* Number of hills kept beyond  */
+					/* the acknowledged edge        */
 
 #define TCP_O_END	0x00		/* End of option list		*/
 #define TCP_1_NOP	0x01		/* Single padding NOP		*/
@@ -87,6 +87,7 @@ struct ip_tcp_hdr {
 #define TCP_OPT_LEN_A	0x0a		/* Timestamp Length		*/
 #define TCP_MSS		1460		/* Max segment size		*/
 #define TCP_SCALE	0x01		/* Scale			*/
+#define TCP_SCALE_MAX	14		/* Largest scale allowed	*/
 
 /**
  * struct tcp_mss - TCP option structure for MSS (Max segment size)
@@ -279,6 +280,7 @@ enum tcp_state {
 
 enum tcp_state tcp_get_tcp_state(void);
 void tcp_set_tcp_state(enum tcp_state new_state);
+int tcp_select_conn(u16 port);
 int tcp_set_tcp_header(uchar *pkt, int dport, int sport, int payload_len,
 		       u8 action, u32 tcp_seq_num, u32 tcp_ack_num);
 
@@ -299,7 +301,30 @@ typedef void rxhand_tcp(uchar *pkt, u16 dport,
 			u8 action, unsigned int len);
 void tcp_set_tcp_handler(rxhand_tcp *f);
 
+/**
+ * rxhand_tcp_check() - check that data received can be taken
+ * @pkt: pointer to the data
+ * @tcp_seq_num: TCP sequential number of the data
+ * @len: length of the data
+ *
+ * Return: true to take the data, false to drop it for the peer to send again
+ */
+typedef bool rxhand_tcp_check(uchar *pkt, u32 tcp_seq_num, int len);
+void tcp_set_tcp_check(rxhand_tcp_check *f);
+void tcp_set_rx_window(u32 size, bool ooo);
+u32 tcp_get_ack_edge(void);
+
+struct ip6_hdr;
+
 void rxhand_tcp_f(union tcp_build_pkt *b, unsigned int len);
+void rxhand_tcp6_f(struct ip6_hdr *ip6, unsigned int len);
+
+/**
+ * tcp_ip_extra() - room the IP header of TCP packets takes beyond IPv4's
+ *
+ * Return: IP6_HDR_SIZE - IP_HDR_SIZE while TCP goes over IPv6, else 0
+ */
+int tcp_ip_extra(void);
 
 u16 tcp_set_pseudo_header(uchar *pkt, struct in_addr src, struct in_addr dest,
 			  int tcp_len, int pkt_len);
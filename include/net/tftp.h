@@ -22,6 +22,12 @@ void tftp_start(enum proto_t protocol);	/* Begin TFTP get/put */
 void tftp_start_server(void);	/* Wait for incoming TFTP put */
 #endif
 
+/*
+ * Leave the multicast group of a TFTP download, if any, and free its state.
+ * net_loop() calls this on every exit and before a restart.
+ */
+void tftp_mcast_cleanup(void);
+
 extern ulong tftp_timeout_ms;
 extern int tftp_timeout_count_max;
 
@@ -20,3 +20,6 @@ enum wget_state {
 #define SERVER_PORT		80
 #define WGET_RETRY_COUNT	30
 #define WGET_TIMEOUT		2000UL
+#define WGET_RESUME_TIMEOUTS	3	/* Timeouts in a row before resuming */
+#define WGET_ACK_SEGMENTS	2	/* Segments acknowledged at once */
+#define WGET_ACK_DELAY		10UL	/* ms before acknowledging fewer */
@@ -97,6 +97,8 @@ struct udp_hdr {
 #define IPV6_NDISC_HOPLIMIT             255
 #define NDISC_TIMEOUT			5000UL
 #define NDISC_TIMEOUT_COUNT             3
+/* how long a neighbour's link-layer address is trusted, see RFC 4861 */
+#define NDISC_REACHABLE_TIME		30000UL
 
 /* struct icmp6hdr - Internet Control Message Protocol header for IPV6 */
 struct icmp6hdr {
@@ -344,6 +346,22 @@ int ip6_add_hdr(uchar *xip, struct in6_addr *src, struct in6_addr *dest,
 int net_send_udp_packet6(uchar *ether, struct in6_addr *dest, int dport,
 			 int sport, int len);
 
+/**
+ * net_send_tcp_packet6() - Make up TCP packet to the server and send it
+ *
+ * This is net_send_tcp_packet() over IPv6, to net_server_ip6.
+ *
+ * @payload_len:	length of the payload, which is in place already
+ * @dport:		destination port
+ * @sport:		source port
+ * @action:		TCP flags
+ * @tcp_seq_num:	TCP sequence number
+ * @tcp_ack_num:	TCP acknowledgment number
+ * Return: 0 if sent, 1 if waiting for ND, -ve on error
+ */
+int net_send_tcp_packet6(int payload_len, int dport, int sport, u8 action,
+			 u32 tcp_seq_num, u32 tcp_ack_num);
+
 /**
  * net_ip6_handler() - Handle IPv6 packet
  *
@@ -432,6 +450,13 @@ net_send_udp_packet6(uchar *ether, struct in6_addr *dest,
 	return -1;
 }
 
+static inline int
+net_send_tcp_packet6(int payload_len, int dport, int sport, u8 action,
+		     u32 tcp_seq_num, u32 tcp_ack_num)
+{
+	return -1;
+}
+
 static inline int
 net_ip6_handler(struct ethernet_hdr *et, struct ip6_hdr *ip6,
 		int len)
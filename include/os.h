@@ -525,4 +525,25 @@ long os_get_time_offset(void);
  */
 void os_set_time_offset(long offset);
 
+/**
+ * os_thread_start() - start a host thread
+ *
+ * The thread must not call back into U-Boot code that uses global data or
+ * the U-Boot heap, since neither is thread-safe.
+ *
+ * @tidp:	Returns the thread ID, for use with os_thread_join()
+ * @fn:		Function to run in the new thread
+ * @arg:	Argument to pass to @fn
+ * Return:	0 if OK, -EAGAIN if the thread could not be created
+ */
+int os_thread_start(ulong *tidp, void *(*fn)(void *arg), void *arg);
+
+/**
+ * os_thread_join() - wait for a host thread to finish
+ *
+ * @tid:	Thread ID returned by os_thread_start()
+ * Return:	0 if OK, -ESRCH if the thread could not be joined
+ */
+int os_thread_join(ulong tid);
+
 #endif
@@ -251,6 +251,8 @@
 #define SDHCI_QUIRK_SUPPORT_SINGLE	(1 << 10)
 /* Capability register bit-63 indicates HS400 support */
 #define SDHCI_QUIRK_CAPS_BIT63_FOR_HS400	BIT(11)
+/* Controller cannot end multiple-block transfers announced by CMD23 */
+#define SDHCI_QUIRK_NO_CMD23		BIT(12)
 
 /* to make gcc happy */
 struct sdhci_host;
@@ -355,6 +357,11 @@ struct sdhci_host {
 #if CONFIG_IS_ENABLED(MMC_SDHCI_ADMA)
 	struct sdhci_adma_desc *adma_desc_table;
 #endif
+#if CONFIG_IS_ENABLED(BLK_ASYNC)
+	struct mmc_data *bg_data;	/* data of the DMA left running */
+	dma_addr_t bg_addr;	/* next SDMA boundary of that transfer */
+	ulong bg_start;		/* time it started, for the timeout */
+#endif
 };
 
 #ifdef CONFIG_MMC_SDHCI_IO_ACCESSORS
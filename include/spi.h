@@ -654,6 +654,81 @@ int spi_slave_of_to_plat(struct udevice *dev, struct dm_spi_slave_plat *plat);
  */
 int spi_cs_info(struct udevice *bus, uint cs, struct spi_cs_info *info);
 
+/* Longest pattern that spi_scan_taps() and the tap cache can compare */
+#define SPI_TAP_SCAN_MAX_LEN	16
+
+/**
+ * struct spi_tap_scan - Describes a read-capture delay scan
+ *
+ * Controllers that sample read data with a programmable delay need to find
+ * the delay (tap) which works at the current clock. This is done by reading
+ * something known, e.g. the flash ID, at every tap.
+ *
+ * @taps:	Number of taps, 0..@taps - 1 are tried
+ * @set_tap:	Select a tap; returns 0 if OK, -ve on error
+ * @read:	Read @len bytes at the current tap; returns 0 if OK, -ve on
+ *		error. A read which returns wrong data is not an error
+ * @pattern:	Data which @read must return for the tap to pass
+ * @len:	Length of @pattern, at most SPI_TAP_SCAN_MAX_LEN
+ */
+struct spi_tap_scan {
+	uint taps;
+	int (*set_tap)(struct udevice *dev, uint tap);
+	int (*read)(struct udevice *dev, u8 *buf, uint len);
+	const u8 *pattern;
+	uint len;
+};
+
+/**
+ * spi_scan_taps() - Find the best read-capture tap
+ *
+ * This tries every tap and picks the middle of the widest run of passing
+ * taps, which leaves the most margin on both sides. The tap is left at the
+ * last one tried, so the caller must select the result.
+ *
+ * @dev:	Device passed to the @scan callbacks
+ * @scan:	Describes the scan
+ * @lop:	Returns the first tap of the window, if not NULL
+ * @hip:	Returns the last tap of the window, if not NULL
+ * Return: tap to use, -ENOENT if no tap passes, other -ve value on error
+ */
+int spi_scan_taps(struct udevice *dev, const struct spi_tap_scan *scan,
+		  int *lop, int *hip);
+
+/**
+ * spi_tap_cache_get() - Look up a previously calibrated tap
+ *
+ * With CONFIG_SPI_TAP_CACHE (CONFIG_SPL_SPI_TAP_CACHE in SPL) the result of
+ * a tap scan is kept in the environment variable spi<seq>_rddelay. It is
+ * only used if it was found for the same clock, chip select and pattern, so
+ * that a different flash or bus speed triggers a new scan.
+ *
+ * @bus:	SPI bus
+ * @hz:		Bus clock the tap is needed for
+ * @cs:		Chip select
+ * @pattern:	Pattern used to calibrate
+ * @len:	Length of @pattern
+ * Return: cached tap, or -ENOENT if there is no matching entry
+ */
+int spi_tap_cache_get(struct udevice *bus, uint hz, uint cs,
+		      const u8 *pattern, uint len);
+
+/**
+ * spi_tap_cache_set() - Record a calibrated tap
+ *
+ * This updates the environment only; the entry survives a reset once the
+ * environment is saved.
+ *
+ * @bus:	SPI bus
+ * @hz:		Bus clock the tap was found for
+ * @cs:		Chip select
+ * @pattern:	Pattern used to calibrate
+ * @len:	Length of @pattern
+ * @tap:	Tap to record
+ */
+void spi_tap_cache_set(struct udevice *bus, uint hz, uint cs,
+		       const u8 *pattern, uint len, uint tap);
+
 struct sandbox_state;
 
 /**
@@ -6,6 +6,7 @@
  */
 
 #include <common.h>
+#include <blk.h>
 #include <bootm.h>
 #include <div64.h>
 #include <dm/device.h>
@@ -2167,6 +2168,9 @@ static efi_status_t EFIAPI efi_exit_boot_services(efi_handle_t image_handle,
 	/* Notify variable services */
 	efi_variables_boot_exit_notify();
 
+	/* The OS takes over the disks: write back the block cache */
+	blkcache_flush(-1, 0);
+
 	/* Remove all events except EVT_SIGNAL_VIRTUAL_ADDRESS_CHANGE */
 	list_for_each_entry_safe(evt, next_event, &efi_events, link) {
 		if (evt->type != EVT_SIGNAL_VIRTUAL_ADDRESS_CHANGE)
@@ -3174,6 +3178,9 @@ efi_status_t EFIAPI efi_start_image(efi_handle_t image_handle,
 		}
 	}
 
+	/* the image may access the disks without going through U-Boot */
+	blkcache_flush(-1, 0);
+
 	/* call the image! */
 	if (setjmp(&exit_jmp)) {
 		/*
@@ -729,7 +729,8 @@ static void EFIAPI efi_network_timer_notify(struct efi_event *event,
 
 	if (!rx_packet_num) {
 		push_packet = efi_net_push;
-		eth_rx();
+		/* Leave what does not fit into the ring with the driver */
+		eth_rx_max(ETH_PACKETS_BATCH_RECV);
 		push_packet = NULL;
 		if (rx_packet_num) {
 			this->int_status |=
@@ -6,6 +6,7 @@
  */
 
 #include <common.h>
+#include <blk.h>
 #include <command.h>
 #include <cpu_func.h>
 #include <dm.h>
@@ -206,6 +207,7 @@ static void EFIAPI efi_reset_system_boottime(
 			break;
 		}
 	}
+	blkcache_flush(-1, 0);
 	switch (reset_type) {
 	case EFI_RESET_COLD:
 	case EFI_RESET_WARM:
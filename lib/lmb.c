@@ -8,6 +8,7 @@
 
 #include <common.h>
 #include <efi_loader.h>
+#include <event.h>
 #include <image.h>
 #include <mapmem.h>
 #include <lmb.h>
@@ -194,6 +195,12 @@ static void lmb_reserve_common(struct lmb *lmb, void *fdt_blob)
 	arch_lmb_reserve(lmb);
 	board_lmb_reserve(lmb);
 
+	if (CONFIG_IS_ENABLED(EVENT)) {
+		struct event_lmb_reserve data = { .lmb = lmb };
+
+		event_notify(EVT_LMB_RESERVE, &data, sizeof(data));
+	}
+
 	if (CONFIG_IS_ENABLED(OF_LIBFDT) && fdt_blob)
 		boot_fdt_add_mem_rsv_regions(lmb, fdt_blob);
 
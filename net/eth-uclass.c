@@ -28,10 +28,30 @@ DECLARE_GLOBAL_DATA_PTR;
  * struct eth_device_priv - private structure for each Ethernet device
  *
  * @state: The state of the Ethernet MAC driver (defined by enum eth_state_t)
+ * @stats: The statistics of the device
+ * @csum: The checksums the device works out itself, see enum eth_csum
  */
 struct eth_device_priv {
 	enum eth_state_t state;
 	bool running;
+	struct eth_stats stats;
+	uint csum;
+};
+
+/* Most lent buffers a driver may hold at once */
+#define ETH_RX_LENT_MAX		64
+
+/**
+ * struct eth_rx_lent - buffer lent to the driver for a packet payload
+ *
+ * @buf: The buffer
+ * @slot: Bytes of it meant for the payload
+ * @size: Bytes the controller may write to it
+ */
+struct eth_rx_lent {
+	void *buf;
+	ulong slot;
+	ulong size;
 };
 
 /**
@@ -40,10 +60,20 @@ struct eth_device_priv {
  * @current: The Ethernet device that the network functions are using
  * @no_bootdevs: true to skip binding Ethernet bootdevs (this is a negative flag
  * so that the default value enables it)
+ * @lend: Memory lent for payloads, lend.buf is NULL if none
+ * @lend_next: Next buffer to hand out from @lend
+ * @lent: Buffers the driver holds, in the order it took them
+ * @lent_first: Index of the first of them in @lent
+ * @lent_count: Number of them
  */
 struct eth_uclass_priv {
 	struct udevice *current;
 	bool no_bootdevs;
+	struct eth_rx_lend lend;
+	void *lend_next;
+	struct eth_rx_lent lent[ETH_RX_LENT_MAX];
+	int lent_first;
+	int lent_count;
 };
 
 /* eth_errno - This stores the most recent failure code from DM functions */
@@ -223,6 +253,48 @@ int eth_get_dev_index(void)
 	return -1;
 }
 
+int eth_get_stats(struct udevice *dev, struct eth_stats *stats)
+{
+	struct eth_device_priv *priv = dev_get_uclass_priv(dev);
+
+	if (!device_active(dev) || !priv)
+		return -ENODEV;
+
+	/* Hardware counters are only there while the device runs */
+	if (priv->running && eth_get_ops(dev)->get_stats)
+		eth_get_ops(dev)->get_stats(dev, &priv->stats);
+	*stats = priv->stats;
+
+	return 0;
+}
+
+void eth_set_csum(struct udevice *dev, uint csum)
+{
+	struct eth_device_priv *priv = dev_get_uclass_priv(dev);
+
+	priv->csum = csum;
+}
+
+bool eth_tx_csum(void)
+{
+	struct udevice *current = eth_get_dev();
+	struct eth_device_priv *priv;
+
+	if (!current || !device_active(current))
+		return false;
+	priv = dev_get_uclass_priv(current);
+
+	return priv->csum & ETH_CSUM_TX;
+}
+
+void eth_rx_csum_ok(struct udevice *dev)
+{
+	struct eth_device_priv *priv = dev_get_uclass_priv(dev);
+
+	if (priv->csum & ETH_CSUM_RX)
+		net_rx_csum_ok = true;
+}
+
 static int eth_write_hwaddr(struct udevice *dev)
 {
 	struct eth_pdata *pdata;
@@ -349,6 +421,7 @@ int eth_init(void)
 
 void eth_halt(void)
 {
+	struct eth_uclass_priv *uc_priv;
 	struct udevice *current;
 	struct eth_device_priv *priv;
 
@@ -360,11 +433,130 @@ void eth_halt(void)
 	if (!priv || !priv->running)
 		return;
 
+	if (eth_get_ops(current)->get_stats)
+		eth_get_ops(current)->get_stats(current, &priv->stats);
 	eth_get_ops(current)->stop(current);
 	priv->state = ETH_STATE_PASSIVE;
 	priv->running = false;
+
+	/* A stopped driver holds no lent buffers */
+	uc_priv = eth_get_uclass_priv();
+	if (uc_priv) {
+		uc_priv->lend.buf = NULL;
+		uc_priv->lent_count = 0;
+	}
+}
+
+#if IS_ENABLED(CONFIG_NET_RX_LEND)
+void eth_rx_lend(const struct eth_rx_lend *lend)
+{
+	struct eth_uclass_priv *priv = eth_get_uclass_priv();
+
+	if (!priv)
+		return;
+
+	if (!lend) {
+		priv->lend.buf = NULL;
+		return;
+	}
+
+	priv->lend = *lend;
+	/* Buffers already taken go to the packets received first */
+	priv->lend_next = lend->buf + priv->lent_count * lend->step;
+}
+
+bool eth_rx_lent(const void *buf, ulong size)
+{
+	struct eth_uclass_priv *priv = eth_get_uclass_priv();
+	ulong start = (ulong)buf;
+	ulong end = start + size;
+	struct eth_rx_lent *lent;
+	int i;
+
+	if (!priv)
+		return false;
+
+	for (i = 0; i < priv->lent_count; i++) {
+		lent = &priv->lent[(priv->lent_first + i) % ETH_RX_LENT_MAX];
+		if (start < ALIGN((ulong)lent->buf + lent->size,
+				  ARCH_DMA_MINALIGN) &&
+		    end > ALIGN_DOWN((ulong)lent->buf, ARCH_DMA_MINALIGN))
+			return true;
+	}
+
+	return false;
+}
+
+void eth_rx_reclaim(void)
+{
+	struct eth_uclass_priv *priv = eth_get_uclass_priv();
+
+	if (!priv)
+		return;
+
+	priv->lend.buf = NULL;
+	if (priv->lent_count) {
+		eth_halt();
+		priv->lent_count = 0;
+	}
+}
+
+void *eth_rx_take(struct udevice *dev, ulong size)
+{
+	struct eth_uclass_priv *priv = eth_get_uclass_priv();
+	struct eth_rx_lent *lent;
+	void *buf;
+	int i;
+
+	if (!priv || dev != priv->current || !priv->lend.buf ||
+	    priv->lent_count == ETH_RX_LENT_MAX)
+		return NULL;
+
+	buf = priv->lend_next;
+	if (buf + size > priv->lend.end)
+		return NULL;
+
+	/*
+	 * The controller fills buffers in the order they were taken. One
+	 * may run into the next, which is filled later, but must not run
+	 * into a payload received before it.
+	 */
+	for (i = 0; i < priv->lent_count; i++) {
+		lent = &priv->lent[(priv->lent_first + i) % ETH_RX_LENT_MAX];
+		if (buf < lent->buf + lent->slot && buf + size > lent->buf)
+			return NULL;
+	}
+
+	lent = &priv->lent[(priv->lent_first + priv->lent_count) %
+			   ETH_RX_LENT_MAX];
+	lent->buf = buf;
+	lent->slot = priv->lend.step;
+	lent->size = size;
+	priv->lent_count++;
+	priv->lend_next += priv->lend.step;
+
+	return buf;
 }
 
+void eth_rx_give(struct udevice *dev, void *buf, int len)
+{
+	struct eth_uclass_priv *priv = eth_get_uclass_priv();
+
+	if (!priv || !priv->lent_count ||
+	    priv->lent[priv->lent_first].buf != buf) {
+		debug("%s: %p was not lent\n", __func__, buf);
+		return;
+	}
+
+	priv->lent_first = (priv->lent_first + 1) % ETH_RX_LENT_MAX;
+	priv->lent_count--;
+	if (len > 0) {
+		net_rx_payload = buf;
+		net_rx_payload_len = len;
+	}
+}
+#endif
+
 int eth_is_active(struct udevice *dev)
 {
 	struct eth_device_priv *priv;
@@ -376,8 +568,32 @@ int eth_is_active(struct udevice *dev)
 	return priv->state == ETH_STATE_ACTIVE;
 }
 
+int eth_mcast_join(struct in_addr mcast_ip, int join)
+{
+	struct udevice *current;
+	u32 addr = ntohl(mcast_ip.s_addr);
+	u8 mcast_mac[ARP_HLEN];
+
+	current = eth_get_dev();
+	if (!current || !eth_is_active(current))
+		return -EINVAL;
+	if (!eth_get_ops(current)->mcast)
+		return -ENOSYS;
+
+	/* 01:00:5e followed by the low 23 bits of the group, see RFC 1112 */
+	mcast_mac[0] = 0x01;
+	mcast_mac[1] = 0x00;
+	mcast_mac[2] = 0x5e;
+	mcast_mac[3] = (addr >> 16) & 0x7f;
+	mcast_mac[4] = (addr >> 8) & 0xff;
+	mcast_mac[5] = addr & 0xff;
+
+	return eth_get_ops(current)->mcast(current, mcast_mac, join);
+}
+
 int eth_send(void *packet, int length)
 {
+	struct eth_device_priv *priv;
 	struct udevice *current;
 	int ret;
 
@@ -389,9 +605,14 @@ int eth_send(void *packet, int length)
 		return -EINVAL;
 
 	ret = eth_get_ops(current)->send(current, packet, length);
+	priv = dev_get_uclass_priv(current);
 	if (ret < 0) {
 		/* We cannot completely return the error at present */
 		debug("%s: send() returned error %d\n", __func__, ret);
+		priv->stats.tx_errors++;
+	} else {
+		priv->stats.tx_packets++;
+		priv->stats.tx_bytes += length;
 	}
 #if defined(CONFIG_CMD_PCAP)
 	if (ret >= 0)
@@ -400,8 +621,9 @@ int eth_send(void *packet, int length)
 	return ret;
 }
 
-int eth_rx(void)
+int eth_rx_max(int max)
 {
+	struct eth_device_priv *priv;
 	struct udevice *current;
 	uchar *packet;
 	int flags;
@@ -415,13 +637,21 @@ int eth_rx(void)
 	if (!eth_is_active(current))
 		return -EINVAL;
 
-	/* Process up to 32 packets at one time */
+	/* Process all the packets received, so that the ring is free again */
+	priv = dev_get_uclass_priv(current);
 	flags = ETH_RECV_CHECK_DEVICE;
-	for (i = 0; i < ETH_PACKETS_BATCH_RECV; i++) {
+	ret = 0;
+	for (i = 0; i < max; i++) {
 		ret = eth_get_ops(current)->recv(current, flags, &packet);
 		flags = 0;
-		if (ret > 0)
+		if (ret > 0) {
+			priv->stats.rx_packets++;
+			priv->stats.rx_bytes += ret + net_rx_payload_len;
 			net_process_received_packet(packet, ret);
+		}
+		net_rx_payload = NULL;
+		net_rx_payload_len = 0;
+		net_rx_csum_ok = false;
 		if (ret >= 0 && eth_get_ops(current)->free_pkt)
 			eth_get_ops(current)->free_pkt(current, packet, ret);
 		if (ret <= 0)
@@ -432,10 +662,16 @@ int eth_rx(void)
 	if (ret < 0) {
 		/* We cannot completely return the error at present */
 		debug("%s: recv() returned error %d\n", __func__, ret);
+		priv->stats.rx_errors++;
 	}
 	return ret;
 }
 
+int eth_rx(void)
+{
+	return eth_rx_max(ETH_RX_BATCH_MAX);
+}
+
 int eth_initialize(void)
 {
 	int num_devices = 0;
@@ -10,6 +10,7 @@
 /* Neighbour Discovery for IPv6 */
 
 #include <common.h>
+#include <dm.h>
 #include <net.h>
 #include <net6.h>
 #include <ndisc.h>
@@ -41,6 +42,89 @@ struct in6_addr all_routers = ALL_ROUTERS_MULT_ADDR;
 
 #define IP6_NDISC_OPT_SPACE(len) (((len) + 2 + 7) & ~7)
 
+/**
+ * struct ndisc_neigh - a neighbour whose link-layer address is known
+ *
+ * @ip6:	its IPv6 address, unspecified if the entry is free
+ * @enetaddr:	its MAC address
+ * @time:	when it was last learned
+ */
+struct ndisc_neigh {
+	struct in6_addr ip6;
+	uchar enetaddr[6];
+	ulong time;
+};
+
+static struct ndisc_neigh ndisc_cache[CONFIG_IPV6_NDISC_CACHE];
+/* Entry the next neighbour learned takes, unless it is known already */
+static int ndisc_cache_next;
+/* Device the neighbours were learned on */
+static struct udevice *ndisc_cache_dev;
+
+/**
+ * ndisc_next_hop() - find the neighbour packets to a host go to
+ *
+ * @dest:	IPv6 address of the host
+ * Return: the host itself, or the gateway if it is not on our subnet
+ */
+static struct in6_addr *ndisc_next_hop(struct in6_addr *dest)
+{
+	if (!ip6_addr_in_subnet(&net_ip6, dest, net_prefix_length) &&
+	    !ip6_is_unspecified_addr(&net_gateway6))
+		return &net_gateway6;
+
+	return dest;
+}
+
+static struct ndisc_neigh *ndisc_find(struct in6_addr *ip6)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(ndisc_cache); i++) {
+		if (!memcmp(&ndisc_cache[i].ip6, ip6, sizeof(*ip6)))
+			return &ndisc_cache[i];
+	}
+
+	return NULL;
+}
+
+/**
+ * ndisc_learn() - remember the link-layer address of a neighbour
+ *
+ * @ip6:	IPv6 address of the neighbour
+ * @enetaddr:	its MAC address
+ */
+static void ndisc_learn(struct in6_addr *ip6, const uchar enetaddr[6])
+{
+	struct ndisc_neigh *neigh;
+
+	if (ip6_is_unspecified_addr(ip6))
+		return;
+
+	neigh = ndisc_find(ip6);
+	if (!neigh) {
+		neigh = &ndisc_cache[ndisc_cache_next];
+		ndisc_cache_next = (ndisc_cache_next + 1) %
+				   ARRAY_SIZE(ndisc_cache);
+		net_copy_ip6(&neigh->ip6, ip6);
+	}
+	memcpy(neigh->enetaddr, enetaddr, 6);
+	neigh->time = get_timer(0);
+}
+
+int ndisc_lookup(struct in6_addr *dest, uchar enetaddr[6])
+{
+	struct ndisc_neigh *neigh = ndisc_find(ndisc_next_hop(dest));
+
+	if (!neigh || ip6_is_unspecified_addr(&neigh->ip6) ||
+	    get_timer(neigh->time) > NDISC_REACHABLE_TIME)
+		return -ENOENT;
+
+	memcpy(enetaddr, neigh->enetaddr, 6);
+
+	return 0;
+}
+
 /**
  * ndisc_insert_option() - Insert an option into a neighbor discovery packet
  *
@@ -262,16 +346,10 @@ ip6_send_na(uchar *eth_dst_addr, struct in6_addr *neigh_addr,
 void ndisc_request(void)
 {
 	if (!ip6_addr_in_subnet(&net_ip6, &net_nd_sol_packet_ip6,
-				net_prefix_length)) {
-		if (ip6_is_unspecified_addr(&net_gateway6)) {
-			puts("## Warning: gatewayip6 is needed but not set\n");
-			net_nd_rep_packet_ip6 = net_nd_sol_packet_ip6;
-		} else {
-			net_nd_rep_packet_ip6 = net_gateway6;
-		}
-	} else {
-		net_nd_rep_packet_ip6 = net_nd_sol_packet_ip6;
-	}
+				net_prefix_length) &&
+	    ip6_is_unspecified_addr(&net_gateway6))
+		puts("## Warning: gatewayip6 is needed but not set\n");
+	net_nd_rep_packet_ip6 = *ndisc_next_hop(&net_nd_sol_packet_ip6);
 
 	ip6_send_ns(&net_nd_rep_packet_ip6);
 }
@@ -314,6 +392,12 @@ void ndisc_init(void)
 	net_nd_tx_packet_size = 0;
 	net_nd_tx_packet = &net_nd_packet_buf[0] + (PKTALIGN - 1);
 	net_nd_tx_packet -= (ulong)net_nd_tx_packet % PKTALIGN;
+
+	/* Neighbours are kept from one command to the next, on the same link */
+	if (ndisc_cache_dev != eth_get_dev()) {
+		memset(ndisc_cache, '\0', sizeof(ndisc_cache));
+		ndisc_cache_dev = eth_get_dev();
+	}
 }
 
 /*
@@ -443,6 +527,8 @@ int ndisc_receive(struct ethernet_hdr *et, struct ip6_hdr *ip6, int len)
 		if (ip6_is_our_addr(&ndisc->target) &&
 		    ndisc_has_option(ip6, ND_OPT_SOURCE_LL_ADDR)) {
 			ndisc_extract_enetaddr(ndisc, neigh_eth_addr);
+			/* It is going to talk to us, likely we to it too */
+			ndisc_learn(&ip6->saddr, neigh_eth_addr);
 			ip6_send_na(neigh_eth_addr, &ip6->saddr,
 				    &ndisc->target);
 		}
@@ -459,8 +545,9 @@ int ndisc_receive(struct ethernet_hdr *et, struct ip6_hdr *ip6, int len)
 			ndisc_extract_enetaddr(ndisc, neigh_eth_addr);
 
 			/* save address for later use */
-			if (!net_nd_packet_mac)
-				net_nd_packet_mac = neigh_eth_addr;
+			ndisc_learn(&ndisc->target, neigh_eth_addr);
+			if (net_nd_packet_mac)
+				memcpy(net_nd_packet_mac, neigh_eth_addr, 6);
 
 			/* modify header, and transmit it */
 			memcpy(((struct ethernet_hdr *)net_nd_tx_packet)->et_dest,
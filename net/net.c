@@ -100,6 +100,7 @@
 #if defined(CONFIG_CMD_PCAP)
 #include <net/pcap.h>
 #endif
+#include <net/sink.h>
 #include <net/udp.h>
 #if defined(CONFIG_LED_STATUS)
 #include <miiphy.h>
@@ -151,10 +152,18 @@ u8 net_server_ethaddr[6];
 struct in_addr	net_ip;
 /* Server IP addr (0 = unknown) */
 struct in_addr	net_server_ip;
+/* Multicast group joined (0 = none) */
+struct in_addr	net_mcast_addr;
 /* Current receive packet */
 uchar *net_rx_packet;
 /* Current rx packet length */
 int		net_rx_packet_len;
+/* Payload of the current rx packet, if the driver put it apart */
+uchar *net_rx_payload;
+/* Its length */
+int		net_rx_payload_len;
+/* The device checked the checksums of the current rx packet */
+bool		net_rx_csum_ok;
 /* IP packet ID */
 static unsigned	net_ip_id;
 /* Ethernet bcast address */
@@ -388,9 +397,18 @@ static void net_clear_handlers(void)
 	net_set_timeout_handler(0, NULL);
 }
 
+/* Leave any multicast group joined for a transfer, before the device halts */
+static void net_mcast_cleanup(void)
+{
+	if (IS_ENABLED(CONFIG_TFTP_MULTICAST))
+		tftp_mcast_cleanup();
+}
+
 static void net_cleanup_loop(void)
 {
+	net_mcast_cleanup();
 	net_clear_handlers();
+	eth_rx_reclaim();
 }
 
 int net_init(void)
@@ -715,6 +733,13 @@ restart:
 
 		case NETLOOP_SUCCESS:
 			net_cleanup_loop();
+			if (net_sink_end(true)) {
+				eth_halt();
+				/* Invalidate the last protocol */
+				eth_set_last_protocol(BOOTP);
+				ret = -EIO;
+				goto done;
+			}
 			if (net_boot_file_size > 0) {
 				printf("Bytes transferred = %d (%x hex)\n",
 				       net_boot_file_size, net_boot_file_size);
@@ -746,6 +771,8 @@ restart:
 	}
 
 done:
+	/* Give up writing a file which was not all loaded */
+	net_sink_end(false);
 #ifdef CONFIG_USB_KEYBOARD
 	net_busy_flag = 0;
 #endif
@@ -777,6 +804,7 @@ int net_start_again(void)
 	unsigned long retrycnt = 0;
 	int ret;
 
+	net_mcast_cleanup();
 	nretry = env_get("netretry");
 	if (nretry) {
 		if (!strcmp(nretry, "yes"))
@@ -904,6 +932,10 @@ int net_send_udp_packet(uchar *ether, struct in_addr dest, int dport, int sport,
 int net_send_tcp_packet(int payload_len, int dport, int sport, u8 action,
 			u32 tcp_seq_num, u32 tcp_ack_num)
 {
+	if (IS_ENABLED(CONFIG_IPV6) && use_ip6)
+		return net_send_tcp_packet6(payload_len, dport, sport, action,
+					    tcp_seq_num, tcp_ack_num);
+
 	return net_send_ip_packet(net_server_ethaddr, net_server_ip, dport,
 				  sport, payload_len, IPPROTO_TCP, action,
 				  tcp_seq_num, tcp_ack_num);
@@ -917,6 +949,7 @@ int net_send_ip_packet(uchar *ether, struct in_addr dest, int dport, int sport,
 	uchar *pkt;
 	int eth_hdr_size;
 	int pkt_hdr_size;
+	__maybe_unused int ret;
 
 	/* make sure the net_tx_packet is initialized (net_init() was called) */
 	assert(net_tx_packet != NULL);
@@ -943,10 +976,12 @@ int net_send_ip_packet(uchar *ether, struct in_addr dest, int dport, int sport,
 		break;
 #if defined(CONFIG_PROT_TCP)
 	case IPPROTO_TCP:
-		pkt_hdr_size = eth_hdr_size
-			+ tcp_set_tcp_header(pkt + eth_hdr_size, dport, sport,
-					     payload_len, action, tcp_seq_num,
-					     tcp_ack_num);
+		ret = tcp_set_tcp_header(pkt + eth_hdr_size, dport, sport,
+					 payload_len, action, tcp_seq_num,
+					 tcp_ack_num);
+		if (ret < 0)
+			return ret;
+		pkt_hdr_size = eth_hdr_size + ret;
 		break;
 #endif
 	default:
@@ -1194,6 +1229,7 @@ void net_process_received_packet(uchar *in_packet, int len)
 	struct ip_udp_hdr *ip;
 	struct in_addr dst_ip;
 	struct in_addr src_ip;
+	uchar *payload;
 	int eth_proto;
 #if defined(CONFIG_CMD_CDP)
 	int iscdp;
@@ -1315,11 +1351,20 @@ void net_process_received_packet(uchar *in_packet, int len)
 			      (ulong)IP_HDR_SIZE);
 			return;
 		}
-		/* Check the packet length */
-		if (len < ntohs(ip->ip_len)) {
-			debug("len bad %d < %d\n", len, ntohs(ip->ip_len));
+		/* Check the packet length, its payload may be apart */
+		if (len + net_rx_payload_len < ntohs(ip->ip_len)) {
+			debug("len bad %d < %d\n", len + net_rx_payload_len,
+			      ntohs(ip->ip_len));
 			return;
 		}
+		if (net_rx_payload) {
+			/* Only the headers are here, see eth_rx_lend() */
+			if (len >= ntohs(ip->ip_len) ||
+			    (ip->ip_off & htons(IP_OFFS | IP_FLAGS_MFRAG)) ||
+			    (ip->ip_p != IPPROTO_TCP && ip->ip_p != IPPROTO_UDP))
+				return;
+			net_rx_payload_len = ntohs(ip->ip_len) - len;
+		}
 		len = ntohs(ip->ip_len);
 		if (len < IP_HDR_SIZE) {
 			debug("bad ip->ip_len %d < %d\n", len, (int)IP_HDR_SIZE);
@@ -1342,7 +1387,9 @@ void net_process_received_packet(uchar *in_packet, int len)
 		/* If it is not for us, ignore it */
 		dst_ip = net_read_ip(&ip->ip_dst);
 		if (net_ip.s_addr && dst_ip.s_addr != net_ip.s_addr &&
-		    dst_ip.s_addr != 0xFFFFFFFF) {
+		    dst_ip.s_addr != 0xFFFFFFFF &&
+		    (!net_mcast_addr.s_addr ||
+		     dst_ip.s_addr != net_mcast_addr.s_addr)) {
 				return;
 		}
 		/* Read source IP address for later use */
@@ -1394,12 +1441,16 @@ void net_process_received_packet(uchar *in_packet, int len)
 
 		if (ntohs(ip->udp_len) < UDP_HDR_SIZE || ntohs(ip->udp_len) > len - IP_HDR_SIZE)
 			return;
+		if (net_rx_payload &&
+		    len - net_rx_payload_len != IP_UDP_HDR_SIZE)
+			return;
 
 		debug_cond(DEBUG_DEV_PKT,
 			   "received UDP (to=%pI4, from=%pI4, len=%d)\n",
 			   &dst_ip, &src_ip, len);
 
-		if (IS_ENABLED(CONFIG_UDP_CHECKSUM) && ip->udp_xsum != 0) {
+		if (IS_ENABLED(CONFIG_UDP_CHECKSUM) && ip->udp_xsum != 0 &&
+		    !net_rx_csum_ok) {
 			ulong   xsum;
 			u8 *sumptr;
 			ushort  sumlen;
@@ -1419,6 +1470,9 @@ void net_process_received_packet(uchar *in_packet, int len)
 				xsum += (sumptr[0] << 8) + sumptr[1];
 				sumptr += 2;
 				sumlen -= 2;
+				if (net_rx_payload &&
+				    sumptr == (u8 *)ip + IP_UDP_HDR_SIZE)
+					sumptr = net_rx_payload;
 			}
 			if (sumlen > 0)
 				xsum += (sumptr[0] << 8) + sumptr[0];
@@ -1433,8 +1487,10 @@ void net_process_received_packet(uchar *in_packet, int len)
 			}
 		}
 
+		payload = net_rx_payload ? net_rx_payload :
+			  (uchar *)ip + IP_UDP_HDR_SIZE;
 #if defined(CONFIG_NETCONSOLE) && !defined(CONFIG_SPL_BUILD)
-		nc_input_packet((uchar *)ip + IP_UDP_HDR_SIZE,
+		nc_input_packet(payload,
 				src_ip,
 				ntohs(ip->udp_dst),
 				ntohs(ip->udp_src),
@@ -1443,7 +1499,7 @@ void net_process_received_packet(uchar *in_packet, int len)
 		/*
 		 * IP header OK.  Pass the packet to the current handler.
 		 */
-		(*udp_packet_handler)((uchar *)ip + IP_UDP_HDR_SIZE,
+		(*udp_packet_handler)(payload,
 				      ntohs(ip->udp_dst),
 				      src_ip,
 				      ntohs(ip->udp_src),
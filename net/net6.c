@@ -15,6 +15,7 @@
 #include <net.h>
 #include <net6.h>
 #include <ndisc.h>
+#include <net/tcp.h>
 
 /* NULL IPv6 address */
 struct in6_addr const net_null_addr_ip6 = ZERO_IPV6_ADDR;
@@ -324,25 +325,22 @@ int ip6_add_hdr(uchar *xip, struct in6_addr *src, struct in6_addr *dest,
 	return sizeof(struct ip6_hdr);
 }
 
-int net_send_udp_packet6(uchar *ether, struct in6_addr *dest, int dport,
-			 int sport, int len)
+/**
+ * ip6_send() - add the Ethernet and IPv6 headers to a packet and send it
+ *
+ * @ether:	MAC address of the next hop, zero if it is to be found
+ * @dest:	destination IPv6 addr
+ * @proto:	protocol of what follows the IPv6 header in net_tx_packet
+ * @len:	its length
+ * Return: 0 if sent, 1 if waiting for neighbour discovery
+ */
+static int ip6_send(uchar *ether, struct in6_addr *dest, int proto, int len)
 {
 	uchar *pkt;
-	struct udp_hdr *udp;
-	u16 csum_p;
 
-	udp = (struct udp_hdr *)((uchar *)net_tx_packet + net_eth_hdr_size() +
-			IP6_HDR_SIZE);
-
-	udp->udp_dst = htons(dport);
-	udp->udp_src = htons(sport);
-	udp->udp_len = htons(len + UDP_HDR_SIZE);
-
-	/* checksum */
-	udp->udp_xsum = 0;
-	csum_p = csum_partial((u8 *)udp, len + UDP_HDR_SIZE, 0);
-	udp->udp_xsum = csum_ipv6_magic(&net_ip6, dest, len + UDP_HDR_SIZE,
-					IPPROTO_UDP, csum_p);
+	/* it may be known from an earlier packet, or an earlier command */
+	if (!memcmp(ether, net_null_ethaddr, 6))
+		ndisc_lookup(dest, ether);
 
 	/* if MAC address was not discovered yet, save the packet and do
 	 * neighbour discovery
@@ -353,13 +351,12 @@ int net_send_udp_packet6(uchar *ether, struct in6_addr *dest, int dport,
 
 		pkt = net_nd_tx_packet;
 		pkt += net_set_ether(pkt, net_nd_packet_mac, PROT_IP6);
-		pkt += ip6_add_hdr(pkt, &net_ip6, dest, IPPROTO_UDP, 64,
-				len + UDP_HDR_SIZE);
-		memcpy(pkt, (uchar *)udp, len + UDP_HDR_SIZE);
+		pkt += ip6_add_hdr(pkt, &net_ip6, dest, proto, 64, len);
+		memcpy(pkt, net_tx_packet + net_eth_hdr_size() + IP6_HDR_SIZE,
+		       len);
 
 		/* size of the waiting packet */
-		net_nd_tx_packet_size = (pkt - net_nd_tx_packet) +
-			UDP_HDR_SIZE + len;
+		net_nd_tx_packet_size = (pkt - net_nd_tx_packet) + len;
 
 		/* and do the neighbor solicitation */
 		net_nd_try = 1;
@@ -370,18 +367,62 @@ int net_send_udp_packet6(uchar *ether, struct in6_addr *dest, int dport,
 
 	pkt = (uchar *)net_tx_packet;
 	pkt += net_set_ether(pkt, ether, PROT_IP6);
-	pkt += ip6_add_hdr(pkt, &net_ip6, dest, IPPROTO_UDP, 64,
-			len + UDP_HDR_SIZE);
-	(void)eth_send(net_tx_packet, pkt - net_tx_packet + UDP_HDR_SIZE + len);
+	pkt += ip6_add_hdr(pkt, &net_ip6, dest, proto, 64, len);
+	(void)eth_send(net_tx_packet, pkt - net_tx_packet + len);
 
 	return 0;	/* transmitted */
 }
 
+int net_send_udp_packet6(uchar *ether, struct in6_addr *dest, int dport,
+			 int sport, int len)
+{
+	struct udp_hdr *udp;
+	u16 csum_p;
+
+	udp = (struct udp_hdr *)((uchar *)net_tx_packet + net_eth_hdr_size() +
+			IP6_HDR_SIZE);
+
+	udp->udp_dst = htons(dport);
+	udp->udp_src = htons(sport);
+	udp->udp_len = htons(len + UDP_HDR_SIZE);
+
+	/* checksum, unless the device fills it in */
+	udp->udp_xsum = 0;
+	if (!eth_tx_csum()) {
+		csum_p = csum_partial((u8 *)udp, len + UDP_HDR_SIZE, 0);
+		udp->udp_xsum = csum_ipv6_magic(&net_ip6, dest,
+						len + UDP_HDR_SIZE,
+						IPPROTO_UDP, csum_p);
+	}
+
+	return ip6_send(ether, dest, IPPROTO_UDP, len + UDP_HDR_SIZE);
+}
+
+#if defined(CONFIG_PROT_TCP)
+int net_send_tcp_packet6(int payload_len, int dport, int sport, u8 action,
+			 u32 tcp_seq_num, u32 tcp_ack_num)
+{
+	uchar *pkt = net_tx_packet + net_eth_hdr_size();
+	int hdr_len;
+
+	/* The TCP header is built after an IPv4 header, which ours replaces */
+	hdr_len = tcp_set_tcp_header(pkt + IP6_HDR_SIZE - IP_HDR_SIZE, dport,
+				     sport, payload_len, action, tcp_seq_num,
+				     tcp_ack_num);
+	if (hdr_len < 0)
+		return hdr_len;
+
+	return ip6_send(net_server_ethaddr, &net_server_ip6, IPPROTO_TCP,
+			hdr_len - IP_HDR_SIZE + payload_len);
+}
+#endif
+
 int net_ip6_handler(struct ethernet_hdr *et, struct ip6_hdr *ip6, int len)
 {
 	struct in_addr zero_ip = {.s_addr = 0 };
 	struct icmp6hdr *icmp;
 	struct udp_hdr *udp;
+	uchar *payload;
 	u16 csum;
 	u16 csum_p;
 	u16 hlen;
@@ -392,11 +433,22 @@ int net_ip6_handler(struct ethernet_hdr *et, struct ip6_hdr *ip6, int len)
 	if (ip6->version != 6)
 		return -EINVAL;
 
+	/* Check the packet length, its payload may be apart */
+	hlen = ntohs(ip6->payload_len);
+	if (len + net_rx_payload_len < IP6_HDR_SIZE + hlen)
+		return -EINVAL;
+	if (net_rx_payload) {
+		/* Only the headers are here, see eth_rx_lend() */
+		if (len >= IP6_HDR_SIZE + hlen ||
+		    (ip6->nexthdr != IPPROTO_TCP && ip6->nexthdr != IPPROTO_UDP))
+			return -EINVAL;
+		net_rx_payload_len = IP6_HDR_SIZE + hlen - len;
+	}
+
 	switch (ip6->nexthdr) {
 	case PROT_ICMPV6:
 		icmp = (struct icmp6hdr *)(((uchar *)ip6) + IP6_HDR_SIZE);
 		csum = icmp->icmp6_cksum;
-		hlen = ntohs(ip6->payload_len);
 		icmp->icmp6_cksum = 0;
 		/* checksum */
 		csum_p = csum_partial((u8 *)icmp, hlen, 0);
@@ -422,25 +474,39 @@ int net_ip6_handler(struct ethernet_hdr *et, struct ip6_hdr *ip6, int len)
 		break;
 	case IPPROTO_UDP:
 		udp = (struct udp_hdr *)(((uchar *)ip6) + IP6_HDR_SIZE);
-		csum = udp->udp_xsum;
-		hlen = ntohs(ip6->payload_len);
-		udp->udp_xsum = 0;
-		/* checksum */
-		csum_p = csum_partial((u8 *)udp, hlen, 0);
-		udp->udp_xsum = csum_ipv6_magic(&ip6->saddr, &ip6->daddr,
-						hlen, IPPROTO_UDP, csum_p);
-
-		if (csum != udp->udp_xsum)
+		payload = net_rx_payload ? net_rx_payload :
+			  (uchar *)udp + UDP_HDR_SIZE;
+		if (net_rx_payload &&
+		    len != IP6_HDR_SIZE + UDP_HDR_SIZE)
 			return -EINVAL;
 
+		/* checksum, unless the device checked it */
+		if (!net_rx_csum_ok) {
+			csum = udp->udp_xsum;
+			udp->udp_xsum = 0;
+			csum_p = csum_partial(payload, hlen - UDP_HDR_SIZE,
+					      csum_partial((u8 *)udp,
+							   UDP_HDR_SIZE, 0));
+			udp->udp_xsum = csum_ipv6_magic(&ip6->saddr,
+							&ip6->daddr, hlen,
+							IPPROTO_UDP, csum_p);
+
+			if (csum != udp->udp_xsum)
+				return -EINVAL;
+		}
+
 		/* IP header OK. Pass the packet to the current handler. */
-		net_get_udp_handler()((uchar *)ip6 + IP6_HDR_SIZE +
-					UDP_HDR_SIZE,
+		net_get_udp_handler()(payload,
 				ntohs(udp->udp_dst),
 				zero_ip,
 				ntohs(udp->udp_src),
 				ntohs(udp->udp_len) - 8);
 		break;
+#if defined(CONFIG_PROT_TCP)
+	case IPPROTO_TCP:
+		rxhand_tcp6_f(ip6, IP6_HDR_SIZE + hlen);
+		break;
+#endif
 	default:
 		return -EINVAL;
 	}
@@ -33,6 +33,7 @@
 #include <common.h>
 #include <command.h>
 #include <display_options.h>
+#include <env.h>
 #ifdef CONFIG_SYS_DIRECT_FLASH_NFS
 #include <flash.h>
 #endif
@@ -44,6 +45,9 @@
 #include "nfs.h"
 #include "bootp.h"
 #include <time.h>
+#include <linux/build_bug.h>
+#include <linux/kernel.h>
+#include <net/tcp.h>
 
 #define HASHES_PER_LINE 65	/* Number of "loading" hashes per line	*/
 #define NFS_RETRY_COUNT 30
@@ -51,12 +55,45 @@
 #define NFS_RPC_ERR	1
 #define NFS_RPC_DROP	124
 
+/* Largest number of READ requests in flight, and their minimum timeout */
+#define NFS_WINDOW_MAX	32
+#define NFS_RTO_MIN	50
+
 static int fs_mounted;
 static unsigned long rpc_id;
-static int nfs_offset = -1;
-static int nfs_len;
 static const ulong nfs_timeout = CONFIG_NFS_TIMEOUT;
 
+/**
+ * struct nfs_read_slot - one READ request in flight
+ *
+ * @id:		XID of the request, kept when it is sent again so that a late
+ *		reply to the first copy is still accepted
+ * @offset:	Offset into the file
+ * @len:	Number of bytes requested
+ * @sent:	Time the request was last sent
+ * @retries:	Number of times the request was sent again
+ * @busy:	The request is waiting for its reply
+ */
+struct nfs_read_slot {
+	ulong id;
+	u32 offset;
+	u32 len;
+	ulong sent;
+	int retries;
+	bool busy;
+};
+
+static struct nfs_read_slot nfs_slots[NFS_WINDOW_MAX];
+static int nfs_window_max;	/* Window size set by nfswindowsize */
+static int nfs_window;		/* Window size, shrunk when replies are lost */
+static int nfs_window_acks;	/* Replies since the window last changed */
+static u32 nfs_next_offset;	/* Offset of the next new READ request */
+static u32 nfs_eof;		/* File size once known, else U32_MAX */
+static u32 nfs_bytes;		/* Bytes received, for the progress hashes */
+static long nfs_srtt;		/* Smoothed round-trip time in ms, times 8 */
+static ulong nfs_rto;		/* Time to wait for a READ reply */
+static u32 nfs_read_size;	/* Bytes asked for by each READ request */
+
 static char dirfh[NFS_FHSIZE];	/* NFSv2 / NFSv3 file handle of directory */
 static char filefh[NFS3_FHSIZE]; /* NFSv2 / NFSv3 file handle */
 static unsigned int filefh3_length;	/* (variable) length of filefh when NFSv3 */
@@ -178,18 +215,185 @@ static uint32_t *rpc_add_credentials(uint32_t *p)
 	return p;
 }
 
+/**************************************************************************
+RPC over TCP - NFS calls and replies are records (RFC 5531 section 11) on a
+single connection, the portmapper and mount daemon are still asked over UDP
+**************************************************************************/
+#define NFS_TCP_LAST_FRAG	0x80000000
+#define NFS_TCP_TXBUF		8192	/* fits a full window of READ calls */
+/* Largest READ record: mark, call header, credentials and NFSv3 arguments */
+#define NFS_TCP_READ_CALL	(4 + (6 + 9 + 1 + NFS3_FHSIZE / 4 + 4) * 4)
+
+static bool nfs_tcp;		/* Send NFS calls over TCP */
+static bool nfs_tcp_connected;
+static int nfs_tcp_port;	/* Our TCP port */
+static u32 nfs_tcp_snd_una;	/* Oldest byte not acknowledged by the server */
+static u32 nfs_tcp_snd_nxt;	/* Next byte to send */
+static u32 nfs_tcp_rcv_nxt;	/* Next byte expected from the server */
+static u32 nfs_tcp_queued;	/* Bytes in nfs_tcp_txbuf, from snd_una on */
+static uchar nfs_tcp_txbuf[NFS_TCP_TXBUF];
+
+/**
+ * struct nfs_tcp_rx - the record being received
+ *
+ * @mark:	Record marker of the current fragment
+ * @mark_len:	Number of bytes of @mark received
+ * @frag_left:	Number of bytes left in the current fragment
+ * @last:	The current fragment is the last one of the record
+ * @len:	Number of bytes of the record received
+ * @rec:	Start of the record, which is all of it unless it is a READ
+ *		reply whose data is stored as it arrives
+ * @stream:	The record is a READ reply whose header is in @rec
+ * @slot:	READ request replied to, NULL to drop the data
+ * @data:	Offset of the file data in the record
+ * @count:	Number of bytes of file data in the record
+ * @eof:	The reply says that the end of the file was reached
+ */
+static struct nfs_tcp_rx {
+	__be32 mark;
+	u32 mark_len;
+	u32 frag_left;
+	bool last;
+	u32 len;
+	struct rpc_t rec;
+	bool stream;
+	struct nfs_read_slot *slot;
+	u32 data;
+	u32 count;
+	bool eof;
+} nfs_rx;
+
+static rxhand_tcp nfs_tcp_handler;
+
+static bool nfs_use_tcp(void)
+{
+	return IS_ENABLED(CONFIG_NFS_TCP) && nfs_tcp;
+}
+
+static void nfs_tcp_syn(void)
+{
+	/* Too many SYNs are turned into a FIN otherwise */
+	tcp_set_tcp_state(TCP_CLOSED);
+	net_send_tcp_packet(0, nfs_server_port, nfs_tcp_port, TCP_SYN, 0, 0);
+}
+
+static void nfs_tcp_connect(void)
+{
+	/* A reserved port, as for UDP, since servers may insist on one */
+	nfs_tcp_port = 512 + get_ticks() % 512;
+	nfs_tcp_snd_una = 1;
+	nfs_tcp_snd_nxt = 1;
+	memset(&nfs_rx, '\0', sizeof(nfs_rx));
+
+	/* The TCP stack only talks to net_server_ip */
+	net_server_ip = nfs_server_ip;
+	tcp_set_tcp_handler(nfs_tcp_handler);
+	nfs_tcp_syn();
+}
+
+static void nfs_tcp_ack(void)
+{
+	net_send_tcp_packet(0, nfs_server_port, nfs_tcp_port, TCP_ACK,
+			    nfs_tcp_snd_nxt, nfs_tcp_rcv_nxt);
+}
+
+/* Send the queued bytes which have not been sent yet */
+static void nfs_tcp_push(void)
+{
+	uchar *payload = net_tx_packet + net_eth_hdr_size() + IP_TCP_HDR_SIZE +
+			 TCP_TSOPT_SIZE + 2;
+	u32 sent, len;
+
+	if (!nfs_tcp_connected)
+		return;
+
+	while ((sent = nfs_tcp_snd_nxt - nfs_tcp_snd_una) < nfs_tcp_queued) {
+		len = min_t(u32, nfs_tcp_queued - sent, TCP_MSS);
+		memcpy(payload, nfs_tcp_txbuf + sent, len);
+		net_send_tcp_packet(len, nfs_server_port, nfs_tcp_port,
+				    TCP_PUSH, nfs_tcp_snd_nxt, nfs_tcp_rcv_nxt);
+		nfs_tcp_snd_nxt += len;
+	}
+}
+
+/* Queue an RPC call as a record and send it, connecting first if needed */
+static void nfs_tcp_send(const void *data, u32 len)
+{
+	__be32 mark = htonl(NFS_TCP_LAST_FRAG | len);
+
+	BUILD_BUG_ON(NFS_WINDOW_MAX * NFS_TCP_READ_CALL > NFS_TCP_TXBUF);
+
+	/* A call cannot be dropped: nothing would ever resend it */
+	if (nfs_tcp_queued + sizeof(mark) + len > NFS_TCP_TXBUF) {
+		printf("*** ERROR: No room to send %u bytes over TCP\n", len);
+		net_set_state(NETLOOP_FAIL);
+		return;
+	}
+
+	memcpy(nfs_tcp_txbuf + nfs_tcp_queued, &mark, sizeof(mark));
+	memcpy(nfs_tcp_txbuf + nfs_tcp_queued + sizeof(mark), data, len);
+	nfs_tcp_queued += sizeof(mark) + len;
+
+	if (nfs_tcp_connected)
+		nfs_tcp_push();
+	else if (tcp_get_tcp_state() != TCP_SYN_SENT)
+		nfs_tcp_connect();
+}
+
+/*
+ * Send again the SYN or the bytes which the server has not acknowledged, as
+ * calls are never lost over TCP, only segments. Returns false if there is
+ * nothing to send.
+ */
+static bool nfs_tcp_retransmit(void)
+{
+	if (!nfs_use_tcp())
+		return false;
+
+	if (!nfs_tcp_connected) {
+		if (tcp_get_tcp_state() != TCP_SYN_SENT)
+			return false;
+		nfs_tcp_syn();
+		return true;
+	}
+
+	if (nfs_tcp_snd_una == nfs_tcp_snd_nxt)
+		return false;
+
+	nfs_tcp_snd_nxt = nfs_tcp_snd_una;
+	nfs_tcp_push();
+
+	return true;
+}
+
+static void nfs_tcp_close(void)
+{
+	if (!nfs_use_tcp())
+		return;
+
+	if (nfs_tcp_connected) {
+		net_send_tcp_packet(0, nfs_server_port, nfs_tcp_port,
+				    TCP_FIN | TCP_ACK, nfs_tcp_snd_nxt,
+				    nfs_tcp_rcv_nxt);
+		nfs_tcp_snd_nxt++;
+	} else {
+		tcp_set_tcp_state(TCP_CLOSED);
+	}
+	nfs_tcp_connected = false;
+	nfs_tcp_queued = 0;
+}
+
 /**************************************************************************
 RPC_LOOKUP - Lookup RPC Port numbers
 **************************************************************************/
-static void rpc_req(int rpc_prog, int rpc_proc, uint32_t *data, int datalen)
+static void rpc_send(unsigned long id, int rpc_prog, int rpc_proc,
+		     uint32_t *data, int datalen)
 {
 	struct rpc_t rpc_pkt;
-	unsigned long id;
 	uint32_t *p;
 	int pktlen;
 	int sport;
 
-	id = ++rpc_id;
 	rpc_pkt.u.call.id = htonl(id);
 	rpc_pkt.u.call.type = htonl(MSG_CALL);
 	rpc_pkt.u.call.rpcvers = htonl(2);	/* use RPC version 2 */
@@ -242,6 +446,11 @@ static void rpc_req(int rpc_prog, int rpc_proc, uint32_t *data, int datalen)
 
 	pktlen = (char *)p + datalen * sizeof(uint32_t) - (char *)&rpc_pkt;
 
+	if (rpc_prog == PROG_NFS && nfs_use_tcp()) {
+		nfs_tcp_send(&rpc_pkt.u.data[0], pktlen);
+		return;
+	}
+
 	memcpy((char *)net_tx_packet + net_eth_hdr_size() + IP_UDP_HDR_SIZE,
 	       &rpc_pkt.u.data[0], pktlen);
 
@@ -256,6 +465,11 @@ static void rpc_req(int rpc_prog, int rpc_proc, uint32_t *data, int datalen)
 			    nfs_our_port, pktlen);
 }
 
+static void rpc_req(int rpc_prog, int rpc_proc, uint32_t *data, int datalen)
+{
+	rpc_send(++rpc_id, rpc_prog, rpc_proc, data, datalen);
+}
+
 /**************************************************************************
 RPC_LOOKUP - Lookup RPC Port numbers
 **************************************************************************/
@@ -267,7 +481,10 @@ static void rpc_lookup_req(int prog, int ver)
 	data[2] = 0; data[3] = 0;	/* auth verifier */
 	data[4] = htonl(prog);
 	data[5] = htonl(ver);
-	data[6] = htonl(17);	/* IP_UDP */
+	if (prog == PROG_NFS && nfs_use_tcp())
+		data[6] = htonl(IPPROTO_TCP);
+	else
+		data[6] = htonl(IPPROTO_UDP);
 	data[7] = 0;
 	rpc_req(PROG_PORTMAP, PORTMAP_GETPORT, data, 8);
 }
@@ -395,7 +612,7 @@ static void nfs_lookup_req(char *fname)
 /**************************************************************************
 NFS_READ - Read File on NFS Server
 **************************************************************************/
-static void nfs_read_req(int offset, int readlen)
+static void nfs_read_req(struct nfs_read_slot *slot)
 {
 	uint32_t data[1024];
 	uint32_t *p;
@@ -407,22 +624,203 @@ static void nfs_read_req(int offset, int readlen)
 	if (choosen_nfs_version != NFS_V3) {
 		memcpy(p, filefh, NFS_FHSIZE);
 		p += (NFS_FHSIZE / 4);
-		*p++ = htonl(offset);
-		*p++ = htonl(readlen);
+		*p++ = htonl(slot->offset);
+		*p++ = htonl(slot->len);
 		*p++ = 0;
 	} else { /* NFS_V3 */
 		*p++ = htonl(filefh3_length);
 		memcpy(p, filefh, filefh3_length);
 		p += (filefh3_length / 4);
 		*p++ = htonl(0); /* offset is 64-bit long, so fill with 0 */
-		*p++ = htonl(offset);
-		*p++ = htonl(readlen);
+		*p++ = htonl(slot->offset);
+		*p++ = htonl(slot->len);
 		*p++ = 0;
 	}
 
 	len = (uint32_t *)p - (uint32_t *)&(data[0]);
 
-	rpc_req(PROG_NFS, NFS_READ, data, len);
+	rpc_send(slot->id, PROG_NFS, NFS_READ, data, len);
+	slot->sent = get_timer(0);
+}
+
+/**************************************************************************
+NFS_READ window - several READ requests in flight at once
+**************************************************************************/
+static void nfs_timeout_handler(void);
+
+static void nfs_read_start(void)
+{
+	memset(nfs_slots, '\0', sizeof(nfs_slots));
+	nfs_window_max = clamp_t(ulong, env_get_ulong("nfswindowsize", 10,
+						      CONFIG_NFS_WINDOWSIZE),
+				 1, NFS_WINDOW_MAX);
+	nfs_window = nfs_window_max;
+	nfs_window_acks = 0;
+	nfs_next_offset = 0;
+	nfs_eof = U32_MAX;
+	nfs_bytes = 0;
+	nfs_srtt = -1;
+	nfs_rto = nfs_timeout;
+	nfs_read_size = nfs_use_tcp() ? NFS_TCP_READ_SIZE : NFS_READ_SIZE;
+}
+
+/* Send new requests until the window is full or the whole file is asked for */
+static void nfs_read_fill(void)
+{
+	struct nfs_read_slot *slot;
+	int i, busy = 0;
+
+	for (i = 0; i < NFS_WINDOW_MAX; i++)
+		busy += nfs_slots[i].busy;
+
+	for (i = 0; i < NFS_WINDOW_MAX && busy < nfs_window &&
+	     nfs_next_offset < nfs_eof; i++) {
+		slot = &nfs_slots[i];
+		if (slot->busy)
+			continue;
+
+		slot->id = ++rpc_id;
+		slot->offset = nfs_next_offset;
+		slot->len = nfs_read_size;
+		slot->retries = 0;
+		slot->busy = true;
+		nfs_next_offset += nfs_read_size;
+		busy++;
+		nfs_read_req(slot);
+	}
+
+	net_set_timeout_handler(nfs_rto, nfs_timeout_handler);
+}
+
+static struct nfs_read_slot *nfs_read_find(ulong id)
+{
+	int i;
+
+	for (i = 0; i < NFS_WINDOW_MAX; i++) {
+		if (nfs_slots[i].busy && nfs_slots[i].id == id)
+			return &nfs_slots[i];
+	}
+
+	return NULL;
+}
+
+/*
+ * Send again the requests whose reply is overdue, each with its own timeout
+ * which doubles every time it is sent again, and halve the window if any
+ * was. Over TCP the unacknowledged part of the stream is sent again instead
+ * and TCP itself backs off. Returns false once a request has been sent too
+ * often.
+ */
+static bool nfs_read_resend(void)
+{
+	struct nfs_read_slot *slot;
+	bool lost = false;
+	ulong rto;
+	int i;
+
+	for (i = 0; i < NFS_WINDOW_MAX; i++) {
+		slot = &nfs_slots[i];
+		if (!slot->busy)
+			continue;
+
+		rto = min(nfs_rto << min(slot->retries, 5), nfs_timeout);
+		if (get_timer(slot->sent) < rto)
+			continue;
+
+		if (++slot->retries > NFS_RETRY_COUNT)
+			return false;
+		if (nfs_use_tcp())
+			slot->sent = get_timer(0);
+		else
+			nfs_read_req(slot);
+		lost = true;
+	}
+
+	if (lost) {
+		puts("T ");
+		if (nfs_use_tcp()) {
+			nfs_tcp_retransmit();
+		} else {
+			nfs_window = max(nfs_window / 2, 1);
+			nfs_window_acks = 0;
+		}
+	}
+
+	return true;
+}
+
+static void nfs_read_progress(int rlen)
+{
+	const u32 step = NFS_READ_SIZE / 2 * 10;
+	u32 n;
+
+	for (n = nfs_bytes / step; n < (nfs_bytes + rlen) / step; n++) {
+		if (n && !(n % HASHES_PER_LINE))
+			puts("\n\t ");
+		putc('#');
+	}
+	nfs_bytes += rlen;
+}
+
+/* Account for a reply of @rlen bytes to the request in @slot */
+static void nfs_read_complete(struct nfs_read_slot *slot, int rlen, bool eof)
+{
+	int i;
+
+	/* Only time replies to requests which were sent once, as TCP does */
+	if (!slot->retries) {
+		long rtt = get_timer(slot->sent);
+
+		if (nfs_srtt < 0)
+			nfs_srtt = rtt * 8;
+		else
+			nfs_srtt += rtt - nfs_srtt / 8;
+		nfs_rto = clamp_t(ulong, nfs_srtt / 2, NFS_RTO_MIN,
+				  nfs_timeout);
+	}
+
+	nfs_read_progress(rlen);
+	if (nfs_window < nfs_window_max && ++nfs_window_acks >= nfs_window) {
+		nfs_window++;
+		nfs_window_acks = 0;
+	}
+
+	if (rlen && rlen < slot->len && !eof) {
+		/* Short read, ask for the rest */
+		slot->id = ++rpc_id;
+		slot->offset += rlen;
+		slot->len -= rlen;
+		slot->retries = 0;
+		nfs_read_req(slot);
+		return;
+	}
+
+	slot->busy = false;
+	if (rlen && !eof)
+		return;
+
+	/* Requests beyond the end of the file need no reply */
+	nfs_eof = min(nfs_eof, slot->offset + rlen);
+	for (i = 0; i < NFS_WINDOW_MAX; i++) {
+		if (nfs_slots[i].offset >= nfs_eof)
+			nfs_slots[i].busy = false;
+	}
+}
+
+/* Check whether everything up to the end of the file has been received */
+static bool nfs_read_done(void)
+{
+	int i;
+
+	if (nfs_eof == U32_MAX)
+		return false;
+
+	for (i = 0; i < NFS_WINDOW_MAX; i++) {
+		if (nfs_slots[i].busy)
+			return false;
+	}
+
+	return true;
 }
 
 /**************************************************************************
@@ -449,13 +847,14 @@ static void nfs_send(void)
 		nfs_mount_req(nfs_path);
 		break;
 	case STATE_UMOUNT_REQ:
+		nfs_tcp_close();
 		nfs_umountall_req();
 		break;
 	case STATE_LOOKUP_REQ:
 		nfs_lookup_req(nfs_filename);
 		break;
 	case STATE_READ_REQ:
-		nfs_read_req(nfs_offset, nfs_len);
+		nfs_read_fill();
 		break;
 	case STATE_READLINK_REQ:
 		nfs_readlink_req();
@@ -702,8 +1101,10 @@ static int nfs_readlink_reply(uchar *pkt, unsigned len)
 	return 0;
 }
 
-static int nfs_read_reply(uchar *pkt, unsigned len)
+static int nfs_read_reply(uchar *pkt, unsigned len,
+			  struct nfs_read_slot **slotp, bool *eof)
 {
+	struct nfs_read_slot *slot;
 	struct rpc_t rpc_pkt;
 	int rlen;
 	uchar *data_ptr;
@@ -714,7 +1115,10 @@ static int nfs_read_reply(uchar *pkt, unsigned len)
 
 	if (ntohl(rpc_pkt.u.reply.id) > rpc_id)
 		return -NFS_RPC_ERR;
-	else if (ntohl(rpc_pkt.u.reply.id) < rpc_id)
+
+	/* Replies to requests no longer in flight are duplicates */
+	slot = nfs_read_find(ntohl(rpc_pkt.u.reply.id));
+	if (!slot)
 		return -NFS_RPC_DROP;
 
 	if (rpc_pkt.u.reply.rstatus  ||
@@ -728,21 +1132,17 @@ static int nfs_read_reply(uchar *pkt, unsigned len)
 		return -ntohl(rpc_pkt.u.reply.data[0]);
 	}
 
-	if ((nfs_offset != 0) && !((nfs_offset) %
-			(NFS_READ_SIZE / 2 * 10 * HASHES_PER_LINE)))
-		puts("\n\t ");
-	if (!(nfs_offset % ((NFS_READ_SIZE / 2) * 10)))
-		putc('#');
-
 	if (choosen_nfs_version != NFS_V3) {
 		rlen = ntohl(rpc_pkt.u.reply.data[18]);
 		data_ptr = (uchar *)&(rpc_pkt.u.reply.data[19]);
+		*eof = false;
 	} else {  /* NFS_V3 */
 		int nfsv3_data_offset =
 			nfs3_get_attributes_offset(rpc_pkt.u.reply.data);
 
 		/* count value */
 		rlen = ntohl(rpc_pkt.u.reply.data[1 + nfsv3_data_offset]);
+		*eof = !!rpc_pkt.u.reply.data[2 + nfsv3_data_offset];
 		/* Skip unused values :
 			EOF:		32 bits value,
 			data_size:	32 bits value,
@@ -754,9 +1154,14 @@ static int nfs_read_reply(uchar *pkt, unsigned len)
 	if (((uchar *)&(rpc_pkt.u.reply.data[0]) - (uchar *)(&rpc_pkt) + rlen) > len)
 			return -9999;
 
-	if (store_block(data_ptr, nfs_offset, rlen))
+	if (rlen > slot->len)
+		return -9999;
+
+	if (store_block(data_ptr, slot->offset, rlen))
 			return -9999;
 
+	*slotp = slot;
+
 	return rlen;
 }
 
@@ -765,6 +1170,16 @@ Interfaces of U-BOOT
 **************************************************************************/
 static void nfs_timeout_handler(void)
 {
+	if (nfs_state == STATE_READ_REQ) {
+		if (!nfs_read_resend()) {
+			puts("\nRetry count exceeded; starting again\n");
+			net_start_again();
+			return;
+		}
+		net_set_timeout_handler(nfs_rto, nfs_timeout_handler);
+		return;
+	}
+
 	if (++nfs_timeout_count > NFS_RETRY_COUNT) {
 		puts("\nRetry count exceeded; starting again\n");
 		net_start_again();
@@ -773,24 +1188,47 @@ static void nfs_timeout_handler(void)
 		net_set_timeout_handler(nfs_timeout +
 					nfs_timeout * nfs_timeout_count,
 					nfs_timeout_handler);
+		if ((nfs_state != STATE_LOOKUP_REQ &&
+		     nfs_state != STATE_READLINK_REQ) || !nfs_tcp_retransmit())
+			nfs_send();
+	}
+}
+
+/* Act on the reply of @rlen bytes to the READ request in @slot, or error */
+static void nfs_read_handle(struct nfs_read_slot *slot, int rlen, bool eof)
+{
+	net_set_timeout_handler(nfs_timeout, nfs_timeout_handler);
+	if (rlen >= 0) {
+		nfs_read_complete(slot, rlen, eof);
+		if (nfs_read_done()) {
+			nfs_download_state = NETLOOP_SUCCESS;
+			nfs_state = STATE_UMOUNT_REQ;
+			nfs_send();
+		} else if (!nfs_read_resend()) {
+			puts("\nRetry count exceeded; starting again\n");
+			net_start_again();
+		} else {
+			nfs_send();
+		}
+	} else if ((rlen == -NFSERR_ISDIR) || (rlen == -NFSERR_INVAL)) {
+		/* symbolic link */
+		nfs_state = STATE_READLINK_REQ;
+		nfs_send();
+	} else {
+		debug("NFS READ error (%d)\n", rlen);
+		nfs_state = STATE_UMOUNT_REQ;
 		nfs_send();
 	}
 }
 
-static void nfs_handler(uchar *pkt, unsigned dest, struct in_addr sip,
-			unsigned src, unsigned len)
+/* Handle a reply received over UDP, or over TCP if not stored as it came */
+static void nfs_reply(uchar *pkt, unsigned len)
 {
+	struct nfs_read_slot *slot = NULL;
+	bool eof = false;
 	int rlen;
 	int reply;
 
-	debug("%s\n", __func__);
-
-	if (len > sizeof(struct rpc_t))
-		return;
-
-	if (dest != nfs_our_port)
-		return;
-
 	switch (nfs_state) {
 	case STATE_PRCLOOKUP_PROG_MOUNT_REQ:
 		if (rpc_lookup_reply(PROG_MOUNT, pkt, len) == -NFS_RPC_DROP)
@@ -802,6 +1240,12 @@ static void nfs_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 	case STATE_PRCLOOKUP_PROG_NFS_REQ:
 		if (rpc_lookup_reply(PROG_NFS, pkt, len) == -NFS_RPC_DROP)
 			break;
+		if (nfs_use_tcp() && !nfs_server_port) {
+			/* No NFS over TCP, ask for the UDP port instead */
+			nfs_tcp = false;
+			nfs_send();
+			break;
+		}
 		nfs_state = STATE_MOUNT_REQ;
 		nfs_send();
 		break;
@@ -856,8 +1300,7 @@ static void nfs_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 			nfs_send();
 		} else {
 			nfs_state = STATE_READ_REQ;
-			nfs_offset = 0;
-			nfs_len = NFS_READ_SIZE;
+			nfs_read_start();
 			nfs_send();
 		}
 		break;
@@ -881,27 +1324,234 @@ static void nfs_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 		break;
 
 	case STATE_READ_REQ:
-		rlen = nfs_read_reply(pkt, len);
-		if (rlen == -NFS_RPC_DROP)
+		rlen = nfs_read_reply(pkt, len, &slot, &eof);
+		if (rlen != -NFS_RPC_DROP)
+			nfs_read_handle(slot, rlen, eof);
+		break;
+	}
+}
+
+static void nfs_handler(uchar *pkt, unsigned dest, struct in_addr sip,
+			unsigned src, unsigned len)
+{
+	debug("%s\n", __func__);
+
+	if (len > sizeof(struct rpc_t))
+		return;
+
+	if (dest != nfs_our_port)
+		return;
+
+	nfs_reply(pkt, len);
+}
+
+/**************************************************************************
+RPC over TCP - receiving replies
+**************************************************************************/
+
+/*
+ * Length of the header of a READ reply, up to the file data, or of the part
+ * of it needed to know more. Returns 0 for an error reply, which is small and
+ * kept whole.
+ */
+static u32 nfs_tcp_read_hdr_len(void)
+{
+	struct rpc_t *rpc = &nfs_rx.rec;
+	u32 hdr = offsetof(struct rpc_t, u.reply.data);
+
+	if (nfs_rx.len < hdr + 4)
+		return hdr + 4;
+
+	if (rpc->u.reply.rstatus  ||
+	    rpc->u.reply.verifier ||
+	    rpc->u.reply.astatus  ||
+	    rpc->u.reply.data[0])
+		return 0;
+
+	if (choosen_nfs_version != NFS_V3)
+		return hdr + 19 * 4;
+
+	if (nfs_rx.len < hdr + 8)
+		return hdr + 8;
+
+	return hdr + (4 + nfs3_get_attributes_offset(rpc->u.reply.data)) * 4;
+}
+
+/* The header of a READ reply is in, store the file data from now on */
+static void nfs_tcp_read_start(u32 hdr)
+{
+	u32 *data = nfs_rx.rec.u.reply.data;
+	int off;
+
+	nfs_rx.stream = true;
+	nfs_rx.data = hdr;
+
+	/* Replies to requests no longer in flight are duplicates */
+	nfs_rx.slot = nfs_read_find(ntohl(nfs_rx.rec.u.reply.id));
+
+	if (choosen_nfs_version != NFS_V3) {
+		nfs_rx.count = ntohl(data[18]);
+		nfs_rx.eof = false;
+	} else {
+		off = nfs3_get_attributes_offset(data);
+		nfs_rx.count = ntohl(data[1 + off]);
+		nfs_rx.eof = !!data[2 + off];
+	}
+}
+
+static void nfs_tcp_rx_data(uchar *p, u32 len)
+{
+	u32 need, n, pos;
+
+	while (!nfs_rx.stream) {
+		need = nfs_state == STATE_READ_REQ ? nfs_tcp_read_hdr_len() : 0;
+		if (need && nfs_rx.len == need) {
+			nfs_tcp_read_start(need);
 			break;
-		net_set_timeout_handler(nfs_timeout, nfs_timeout_handler);
-		if (rlen > 0) {
-			nfs_offset += rlen;
-			nfs_send();
-		} else if ((rlen == -NFSERR_ISDIR) || (rlen == -NFSERR_INVAL)) {
-			/* symbolic link */
-			nfs_state = STATE_READLINK_REQ;
-			nfs_send();
+		}
+		if (!len)
+			return;
+
+		if (!need)
+			need = sizeof(nfs_rx.rec);
+		if (nfs_rx.len >= need) {
+			/* Too long for the buffer, dropped at its end */
+			nfs_rx.len += len;
+			return;
+		}
+		n = min(len, need - nfs_rx.len);
+		memcpy((uchar *)&nfs_rx.rec + nfs_rx.len, p, n);
+		nfs_rx.len += n;
+		p += n;
+		len -= n;
+	}
+
+	pos = nfs_rx.len - nfs_rx.data;
+	if (nfs_rx.slot && nfs_rx.count <= nfs_rx.slot->len &&
+	    pos < nfs_rx.count)
+		store_block(p, nfs_rx.slot->offset + pos,
+			    min(len, nfs_rx.count - pos));
+	nfs_rx.len += len;
+}
+
+static void nfs_tcp_rx_end(void)
+{
+	struct nfs_read_slot *slot = nfs_rx.slot;
+	int rlen;
+
+	if (nfs_rx.stream) {
+		if (slot) {
+			rlen = min(nfs_rx.count, nfs_rx.len - nfs_rx.data);
+			if (nfs_rx.count > slot->len)
+				rlen = -9999;
+			nfs_read_handle(slot, rlen,
+					nfs_rx.eof && rlen == nfs_rx.count);
+		}
+	} else if (nfs_rx.len <= sizeof(nfs_rx.rec)) {
+		nfs_reply((uchar *)&nfs_rx.rec, nfs_rx.len);
+	}
+
+	nfs_rx.len = 0;
+	nfs_rx.stream = false;
+	nfs_rx.slot = NULL;
+}
+
+/* Split the stream from the server into records */
+static void nfs_tcp_recv(uchar *p, u32 len)
+{
+	u32 n;
+
+	/* Once done, whatever follows is of no interest */
+	while (len && nfs_tcp_connected) {
+		if (!nfs_rx.frag_left) {
+			n = min_t(u32, len, sizeof(nfs_rx.mark) - nfs_rx.mark_len);
+			memcpy((uchar *)&nfs_rx.mark + nfs_rx.mark_len, p, n);
+			nfs_rx.mark_len += n;
+			p += n;
+			len -= n;
+			if (nfs_rx.mark_len < sizeof(nfs_rx.mark))
+				break;
+
+			nfs_rx.mark_len = 0;
+			nfs_rx.frag_left = ntohl(nfs_rx.mark) &
+					   ~NFS_TCP_LAST_FRAG;
+			nfs_rx.last = !!(ntohl(nfs_rx.mark) &
+					 NFS_TCP_LAST_FRAG);
 		} else {
-			if (!rlen)
-				nfs_download_state = NETLOOP_SUCCESS;
-			if (rlen < 0)
-				debug("NFS READ error (%d)\n", rlen);
-			nfs_state = STATE_UMOUNT_REQ;
-			nfs_send();
+			n = min(len, nfs_rx.frag_left);
+			nfs_tcp_rx_data(p, n);
+			nfs_rx.frag_left -= n;
+			p += n;
+			len -= n;
 		}
-		break;
+
+		if (!nfs_rx.frag_left && nfs_rx.last) {
+			nfs_rx.last = false;
+			nfs_tcp_rx_end();
+		}
+	}
+}
+
+static void nfs_tcp_handler(uchar *pkt, u16 dport, struct in_addr sip,
+			    u16 sport, u32 tcp_seq_num, u32 tcp_ack_num,
+			    u8 action, unsigned int len)
+{
+	u32 acked;
+
+	if (ntohs(dport) != nfs_tcp_port || ntohs(sport) != nfs_server_port)
+		return;
+
+	if (!nfs_tcp_connected) {
+		if (action & TCP_FIN) {
+			/* The server closes its side too */
+			nfs_tcp_rcv_nxt = tcp_seq_num + 1;
+			nfs_tcp_ack();
+		} else if ((action & TCP_ACK) && !len &&
+			   tcp_get_tcp_state() == TCP_ESTABLISHED &&
+			   nfs_tcp_queued) {
+			/* SYN and ACK */
+			nfs_tcp_connected = true;
+			nfs_tcp_rcv_nxt = tcp_seq_num + 1;
+			nfs_tcp_ack();
+			nfs_tcp_push();
+		}
+		return;
+	}
+
+	/* The server has the bytes it acknowledges, forget them */
+	acked = tcp_ack_num - nfs_tcp_snd_una;
+	if (acked && acked <= nfs_tcp_queued) {
+		nfs_tcp_queued -= acked;
+		memmove(nfs_tcp_txbuf, nfs_tcp_txbuf + acked, nfs_tcp_queued);
+		nfs_tcp_snd_una = tcp_ack_num;
+		if ((s32)(nfs_tcp_snd_nxt - nfs_tcp_snd_una) < 0)
+			nfs_tcp_snd_nxt = nfs_tcp_snd_una;
+	}
+
+	if (action & TCP_FIN) {
+		puts("\n*** ERROR: NFS server closed the connection\n");
+		nfs_tcp_rcv_nxt = tcp_seq_num + 1;
+		nfs_tcp_ack();
+		nfs_tcp_connected = false;
+		nfs_tcp_queued = 0;
+		nfs_state = STATE_UMOUNT_REQ;
+		nfs_send();
+		return;
 	}
+
+	if (!len)
+		return;
+
+	/* Nothing is kept out of order, ask for what comes next again */
+	if (tcp_seq_num != nfs_tcp_rcv_nxt) {
+		nfs_tcp_ack();
+		return;
+	}
+
+	nfs_tcp_rcv_nxt += len;
+	nfs_tcp_recv(pkt, len);
+	if (nfs_tcp_connected)
+		nfs_tcp_ack();
 }
 
 
@@ -965,6 +1615,10 @@ void nfs_start(void)
 	nfs_timeout_count = 0;
 	nfs_state = STATE_PRCLOOKUP_PROG_MOUNT_REQ;
 
+	nfs_tcp = IS_ENABLED(CONFIG_NFS_TCP);
+	nfs_tcp_connected = false;
+	nfs_tcp_queued = 0;
+
 	/*nfs_our_port = 4096 + (get_ticks() % 3072);*/
 	/*FIX ME !!!*/
 	nfs_our_port = 1000;
@@ -42,6 +42,8 @@
  * case, most NFS servers are optimized for a power of 2.
  */
 #define NFS_READ_SIZE	1024	/* biggest power of two that fits Ether frame */
+/* Over TCP the reply is a stream, so only the server limits the size */
+#define NFS_TCP_READ_SIZE	32768
 #define NFS_MAX_ATTRS	26
 
 /* Values for Accept State flag on RPC answers (See: rfc1831) */
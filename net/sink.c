@@ -0,0 +1,915 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Write files loaded over the network straight to storage
+ *
+ * Rather than loading a file into memory and writing it to storage once it
+ * is all there, which limits its size to the memory free, the protocol
+ * passes the file on as it arrives. It goes into a ring buffer, from which
+ * it is written out in order, a chunk at a time, as soon as a chunk is
+ * complete.
+ */
+
+#include <common.h>
+#include <blk.h>
+#include <div64.h>
+#include <gzip.h>
+#include <hash.h>
+#include <image-sparse.h>
+#include <log.h>
+#include <malloc.h>
+#include <memalign.h>
+#include <mtd.h>
+#include <sparse_format.h>
+#include <watchdog.h>
+#include <asm/unaligned.h>
+#include <linux/sizes.h>
+#include <net/sink.h>
+#include <u-boot/crc.h>
+#include <u-boot/zlib.h>
+
+/* Data written out at once, rounded up to blocks or erase blocks */
+#define NET_SINK_CHUNK		SZ_256K
+
+/*
+ * Parts stored past the first byte missing, which TCP with SACK keeps track
+ * of as many of
+ */
+#define NET_SINK_RANGES		32
+
+/**
+ * struct net_sink_range - part of the file stored past the first byte missing
+ * @start: offset of its first byte
+ * @end: offset after its last byte
+ */
+struct net_sink_range {
+	u64 start;
+	u64 end;
+};
+
+enum net_sink_sparse_state {
+	SPARSE_HEADER,
+	SPARSE_CHUNK,
+	SPARSE_RAW,
+	SPARSE_FILL,
+	SPARSE_CRC32,
+	SPARSE_DONE,
+};
+
+/**
+ * struct net_sink - where the next file loaded goes
+ *
+ * @armed: a device is set up
+ * @started: a file is being loaded
+ * @final: all of the file was written out
+ * @type: how it is written
+ * @buf: ring buffer, holding the file from @base on
+ * @size: size of @buf, a number of chunks
+ * @chunk: data written out at once
+ * @base: offset of the first byte not written out yet
+ * @edge: offset of the first byte missing
+ * @ranges: parts stored past @edge
+ * @nr_ranges: number of @ranges
+ * @hash: hash algorithm, NULL if none
+ * @hash_ctx: context of @hash
+ * @written: bytes written to the device
+ * @desc: block device
+ * @start: first block which may be written to
+ * @count: number of blocks which may be written to
+ * @obuf: data for the block device, decompressed or unpacked
+ * @ofill: bytes in @obuf
+ * @oblk: block the first byte of @obuf goes to, from @start
+ * @mtd: MTD device
+ * @moff: next offset written to in @mtd
+ * @gz: state of the gzip decompression
+ * @gz.zs: zlib stream
+ * @gz.header: the gzip header was read
+ * @gz.end: the end of the deflate stream was seen
+ * @gz.crc: CRC32 of the data decompressed
+ * @gz.len: length of the data decompressed
+ * @gz.trailer: gzip trailer, following the deflate stream
+ * @gz.trailer_len: bytes in @gz.trailer
+ * @sparse: state of the sparse image reading
+ * @sparse.state: what is being read
+ * @sparse.hdr: the header being read, or its start
+ * @sparse.need: bytes of it to read
+ * @sparse.got: bytes of it read so far
+ * @sparse.left: raw data left in the chunk
+ * @sparse.blk: block the next chunk goes to, from @start
+ * @sparse.blks: blocks of the chunk, in device blocks
+ * @sparse.blk_sz: block size of the image
+ * @sparse.file_hdr_sz: size of the file header
+ * @sparse.chunk_hdr_sz: size of a chunk header
+ * @sparse.chunks: chunks left
+ */
+static struct net_sink {
+	bool armed;
+	bool started;
+	bool final;
+	enum net_sink_type type;
+	u8 *buf;
+	ulong size;
+	ulong chunk;
+	u64 base;
+	u64 edge;
+	struct net_sink_range ranges[NET_SINK_RANGES];
+	int nr_ranges;
+	struct hash_algo *hash;
+	void *hash_ctx;
+	u64 written;
+	struct blk_desc *desc;
+	lbaint_t start;
+	lbaint_t count;
+	u8 *obuf;
+	ulong ofill;
+	lbaint_t oblk;
+	struct mtd_info *mtd;
+	u64 moff;
+	union {
+		struct {
+			z_stream zs;
+			bool header;
+			bool end;
+			u32 crc;
+			u64 len;
+			u8 trailer[8];
+			int trailer_len;
+		} gz;
+		struct {
+			enum net_sink_sparse_state state;
+			u8 hdr[64];
+			ulong need;
+			ulong got;
+			u64 left;
+			lbaint_t blk;
+			lbaint_t blks;
+			u32 blk_sz;
+			u16 file_hdr_sz;
+			u16 chunk_hdr_sz;
+			u32 chunks;
+		} sparse;
+	};
+} sink;
+
+static const char *const net_sink_names[] = {
+	[NET_SINK_BLK]		= "blk",
+	[NET_SINK_GZIP]		= "gz",
+	[NET_SINK_SPARSE]	= "sparse",
+	[NET_SINK_MTD]		= "mtd",
+};
+
+/* Get where the byte at offset @off in the file goes in the ring buffer */
+static ulong sink_pos(u64 off)
+{
+	return do_div(off, sink.size);
+}
+
+/**
+ * sink_blk_write() - write blocks to the block device
+ * @blk: first block, from the start of the area written to
+ * @cnt: number of blocks
+ * @buf: data
+ *
+ * Return: 0 if OK, -ve on error
+ */
+static int sink_blk_write(lbaint_t blk, lbaint_t cnt, const void *buf)
+{
+	if (blk + cnt > sink.count) {
+		printf("netsink: Past the end of the area written to\n");
+		return -ENOSPC;
+	}
+	if (blk_dwrite(sink.desc, sink.start + blk, cnt, buf) != cnt) {
+		printf("netsink: Write error at block " LBAF "\n",
+		       sink.start + blk);
+		return -EIO;
+	}
+	sink.written += (u64)cnt * sink.desc->blksz;
+
+	return 0;
+}
+
+/**
+ * sink_obuf_flush() - write the whole blocks in the output buffer
+ * @all: write all of it, padding the last block with zeroes
+ *
+ * Return: 0 if OK, -ve on error
+ */
+static int sink_obuf_flush(bool all)
+{
+	ulong blksz = sink.desc->blksz;
+	lbaint_t cnt;
+	ulong len;
+	int ret;
+
+	cnt = all ? DIV_ROUND_UP(sink.ofill, blksz) : sink.ofill / blksz;
+	if (!cnt)
+		return 0;
+
+	len = cnt * blksz;
+	if (len > sink.ofill) {
+		memset(sink.obuf + sink.ofill, '\0', len - sink.ofill);
+		sink.ofill = len;
+	}
+	ret = sink_blk_write(sink.oblk, cnt, sink.obuf);
+	if (ret)
+		return ret;
+	sink.oblk += cnt;
+	sink.ofill -= len;
+	memmove(sink.obuf, sink.obuf + len, sink.ofill);
+
+	return 0;
+}
+
+/**
+ * sink_obuf_put() - queue data for the block device
+ * @buf: data
+ * @len: length of @buf
+ *
+ * Return: 0 if OK, -ve on error
+ */
+static int sink_obuf_put(const u8 *buf, ulong len)
+{
+	ulong n;
+	int ret;
+
+	while (len) {
+		n = min(len, sink.chunk - sink.ofill);
+		memcpy(sink.obuf + sink.ofill, buf, n);
+		sink.ofill += n;
+		buf += n;
+		len -= n;
+		if (sink.ofill == sink.chunk) {
+			ret = sink_obuf_flush(false);
+			if (ret)
+				return ret;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * sink_gz_write() - decompress data for the block device
+ * @buf: compressed data
+ * @len: length of @buf
+ *
+ * Return: 0 if OK, -ve on error
+ */
+static int sink_gz_write(const u8 *buf, ulong len)
+{
+	z_stream *zs = &sink.gz.zs;
+	ulong n;
+	int ret;
+
+	if (!IS_ENABLED(CONFIG_GZIP))
+		return -ENOSYS;
+
+	if (!sink.gz.header) {
+		ret = -EINVAL;
+		if (len > 10 && buf[0] == 0x1f && buf[1] == 0x8b)
+			ret = gzip_parse_header(buf, len);
+		if (ret < 0) {
+			printf("netsink: Bad gzip header\n");
+			return -EINVAL;
+		}
+		buf += ret;
+		len -= ret;
+		sink.gz.header = true;
+	}
+
+	zs->next_in = (u8 *)buf;
+	zs->avail_in = len;
+	while (zs->avail_in && !sink.gz.end) {
+		zs->next_out = sink.obuf + sink.ofill;
+		zs->avail_out = sink.chunk - sink.ofill;
+		ret = inflate(zs, Z_SYNC_FLUSH);
+		if (ret != Z_OK && ret != Z_STREAM_END) {
+			printf("netsink: inflate() returned %d\n", ret);
+			return -EINVAL;
+		}
+		n = sink.chunk - sink.ofill - zs->avail_out;
+		sink.gz.crc = crc32(sink.gz.crc, sink.obuf + sink.ofill, n);
+		sink.gz.len += n;
+		sink.ofill += n;
+		if (ret == Z_STREAM_END)
+			sink.gz.end = true;
+		if (sink.ofill == sink.chunk) {
+			ret = sink_obuf_flush(false);
+			if (ret)
+				return ret;
+		}
+	}
+
+	/* What follows the deflate stream is the trailer */
+	n = min_t(ulong, zs->avail_in,
+		  sizeof(sink.gz.trailer) - sink.gz.trailer_len);
+	memcpy(sink.gz.trailer + sink.gz.trailer_len, zs->next_in, n);
+	sink.gz.trailer_len += n;
+
+	return 0;
+}
+
+/* Check that the data decompressed matches the gzip trailer */
+static int sink_gz_finish(void)
+{
+	int ret;
+
+	ret = sink_obuf_flush(true);
+	if (ret)
+		return ret;
+
+	if (!sink.gz.end || sink.gz.trailer_len != sizeof(sink.gz.trailer)) {
+		printf("netsink: Truncated gzip data\n");
+		return -EINVAL;
+	}
+	if (get_unaligned_le32(sink.gz.trailer) != sink.gz.crc ||
+	    get_unaligned_le32(sink.gz.trailer + 4) != (u32)sink.gz.len) {
+		printf("netsink: gzip CRC or length mismatch\n");
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+/**
+ * sink_sparse_read() - read the next @need bytes of the sparse image
+ * @state: what they are
+ * @need: number of bytes
+ */
+static void sink_sparse_read(enum net_sink_sparse_state state, ulong need)
+{
+	sink.sparse.state = state;
+	sink.sparse.need = need;
+	sink.sparse.got = 0;
+}
+
+/* Go on to the next chunk of the sparse image, if any */
+static void sink_sparse_next(void)
+{
+	if (sink.sparse.chunks--)
+		sink_sparse_read(SPARSE_CHUNK, sink.sparse.chunk_hdr_sz);
+	else
+		sink.sparse.state = SPARSE_DONE;
+}
+
+/* Take in the sparse image header */
+static int sink_sparse_header(void)
+{
+	sparse_header_t *hdr = (sparse_header_t *)sink.sparse.hdr;
+	ulong blksz = sink.desc->blksz;
+	u32 blk_sz = le32_to_cpu(hdr->blk_sz);
+
+	if (!is_sparse_image(hdr) ||
+	    le16_to_cpu(hdr->file_hdr_sz) < sizeof(sparse_header_t) ||
+	    le16_to_cpu(hdr->chunk_hdr_sz) < sizeof(chunk_header_t) ||
+	    le16_to_cpu(hdr->chunk_hdr_sz) > sizeof(sink.sparse.hdr) ||
+	    !blk_sz || blk_sz % blksz || sink.chunk % blk_sz) {
+		printf("netsink: Bad sparse image header\n");
+		return -EINVAL;
+	}
+	if ((u64)le32_to_cpu(hdr->total_blks) * (blk_sz / blksz) >
+	    sink.count) {
+		printf("netsink: Sparse image larger than the area written to\n");
+		return -ENOSPC;
+	}
+
+	sink.sparse.blk_sz = blk_sz;
+	sink.sparse.file_hdr_sz = le16_to_cpu(hdr->file_hdr_sz);
+	sink.sparse.chunk_hdr_sz = le16_to_cpu(hdr->chunk_hdr_sz);
+	sink.sparse.chunks = le32_to_cpu(hdr->total_chunks);
+	sink_sparse_next();
+
+	return 0;
+}
+
+/* Take in a chunk header */
+static int sink_sparse_chunk(void)
+{
+	chunk_header_t *hdr = (chunk_header_t *)sink.sparse.hdr;
+	u64 len = le32_to_cpu(hdr->total_sz) - sink.sparse.chunk_hdr_sz;
+	u64 size = (u64)le32_to_cpu(hdr->chunk_sz) * sink.sparse.blk_sz;
+
+	if (le32_to_cpu(hdr->total_sz) < sink.sparse.chunk_hdr_sz)
+		len = ~0ULL;
+	sink.sparse.blks = lldiv(size, sink.desc->blksz);
+
+	switch (le16_to_cpu(hdr->chunk_type)) {
+	case CHUNK_TYPE_RAW:
+		if (len != size)
+			break;
+		sink.sparse.state = SPARSE_RAW;
+		sink.sparse.left = len;
+		sink.oblk = sink.sparse.blk;
+		sink.sparse.blk += sink.sparse.blks;
+		if (!len)
+			sink_sparse_next();
+		return 0;
+	case CHUNK_TYPE_FILL:
+		if (len != sizeof(u32))
+			break;
+		sink_sparse_read(SPARSE_FILL, len);
+		return 0;
+	case CHUNK_TYPE_DONT_CARE:
+		if (len)
+			break;
+		sink.sparse.blk += sink.sparse.blks;
+		sink_sparse_next();
+		return 0;
+	case CHUNK_TYPE_CRC32:
+		if (len != sizeof(u32))
+			break;
+		sink_sparse_read(SPARSE_CRC32, len);
+		return 0;
+	}
+
+	printf("netsink: Bad sparse chunk type %x\n",
+	       le16_to_cpu(hdr->chunk_type));
+	return -EINVAL;
+}
+
+/* Write out a fill chunk */
+static int sink_sparse_fill(void)
+{
+	u32 *fill = (u32 *)sink.obuf;
+	lbaint_t per = sink.chunk / sink.desc->blksz;
+	lbaint_t cnt;
+	int ret;
+	int i;
+
+	for (i = 0; i < sink.chunk / sizeof(u32); i++)
+		fill[i] = get_unaligned((u32 *)sink.sparse.hdr);
+
+	while (sink.sparse.blks) {
+		cnt = min(sink.sparse.blks, per);
+		ret = sink_blk_write(sink.sparse.blk, cnt, sink.obuf);
+		if (ret)
+			return ret;
+		sink.sparse.blk += cnt;
+		sink.sparse.blks -= cnt;
+	}
+	sink_sparse_next();
+
+	return 0;
+}
+
+/**
+ * sink_sparse_write() - unpack a sparse image for the block device
+ * @buf: part of the sparse image
+ * @len: length of @buf
+ *
+ * Return: 0 if OK, -ve on error
+ */
+static int sink_sparse_write(const u8 *buf, ulong len)
+{
+	ulong n;
+	int ret;
+
+	while (len) {
+		switch (sink.sparse.state) {
+		case SPARSE_RAW:
+			n = min_t(u64, len, sink.sparse.left);
+			ret = sink_obuf_put(buf, n);
+			if (ret)
+				return ret;
+			sink.sparse.left -= n;
+			if (!sink.sparse.left) {
+				/* Raw chunks are made of whole blocks */
+				ret = sink_obuf_flush(false);
+				if (ret)
+					return ret;
+				sink_sparse_next();
+			}
+			break;
+		case SPARSE_DONE:
+			printf("netsink: Data past the end of the sparse image\n");
+			return -EINVAL;
+		default:
+			n = min(len, sink.sparse.need - sink.sparse.got);
+			if (sink.sparse.got < sizeof(sink.sparse.hdr))
+				memcpy(sink.sparse.hdr + sink.sparse.got, buf,
+				       min(n, sizeof(sink.sparse.hdr) -
+				       sink.sparse.got));
+			sink.sparse.got += n;
+			if (sink.sparse.got < sink.sparse.need)
+				break;
+
+			ret = 0;
+			if (sink.sparse.state == SPARSE_HEADER)
+				ret = sink_sparse_header();
+			else if (sink.sparse.state == SPARSE_CHUNK)
+				ret = sink_sparse_chunk();
+			else if (sink.sparse.state == SPARSE_FILL)
+				ret = sink_sparse_fill();
+			else
+				sink_sparse_next();
+			if (ret)
+				return ret;
+			break;
+		}
+		buf += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+/**
+ * sink_mtd_write() - write data to the MTD device, erasing it first
+ * @buf: data, with room to pad it to a whole erase block
+ * @len: length of @buf
+ *
+ * Return: 0 if OK, -ve on error
+ */
+static int sink_mtd_write(u8 *buf, ulong len)
+{
+	struct mtd_info *mtd = sink.mtd;
+	struct erase_info erase = {};
+	size_t retlen;
+	ulong n;
+	int ret;
+
+	if (!IS_ENABLED(CONFIG_MTD))
+		return -ENOSYS;
+
+	while (len) {
+		for (;;) {
+			if (sink.moff + mtd->erasesize > mtd->size) {
+				printf("netsink: Past the end of %s\n",
+				       mtd->name);
+				return -ENOSPC;
+			}
+			if (!mtd_can_have_bb(mtd))
+				break;
+			ret = mtd_block_isbad(mtd, sink.moff);
+			if (ret < 0) {
+				printf("netsink: Bad block check error at 0x%08llx\n",
+				       sink.moff);
+				return ret;
+			}
+			if (!ret)
+				break;
+			printf("netsink: Skipping bad block at 0x%08llx\n",
+			       sink.moff);
+			sink.moff += mtd->erasesize;
+		}
+
+		erase.mtd = mtd;
+		erase.addr = sink.moff;
+		erase.len = mtd->erasesize;
+		ret = mtd_erase(mtd, &erase);
+		if (ret) {
+			printf("netsink: Erase error at 0x%08llx\n", sink.moff);
+			return ret;
+		}
+
+		n = min_t(ulong, len, mtd->erasesize);
+		if (n % mtd->writesize) {
+			memset(buf + n, 0xff,
+			       mtd->writesize - n % mtd->writesize);
+			n = roundup(n, mtd->writesize);
+		}
+		ret = mtd_write(mtd, sink.moff, n, &retlen, buf);
+		if (ret || retlen != n) {
+			printf("netsink: Write error at 0x%08llx\n", sink.moff);
+			return ret ?: -EIO;
+		}
+		sink.written += n;
+		sink.moff += mtd->erasesize;
+		buf += n;
+		len -= min_t(ulong, len, n);
+	}
+
+	return 0;
+}
+
+/**
+ * sink_out() - write out data from the ring buffer
+ * @buf: data, which starts a chunk
+ * @len: length of @buf, up to a chunk
+ *
+ * Return: 0 if OK, -ve on error
+ */
+static int sink_out(u8 *buf, ulong len)
+{
+	lbaint_t cnt;
+	ulong blksz;
+	int ret;
+
+	switch (sink.type) {
+	case NET_SINK_BLK:
+		/* Only the end of the file may not fill a block */
+		blksz = sink.desc->blksz;
+		cnt = DIV_ROUND_UP(len, blksz);
+		memset(buf + len, '\0', cnt * blksz - len);
+		ret = sink_blk_write(sink.oblk, cnt, buf);
+		sink.oblk += cnt;
+		return ret;
+	case NET_SINK_GZIP:
+		return sink_gz_write(buf, len);
+	case NET_SINK_SPARSE:
+		return sink_sparse_write(buf, len);
+	case NET_SINK_MTD:
+		return sink_mtd_write(buf, len);
+	}
+
+	return -EINVAL;
+}
+
+/**
+ * sink_drain() - write out the chunks complete in the ring buffer
+ * @all: write out all that is there, the file being complete
+ *
+ * Return: 0 if OK, -ve on error
+ */
+static int sink_drain(bool all)
+{
+	ulong len;
+	u8 *buf;
+	int ret;
+
+	while (sink.edge - sink.base >= sink.chunk ||
+	       (all && sink.edge > sink.base)) {
+		len = min_t(u64, sink.edge - sink.base, sink.chunk);
+		buf = sink.buf + sink_pos(sink.base);
+		if (sink.hash) {
+			ret = sink.hash->hash_update(sink.hash, sink.hash_ctx,
+						     buf, len, 0);
+			if (ret) {
+				sink.hash = NULL;
+				return -EINVAL;
+			}
+		}
+		ret = sink_out(buf, len);
+		if (ret)
+			return ret;
+		sink.base += len;
+		schedule();
+	}
+	if (all)
+		sink.final = true;
+
+	return 0;
+}
+
+/**
+ * sink_fill() - record that a part of the file is stored
+ * @start: offset of its first byte
+ * @end: offset after its last byte
+ *
+ * Return: 0 if OK, -ENOSPC if too many parts are stored past the first byte
+ * missing
+ */
+static int sink_fill(u64 start, u64 end)
+{
+	struct net_sink_range *r;
+	int i;
+
+	/* Take out the ranges it touches, merging them in */
+	for (i = 0; i < sink.nr_ranges;) {
+		r = &sink.ranges[i];
+		if (r->start <= end && r->end >= start) {
+			start = min(start, r->start);
+			end = max(end, r->end);
+			*r = sink.ranges[--sink.nr_ranges];
+		} else {
+			i++;
+		}
+	}
+
+	if (start <= sink.edge) {
+		sink.edge = max(sink.edge, end);
+		return 0;
+	}
+	if (sink.nr_ranges == NET_SINK_RANGES)
+		return -ENOSPC;
+	r = &sink.ranges[sink.nr_ranges++];
+	r->start = start;
+	r->end = end;
+
+	return 0;
+}
+
+/**
+ * sink_arm() - set up the ring buffer for a device
+ * @type: how the file is written
+ * @chunk: data written out at once
+ *
+ * Return: 0 if OK, -ENOMEM if out of memory
+ */
+static int sink_arm(enum net_sink_type type, ulong chunk)
+{
+	net_sink_release();
+
+	sink.type = type;
+	sink.chunk = chunk;
+	sink.size = roundup(max_t(ulong, CONFIG_NETSINK_BUF_SIZE, 2 * chunk),
+			    chunk);
+	sink.buf = malloc_cache_aligned(sink.size);
+	if (type == NET_SINK_GZIP || type == NET_SINK_SPARSE)
+		sink.obuf = malloc_cache_aligned(chunk);
+	if (!sink.buf || (!sink.obuf && type != NET_SINK_BLK &&
+			  type != NET_SINK_MTD)) {
+		net_sink_release();
+		return -ENOMEM;
+	}
+	sink.armed = true;
+
+	return 0;
+}
+
+int net_sink_blk(enum net_sink_type type, struct blk_desc *desc,
+		 lbaint_t start, lbaint_t count)
+{
+	int ret;
+
+	if (type == NET_SINK_MTD ||
+	    (type == NET_SINK_GZIP && !IS_ENABLED(CONFIG_GZIP)))
+		return -EINVAL;
+
+	ret = sink_arm(type, roundup(NET_SINK_CHUNK, desc->blksz));
+	if (ret)
+		return ret;
+	sink.desc = desc;
+	sink.start = start;
+	sink.count = count;
+
+	if (type == NET_SINK_GZIP) {
+		sink.gz.zs.zalloc = gzalloc;
+		sink.gz.zs.zfree = gzfree;
+		if (inflateInit2(&sink.gz.zs, -MAX_WBITS) != Z_OK) {
+			net_sink_release();
+			return -ENOMEM;
+		}
+	} else if (type == NET_SINK_SPARSE) {
+		sink_sparse_read(SPARSE_HEADER, sizeof(sparse_header_t));
+	}
+
+	return 0;
+}
+
+int net_sink_mtd(struct mtd_info *mtd, u64 off)
+{
+	int ret;
+
+	if (!IS_ENABLED(CONFIG_MTD) || mtd_mod_by_eb(off, mtd))
+		return -EINVAL;
+
+	ret = sink_arm(NET_SINK_MTD, roundup(NET_SINK_CHUNK, mtd->erasesize));
+	if (ret)
+		return ret;
+	sink.mtd = mtd;
+	sink.moff = off;
+
+	return 0;
+}
+
+void net_sink_show(void)
+{
+	if (!sink.armed) {
+		printf("Files are loaded into memory\n");
+		return;
+	}
+
+	printf("The next file is written (%s) to ", net_sink_names[sink.type]);
+	if (sink.type == NET_SINK_MTD)
+		printf("%s from 0x%08llx\n", sink.mtd->name, sink.moff);
+	else
+		printf("%s %d from block " LBAF ", " LBAF " blocks\n",
+		       blk_get_uclass_name(sink.desc->uclass_id),
+		       sink.desc->devnum, sink.start, sink.count);
+	printf("Buffer: %lu KiB, written out %lu KiB at a time\n",
+	       sink.size / SZ_1K, sink.chunk / SZ_1K);
+}
+
+void net_sink_release(void)
+{
+	u8 digest[HASH_MAX_DIGEST_SIZE];
+
+	if (sink.type == NET_SINK_GZIP && sink.armed && IS_ENABLED(CONFIG_GZIP))
+		inflateEnd(&sink.gz.zs);
+	if (sink.hash)
+		sink.hash->hash_finish(sink.hash, sink.hash_ctx, digest,
+				       sizeof(digest));
+	if (sink.mtd && IS_ENABLED(CONFIG_MTD))
+		put_mtd_device(sink.mtd);
+	free(sink.buf);
+	free(sink.obuf);
+	memset(&sink, '\0', sizeof(sink));
+}
+
+bool net_sink_start(void)
+{
+	if (!sink.armed)
+		return false;
+
+	if (!sink.started)
+		printf("Writing to storage (%s)\n", net_sink_names[sink.type]);
+	sink.started = true;
+
+	return true;
+}
+
+int net_sink_write(u64 off, const void *buf, ulong len)
+{
+	u64 end = off + len;
+	ulong pos, n;
+	int ret;
+
+	if (!sink.started || sink.final)
+		return -EINVAL;
+
+	/* What was stored already may come again */
+	if (end <= sink.edge)
+		return 0;
+	if (off < sink.edge) {
+		buf += sink.edge - off;
+		len = end - sink.edge;
+		off = sink.edge;
+	}
+	if (end > sink.base + sink.size)
+		return -ENOSPC;
+
+	pos = sink_pos(off);
+	n = min(len, sink.size - pos);
+	memcpy(sink.buf + pos, buf, n);
+	memcpy(sink.buf, buf + n, len - n);
+
+	ret = sink_fill(off, end);
+	if (ret)
+		return ret;
+
+	return sink_drain(false);
+}
+
+ulong net_sink_room(void)
+{
+	/* Less than a chunk waits to be written out past the base */
+	return sink.size - sink.chunk;
+}
+
+int net_sink_hash(struct hash_algo *algo)
+{
+	int ret;
+
+	/* Starting again, the hash covers what was written out already */
+	if (sink.hash == algo)
+		return 0;
+	if (sink.hash || sink.base)
+		return -EINVAL;
+
+	ret = algo->hash_init(algo, &sink.hash_ctx);
+	if (ret)
+		return -EINVAL;
+	sink.hash = algo;
+
+	return 0;
+}
+
+int net_sink_digest(u8 *digest, int *size)
+{
+	struct hash_algo *algo = sink.hash;
+	int ret;
+
+	if (!algo)
+		return -EINVAL;
+
+	ret = sink_drain(true);
+	if (ret)
+		return ret;
+
+	sink.hash = NULL;
+	ret = algo->hash_finish(algo, sink.hash_ctx, digest, *size);
+	if (ret)
+		return -EINVAL;
+	*size = algo->digest_size;
+
+	return 0;
+}
+
+int net_sink_end(bool ok)
+{
+	int ret = 0;
+
+	if (!sink.started)
+		return 0;
+
+	if (ok) {
+		ret = sink_drain(true);
+		if (!ret && sink.nr_ranges) {
+			printf("netsink: Parts of the file are missing\n");
+			ret = -EIO;
+		}
+		if (!ret && sink.type == NET_SINK_GZIP)
+			ret = sink_gz_finish();
+		if (!ret && sink.type == NET_SINK_SPARSE &&
+		    sink.sparse.state != SPARSE_DONE) {
+			printf("netsink: Truncated sparse image\n");
+			ret = -EINVAL;
+		}
+	}
+
+	printf("Written to storage: %llu bytes (%llx hex)%s\n", sink.written,
+	       sink.written, ok && !ret ? "" : ", incomplete");
+	net_sink_release();
+
+	return ret;
+}
@@ -23,36 +23,51 @@
 #include <env_internal.h>
 #include <errno.h>
 #include <net.h>
+#include <net6.h>
 #include <net/tcp.h>
 
-/*
- * TCP sliding window  control used by us to request re-TX
+/**
+ * struct tcp_conn - state of a connection, told apart by our port
+ *
+ * @port: our port, 0 if the entry is free
+ * @state: TCP connection state
+ * @lost: TCP sliding window control used by us to request re-TX
+ * @loc_timestamp: our TCP option timestamp
+ * @rmt_timestamp: the peer's TCP option timestamp
+ * @seq_init: first sequence number of the peer
+ * @ack_edge: next sequence number expected from the peer
+ * @rx_ooo: the handler keeps data received out of order
+ * @rx_scale: scale of the receive window, worked out from its size when the
+ *	SYN is sent
+ * @rmt_scale: the peer's SYN scales windows too, so ours is scaled
+ * @hills: data received beyond the acknowledged edge, in sequence order.
+ *	Search for TCP_SACK and review the comments before the code section
+ * @nr_hills: number of @hills
  */
-static struct tcp_sack_v tcp_lost;
+struct tcp_conn {
+	u16 port;
+	enum tcp_state state;
+	struct tcp_sack_v lost;
+	u32 loc_timestamp;
+	u32 rmt_timestamp;
+	u32 seq_init;
+	u32 ack_edge;
+	bool rx_ooo;
+	u8 rx_scale;
+	bool rmt_scale;
+	struct sack_edges hills[TCP_SACK];
+	int nr_hills;
+};
 
-/* TCP option timestamp */
-static u32 loc_timestamp;
-static u32 rmt_timestamp;
+static struct tcp_conn tcp_conns[CONFIG_PROT_TCP_CONNS];
 
-static u32 tcp_seq_init;
-static u32 tcp_ack_edge;
+/* The connection of the packet last sent or received */
+static struct tcp_conn *tcp_conn = tcp_conns;
 
 static int tcp_activity_count;
 
-/*
- * Search for TCP_SACK and review the comments before the code section
- * TCP_SACK is the number of packets at the front of the stream
- */
-
-enum pkt_state {PKT, NOPKT};
-struct sack_r {
-	struct sack_edges se;
-	enum pkt_state st;
-};
-
-static struct sack_r edge_a[TCP_SACK];
-static unsigned int sack_idx;
-static unsigned int prev_len;
+/* Receive window offered to the peer */
+static u32 tcp_rx_window;
 
 /*
  * TCP lengths are stored as a rounded up number of 32 bit words.
@@ -64,11 +79,9 @@ static unsigned int prev_len;
 #define SHIFT_TO_TCPHDRLEN_FIELD(x) ((x) << 4)
 #define GET_TCP_HDR_LEN_IN_BYTES(x) ((x) >> 2)
 
-/* TCP connection state */
-static enum tcp_state current_tcp_state;
-
 /* Current TCP RX packet handler */
 static rxhand_tcp *tcp_packet_handler;
+static rxhand_tcp_check *tcp_packet_check;
 
 /**
  * tcp_get_tcp_state() - get current TCP state
@@ -77,7 +90,7 @@ static rxhand_tcp *tcp_packet_handler;
  */
 enum tcp_state tcp_get_tcp_state(void)
 {
-	return current_tcp_state;
+	return tcp_conn->state;
 }
 
 /**
@@ -86,7 +99,56 @@ enum tcp_state tcp_get_tcp_state(void)
  */
 void tcp_set_tcp_state(enum tcp_state new_state)
 {
-	current_tcp_state = new_state;
+	tcp_conn->state = new_state;
+}
+
+/**
+ * tcp_conn_find() - find the connection on one of our ports
+ * @port: our port
+ *
+ * A port not seen before takes a free entry, or one whose connection is
+ * closed.
+ *
+ * Return: the connection, NULL if all are in use
+ */
+static struct tcp_conn *tcp_conn_find(u16 port)
+{
+	struct tcp_conn *conn, *free = NULL;
+
+	for (conn = tcp_conns; conn < tcp_conns + ARRAY_SIZE(tcp_conns);
+	     conn++) {
+		if (conn->port == port)
+			return conn;
+		if (!free && (!conn->port || conn->state == TCP_CLOSED))
+			free = conn;
+	}
+	if (free) {
+		memset(free, '\0', sizeof(*free));
+		free->port = port;
+	}
+
+	return free;
+}
+
+/**
+ * tcp_select_conn() - select the connection on one of our ports
+ * @port: our port
+ *
+ * tcp_get_tcp_state(), tcp_set_tcp_state(), tcp_set_rx_window() and
+ * tcp_get_ack_edge() then act on it. Sending or receiving a packet selects
+ * its connection too.
+ *
+ * Return: 0 if OK, -ENOSPC if all CONFIG_PROT_TCP_CONNS connections are in use
+ */
+int tcp_select_conn(u16 port)
+{
+	struct tcp_conn *conn = tcp_conn_find(port);
+
+	if (!conn)
+		return -ENOSPC;
+	tcp_conn = conn;
+
+	return 0;
 }
 
 static void dummy_handler(uchar *pkt, u16 dport,
@@ -99,6 +161,9 @@ static void dummy_handler(uchar *pkt, u16 dport,
 /**
  * tcp_set_tcp_handler() - set a handler to receive data
  * @f: handler
+ *
+ * This also sets the receive window back to the default, removes the check
+ * set by tcp_set_tcp_check() and forgets all connections.
  */
 void tcp_set_tcp_handler(rxhand_tcp *f)
 {
@@ -107,38 +172,86 @@ void tcp_set_tcp_handler(rxhand_tcp *f)
 		tcp_packet_handler = dummy_handler;
 	else
 		tcp_packet_handler = f;
+	tcp_packet_check = NULL;
+	memset(tcp_conns, '\0', sizeof(tcp_conns));
+	tcp_conn = tcp_conns;
+	tcp_set_rx_window(0, false);
 }
 
 /**
- * tcp_set_pseudo_header() - set TCP pseudo header
+ * tcp_set_tcp_check() - set a check of data received, before it is taken
+ * @f: check, NULL to take all data
+ */
+void tcp_set_tcp_check(rxhand_tcp_check *f)
+{
+	tcp_packet_check = f;
+}
+
+/**
+ * tcp_set_rx_window() - set the receive window offered to the peer
+ * @size: bytes the handler takes beyond the acknowledged edge, 0 for as many
+ *        as fit in the receive packet buffers
+ * @ooo: the handler keeps data received out of order on the selected
+ *       connection
+ *
+ * A window larger than 64 KiB needs window scaling, which is agreed on in the
+ * SYN, so it must be set before connecting. Only handlers which place data at
+ * its offset in the stream, whatever order it arrives in, may set @ooo. Other
+ * data received beyond a hole is neither acknowledged nor reported in SACKs.
+ * New connections start without @ooo.
+ */
+void tcp_set_rx_window(u32 size, bool ooo)
+{
+	tcp_rx_window = size ? size : PKTBUFSRX * TCP_MSS;
+	tcp_conn->rx_ooo = ooo;
+	if (!ooo)
+		tcp_conn->nr_hills = 0;
+}
+
+/**
+ * tcp_get_ack_edge() - get the sequence number of the next byte expected
+ *
+ * Return: right edge of the data received in order
+ */
+u32 tcp_get_ack_edge(void)
+{
+	return tcp_conn->ack_edge;
+}
+
+int tcp_ip_extra(void)
+{
+	return IS_ENABLED(CONFIG_IPV6) && use_ip6 ?
+	       IP6_HDR_SIZE - IP_HDR_SIZE : 0;
+}
+
+/* Whether sequence number @a comes before @b */
+static bool tcp_seq_before(u32 a, u32 b)
+{
+	return (s32)(a - b) < 0;
+}
+
+/**
+ * tcp_pseudo_checksum() - set TCP pseudo header and checksum the packet
  * @pkt: the packet
  * @src: source IP address
  * @dest: destinaion IP address
  * @tcp_len: tcp length
- * @pkt_len: packet length
+ * @sum_len: bytes of it to checksum
  *
- * Return: the checksum of the packet
+ * Return: the checksum of the pseudo header and the first @sum_len bytes
  */
-u16 tcp_set_pseudo_header(uchar *pkt, struct in_addr src, struct in_addr dest,
-			  int tcp_len, int pkt_len)
+static u16 tcp_pseudo_checksum(uchar *pkt, struct in_addr src,
+			       struct in_addr dest, int tcp_len, int sum_len)
 {
 	union tcp_build_pkt *b = (union tcp_build_pkt *)pkt;
 	int checksum_len;
 
-	/*
-	 * Pseudo header
-	 *
-	 * Zero the byte after the last byte so that the header checksum
-	 * will always work.
-	 */
-	pkt[pkt_len] = 0;
-
 	net_copy_ip((void *)&b->ph.p_src, &src);
 	net_copy_ip((void *)&b->ph.p_dst, &dest);
 	b->ph.rsvd = 0;
 	b->ph.p	= IPPROTO_TCP;
 	b->ph.len = htons(tcp_len);
-	checksum_len = tcp_len + PSEUDO_HDR_SIZE;
+	checksum_len = sum_len + PSEUDO_HDR_SIZE;
 
 	debug_cond(DEBUG_DEV_PKT,
 		   "TCP Pesudo  Header  (to=%pI4, from=%pI4, Len=%d)\n",
@@ -147,6 +260,30 @@ u16 tcp_set_pseudo_header(uchar *pkt, struct in_addr src, struct in_addr dest,
 	return compute_ip_checksum(pkt + PSEUDO_PAD_SIZE, checksum_len);
 }
 
+/**
+ * tcp_set_pseudo_header() - set TCP pseudo header
+ * @pkt: the packet
+ * @src: source IP address
+ * @dest: destinaion IP address
+ * @tcp_len: tcp length
+ * @pkt_len: packet length
+ *
+ * Return: the checksum of the packet
+ */
+u16 tcp_set_pseudo_header(uchar *pkt, struct in_addr src, struct in_addr dest,
+			  int tcp_len, int pkt_len)
+{
+	/*
+	 * Pseudo header
+	 *
+	 * Zero the byte after the last byte so that the header checksum
+	 * will always work.
+	 */
+	pkt[pkt_len] = 0;
+
+	return tcp_pseudo_checksum(pkt, src, dest, tcp_len, tcp_len);
+}
+
 /**
  * net_set_ack_options() - set TCP options in acknowledge packets
  * @b: the packet
@@ -155,23 +292,25 @@ u16 tcp_set_pseudo_header(uchar *pkt, struct in_addr src, struct in_addr dest,
  */
 int net_set_ack_options(union tcp_build_pkt *b)
 {
+	struct tcp_sack_v *lost = &tcp_conn->lost;
+
 	b->sack.hdr.tcp_hlen = SHIFT_TO_TCPHDRLEN_FIELD(LEN_B_TO_DW(TCP_HDR_SIZE));
 
 	b->sack.t_opt.kind = TCP_O_TS;
 	b->sack.t_opt.len = TCP_OPT_LEN_A;
-	b->sack.t_opt.t_snd = htons(loc_timestamp);
-	b->sack.t_opt.t_rcv = rmt_timestamp;
+	b->sack.t_opt.t_snd = htons(tcp_conn->loc_timestamp);
+	b->sack.t_opt.t_rcv = tcp_conn->rmt_timestamp;
 	b->sack.sack_v.kind = TCP_1_NOP;
 	b->sack.sack_v.len = 0;
 
 	if (IS_ENABLED(CONFIG_PROT_TCP_SACK)) {
-		if (tcp_lost.len > TCP_OPT_LEN_2) {
+		if (lost->len > TCP_OPT_LEN_2) {
 			debug_cond(DEBUG_DEV_PKT, "TCP ack opt lost.len %x\n",
-				   tcp_lost.len);
-			b->sack.sack_v.len = tcp_lost.len;
+				   lost->len);
+			b->sack.sack_v.len = lost->len;
 			b->sack.sack_v.kind = TCP_V_SACK;
-			b->sack.sack_v.hill[0].l = htonl(tcp_lost.hill[0].l);
-			b->sack.sack_v.hill[0].r = htonl(tcp_lost.hill[0].r);
+			b->sack.sack_v.hill[0].l = htonl(lost->hill[0].l);
+			b->sack.sack_v.hill[0].r = htonl(lost->hill[0].r);
 
 			/*
 			 * These SACK structures are initialized with NOPs to
@@ -179,17 +318,17 @@ int net_set_ack_options(union tcp_build_pkt *b)
 			 * SACK structures used for both header padding and
 			 * internally.
 			 */
-			b->sack.sack_v.hill[1].l = htonl(tcp_lost.hill[1].l);
-			b->sack.sack_v.hill[1].r = htonl(tcp_lost.hill[1].r);
-			b->sack.sack_v.hill[2].l = htonl(tcp_lost.hill[2].l);
-			b->sack.sack_v.hill[2].r = htonl(tcp_lost.hill[2].r);
+			b->sack.sack_v.hill[1].l = htonl(lost->hill[1].l);
+			b->sack.sack_v.hill[1].r = htonl(lost->hill[1].r);
+			b->sack.sack_v.hill[2].l = htonl(lost->hill[2].l);
+			b->sack.sack_v.hill[2].r = htonl(lost->hill[2].r);
 			b->sack.sack_v.hill[3].l = TCP_O_NOP;
 			b->sack.sack_v.hill[3].r = TCP_O_NOP;
 		}
 
 		b->sack.hdr.tcp_hlen = SHIFT_TO_TCPHDRLEN_FIELD(ROUND_TCPHDR_LEN(TCP_HDR_SIZE +
 										 TCP_TSOPT_SIZE +
-										 tcp_lost.len));
+										 lost->len));
 	} else {
 		b->sack.sack_v.kind = 0;
 		b->sack.hdr.tcp_hlen = SHIFT_TO_TCPHDRLEN_FIELD(ROUND_TCPHDR_LEN(TCP_HDR_SIZE +
@@ -210,17 +349,25 @@ int net_set_ack_options(union tcp_build_pkt *b)
  */
 void net_set_syn_options(union tcp_build_pkt *b)
 {
+	u8 scale;
+
 	if (IS_ENABLED(CONFIG_PROT_TCP_SACK))
-		tcp_lost.len = 0;
+		tcp_conn->lost.len = 0;
 
 	b->ip.hdr.tcp_hlen = 0xa0;
 
 	b->ip.mss.kind = TCP_O_MSS;
 	b->ip.mss.len = TCP_OPT_LEN_4;
-	b->ip.mss.mss = htons(TCP_MSS);
+	b->ip.mss.mss = htons(TCP_MSS - tcp_ip_extra());
 	b->ip.scale.kind = TCP_O_SCL;
-	b->ip.scale.scale = TCP_SCALE;
+	for (scale = 0; scale < TCP_SCALE_MAX &&
+	     tcp_rx_window >> scale > U16_MAX; scale++)
+		;
+	tcp_conn->rx_scale = scale;
+	b->ip.scale.scale = scale;
 	b->ip.scale.len = TCP_OPT_LEN_3;
+	tcp_conn->rmt_scale = false;
+	tcp_conn->nr_hills = 0;
 	if (IS_ENABLED(CONFIG_PROT_TCP_SACK)) {
 		b->ip.sack_p.kind = TCP_P_SACK;
 		b->ip.sack_p.len = TCP_OPT_LEN_2;
@@ -230,8 +377,8 @@ void net_set_syn_options(union tcp_build_pkt *b)
 	}
 	b->ip.t_opt.kind = TCP_O_TS;
 	b->ip.t_opt.len = TCP_OPT_LEN_A;
-	loc_timestamp = get_ticks();
-	rmt_timestamp = 0;
+	tcp_conn->loc_timestamp = get_ticks();
+	tcp_conn->rmt_timestamp = 0;
 	b->ip.t_opt.t_snd = 0;
 	b->ip.t_opt.t_rcv = 0;
 	b->ip.end = TCP_O_END;
@@ -244,6 +391,12 @@ int tcp_set_tcp_header(uchar *pkt, int dport, int sport, int payload_len,
 	int pkt_hdr_len;
 	int pkt_len;
 	int tcp_len;
+	u32 win;
+	int ret;
+
+	ret = tcp_select_conn(sport);
+	if (ret)
+		return ret;
 
 	/*
 	 * Header: 5 32 bit words. 4 bits TCP header Length,
@@ -264,11 +417,11 @@ int tcp_set_tcp_header(uchar *pkt, int dport, int sport, int payload_len,
 		tcp_seq_num = 0;
 		tcp_ack_num = 0;
 		pkt_hdr_len = IP_TCP_O_SIZE;
-		if (current_tcp_state == TCP_SYN_SENT) {  /* Too many SYNs */
+		if (tcp_conn->state == TCP_SYN_SENT) {  /* Too many SYNs */
 			action = TCP_FIN;
-			current_tcp_state = TCP_FIN_WAIT_1;
+			tcp_conn->state = TCP_FIN_WAIT_1;
 		} else {
-			current_tcp_state = TCP_SYN_SENT;
+			tcp_conn->state = TCP_SYN_SENT;
 		}
 		break;
 	case TCP_SYN | TCP_ACK:
@@ -286,20 +439,20 @@ int tcp_set_tcp_header(uchar *pkt, int dport, int sport, int payload_len,
 			   &net_server_ip, &net_ip, tcp_seq_num, tcp_ack_num);
 		payload_len = 0;
 		pkt_hdr_len = IP_TCP_HDR_SIZE;
-		current_tcp_state = TCP_FIN_WAIT_1;
+		tcp_conn->state = TCP_FIN_WAIT_1;
 		break;
 	case TCP_RST | TCP_ACK:
 	case TCP_RST:
 		debug_cond(DEBUG_DEV_PKT,
 			   "TCP Hdr:RST  (%pI4, %pI4, s=%u, a=%u)\n",
 			   &net_server_ip, &net_ip, tcp_seq_num, tcp_ack_num);
-		current_tcp_state = TCP_CLOSED;
+		tcp_conn->state = TCP_CLOSED;
 		break;
 	/* Notify connection closing */
 	case (TCP_FIN | TCP_ACK):
 	case (TCP_FIN | TCP_ACK | TCP_PUSH):
-		if (current_tcp_state == TCP_CLOSE_WAIT)
-			current_tcp_state = TCP_CLOSING;
+		if (tcp_conn->state == TCP_CLOSE_WAIT)
+			tcp_conn->state = TCP_CLOSING;
 
 		debug_cond(DEBUG_DEV_PKT,
 			   "TCP Hdr:FIN ACK PSH(%pI4, %pI4, s=%u, a=%u, A=%x)\n",
@@ -318,9 +471,9 @@ int tcp_set_tcp_header(uchar *pkt, int dport, int sport, int payload_len,
 	pkt_len	= pkt_hdr_len + payload_len;
 	tcp_len	= pkt_len - IP_HDR_SIZE;
 
-	tcp_ack_edge = tcp_ack_num;
+	tcp_conn->ack_edge = tcp_ack_num;
 	/* TCP Header */
-	b->ip.hdr.tcp_ack = htonl(tcp_ack_edge);
+	b->ip.hdr.tcp_ack = htonl(tcp_conn->ack_edge);
 	b->ip.hdr.tcp_src = htons(sport);
 	b->ip.hdr.tcp_dst = htons(dport);
 	b->ip.hdr.tcp_seq = htonl(tcp_seq_num);
@@ -333,20 +486,35 @@ int tcp_set_tcp_header(uchar *pkt, int dport, int sport, int payload_len,
 	 * there will be data loss, recovery may work or the sending TCP,
 	 * the server, could abort the stream transmission.
 	 * MSS is governed by maximum Ethernet frame length.
-	 * The number of buffers is governed by the desire to have a queue of
-	 * full buffers to be processed at the destination to maximize
-	 * throughput. Temporary memory use for the boot phase on modern
-	 * SOCs is may not be considered a constraint to buffer space, if
-	 * it is, then the u-boot tftp or nfs kernel netboot should be
-	 * considered.
+	 * By default the window is what fits in the receive buffers. A
+	 * handler which writes data straight to where it belongs, such as
+	 * wget, offers the memory it loads into instead. The window in a SYN
+	 * is never scaled.
 	 */
-	b->ip.hdr.tcp_win = htons(PKTBUFSRX * TCP_MSS >> TCP_SCALE);
+	win = tcp_rx_window;
+	if (!(action & TCP_SYN) && tcp_conn->rmt_scale)
+		win >>= tcp_conn->rx_scale;
+	b->ip.hdr.tcp_win = htons(min_t(u32, win, U16_MAX));
 
 	b->ip.hdr.tcp_xsum = 0;
 	b->ip.hdr.tcp_ugr = 0;
 
-	b->ip.hdr.tcp_xsum = tcp_set_pseudo_header(pkt, net_ip, net_server_ip,
-						   tcp_len, pkt_len);
+	/* The IPv6 header goes over the IPv4 one, see net_send_tcp_packet6() */
+	if (IS_ENABLED(CONFIG_IPV6) && use_ip6) {
+		if (!eth_tx_csum())
+			b->ip.hdr.tcp_xsum =
+				csum_ipv6_magic(&net_ip6, &net_server_ip6,
+						tcp_len, IPPROTO_TCP,
+						csum_partial(pkt + IP_HDR_SIZE,
+							     tcp_len, 0));
+		return pkt_hdr_len;
+	}
+
+	/* The device may fill the checksum in */
+	if (!eth_tx_csum())
+		b->ip.hdr.tcp_xsum = tcp_set_pseudo_header(pkt, net_ip,
+							   net_server_ip,
+							   tcp_len, pkt_len);
 
 	net_set_ip_header((uchar *)&b->ip, net_server_ip, net_ip,
 			  pkt_len, IPPROTO_TCP);
@@ -354,112 +522,87 @@ int tcp_set_tcp_header(uchar *pkt, int dport, int sport, int payload_len,
 	return pkt_hdr_len;
 }
 
+/**
+ * tcp_sack_fill() - set the SACK option from the hills received
+ * @last: index of the hill holding the last segment received, or -1
+ *
+ * The hill with the last segment goes first, as RFC 2018 asks, followed by
+ * those nearest the acknowledged edge, whose holes the peer fills next.
+ */
+static void tcp_sack_fill(int last)
+{
+	int i, n = 0;
+
+	if (!IS_ENABLED(CONFIG_PROT_TCP_SACK))
+		return;
+
+	if (last >= 0)
+		tcp_conn->lost.hill[n++] = tcp_conn->hills[last];
+	for (i = 0; i < tcp_conn->nr_hills && n < TCP_SACK_HILLS - 1; i++) {
+		if (i != last)
+			tcp_conn->lost.hill[n++] = tcp_conn->hills[i];
+	}
+	tcp_conn->lost.len = TCP_OPT_LEN_2 + n * TCP_OPT_LEN_8;
+}
+
 /**
  * tcp_hole() - Selective Acknowledgment (Essential for fast stream transfer)
  * @tcp_seq_num: TCP sequence start number
  * @len: the length of sequence numbers
+ *
+ * A segment reaching the acknowledged edge moves it on, over any hills it
+ * now joins up with. Segments beyond a hole are kept as hills, merged with
+ * their neighbours, if the handler keeps data received out of order. Once
+ * TCP_SACK hills are kept, segments making new ones are dropped and sent
+ * again by the peer.
  */
 void tcp_hole(u32 tcp_seq_num, u32 len)
 {
-	u32 idx_sack, sack_in;
-	u32 sack_end = TCP_SACK - 1;
-	u32 hill = 0;
-	enum pkt_state expect = PKT;
-	u32 seq = tcp_seq_num - tcp_seq_init;
-	u32 hol_l = tcp_ack_edge - tcp_seq_init;
-	u32 hol_r = 0;
-
-	/* Place new seq number in correct place in receive array */
-	if (prev_len == 0)
-		prev_len = len;
-
-	idx_sack = sack_idx + ((tcp_seq_num - tcp_ack_edge) / prev_len);
-	if (idx_sack < TCP_SACK) {
-		edge_a[idx_sack].se.l = tcp_seq_num;
-		edge_a[idx_sack].se.r = tcp_seq_num + len;
-		edge_a[idx_sack].st = PKT;
-
-		/*
-		 * The fin (last) packet is not the same length as data
-		 * packets, and if it's length is recorded and used for
-		 *  array index calculation, calculation breaks.
-		 */
-		if (prev_len < len)
-			prev_len = len;
-	}
-
-	debug_cond(DEBUG_DEV_PKT,
-		   "TCP 1 seq %d, edg %d, len %d, sack_idx %d, sack_end %d\n",
-		    seq, hol_l, len, sack_idx, sack_end);
-
-	/* Right edge of contiguous stream, is the left edge of first hill */
-	hol_l = tcp_seq_num - tcp_seq_init;
-	hol_r = hol_l + len;
-
-	if (IS_ENABLED(CONFIG_PROT_TCP_SACK))
-		tcp_lost.len = TCP_OPT_LEN_2;
+	struct tcp_conn *conn = tcp_conn;
+	u32 l = tcp_seq_num;
+	u32 r = tcp_seq_num + len;
+	int i, j, last = -1;
+
+	debug_cond(DEBUG_DEV_PKT, "TCP hole seq %u, len %u, edge %u, hills %d\n",
+		   tcp_seq_num - conn->seq_init, len,
+		   conn->ack_edge - conn->seq_init, conn->nr_hills);
+
+	if (!tcp_seq_before(conn->ack_edge, r)) {
+		/* Nothing new */
+	} else if (!tcp_seq_before(conn->ack_edge, l)) {
+		conn->ack_edge = r;
+		for (i = 0; i < conn->nr_hills &&
+		     !tcp_seq_before(conn->ack_edge, conn->hills[i].l); i++) {
+			if (tcp_seq_before(conn->ack_edge, conn->hills[i].r))
+				conn->ack_edge = conn->hills[i].r;
+		}
+		conn->nr_hills -= i;
+		memmove(conn->hills, conn->hills + i,
+			conn->nr_hills * sizeof(*conn->hills));
+	} else if (conn->rx_ooo) {
+		/* Hills from i up to j touch the segment and become one */
+		for (i = 0; i < conn->nr_hills &&
+		     tcp_seq_before(conn->hills[i].r, l); i++)
+			;
+		for (j = i; j < conn->nr_hills &&
+		     !tcp_seq_before(r, conn->hills[j].l); j++) {
+			if (tcp_seq_before(conn->hills[j].l, l))
+				l = conn->hills[j].l;
+			if (tcp_seq_before(r, conn->hills[j].r))
+				r = conn->hills[j].r;
+		}
 
-	debug_cond(DEBUG_DEV_PKT,
-		   "TCP 1 in %d, seq %d, pkt_l %d, pkt_r %d, sack_idx %d, sack_end %d\n",
-		   idx_sack, seq, hol_l, hol_r, sack_idx, sack_end);
-
-	for (sack_in = sack_idx; sack_in < sack_end && hill < TCP_SACK_HILLS;
-	     sack_in++)  {
-		switch (expect) {
-		case NOPKT:
-			switch (edge_a[sack_in].st) {
-			case NOPKT:
-				debug_cond(DEBUG_INT_STATE, "N");
-				break;
-			case PKT:
-				debug_cond(DEBUG_INT_STATE, "n");
-				if (IS_ENABLED(CONFIG_PROT_TCP_SACK)) {
-					tcp_lost.hill[hill].l =
-						edge_a[sack_in].se.l;
-					tcp_lost.hill[hill].r =
-						edge_a[sack_in].se.r;
-				}
-				expect = PKT;
-				break;
-			}
-			break;
-		case PKT:
-			switch (edge_a[sack_in].st) {
-			case NOPKT:
-				debug_cond(DEBUG_INT_STATE, "p");
-				if (sack_in > sack_idx &&
-				    hill < TCP_SACK_HILLS) {
-					hill++;
-					if (IS_ENABLED(CONFIG_PROT_TCP_SACK))
-						tcp_lost.len += TCP_OPT_LEN_8;
-				}
-				expect = NOPKT;
-				break;
-			case PKT:
-				debug_cond(DEBUG_INT_STATE, "P");
-
-				if (tcp_ack_edge == edge_a[sack_in].se.l) {
-					tcp_ack_edge = edge_a[sack_in].se.r;
-					edge_a[sack_in].st = NOPKT;
-					sack_idx++;
-				} else {
-					if (IS_ENABLED(CONFIG_PROT_TCP_SACK) &&
-					    hill < TCP_SACK_HILLS)
-						tcp_lost.hill[hill].r =
-							edge_a[sack_in].se.r;
-				if (IS_ENABLED(CONFIG_PROT_TCP_SACK) &&
-				    sack_in == sack_end - 1)
-					tcp_lost.hill[hill].r =
-						edge_a[sack_in].se.r;
-				}
-				break;
-			}
-			break;
+		if (i < j || conn->nr_hills < TCP_SACK) {
+			memmove(conn->hills + i + 1, conn->hills + j,
+				(conn->nr_hills - j) * sizeof(*conn->hills));
+			conn->nr_hills += i + 1 - j;
+			conn->hills[i].l = l;
+			conn->hills[i].r = r;
+			last = i;
 		}
 	}
-	debug_cond(DEBUG_INT_STATE, "\n");
-	if (!IS_ENABLED(CONFIG_PROT_TCP_SACK) || tcp_lost.len <= TCP_OPT_LEN_2)
-		sack_idx = 0;
+
+	tcp_sack_fill(last);
 }
 
 /**
@@ -470,33 +613,34 @@ void tcp_hole(u32 tcp_seq_num, u32 len)
 void tcp_parse_options(uchar *o, int o_len)
 {
 	struct tcp_t_opt  *tsopt;
+	uchar *end = o + o_len;
 	uchar *p = o;
 
 	/*
 	 * NOPs are options with a zero length, and thus are special.
 	 * All other options have length fields.
 	 */
-	for (p = o; p < (o + o_len); p = p + p[1]) {
-		if (!p[1])
-			return; /* Finished processing options */
+	while (p < end) {
+		if (p[0] == TCP_O_END)
+			return;
+		if (p[0] == TCP_1_NOP) {
+			p++;
+			continue;
+		}
+		if (p + 1 >= end || p[1] < TCP_OPT_LEN_2)
+			return; /* Malformed option */
 
 		switch (p[0]) {
-		case TCP_O_END:
-			return;
-		case TCP_O_MSS:
 		case TCP_O_SCL:
-		case TCP_P_SACK:
-		case TCP_V_SACK:
+			/* Only sent in a SYN, our window may be scaled */
+			tcp_conn->rmt_scale = true;
 			break;
 		case TCP_O_TS:
 			tsopt = (struct tcp_t_opt *)p;
-			rmt_timestamp = tsopt->t_snd;
-			return;
+			tcp_conn->rmt_timestamp = tsopt->t_snd;
+			break;
 		}
-
-		/* Process optional NOPs */
-		if (p[0] == TCP_O_NOP)
-			p++;
+		p += p[1];
 	}
 }
 
@@ -508,7 +652,6 @@ static u8 tcp_state_machine(u8 tcp_flags, u32 tcp_seq_num, int payload_len)
 	u8 tcp_push = tcp_flags & TCP_PUSH;
 	u8 tcp_ack = tcp_flags & TCP_ACK;
 	u8 action = TCP_DATA;
-	int i;
 
 	/*
 	 * tcp_flags are examined to determine TX action in a given state
@@ -522,20 +665,20 @@ static u8 tcp_state_machine(u8 tcp_flags, u32 tcp_seq_num, int payload_len)
 	debug_cond(DEBUG_INT_STATE, "TCP STATE ENTRY %x\n", action);
 	if (tcp_rst) {
 		action = TCP_DATA;
-		current_tcp_state = TCP_CLOSED;
+		tcp_conn->state = TCP_CLOSED;
 		net_set_state(NETLOOP_FAIL);
 		debug_cond(DEBUG_INT_STATE, "TCP Reset %x\n", tcp_flags);
 		return TCP_RST;
 	}
 
-	switch  (current_tcp_state) {
+	switch  (tcp_conn->state) {
 	case TCP_CLOSED:
 		debug_cond(DEBUG_INT_STATE, "TCP CLOSED %x\n", tcp_flags);
 		if (tcp_syn) {
 			action = TCP_SYN | TCP_ACK;
-			tcp_seq_init = tcp_seq_num;
-			tcp_ack_edge = tcp_seq_num + 1;
-			current_tcp_state = TCP_SYN_RECEIVED;
+			tcp_conn->seq_init = tcp_seq_num;
+			tcp_conn->ack_edge = tcp_seq_num + 1;
+			tcp_conn->state = TCP_SYN_RECEIVED;
 		} else if (tcp_ack || tcp_fin) {
 			action = TCP_DATA;
 		}
@@ -546,18 +689,13 @@ static u8 tcp_state_machine(u8 tcp_flags, u32 tcp_seq_num, int payload_len)
 			   tcp_flags, tcp_seq_num);
 		if (tcp_fin) {
 			action = action | TCP_PUSH;
-			current_tcp_state = TCP_CLOSE_WAIT;
+			tcp_conn->state = TCP_CLOSE_WAIT;
 		} else if (tcp_ack || (tcp_syn && tcp_ack)) {
 			action |= TCP_ACK;
-			tcp_seq_init = tcp_seq_num;
-			tcp_ack_edge = tcp_seq_num + 1;
-			sack_idx = 0;
-			edge_a[sack_idx].se.l = tcp_ack_edge;
-			edge_a[sack_idx].se.r = tcp_ack_edge;
-			prev_len = 0;
-			current_tcp_state = TCP_ESTABLISHED;
-			for (i = 0; i < TCP_SACK; i++)
-				edge_a[i].st = NOPKT;
+			tcp_conn->seq_init = tcp_seq_num;
+			tcp_conn->ack_edge = tcp_seq_num + 1;
+			tcp_conn->nr_hills = 0;
+			tcp_conn->state = TCP_ESTABLISHED;
 
 			if (tcp_syn && tcp_ack)
 				action |= TCP_PUSH;
@@ -572,11 +710,11 @@ static u8 tcp_state_machine(u8 tcp_flags, u32 tcp_seq_num, int payload_len)
 			tcp_fin = TCP_DATA;  /* cause standalone FIN */
 		}
 
-		if ((tcp_fin) &&
-		    (!IS_ENABLED(CONFIG_PROT_TCP_SACK) ||
-		     tcp_lost.len <= TCP_OPT_LEN_2)) {
+		/* A FIN is only taken once everything before it arrived */
+		if (tcp_fin && !tcp_conn->nr_hills &&
+		    !tcp_seq_before(tcp_conn->ack_edge, tcp_seq_num)) {
 			action = action | TCP_FIN | TCP_PUSH | TCP_ACK;
-			current_tcp_state = TCP_CLOSE_WAIT;
+			tcp_conn->state = TCP_CLOSE_WAIT;
 		} else if (tcp_ack) {
 			action = TCP_DATA;
 		}
@@ -594,7 +732,7 @@ static u8 tcp_state_machine(u8 tcp_flags, u32 tcp_seq_num, int payload_len)
 		debug_cond(DEBUG_INT_STATE, "TCP_FIN_WAIT_2 (%x)\n", tcp_flags);
 		if (tcp_ack) {
 			action = TCP_PUSH | TCP_ACK;
-			current_tcp_state = TCP_CLOSED;
+			tcp_conn->state = TCP_CLOSED;
 			puts("\n");
 		} else if (tcp_syn) {
 			action = TCP_DATA;
@@ -605,20 +743,20 @@ static u8 tcp_state_machine(u8 tcp_flags, u32 tcp_seq_num, int payload_len)
 	case TCP_FIN_WAIT_1:
 		debug_cond(DEBUG_INT_STATE, "TCP_FIN_WAIT_1 (%x)\n", tcp_flags);
 		if (tcp_fin) {
-			tcp_ack_edge++;
+			tcp_conn->ack_edge++;
 			action = TCP_ACK | TCP_FIN;
-			current_tcp_state = TCP_FIN_WAIT_2;
+			tcp_conn->state = TCP_FIN_WAIT_2;
 		}
 		if (tcp_syn)
 			action = TCP_RST;
 		if (tcp_ack)
-			current_tcp_state = TCP_CLOSED;
+			tcp_conn->state = TCP_CLOSED;
 		break;
 	case TCP_CLOSING:
 		debug_cond(DEBUG_INT_STATE, "TCP_CLOSING (%x)\n", tcp_flags);
 		if (tcp_ack) {
 			action = TCP_PUSH;
-			current_tcp_state = TCP_CLOSED;
+			tcp_conn->state = TCP_CLOSED;
 			puts("\n");
 		} else if (tcp_syn) {
 			action = TCP_RST;
@@ -631,47 +769,21 @@ static u8 tcp_state_machine(u8 tcp_flags, u32 tcp_seq_num, int payload_len)
 }
 
 /**
- * rxhand_tcp_f() - process receiving data and call data handler.
- * @b: the packet
- * @pkt_len: the length of packet.
+ * tcp_rx() - process a segment whose checksums are good
+ * @b: the packet, the TCP header following an IPv4 header
+ * @tcp_hdr_len: length of the TCP header
+ * @payload: the data of the segment
+ * @payload_len: length of @payload
  */
-void rxhand_tcp_f(union tcp_build_pkt *b, unsigned int pkt_len)
+static void tcp_rx(union tcp_build_pkt *b, int tcp_hdr_len, uchar *payload,
+		   int payload_len)
 {
-	int tcp_len = pkt_len - IP_HDR_SIZE;
-	u16 tcp_rx_xsum = b->ip.hdr.ip_sum;
 	u8  tcp_action = TCP_DATA;
 	u32 tcp_seq_num, tcp_ack_num;
-	int tcp_hdr_len, payload_len;
-
-	/* Verify IP header */
-	debug_cond(DEBUG_DEV_PKT,
-		   "TCP RX in RX Sum (to=%pI4, from=%pI4, len=%d)\n",
-		   &b->ip.hdr.ip_src, &b->ip.hdr.ip_dst, pkt_len);
-
-	b->ip.hdr.ip_src = net_server_ip;
-	b->ip.hdr.ip_dst = net_ip;
-	b->ip.hdr.ip_sum = 0;
-	if (tcp_rx_xsum != compute_ip_checksum(b, IP_HDR_SIZE)) {
-		debug_cond(DEBUG_DEV_PKT,
-			   "TCP RX IP xSum Error (%pI4, =%pI4, len=%d)\n",
-			   &net_ip, &net_server_ip, pkt_len);
-		return;
-	}
 
-	/* Build pseudo header and verify TCP header */
-	tcp_rx_xsum = b->ip.hdr.tcp_xsum;
-	b->ip.hdr.tcp_xsum = 0;
-	if (tcp_rx_xsum != tcp_set_pseudo_header((uchar *)b, b->ip.hdr.ip_src,
-						 b->ip.hdr.ip_dst, tcp_len,
-						 pkt_len)) {
-		debug_cond(DEBUG_DEV_PKT,
-			   "TCP RX TCP xSum Error (%pI4, %pI4, len=%d)\n",
-			   &net_ip, &net_server_ip, tcp_len);
+	/* Too many connections, let the peer try again later */
+	if (tcp_select_conn(ntohs(b->ip.hdr.tcp_dst)))
 		return;
-	}
-
-	tcp_hdr_len = GET_TCP_HDR_LEN_IN_BYTES(b->ip.hdr.tcp_hlen);
-	payload_len = tcp_len - tcp_hdr_len;
 
 	if (tcp_hdr_len > TCP_HDR_SIZE)
 		tcp_parse_options((uchar *)b + IP_TCP_HDR_SIZE,
@@ -683,6 +795,11 @@ void rxhand_tcp_f(union tcp_build_pkt *b, unsigned int pkt_len)
 	tcp_seq_num = ntohl(b->ip.hdr.tcp_seq);
 	tcp_ack_num = ntohl(b->ip.hdr.tcp_ack);
 
+	/* Data the app cannot take yet is sent again by the peer */
+	if (payload_len > 0 && tcp_packet_check &&
+	    !tcp_packet_check(payload, tcp_seq_num, payload_len))
+		payload_len = 0;
+
 	/* Packets are not ordered. Send to app as received. */
 	tcp_action = tcp_state_machine(b->ip.hdr.tcp_flags,
 				       tcp_seq_num, payload_len);
@@ -698,14 +815,14 @@ void rxhand_tcp_f(union tcp_build_pkt *b, unsigned int pkt_len)
 			   "TCP Notify (action=%x, Seq=%u,Ack=%u,Pay%d)\n",
 			   tcp_action, tcp_seq_num, tcp_ack_num, payload_len);
 
-		(*tcp_packet_handler) ((uchar *)b + pkt_len - payload_len, b->ip.hdr.tcp_dst,
+		(*tcp_packet_handler) (payload, b->ip.hdr.tcp_dst,
 				       b->ip.hdr.ip_src, b->ip.hdr.tcp_src, tcp_seq_num,
 				       tcp_ack_num, tcp_action, payload_len);
 
 	} else if (tcp_action != TCP_DATA) {
 		debug_cond(DEBUG_DEV_PKT,
 			   "TCP Action (action=%x,Seq=%u,Ack=%u,Pay=%d)\n",
-			   tcp_action, tcp_ack_num, tcp_ack_edge, payload_len);
+			   tcp_action, tcp_ack_num, tcp_conn->ack_edge, payload_len);
 
 		/*
 		 * Warning: Incoming Ack & Seq sequence numbers are transposed
@@ -714,6 +831,132 @@ void rxhand_tcp_f(union tcp_build_pkt *b, unsigned int pkt_len)
 		net_send_tcp_packet(0, ntohs(b->ip.hdr.tcp_src),
 				    ntohs(b->ip.hdr.tcp_dst),
 				    (tcp_action & (~TCP_PUSH)),
-				    tcp_ack_num, tcp_ack_edge);
+				    tcp_ack_num, tcp_conn->ack_edge);
 	}
 }
+
+/**
+ * rxhand_tcp_f() - process receiving data and call data handler.
+ * @b: the packet
+ * @pkt_len: the length of packet.
+ */
+void rxhand_tcp_f(union tcp_build_pkt *b, unsigned int pkt_len)
+{
+	int tcp_len = pkt_len - IP_HDR_SIZE;
+	u16 tcp_rx_xsum = b->ip.hdr.ip_sum;
+	int tcp_hdr_len, payload_len;
+	uchar *payload;
+	u16 xsum;
+
+	/* Verify IP header */
+	debug_cond(DEBUG_DEV_PKT,
+		   "TCP RX in RX Sum (to=%pI4, from=%pI4, len=%d)\n",
+		   &b->ip.hdr.ip_src, &b->ip.hdr.ip_dst, pkt_len);
+
+	b->ip.hdr.ip_src = net_server_ip;
+	b->ip.hdr.ip_dst = net_ip;
+	b->ip.hdr.ip_sum = 0;
+	if (tcp_rx_xsum != compute_ip_checksum(b, IP_HDR_SIZE)) {
+		debug_cond(DEBUG_DEV_PKT,
+			   "TCP RX IP xSum Error (%pI4, =%pI4, len=%d)\n",
+			   &net_ip, &net_server_ip, pkt_len);
+		return;
+	}
+
+	tcp_hdr_len = GET_TCP_HDR_LEN_IN_BYTES(b->ip.hdr.tcp_hlen);
+	payload_len = tcp_len - tcp_hdr_len;
+	payload = (uchar *)b + pkt_len - payload_len;
+
+	if (net_rx_payload) {
+		/* The driver put the payload apart, see eth_rx_lend() */
+		if (payload_len != net_rx_payload_len)
+			return;
+		payload = net_rx_payload;
+	}
+
+	/* Build pseudo header and verify TCP header, unless the device did */
+	tcp_rx_xsum = b->ip.hdr.tcp_xsum;
+	b->ip.hdr.tcp_xsum = 0;
+	if (net_rx_csum_ok) {
+		xsum = tcp_rx_xsum;
+	} else if (net_rx_payload) {
+		xsum = tcp_pseudo_checksum((uchar *)b, b->ip.hdr.ip_src,
+					   b->ip.hdr.ip_dst, tcp_len,
+					   tcp_hdr_len);
+		xsum = add_ip_checksums(tcp_hdr_len, xsum,
+					compute_ip_checksum(payload,
+							    payload_len));
+	} else {
+		xsum = tcp_set_pseudo_header((uchar *)b, b->ip.hdr.ip_src,
+					     b->ip.hdr.ip_dst, tcp_len,
+					     pkt_len);
+	}
+	if (tcp_rx_xsum != xsum) {
+		debug_cond(DEBUG_DEV_PKT,
+			   "TCP RX TCP xSum Error (%pI4, %pI4, len=%d)\n",
+			   &net_ip, &net_server_ip, tcp_len);
+		return;
+	}
+
+	tcp_rx(b, tcp_hdr_len, payload, payload_len);
+}
+
+#if IS_ENABLED(CONFIG_IPV6)
+/**
+ * rxhand_tcp6_f() - process data received over IPv6 and call data handler.
+ * @ip6: the packet
+ * @pkt_len: its length, from the IPv6 header on
+ *
+ * Once the checksum is checked, the end of the IPv6 header is made into the
+ * IPv4 header the TCP header is handled after.
+ */
+void rxhand_tcp6_f(struct ip6_hdr *ip6, unsigned int pkt_len)
+{
+	union tcp_build_pkt *b = (void *)ip6 + IP6_HDR_SIZE - IP_HDR_SIZE;
+	uchar *tcp = (uchar *)ip6 + IP6_HDR_SIZE;
+	int tcp_len = pkt_len - IP6_HDR_SIZE;
+	int tcp_hdr_len, payload_len;
+	uchar *payload;
+	uint xsum;
+
+	if (!use_ip6 ||
+	    memcmp(&ip6->saddr, &net_server_ip6, sizeof(struct in6_addr)))
+		return;
+
+	tcp_hdr_len = GET_TCP_HDR_LEN_IN_BYTES(b->ip.hdr.tcp_hlen);
+	if (tcp_hdr_len < TCP_HDR_SIZE || tcp_hdr_len > tcp_len)
+		return;
+	payload_len = tcp_len - tcp_hdr_len;
+	payload = tcp + tcp_hdr_len;
+
+	if (net_rx_payload) {
+		/* The driver put the payload apart, see eth_rx_lend() */
+		if (payload_len != net_rx_payload_len)
+			return;
+		payload = net_rx_payload;
+	}
+
+	/*
+	 * With its checksum summed too, a good segment sums to 0xffff. This
+	 * relies on csum_ipv6_magic() returning such a sum as it is, rather
+	 * than as its complement 0 which it returns for other sums; see
+	 * csum_fold() in net6.c. Unlike recomputing the checksum with the
+	 * field cleared, as UDP does, this takes both forms of a zero checksum.
+	 */
+	if (!net_rx_csum_ok) {
+		xsum = csum_partial(payload, payload_len,
+				    csum_partial(tcp, tcp_hdr_len, 0));
+		if (csum_ipv6_magic(&ip6->saddr, &ip6->daddr, tcp_len,
+				    IPPROTO_TCP, xsum) != 0xffff) {
+			debug_cond(DEBUG_DEV_PKT,
+				   "TCP RX TCP xSum Error (%pI6c, len=%d)\n",
+				   &ip6->saddr, tcp_len);
+			return;
+		}
+	}
+
+	b->ip.hdr.ip_src = net_server_ip;
+	b->ip.hdr.ip_dst = net_ip;
+	tcp_rx(b, tcp_hdr_len, payload, payload_len);
+}
+#endif
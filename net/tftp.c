@@ -13,10 +13,13 @@
 #include <image.h>
 #include <lmb.h>
 #include <log.h>
+#include <malloc.h>
 #include <mapmem.h>
 #include <net.h>
 #include <net6.h>
 #include <asm/global_data.h>
+#include <linux/bitops.h>
+#include <net/sink.h>
 #include <net/tftp.h>
 #include "bootp.h"
 
@@ -98,6 +101,18 @@ static ushort	tftp_windowsize;
 static ushort	tftp_next_ack;
 /* Last nack block we send */
 static ushort	tftp_last_nack;
+/* Adapt the window size to the losses seen, rather than use a fixed one */
+static bool	tftp_adapt;
+/* Time we sent the last ACK at the end of a window, to time the round trip */
+static ulong	tftp_ack_time;
+/* An ACK is out whose round trip has not been timed yet */
+static bool	tftp_rtt_pending;
+/* Smoothed round trip time in ms */
+static ulong	tftp_srtt;
+/* Time to wait for the rest of a window before asking again, in ms */
+static ulong	tftp_rto;
+/* Number of times we asked for blocks again */
+static ulong	tftp_retransmits;
 #ifdef CONFIG_CMD_TFTPPUT
 /* 1 if writing, else 0 */
 static int	tftp_put_active;
@@ -106,6 +121,30 @@ static int	tftp_put_final_block_sent;
 #else
 #define tftp_put_active	0
 #endif
+/* The file goes to storage, see net_sink_start() */
+static bool	tftp_sink;
+/* Ask for the multicast option */
+static bool	tftp_mcast_request;
+/* The server sends the file to a multicast group, see RFC 2090 */
+static bool	tftp_mcast_active;
+/* We are the client whose ACKs the server goes by */
+static bool	tftp_mcast_master;
+/* The UDP port of the group */
+static int	tftp_mcast_port;
+/* The blocks received, a bit each */
+static unsigned long *tftp_mcast_bitmap;
+/* The number of blocks in the file */
+static ulong	tftp_mcast_blocks;
+/* The first block not received yet */
+static ulong	tftp_mcast_hole;
+/* The first block we missed when we last asked for it */
+static ulong	tftp_mcast_nack;
+/* The highest block received, to tell which wrap a block number is in */
+static ulong	tftp_mcast_high;
+/* The number of blocks received */
+static ulong	tftp_mcast_count;
+/* Block numbers can be told apart, so the blocks overheard can be kept */
+static bool	tftp_mcast_synced;
 
 #define STATE_SEND_RRQ	1
 #define STATE_DATA	2
@@ -149,9 +188,19 @@ static char tftp_filename[MAX_LEN];
 #define TFTP_WINDOWSIZE 1
 #endif
 
+#ifdef CONFIG_TFTP_WINDOWSIZE_ADAPTIVE
+#define TFTP_WINDOWSIZE_MAX CONFIG_TFTP_WINDOWSIZE_MAX
+#else
+#define TFTP_WINDOWSIZE_MAX 1
+#endif
+/* Shortest time to wait for the rest of a window, in ms */
+#define TFTP_RTO_MIN	20
+
 static unsigned short tftp_block_size = TFTP_BLOCK_SIZE;
 static unsigned short tftp_block_size_option = CONFIG_TFTP_BLOCKSIZE;
 static unsigned short tftp_window_size_option = TFTP_WINDOWSIZE;
+/* The window size to ask for next, when adapting it */
+static unsigned short tftp_adapt_window = TFTP_WINDOWSIZE_MAX;
 
 static inline int store_block(int block, uchar *src, unsigned int len)
 {
@@ -161,22 +210,29 @@ static inline int store_block(int block, uchar *src, unsigned int len)
 	ulong store_addr = tftp_load_addr + offset;
 	void *ptr;
 
+	if (tftp_sink) {
+		if (net_sink_write(offset, src, len)) {
+			puts("\nTFTP error: cannot write to storage\n");
+			return -1;
+		}
+	} else {
 #ifdef CONFIG_LMB
-	ulong end_addr = tftp_load_addr + tftp_load_size;
+		ulong end_addr = tftp_load_addr + tftp_load_size;
 
-	if (!end_addr)
-		end_addr = ULONG_MAX;
+		if (!end_addr)
+			end_addr = ULONG_MAX;
 
-	if (store_addr < tftp_load_addr ||
-	    store_addr + len > end_addr) {
-		puts("\nTFTP error: ");
-		puts("trying to overwrite reserved memory...\n");
-		return -1;
-	}
+		if (store_addr < tftp_load_addr ||
+		    store_addr + len > end_addr) {
+			puts("\nTFTP error: ");
+			puts("trying to overwrite reserved memory...\n");
+			return -1;
+		}
 #endif
-	ptr = map_sysmem(store_addr, len);
-	memcpy(ptr, src, len);
-	unmap_sysmem(ptr);
+		ptr = map_sysmem(store_addr, len);
+		memcpy(ptr, src, len);
+		unmap_sysmem(ptr);
+	}
 
 	if (net_boot_file_size < newsize)
 		net_boot_file_size = newsize;
@@ -283,6 +339,28 @@ static void update_block_number(void)
 	show_block_marker();
 }
 
+/*
+ * Work out the window size to ask for next time from how the transfer went,
+ * halving it after losses and growing it after a clean transfer
+ */
+static void tftp_adapt_update(bool lost)
+{
+	if (!tftp_adapt)
+		return;
+	if (lost)
+		tftp_adapt_window = max(tftp_windowsize / 2, 1);
+	else
+		tftp_adapt_window = min(tftp_windowsize + 1,
+					TFTP_WINDOWSIZE_MAX);
+}
+
+/* Blocks went missing and we are about to ask for them again */
+static void tftp_lost(void)
+{
+	tftp_retransmits++;
+	tftp_rtt_pending = false;
+}
+
 /* The TFTP get or put is complete */
 static void tftp_complete(void)
 {
@@ -302,8 +380,13 @@ static void tftp_complete(void)
 			time_start * 1000, "/s");
 	}
 	puts("\ndone\n");
+	if (!tftp_put_active) {
+		tftp_adapt_update(tftp_retransmits);
+		debug("%lu retransmits, window %d, next %d\n", tftp_retransmits,
+		      tftp_windowsize, tftp_adapt_window);
+	}
 	if (IS_ENABLED(CONFIG_CMD_BOOTEFI)) {
-		if (!tftp_put_active)
+		if (!tftp_put_active && !tftp_sink)
 			efi_set_bootdev("Net", "", tftp_filename,
 					map_sysmem(tftp_load_addr, 0),
 					net_boot_file_size);
@@ -311,6 +394,172 @@ static void tftp_complete(void)
 	net_set_state(NETLOOP_SUCCESS);
 }
 
+void tftp_mcast_cleanup(void)
+{
+	if (net_mcast_addr.s_addr)
+		eth_mcast_join(net_mcast_addr, 0);
+	net_mcast_addr.s_addr = 0;
+	free(tftp_mcast_bitmap);
+	tftp_mcast_bitmap = NULL;
+	tftp_mcast_active = false;
+}
+
+static bool tftp_mcast_test_block(ulong block)
+{
+	return tftp_mcast_bitmap[BIT_WORD(block)] & BIT_MASK(block);
+}
+
+/*
+ * Handle the value of the multicast option, "addr,port,mc", of which only the
+ * last is given once the transfer is going, when we become the master client.
+ * Return: 0 if OK, -ve on error
+ */
+static int tftp_mcast_option(char *val)
+{
+	struct in_addr addr;
+	char *port, *mc;
+	int ret;
+
+	port = strchr(val, ',');
+	mc = port ? strchr(port + 1, ',') : NULL;
+	if (!mc)
+		return -EINVAL;
+	*port++ = '\0';
+	*mc++ = '\0';
+
+	tftp_mcast_master = dectoul(mc, NULL) == 1;
+	if (tftp_mcast_active)
+		return 0;
+
+	addr = string_to_ip(val);
+	tftp_mcast_port = dectoul(port, NULL);
+	if (!addr.s_addr || !tftp_mcast_port)
+		return -EINVAL;
+
+	ret = eth_mcast_join(addr, 1);
+	if (ret) {
+		printf("Cannot join multicast group %pI4 (err=%d)\n", &addr,
+		       ret);
+		return ret;
+	}
+	net_mcast_addr = addr;
+	tftp_mcast_active = true;
+
+	return 0;
+}
+
+/* Start a multicast transfer once the options are known */
+static int tftp_mcast_start(void)
+{
+	ulong size = 0;
+
+#ifdef CONFIG_TFTP_TSIZE
+	size = tftp_tsize;
+#endif
+	if (!size) {
+		puts("Multicast needs the file size\n");
+		return -EINVAL;
+	}
+
+	tftp_mcast_blocks = size / tftp_block_size + 1;
+	tftp_mcast_bitmap = calloc(BITS_TO_LONGS(tftp_mcast_blocks + 1),
+				   sizeof(long));
+	if (!tftp_mcast_bitmap)
+		return -ENOMEM;
+
+	tftp_mcast_hole = 1;
+	tftp_mcast_nack = 0;
+	tftp_mcast_high = 0;
+	tftp_mcast_count = 0;
+	/*
+	 * Block numbers wrap every 65536 blocks, so in a larger file the block
+	 * a number stands for is only known once we have asked for the first
+	 * block ourselves
+	 */
+	tftp_mcast_synced = tftp_mcast_blocks < TFTP_SEQUENCE_SIZE;
+	if (!tftp_mcast_synced && !tftp_mcast_master)
+		printf("Multicast: %lu blocks wrap the block number, so blocks are only kept once\n"
+		       "this client is master; use a tftpblocksize of at least %lu to keep them all\n",
+		       tftp_mcast_blocks, size / (TFTP_SEQUENCE_SIZE - 1) + 1);
+	/* The window is the master client's, whichever that is */
+	tftp_adapt = false;
+	debug("multicast %pI4:%d, %lu blocks, master %d\n", &net_mcast_addr,
+	      tftp_mcast_port, tftp_mcast_blocks, tftp_mcast_master);
+
+	return 0;
+}
+
+/*
+ * Take a block received in a multicast transfer, which need not be the one
+ * asked for: whoever is the master client, all the clients receive it. The
+ * master client acknowledges the blocks up to the first one missing, so the
+ * server goes on from there.
+ */
+static void tftp_mcast_data(uchar *pkt, unsigned len)
+{
+	ushort num = ntohs(*(__be16 *)pkt);
+	bool dup = false;
+	ulong block;
+
+	timeout_count = 0;
+	timeout_count_max = tftp_timeout_count_max;
+	net_set_timeout_handler(timeout_ms, tftp_timeout_handler);
+
+	if (!tftp_mcast_synced) {
+		/* The first block the master client gets once it asks for it */
+		if (!tftp_mcast_master || tftp_mcast_hole != 1 || num != 1)
+			return;
+		tftp_mcast_synced = true;
+	}
+	if (tftp_mcast_blocks < TFTP_SEQUENCE_SIZE)
+		block = num;
+	else
+		block = tftp_mcast_high + (short)(num - (ushort)tftp_mcast_high);
+	if (!block || block > tftp_mcast_blocks ||
+	    (len < tftp_block_size) != (block == tftp_mcast_blocks))
+		return;
+	tftp_mcast_high = max(tftp_mcast_high, block);
+
+	if (tftp_mcast_test_block(block)) {
+		dup = true;
+	} else {
+		if (store_block(block, pkt + 2, len)) {
+			eth_halt();
+			net_set_state(NETLOOP_FAIL);
+			return;
+		}
+		generic_set_bit(block, tftp_mcast_bitmap);
+		/* Show how many blocks there are so far */
+		tftp_cur_block = ++tftp_mcast_count;
+		show_block_marker();
+	}
+
+	while (tftp_mcast_hole <= tftp_mcast_blocks &&
+	       tftp_mcast_test_block(tftp_mcast_hole))
+		tftp_mcast_hole++;
+	if (tftp_mcast_hole > tftp_mcast_blocks) {
+		/* Every client acknowledges the last block, to be done */
+		tftp_mcast_master = true;
+		tftp_send();
+		tftp_mcast_cleanup();
+		tftp_complete();
+		return;
+	}
+
+	if (!tftp_mcast_master)
+		return;
+	/* Within a window, wait for its end */
+	if (!dup && tftp_mcast_hole == block + 1 && block % tftp_windowsize)
+		return;
+	/* Ask once for a block missing, like tftp_handler() does */
+	if (dup || tftp_mcast_hole <= block) {
+		if (tftp_mcast_nack == tftp_mcast_hole)
+			return;
+		tftp_mcast_nack = tftp_mcast_hole;
+	}
+	tftp_send();
+}
+
 static void tftp_send(void)
 {
 	uchar *pkt;
@@ -365,6 +614,8 @@ static void tftp_send(void)
 		if (tftp_state == STATE_SEND_RRQ && tftp_window_size_option > 1)
 			pkt += sprintf((char *)pkt, "windowsize%c%d%c",
 					0, tftp_window_size_option, 0);
+		if (tftp_state == STATE_SEND_RRQ && tftp_mcast_request)
+			pkt += sprintf((char *)pkt, "multicast%c%c", 0, 0);
 		len = pkt - xp;
 		break;
 
@@ -372,10 +623,14 @@ static void tftp_send(void)
 
 	case STATE_RECV_WRQ:
 	case STATE_DATA:
+		/* Only the master client sends ACKs in a multicast transfer */
+		if (tftp_mcast_active && !tftp_mcast_master)
+			return;
 		xp = pkt;
 		s = (ushort *)pkt;
 		s[0] = htons(TFTP_ACK);
-		s[1] = htons(tftp_cur_block);
+		s[1] = htons(tftp_mcast_active ? tftp_mcast_hole - 1 :
+			     tftp_cur_block);
 		pkt = (uchar *)(s + 2);
 #ifdef CONFIG_CMD_TFTPPUT
 		if (tftp_put_active) {
@@ -461,8 +716,10 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 	__be16 *s;
 	int i;
 	u16 timeout_val_rcvd;
+	bool mcast = false;
 
-	if (dest != tftp_our_port) {
+	if (dest != tftp_our_port &&
+	    !(tftp_mcast_active && dest == tftp_mcast_port)) {
 			return;
 	}
 	if (tftp_state != STATE_SEND_RRQ && src != tftp_remote_port &&
@@ -570,8 +827,18 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 				debug("windowsize = %s, %d\n",
 				      (char *)pkt + i + 11, tftp_windowsize);
 			}
+			if (tftp_mcast_request &&
+			    strcasecmp((char *)pkt + i, "multicast") == 0) {
+				mcast = true;
+				if (tftp_mcast_option((char *)pkt + i + 10))
+					tftp_state = STATE_INVALID_OPTION;
+			}
 		}
 
+		if (mcast && !tftp_mcast_bitmap &&
+		    tftp_state != STATE_INVALID_OPTION && tftp_mcast_start())
+			tftp_state = STATE_INVALID_OPTION;
+
 		tftp_next_ack = tftp_windowsize;
 
 #ifdef CONFIG_CMD_TFTPPUT
@@ -588,6 +855,11 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 			return;
 		len -= 2;
 
+		if (tftp_mcast_active) {
+			tftp_mcast_data(pkt, len);
+			break;
+		}
+
 		if (ntohs(*(__be16 *)pkt) != (ushort)(tftp_cur_block + 1)) {
 			debug("Received unexpected block: %d, expected: %d\n",
 			      ntohs(*(__be16 *)pkt),
@@ -607,6 +879,7 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 			 * This just overwellms the server, let's just send one.
 			 */
 			if (tftp_last_nack != tftp_cur_block) {
+				tftp_lost();
 				tftp_send();
 				tftp_last_nack = tftp_cur_block;
 				tftp_next_ack = (ushort)(tftp_cur_block +
@@ -648,7 +921,22 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 		update_block_number();
 		tftp_prev_block = tftp_cur_block;
 		timeout_count_max = tftp_timeout_count_max;
-		net_set_timeout_handler(timeout_ms, tftp_timeout_handler);
+		if (tftp_adapt) {
+			if (tftp_rtt_pending) {
+				ulong rtt = get_timer(tftp_ack_time);
+
+				tftp_srtt = tftp_srtt ? (7 * tftp_srtt + rtt) / 8 :
+					    rtt;
+				tftp_rtt_pending = false;
+			}
+			/* Expect the rest of the window within a few round trips */
+			tftp_rto = clamp(4 * tftp_srtt, (ulong)TFTP_RTO_MIN,
+					 timeout_ms);
+			net_set_timeout_handler(tftp_rto, tftp_timeout_handler);
+		} else {
+			net_set_timeout_handler(timeout_ms,
+						tftp_timeout_handler);
+		}
 
 		if (store_block(tftp_cur_block, pkt + 2, len)) {
 			eth_halt();
@@ -669,6 +957,8 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 		if (tftp_cur_block == tftp_next_ack) {
 			tftp_send();
 			tftp_next_ack += tftp_windowsize;
+			tftp_ack_time = get_timer(0);
+			tftp_rtt_pending = true;
 		}
 		break;
 
@@ -700,11 +990,30 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 
 static void tftp_timeout_handler(void)
 {
+	if (tftp_adapt && tftp_state == STATE_DATA && tftp_rto < timeout_ms) {
+		/*
+		 * The end of the window went missing, so nothing after it told
+		 * us: ask for it again now, waiting longer each time nothing
+		 * comes, up to the full timeout
+		 */
+		tftp_lost();
+		tftp_rto = min(2 * tftp_rto, timeout_ms);
+		net_set_timeout_handler(tftp_rto, tftp_timeout_handler);
+		tftp_last_nack = tftp_cur_block;
+		tftp_next_ack = (ushort)(tftp_cur_block + tftp_windowsize);
+		tftp_send();
+		return;
+	}
+
 	if (++timeout_count > timeout_count_max) {
+		if (tftp_state == STATE_DATA)
+			tftp_adapt_update(true);
 		restart("Retry count exceeded");
 	} else {
 		puts("T ");
 		net_set_timeout_handler(timeout_ms, tftp_timeout_handler);
+		if (tftp_state == STATE_DATA)
+			tftp_lost();
 		if (tftp_state != STATE_RECV_WRQ)
 			tftp_send();
 	}
@@ -777,6 +1086,9 @@ void tftp_start(enum proto_t protocol)
 		saved_tftp_block_size_option = 0;
 	}
 
+	tftp_adapt = IS_ENABLED(CONFIG_TFTP_WINDOWSIZE_ADAPTIVE) &&
+		     protocol == TFTPGET;
+
 	if (IS_ENABLED(CONFIG_NET_TFTP_VARS)) {
 
 		/*
@@ -789,8 +1101,10 @@ void tftp_start(enum proto_t protocol)
 			tftp_block_size_option = simple_strtol(ep, NULL, 10);
 
 		ep = env_get("tftpwindowsize");
-		if (ep != NULL)
+		if (ep != NULL) {
 			tftp_window_size_option = simple_strtol(ep, NULL, 10);
+			tftp_adapt = false;
+		}
 
 		ep = env_get("tftptimeout");
 		if (ep != NULL)
@@ -814,6 +1128,18 @@ void tftp_start(enum proto_t protocol)
 	}
 
 	sanitize_tftp_block_size_option(protocol);
+	if (tftp_adapt)
+		tftp_window_size_option = tftp_adapt_window;
+
+	tftp_mcast_cleanup();
+	/*
+	 * Storage is written in order, which blocks overheard in a multicast
+	 * transfer are not
+	 */
+	tftp_sink = protocol == TFTPGET && net_sink_start();
+	tftp_mcast_request = IS_ENABLED(CONFIG_TFTP_MULTICAST) &&
+			     protocol == TFTPGET && !tftp_sink &&
+			     env_get_yesno("tftpmulticast") != 0;
 
 	debug("TFTP blocksize = %i, TFTP windowsize = %d timeout = %ld ms\n",
 	      tftp_block_size_option, tftp_window_size_option, timeout_ms);
@@ -910,14 +1236,15 @@ void tftp_start(enum proto_t protocol)
 	} else
 #endif
 	{
-		if (tftp_init_load_addr()) {
+		if (!tftp_sink && tftp_init_load_addr()) {
 			eth_halt();
 			net_set_state(NETLOOP_FAIL);
 			puts("\nTFTP error: ");
 			puts("trying to overwrite reserved memory...\n");
 			return;
 		}
-		printf("Load address: 0x%lx\n", tftp_load_addr);
+		if (!tftp_sink)
+			printf("Load address: 0x%lx\n", tftp_load_addr);
 		puts("Loading: *\b");
 		tftp_state = STATE_SEND_RRQ;
 	}
@@ -946,6 +1273,10 @@ void tftp_start(enum proto_t protocol)
 	tftp_cur_block = 0;
 	tftp_windowsize = 1;
 	tftp_last_nack = 0;
+	tftp_rtt_pending = false;
+	tftp_srtt = 0;
+	tftp_rto = timeout_ms;
+	tftp_retransmits = 0;
 	/* zero out server ether in case the server ip has changed */
 	memset(net_server_ethaddr, 0, 6);
 	/* Revert tftp_block_size to dflt */
@@ -963,7 +1294,8 @@ void tftp_start_server(void)
 {
 	tftp_filename[0] = 0;
 
-	if (tftp_init_load_addr()) {
+	tftp_sink = net_sink_start();
+	if (!tftp_sink && tftp_init_load_addr()) {
 		eth_halt();
 		net_set_state(NETLOOP_FAIL);
 		puts("\nTFTP error: trying to overwrite reserved memory...\n");
@@ -971,7 +1303,8 @@ void tftp_start_server(void)
 	}
 	printf("Using %s device\n", eth_get_name());
 	printf("Listening for TFTP transfer on %pI4\n", &net_ip);
-	printf("Load address: 0x%lx\n", tftp_load_addr);
+	if (!tftp_sink)
+		printf("Load address: 0x%lx\n", tftp_load_addr);
 
 	puts("Loading: *\b");
 
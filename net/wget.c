@@ -8,21 +8,24 @@
 #include <common.h>
 #include <display_options.h>
 #include <env.h>
+#include <hash.h>
 #include <image.h>
 #include <mapmem.h>
 #include <net.h>
+#include <net6.h>
+#include <net/sink.h>
 #include <net/tcp.h>
 #include <net/wget.h>
+#include <linux/ctype.h>
 
 static const char bootfile1[] = "GET ";
-static const char bootfile3[] = " HTTP/1.0\r\n\r\n";
+static const char bootfile3[] = " HTTP/1.0\r\n";
 static const char http_eom[] = "\r\n\r\n";
-static const char http_ok[] = "200";
 static const char content_len[] = "Content-Length";
+static const char content_range[] = "Content-Range";
 static const char linefeed[] = "\r\n";
 static struct in_addr web_server_ip;
 static int our_port;
-static int wget_timeout_count;
 
 struct pkt_qd {
 	uchar *pkt;
@@ -40,23 +43,130 @@ static int pkt_q_idx;
 static unsigned long content_length;
 static unsigned int packets;
 
-static unsigned int initial_data_seq_num;
-
-static enum  wget_state current_wget_state;
-
 static char *image_url;
 static unsigned int wget_timeout = WGET_TIMEOUT;
 
 static enum net_loop_state wget_loop_state;
 
-/* Timeout retry parameters */
-static u8 retry_action;			/* actions for TCP retry */
-static unsigned int retry_tcp_ack_num;	/* TCP retry acknowledge number*/
-static unsigned int retry_tcp_seq_num;	/* TCP retry sequence number */
-static int retry_len;			/* TCP retry length */
+/**
+ * struct wget_conn - a connection loading part of the file
+ *
+ * @state: wget state of the connection, WGET_CLOSED if it is not in use
+ * @port: our port
+ * @off: offset in the file of the first byte asked for
+ * @end: offset in the file after the last byte asked for, 0 if not known yet
+ * @data_seq: TCP sequence number of the byte at @off
+ * @retry_action: actions for TCP retry
+ * @retry_tcp_ack_num: TCP retry acknowledge number
+ * @retry_tcp_seq_num: TCP retry sequence number
+ * @retry_len: TCP retry length
+ * @rx_edge: edge of data received in order
+ * @rx_high: highest sequence number received
+ * @ack_pending: segments not acknowledged yet
+ * @ack_time: time the first of them arrived
+ * @timeouts: timeouts in a row
+ * @last_rx: time a packet last arrived, or was last sent again
+ */
+static struct wget_conn {
+	enum wget_state state;
+	u16 port;
+	ulong off;
+	ulong end;
+	u32 data_seq;
+	u8 retry_action;
+	u32 retry_tcp_ack_num;
+	u32 retry_tcp_seq_num;
+	int retry_len;
+	u32 rx_edge;
+	u32 rx_high;
+	int ack_pending;
+	ulong ack_time;
+	int timeouts;
+	ulong last_rx;
+} wget_conns[CONFIG_PROT_TCP_CONNS];
+
+static int wget_nr_conns;		/* Connections to load with */
+static bool wget_sink;			/* The file goes to storage */
+static ulong wget_window;		/* Receive window */
+static struct hash_algo *wget_hash;	/* Algorithm of 'wgethash', if set */
+static u8 wget_hash_want[HASH_MAX_DIGEST_SIZE];
+static ulong wget_next;			/* Offset of the next byte to ask for */
+static unsigned int wget_opened;	/* Connections opened */
+static unsigned int wget_resumes;	/* Connections resumed */
+
+/* Transfer statistics */
+static unsigned int rx_ooo;		/* Segments received beyond a hole */
+static unsigned int rx_retx;		/* Segments filling a hole or seen */
+static unsigned int tx_acks;		/* Acknowledgments sent */
+static ulong time_start;		/* Time the SYN was sent */
+static unsigned int rx_in_place;	/* Segments received in place */
+static int rx_step;			/* Length of full segments */
+
+/*
+ * Segments waiting for lent memory. Two let segments landing one place
+ * early each wait for the next one, see wget_check().
+ */
+#define WGET_RX_PARK 2
+
+/**
+ * struct wget_rx_park - segment waiting for the driver to give back memory
+ * @data: payload of the segment
+ * @offset: where it goes
+ * @len: length of the payload, 0 if none
+ */
+static struct wget_rx_park {
+	uchar data[PKTSIZE_ALIGN];
+	unsigned int offset;
+	int len;
+} rx_park[WGET_RX_PARK];
+
+/**
+ * wget_park() - find room for a segment waiting for lent memory
+ * @len: length of the segment
+ *
+ * Return: room for it, NULL if none
+ */
+static struct wget_rx_park *wget_park(int len)
+{
+	int i;
+
+	for (i = 0; i < WGET_RX_PARK; i++) {
+		if (!rx_park[i].len && len <= sizeof(rx_park[i].data))
+			return &rx_park[i];
+	}
+
+	return NULL;
+}
 
 /**
- * store_block() - store block in memory
+ * wget_unpark() - store the segments waiting for lent memory, which can be
+ */
+static void wget_unpark(void)
+{
+	struct wget_rx_park *park;
+	uchar *ptr;
+
+	for (park = rx_park; park < rx_park + WGET_RX_PARK; park++) {
+		if (!park->len)
+			continue;
+		ptr = map_sysmem(image_load_addr + park->offset, park->len);
+		if (!eth_rx_lent(ptr, park->len)) {
+			memcpy(ptr, park->data, park->len);
+			park->len = 0;
+		}
+		unmap_sysmem(ptr);
+	}
+}
+
+/* Memory is only lent with a single connection, loading into memory */
+static bool wget_lending(void)
+{
+	return IS_ENABLED(CONFIG_NET_RX_LEND) && wget_nr_conns == 1 &&
+	       !wget_sink;
+}
+
+/**
+ * store_block() - store block in memory, or pass it on to storage
  * @src: source of data
  * @offset: offset
  * @len: length
@@ -64,11 +174,38 @@ static int retry_len;			/* TCP retry length */
 static inline int store_block(uchar *src, unsigned int offset, unsigned int len)
 {
 	ulong newsize = offset + len;
+	struct wget_rx_park *park;
 	uchar *ptr;
+	int ret;
 
-	ptr = map_sysmem(image_load_addr + offset, len);
-	memcpy(ptr, src, len);
-	unmap_sysmem(ptr);
+	if (wget_sink) {
+		ret = net_sink_write(offset, src, len);
+		if (ret)
+			return ret;
+	} else {
+		ptr = map_sysmem(image_load_addr + offset, len);
+		/*
+		 * The driver may have put it there already, see wget_lend(),
+		 * or still hold memory there for another segment, which is
+		 * then waited for
+		 */
+		if (ptr == src) {
+			rx_in_place++;
+		} else if (IS_ENABLED(CONFIG_NET_RX_LEND) &&
+			   eth_rx_lent(ptr, len)) {
+			park = wget_park(len);
+			if (!park)
+				return -ENOMEM;
+			memcpy(park->data, src, len);
+			park->offset = offset;
+			park->len = len;
+		} else {
+			memmove(ptr, src, len);
+		}
+		unmap_sysmem(ptr);
+		if (IS_ENABLED(CONFIG_NET_RX_LEND))
+			wget_unpark();
+	}
 
 	if (net_boot_file_size < (offset + len))
 		net_boot_file_size = newsize;
@@ -78,34 +215,48 @@ static inline int store_block(uchar *src, unsigned int offset, unsigned int len)
 
 /**
  * wget_send_stored() - wget response dispatcher
+ * @c: connection
  *
  * WARNING, This, and only this, is the place in wget.c where
  * SEQUENCE NUMBERS are swapped between incoming (RX)
  * and outgoing (TX).
  * Procedure wget_handler() is correct for RX traffic.
  */
-static void wget_send_stored(void)
+static void wget_send_stored(struct wget_conn *c)
 {
-	u8 action = retry_action;
-	int len = retry_len;
-	unsigned int tcp_ack_num = retry_tcp_seq_num + (len == 0 ? 1 : len);
-	unsigned int tcp_seq_num = retry_tcp_ack_num;
+	u8 action = c->retry_action;
+	int len = c->retry_len;
+	unsigned int tcp_ack_num;
+	unsigned int tcp_seq_num = c->retry_tcp_ack_num;
 	uchar *ptr, *offset;
 
-	switch (current_wget_state) {
+	/* Sent again on a timeout if all TCP connections are in use */
+	if (tcp_select_conn(c->port))
+		return;
+
+	/* Data is acknowledged up to the first hole, not just the last one */
+	if (len)
+		tcp_ack_num = tcp_get_ack_edge();
+	else
+		tcp_ack_num = c->retry_tcp_seq_num + 1;
+
+	switch (c->state) {
 	case WGET_CLOSED:
-		debug_cond(DEBUG_WGET, "wget: send SYN\n");
-		current_wget_state = WGET_CONNECTING;
-		net_send_tcp_packet(0, SERVER_PORT, our_port, action,
-				    tcp_seq_num, tcp_ack_num);
-		packets = 0;
 		break;
 	case WGET_CONNECTING:
+		/* The SYN goes again until the server answers */
+		if (action == TCP_SYN) {
+			debug_cond(DEBUG_WGET, "wget: send SYN\n");
+			tcp_set_tcp_state(TCP_CLOSED);
+			net_send_tcp_packet(0, SERVER_PORT, c->port, action,
+					    tcp_seq_num, tcp_ack_num);
+			break;
+		}
 		pkt_q_idx = 0;
-		net_send_tcp_packet(0, SERVER_PORT, our_port, action,
+		net_send_tcp_packet(0, SERVER_PORT, c->port, action,
 				    tcp_seq_num, tcp_ack_num);
 
-		ptr = net_tx_packet + net_eth_hdr_size() +
+		ptr = net_tx_packet + net_eth_hdr_size() + tcp_ip_extra() +
 			IP_TCP_HDR_SIZE + TCP_TSOPT_SIZE + 2;
 		offset = ptr;
 
@@ -117,73 +268,503 @@ static void wget_send_stored(void)
 
 		memcpy(offset, &bootfile3, strlen(bootfile3));
 		offset += strlen(bootfile3);
-		net_send_tcp_packet((offset - ptr), SERVER_PORT, our_port,
+
+		/* Only the part of the file this connection loads */
+		if (c->off || c->end) {
+			offset += sprintf((char *)offset, "Range: bytes=%lu-",
+					  c->off);
+			if (c->end)
+				offset += sprintf((char *)offset, "%lu",
+						  c->end - 1);
+			memcpy(offset, &linefeed, strlen(linefeed));
+			offset += strlen(linefeed);
+		}
+
+		memcpy(offset, &linefeed, strlen(linefeed));
+		offset += strlen(linefeed);
+		net_send_tcp_packet((offset - ptr), SERVER_PORT, c->port,
 				    TCP_PUSH, tcp_seq_num, tcp_ack_num);
-		current_wget_state = WGET_CONNECTED;
+		c->state = WGET_CONNECTED;
 		break;
 	case WGET_CONNECTED:
 	case WGET_TRANSFERRING:
 	case WGET_TRANSFERRED:
-		net_send_tcp_packet(0, SERVER_PORT, our_port, action,
+		net_send_tcp_packet(0, SERVER_PORT, c->port, action,
 				    tcp_seq_num, tcp_ack_num);
+		c->ack_pending = 0;
+		tx_acks++;
 		break;
 	}
 }
 
-static void wget_send(u8 action, unsigned int tcp_seq_num,
-		      unsigned int tcp_ack_num, int len)
+static void wget_send(struct wget_conn *c, u8 action,
+		      unsigned int tcp_seq_num, unsigned int tcp_ack_num,
+		      int len)
 {
-	retry_action = action;
-	retry_tcp_ack_num = tcp_ack_num;
-	retry_tcp_seq_num = tcp_seq_num;
-	retry_len = len;
+	c->retry_action = action;
+	c->retry_tcp_ack_num = tcp_ack_num;
+	c->retry_tcp_seq_num = tcp_seq_num;
+	c->retry_len = len;
 
-	wget_send_stored();
+	wget_send_stored(c);
 }
 
-void wget_fail(char *error_message, unsigned int tcp_seq_num,
-	       unsigned int tcp_ack_num, u8 action)
+static void wget_fail(struct wget_conn *c, char *error_message,
+		      unsigned int tcp_seq_num, unsigned int tcp_ack_num,
+		      u8 action)
 {
 	printf("wget: Transfer Fail - %s\n", error_message);
 	net_set_timeout_handler(0, NULL);
-	wget_send(action, tcp_seq_num, tcp_ack_num, 0);
+	wget_send(c, action, tcp_seq_num, tcp_ack_num, 0);
+	net_set_state(NETLOOP_FAIL);
 }
 
-void wget_success(u8 action, unsigned int tcp_seq_num,
-		  unsigned int tcp_ack_num, int len, int packets)
+/**
+ * wget_report() - print how the transfer went
+ */
+static void wget_report(void)
 {
+	ulong time = get_timer(time_start);
+
 	printf("Packets received %d, Transfer Successful\n", packets);
-	wget_send(action, tcp_seq_num, tcp_ack_num, len);
+	printf("%u out of order, %u retransmitted, %u ACKs sent", rx_ooo,
+	       rx_retx, tx_acks);
+	if (IS_ENABLED(CONFIG_NET_RX_LEND))
+		printf(", %u received in place", rx_in_place);
+	if (wget_opened > 1)
+		printf(", %u connections", wget_opened);
+	if (wget_resumes)
+		printf(", %u resumed", wget_resumes);
+	if (time > 0) {
+		puts(", ");
+		print_size(net_boot_file_size / time * 1000, "/s");
+	}
+	putc('\n');
 }
 
-/*
- * Interfaces of U-BOOT
+/**
+ * wget_hash_parse() - take in the 'wgethash' environment variable
+ *
+ * It holds the name of the algorithm and the hash expected, in hexadecimal,
+ * such as "sha256:9f86d0...".
+ *
+ * Return: 0 if OK or if it is not set, -EINVAL if it is malformed
+ */
+static int wget_hash_parse(void)
+{
+	const char *str = env_get("wgethash");
+	char name[16];
+	char *sep;
+	int ret;
+
+	wget_hash = NULL;
+	if (!IS_ENABLED(CONFIG_HASH) || !str)
+		return 0;
+
+	sep = strchr(str, ':');
+	ret = -EINVAL;
+	if (sep && sep - str < sizeof(name)) {
+		strlcpy(name, str, sep - str + 1);
+		ret = hash_lookup_algo(name, &wget_hash);
+		if (!ret && strlen(sep + 1) != wget_hash->digest_size * 2)
+			ret = -EINVAL;
+	}
+	if (ret) {
+		printf("wget: Bad wgethash '%s'\n", str);
+		wget_hash = NULL;
+		return ret;
+	}
+	hash_parse_string(name, sep + 1, wget_hash_want);
+
+	return 0;
+}
+
+/**
+ * wget_verify() - check the hash of the file loaded
+ *
+ * A file written to storage is hashed as it is written out.
+ *
+ * Return: 0 if OK or if there is nothing to check, -ve on error
+ */
+static int wget_verify(void)
+{
+	u8 got[HASH_MAX_DIGEST_SIZE];
+	int size = sizeof(got);
+	void *buf;
+	int ret;
+
+	if (!wget_hash)
+		return 0;
+
+	if (wget_sink) {
+		ret = net_sink_digest(got, &size);
+	} else {
+		buf = map_sysmem(image_load_addr, net_boot_file_size);
+		ret = hash_block(wget_hash->name, buf, net_boot_file_size, got,
+				 &size);
+		unmap_sysmem(buf);
+	}
+	if (!ret && memcmp(wget_hash_want, got, size))
+		ret = -EBADMSG;
+	if (ret)
+		printf("wget: Transfer Fail - %s hash mismatch\n",
+		       wget_hash->name);
+
+	return ret;
+}
+
+/**
+ * wget_conn_find() - find the connection on one of our ports
+ * @port: our port
+ *
+ * Return: the connection, NULL if none is in use on @port
  */
-static void wget_timeout_handler(void)
+static struct wget_conn *wget_conn_find(u16 port)
 {
-	if (++wget_timeout_count > WGET_RETRY_COUNT) {
+	struct wget_conn *c;
+
+	for (c = wget_conns; c < wget_conns + wget_nr_conns; c++) {
+		if (c->state != WGET_CLOSED && c->port == port)
+			return c;
+	}
+
+	return NULL;
+}
+
+/* Whether a connection other than @c is in use */
+static bool wget_busy(struct wget_conn *c)
+{
+	struct wget_conn *other;
+
+	for (other = wget_conns; other < wget_conns + wget_nr_conns; other++) {
+		if (other != c && other->state != WGET_CLOSED)
+			return true;
+	}
+
+	return false;
+}
+
+/**
+ * wget_conn_open() - open a connection to load part of the file
+ * @c: connection, not in use
+ * @off: offset in the file of the first byte to load
+ * @end: offset in the file after the last byte to load, 0 for up to the end
+ *
+ * The whole file is asked for without a Range header.
+ */
+static void wget_conn_open(struct wget_conn *c, ulong off, ulong end)
+{
+	memset(c, '\0', sizeof(*c));
+	c->state = WGET_CONNECTING;
+	c->port = ++our_port;
+	c->off = off;
+	c->end = end;
+	c->last_rx = get_timer(0);
+	wget_opened++;
+
+	wget_send(c, TCP_SYN, 0, 0, 0);
+}
+
+/**
+ * wget_more() - hand out the rest of the file to the connections not in use
+ *
+ * The parts are small enough for the faster connections to load more of
+ * them, and large enough to be worth opening a connection for.
+ */
+static void wget_more(void)
+{
+	struct wget_conn *c;
+	ulong left, size;
+
+	if (wget_loop_state != NETLOOP_SUCCESS || content_length == -1)
+		return;
+
+	for (c = wget_conns; c < wget_conns + wget_nr_conns &&
+	     wget_next < content_length; c++) {
+		if (c->state != WGET_CLOSED)
+			continue;
+		left = content_length - wget_next;
+		size = max_t(ulong, DIV_ROUND_UP(left, 2 * wget_nr_conns),
+			     CONFIG_WGET_WINDOW_SIZE);
+		size = min(size, left);
+		wget_conn_open(c, wget_next, wget_next + size);
+		wget_next += size;
+	}
+}
+
+/**
+ * wget_done() - finish once no connection is in use any more
+ *
+ * The length of the file is checked against the one the server gave, and
+ * its hash against the 'wgethash' environment variable.
+ */
+static void wget_done(void)
+{
+	if (IS_ENABLED(CONFIG_NET_RX_LEND)) {
+		/* Take back lent memory for the last segment waiting */
+		eth_rx_reclaim();
+		wget_unpark();
+	}
+
+	if (wget_loop_state == NETLOOP_SUCCESS && content_length != -1 &&
+	    net_boot_file_size != content_length) {
+		printf("wget: Transfer Fail - %u bytes out of %lu\n",
+		       net_boot_file_size, content_length);
+		wget_loop_state = NETLOOP_FAIL;
+	} else if (wget_loop_state == NETLOOP_SUCCESS && wget_verify()) {
+		wget_loop_state = NETLOOP_FAIL;
+	}
+
+	if (wget_loop_state == NETLOOP_SUCCESS)
+		wget_report();
+	net_set_state(wget_loop_state);
+}
+
+/**
+ * wget_conn_done() - stop using a connection which loaded its part
+ * @c: connection
+ */
+static void wget_conn_done(struct wget_conn *c)
+{
+	c->state = WGET_CLOSED;
+	wget_more();
+	if (!wget_busy(NULL))
+		wget_done();
+}
+
+/**
+ * wget_resume() - load the rest of the part of a connection on a new one
+ * @c: connection, which stalled or was closed early
+ *
+ * The connection is reset, the new one asks for what follows the data
+ * received in order with a Range request.
+ */
+static void wget_resume(struct wget_conn *c)
+{
+	ulong off;
+
+	tcp_select_conn(c->port);
+	off = c->off + tcp_get_ack_edge() - c->data_seq;
+	net_send_tcp_packet(0, SERVER_PORT, c->port, TCP_RST,
+			    c->retry_tcp_ack_num, 0);
+	if (wget_lending())
+		eth_rx_lend(NULL);
+
+	if (c->end && off >= c->end) {
+		wget_conn_done(c);
+		return;
+	}
+
+	puts("R ");
+	wget_resumes++;
+	wget_conn_open(c, off, c->end);
+}
+
+/**
+ * wget_conn_timeout() - handle a timeout on a connection
+ * @c: connection
+ *
+ * Return: false if wget starts again
+ */
+static bool wget_conn_timeout(struct wget_conn *c)
+{
+	if (++c->timeouts > WGET_RETRY_COUNT) {
 		puts("\nRetry count exceeded; starting again\n");
-		wget_send(TCP_RST, 0, 0, 0);
+		wget_send(c, TCP_RST, 0, 0, 0);
 		net_start_again();
+		return false;
+	}
+
+	/* A connection which stalls for long is given up for a new one */
+	if (c->state == WGET_TRANSFERRING &&
+	    c->timeouts >= WGET_RESUME_TIMEOUTS &&
+	    wget_resumes < WGET_RETRY_COUNT) {
+		wget_resume(c);
 	} else {
 		puts("T ");
-		net_set_timeout_handler(wget_timeout +
-					WGET_TIMEOUT * wget_timeout_count,
-					wget_timeout_handler);
-		wget_send_stored();
+		c->last_rx = get_timer(0);
+		wget_send_stored(c);
 	}
+
+	return true;
+}
+
+/*
+ * Interfaces of U-BOOT
+ */
+
+/**
+ * wget_tick() - send the acknowledgments held back long enough and handle
+ * the timeouts of all connections, then wait for the next one due
+ */
+static void wget_tick(void)
+{
+	ulong wait = wget_timeout;
+	struct wget_conn *c;
+	ulong due;
+
+	for (c = wget_conns; c < wget_conns + wget_nr_conns; c++) {
+		if (c->state == WGET_CLOSED)
+			continue;
+
+		if (c->ack_pending && get_timer(c->ack_time) >= WGET_ACK_DELAY)
+			wget_send_stored(c);
+		else if (c->ack_pending)
+			wait = min(wait, WGET_ACK_DELAY - get_timer(c->ack_time));
+
+		due = wget_timeout + WGET_TIMEOUT * c->timeouts;
+		if (get_timer(c->last_rx) >= due) {
+			if (!wget_conn_timeout(c))
+				return;
+			continue;
+		}
+		wait = min(wait, due - get_timer(c->last_rx));
+	}
+
+	net_set_timeout_handler(wait, wget_tick);
+}
+
+/**
+ * wget_ack() - acknowledge a segment received while transferring
+ * @c: connection
+ * @tcp_seq_num: TCP sequence number of the segment
+ * @tcp_ack_num: TCP acknowledgment number of the segment
+ * @len: length of the segment
+ *
+ * A segment arriving in order, with no hole after it, is acknowledged
+ * together with the next one, or WGET_ACK_DELAY ms later if none comes.
+ * Anything else is acknowledged at once, as RFC 5681 asks, so that the
+ * server learns of holes and of holes filled quickly.
+ */
+static void wget_ack(struct wget_conn *c, u32 tcp_seq_num, u32 tcp_ack_num,
+		     int len)
+{
+	u32 end = tcp_seq_num + len;
+	bool now = true;
+
+	if ((s32)(end - c->rx_edge) <= 0 || (c->rx_high != c->rx_edge &&
+					     tcp_seq_num == c->rx_edge))
+		rx_retx++;
+	else if ((s32)(tcp_seq_num - c->rx_edge) > 0)
+		rx_ooo++;
+	else
+		now = ++c->ack_pending >= WGET_ACK_SEGMENTS;
+
+	if ((s32)(end - c->rx_high) > 0)
+		c->rx_high = end;
+	c->rx_edge = tcp_get_ack_edge();
+
+	if (now)
+		wget_send(c, TCP_ACK, tcp_seq_num, tcp_ack_num, len);
+	else if (c->ack_pending == 1)
+		c->ack_time = get_timer(0);
+}
+
+/**
+ * wget_lend() - lend the memory the next segments go to to the driver
+ * @c: connection
+ * @len: length of the segment just received
+ *
+ * The payloads of full segments arriving in order then land where they
+ * belong, and are not copied. Nothing is lent while there are holes, as
+ * what follows them is stored already.
+ */
+static void wget_lend(struct wget_conn *c, int len)
+{
+	struct eth_rx_lend lend;
+
+	if (len > rx_step)
+		rx_step = len;
+	if (c->rx_high != c->rx_edge || !c->end) {
+		eth_rx_lend(NULL);
+		return;
+	}
+
+	lend.buf = map_sysmem(image_load_addr + c->off + c->rx_edge -
+			      c->data_seq, 0);
+	lend.step = rx_step;
+	lend.end = map_sysmem(image_load_addr + c->end, 0);
+	eth_rx_lend(&lend);
+}
+
+/**
+ * wget_check() - check that a segment can be stored
+ * @pkt: payload of the segment
+ * @tcp_seq_num: TCP sequence number of the segment
+ * @len: length of the segment
+ *
+ * A segment which did not land where it belongs is copied there, which has
+ * to wait until the driver no longer holds memory lent there. A few
+ * segments wait aside, see wget_unpark(), others are sent again by the
+ * server. Memory is only lent with a single connection.
+ *
+ * Return: true if the segment can be stored
+ */
+static bool wget_check(uchar *pkt, u32 tcp_seq_num, int len)
+{
+	struct wget_conn *c = wget_conns;
+	uchar *ptr;
+	bool ok;
+
+	if (c->state != WGET_TRANSFERRING ||
+	    (s32)(tcp_seq_num - c->data_seq) < 0)
+		return true;
+
+	ptr = map_sysmem(image_load_addr + c->off + tcp_seq_num - c->data_seq,
+			 len);
+	ok = ptr == pkt || !eth_rx_lent(ptr, len) || wget_park(len);
+	unmap_sysmem(ptr);
+
+	return ok;
 }
 
 #define PKT_QUEUE_OFFSET 0x20000
 #define PKT_QUEUE_PACKET_SIZE 0x800
 
-static void wget_connected(uchar *pkt, unsigned int tcp_seq_num,
-			   u8 action, unsigned int tcp_ack_num, unsigned int len)
+/**
+ * wget_content_range() - take in the Content-Range header of a 206 reply
+ * @c: connection
+ * @hdr: HTTP header
+ *
+ * Return: 0 if OK, -EINVAL if the header is missing, malformed or not for the
+ * part asked for
+ */
+static int wget_content_range(struct wget_conn *c, char *hdr)
+{
+	char *pos = strstr(hdr, content_range);
+	ulong first, end;
+
+	if (!pos)
+		return -EINVAL;
+	pos += sizeof(content_range) + 1;
+	if (strncmp(pos, "bytes ", 6))
+		return -EINVAL;
+	first = dectoul(pos + 6, &pos);
+	if (first != c->off || *pos != '-')
+		return -EINVAL;
+	end = dectoul(pos + 1, &pos) + 1;
+	if (end <= first || (c->end && end > c->end) || *pos != '/' ||
+	    !isdigit(pos[1]))
+		return -EINVAL;
+
+	c->end = end;
+	content_length = dectoul(pos + 1, NULL);
+	wget_next = max(wget_next, end);
+	debug_cond(DEBUG_WGET, "wget: Connected Range %lx-%lx/%lu\n",
+		   first, end, content_length);
+
+	return 0;
+}
+
+static void wget_connected(struct wget_conn *c, uchar *pkt,
+			   unsigned int tcp_seq_num, u8 action,
+			   unsigned int tcp_ack_num, unsigned int len)
 {
 	uchar *pkt_in_q;
 	char *pos;
 	int hlen, i;
 	uchar *ptr1;
+	ulong status;
 
 	pkt[len] = '\0';
 	pos = strstr((char *)pkt, http_eom);
@@ -191,6 +772,13 @@ static void wget_connected(uchar *pkt, unsigned int tcp_seq_num,
 	if (!pos) {
 		debug_cond(DEBUG_WGET,
 			   "wget: Connected, data before Header %p\n", pkt);
+		/*
+		 * It is not acknowledged, so the server sends it again. It is
+		 * only kept aside in the load area while nothing is loaded.
+		 */
+		if (wget_next || c->off || pkt_q_idx >= ARRAY_SIZE(pkt_q))
+			return;
+
 		pkt_in_q = (void *)image_load_addr + PKT_QUEUE_OFFSET +
 			(pkt_q_idx * PKT_QUEUE_PACKET_SIZE);
 
@@ -213,35 +801,46 @@ static void wget_connected(uchar *pkt, unsigned int tcp_seq_num,
 			i = hlen;
 		printf("%.*s", i,  pkt);
 
-		current_wget_state = WGET_TRANSFERRING;
-
-		if (strstr((char *)pkt, http_ok) == 0) {
-			debug_cond(DEBUG_WGET,
-				   "wget: Connected Bad Xfer\n");
-			initial_data_seq_num = tcp_seq_num + hlen;
-			wget_loop_state = NETLOOP_FAIL;
-			wget_send(action, tcp_seq_num, tcp_ack_num, len);
-		} else {
-			debug_cond(DEBUG_WGET,
-				   "wget: Connctd pkt %p  hlen %x\n",
-				   pkt, hlen);
-			initial_data_seq_num = tcp_seq_num + hlen;
+		c->state = WGET_TRANSFERRING;
+		c->rx_edge = tcp_get_ack_edge();
+		c->rx_high = c->rx_edge;
+		c->data_seq = tcp_seq_num + hlen;
 
+		pos = strchr((char *)pkt, ' ');
+		status = pos ? dectoul(pos + 1, NULL) : 0;
+		if (status == 200 && !wget_busy(c)) {
+			/* The whole file, whatever part was asked for */
+			c->off = 0;
 			pos = strstr((char *)pkt, content_len);
 			if (!pos) {
 				content_length = -1;
 			} else {
-				pos += sizeof(content_len) + 2;
-				strict_strtoul(pos, 10, &content_length);
+				pos += sizeof(content_len) + 1;
+				content_length = dectoul(pos, NULL);
 				debug_cond(DEBUG_WGET,
 					   "wget: Connected Len %lu\n",
 					   content_length);
 			}
+			c->end = content_length == -1 ? 0 : content_length;
+			wget_next = content_length;
+		} else if (status != 206 || wget_content_range(c, (char *)pkt)) {
+			debug_cond(DEBUG_WGET,
+				   "wget: Connected Bad Xfer\n");
+			wget_loop_state = NETLOOP_FAIL;
+		}
+
+		if (wget_loop_state == NETLOOP_SUCCESS) {
+			debug_cond(DEBUG_WGET,
+				   "wget: Connctd pkt %p  hlen %x\n",
+				   pkt, hlen);
 
-			net_boot_file_size = 0;
+			/* Segments now go where they belong, in any order */
+			tcp_set_rx_window(wget_window, true);
+			if (wget_lending())
+				tcp_set_tcp_check(wget_check);
 
 			if (len > hlen)
-				store_block(pkt + hlen, 0, len - hlen);
+				store_block(pkt + hlen, c->off, len - hlen);
 
 			debug_cond(DEBUG_WGET,
 				   "wget: Connected Pkt %p hlen %x\n",
@@ -252,17 +851,21 @@ static void wget_connected(uchar *pkt, unsigned int tcp_seq_num,
 					(phys_addr_t)(pkt_q[i].pkt),
 					pkt_q[i].len);
 				store_block(ptr1,
-					    pkt_q[i].tcp_seq_num -
-					    initial_data_seq_num,
+					    c->off + pkt_q[i].tcp_seq_num -
+					    c->data_seq,
 					    pkt_q[i].len);
 				unmap_sysmem(ptr1);
 				debug_cond(DEBUG_WGET,
 					   "wget: Connctd pkt Q %p len %x\n",
 					   pkt_q[i].pkt, pkt_q[i].len);
 			}
+			pkt_q_idx = 0;
+
+			/* The length is known, the other connections join in */
+			wget_more();
 		}
 	}
-	wget_send(action, tcp_seq_num, tcp_ack_num, len);
+	wget_send(c, action, tcp_seq_num, tcp_ack_num, len);
 }
 
 /**
@@ -285,11 +888,17 @@ static void wget_handler(uchar *pkt, u16 dport,
 			 u8 action, unsigned int len)
 {
 	enum tcp_state wget_tcp_state = tcp_get_tcp_state();
+	struct wget_conn *c = wget_conn_find(ntohs(dport));
+
+	/* Left over from a connection given up */
+	if (!c)
+		return;
 
-	net_set_timeout_handler(wget_timeout, wget_timeout_handler);
 	packets++;
+	c->timeouts = 0;
+	c->last_rx = get_timer(0);
 
-	switch (current_wget_state) {
+	switch (c->state) {
 	case WGET_CLOSED:
 		debug_cond(DEBUG_WGET, "wget: Handler: Error!, State wrong\n");
 		break;
@@ -301,11 +910,11 @@ static void wget_handler(uchar *pkt, u16 dport,
 			if (wget_tcp_state == TCP_ESTABLISHED) {
 				debug_cond(DEBUG_WGET,
 					   "wget: Cting, send, len=%x\n", len);
-				wget_send(action, tcp_seq_num, tcp_ack_num,
+				wget_send(c, action, tcp_seq_num, tcp_ack_num,
 					  len);
 			} else {
 				printf("%.*s", len,  pkt);
-				wget_fail("wget: Handler Connected Fail\n",
+				wget_fail(c, "wget: Handler Connected Fail\n",
 					  tcp_seq_num, tcp_ack_num, action);
 			}
 		}
@@ -314,10 +923,11 @@ static void wget_handler(uchar *pkt, u16 dport,
 		debug_cond(DEBUG_WGET, "wget: Connected seq=%u, len=%x\n",
 			   tcp_seq_num, len);
 		if (!len) {
-			wget_fail("Image not found, no data returned\n",
+			wget_fail(c, "Image not found, no data returned\n",
 				  tcp_seq_num, tcp_ack_num, action);
 		} else {
-			wget_connected(pkt, tcp_seq_num, action, tcp_ack_num, len);
+			wget_connected(c, pkt, tcp_seq_num, action, tcp_ack_num,
+				       len);
 		}
 		break;
 	case WGET_TRANSFERRING:
@@ -325,17 +935,17 @@ static void wget_handler(uchar *pkt, u16 dport,
 			   "wget: Transferring, seq=%x, ack=%x,len=%x\n",
 			   tcp_seq_num, tcp_ack_num, len);
 
-		if (tcp_seq_num >= initial_data_seq_num &&
-		    store_block(pkt, tcp_seq_num - initial_data_seq_num,
+		if ((s32)(tcp_seq_num - c->data_seq) >= 0 &&
+		    store_block(pkt, c->off + tcp_seq_num - c->data_seq,
 				len) != 0) {
-			wget_fail("wget: store error\n",
+			wget_fail(c, "wget: store error\n",
 				  tcp_seq_num, tcp_ack_num, action);
 			return;
 		}
 
 		switch (wget_tcp_state) {
 		case TCP_FIN_WAIT_2:
-			wget_send(TCP_ACK, tcp_seq_num, tcp_ack_num, len);
+			wget_send(c, TCP_ACK, tcp_seq_num, tcp_ack_num, len);
 			fallthrough;
 		case TCP_SYN_SENT:
 		case TCP_SYN_RECEIVED:
@@ -345,22 +955,31 @@ static void wget_handler(uchar *pkt, u16 dport,
 			net_set_state(NETLOOP_FAIL);
 			break;
 		case TCP_ESTABLISHED:
-			wget_send(TCP_ACK, tcp_seq_num, tcp_ack_num,
-				  len);
-			wget_loop_state = NETLOOP_SUCCESS;
+			wget_ack(c, tcp_seq_num, tcp_ack_num, len);
+			if (wget_lending())
+				wget_lend(c, len);
 			break;
 		case TCP_CLOSE_WAIT:     /* End of transfer */
-			current_wget_state = WGET_TRANSFERRED;
-			wget_send(action | TCP_ACK | TCP_FIN,
+			/* Closed early, the rest is asked for again */
+			if (wget_loop_state == NETLOOP_SUCCESS && c->end &&
+			    c->off + tcp_seq_num - c->data_seq < c->end &&
+			    wget_resumes < WGET_RETRY_COUNT) {
+				wget_resume(c);
+				break;
+			}
+			c->state = WGET_TRANSFERRED;
+			wget_send(c, action | TCP_ACK | TCP_FIN,
 				  tcp_seq_num, tcp_ack_num, len);
 			break;
 		}
 		break;
 	case WGET_TRANSFERRED:
-		printf("Packets received %d, Transfer Successful\n", packets);
-		net_set_state(wget_loop_state);
+		wget_conn_done(c);
 		break;
 	}
+
+	if (net_state == NETLOOP_CONTINUE)
+		wget_tick();
 }
 
 #define RANDOM_PORT_START 1024
@@ -383,22 +1002,46 @@ static unsigned int random_port(void)
 
 void wget_start(void)
 {
-	image_url = strchr(net_boot_file_name, ':');
-	if (image_url > 0) {
-		web_server_ip = string_to_ip(net_boot_file_name);
-		++image_url;
-		net_server_ip = web_server_ip;
+	if (IS_ENABLED(CONFIG_IPV6) && use_ip6) {
+		char *s, *e;
+
+		/* The server is [addr]:, or serverip6 if there is none */
+		s = strchr(net_boot_file_name, '[');
+		e = strchr(net_boot_file_name, ']');
+		if (s && e && e[1] == ':') {
+			string_to_ip6(s + 1, e - s - 1, &net_server_ip6);
+			image_url = e + 2;
+		} else {
+			image_url = net_boot_file_name;
+		}
+
+		debug_cond(DEBUG_WGET,
+			   "wget: Transfer HTTP Server %pI6c; our IP %pI6c\n",
+			   &net_server_ip6, &net_ip6);
 	} else {
-		web_server_ip = net_server_ip;
-		image_url = net_boot_file_name;
-	}
+		image_url = strchr(net_boot_file_name, ':');
+		if (image_url > 0) {
+			web_server_ip = string_to_ip(net_boot_file_name);
+			++image_url;
+			net_server_ip = web_server_ip;
+		} else {
+			web_server_ip = net_server_ip;
+			image_url = net_boot_file_name;
+		}
 
-	debug_cond(DEBUG_WGET,
-		   "wget: Transfer HTTP Server %pI4; our IP %pI4\n",
-		   &web_server_ip, &net_ip);
+		debug_cond(DEBUG_WGET,
+			   "wget: Transfer HTTP Server %pI4; our IP %pI4\n",
+			   &web_server_ip, &net_ip);
+	}
 
 	/* Check if we need to send across this subnet */
-	if (net_gateway.s_addr && net_netmask.s_addr) {
+	if (IS_ENABLED(CONFIG_IPV6) && use_ip6) {
+		if (!ip6_addr_in_subnet(&net_ip6, &net_server_ip6,
+					net_prefix_length))
+			debug_cond(DEBUG_WGET,
+				   "wget: sending through gateway %pI6c",
+				   &net_gateway6);
+	} else if (net_gateway.s_addr && net_netmask.s_addr) {
 		struct in_addr our_net;
 		struct in_addr server_net;
 
@@ -420,11 +1063,43 @@ void wget_start(void)
 	debug_cond(DEBUG_WGET,
 		   "\nwget:Load address: 0x%lx\nLoading: *\b", image_load_addr);
 
-	net_set_timeout_handler(wget_timeout, wget_timeout_handler);
+	net_set_timeout_handler(wget_timeout, wget_tick);
 	tcp_set_tcp_handler(wget_handler);
 
-	wget_timeout_count = 0;
-	current_wget_state = WGET_CLOSED;
+	/*
+	 * Storage is written in order, so parts far apart in the file cannot
+	 * be loaded at once, and the window has to fit in what is buffered
+	 */
+	wget_sink = net_sink_start();
+	wget_window = CONFIG_WGET_WINDOW_SIZE;
+	wget_nr_conns = clamp_t(long, env_get_ulong("wgetconns", 10, 1), 1,
+				CONFIG_PROT_TCP_CONNS);
+	if (wget_sink) {
+		wget_window = min(wget_window, net_sink_room());
+		wget_nr_conns = 1;
+	}
+	if (wget_hash_parse() ||
+	    (wget_sink && wget_hash && net_sink_hash(wget_hash))) {
+		net_set_state(NETLOOP_FAIL);
+		return;
+	}
+
+	/* Until the HTTP header is in, only data in order is kept */
+	tcp_set_rx_window(wget_window, false);
+	memset(wget_conns, '\0', sizeof(wget_conns));
+	wget_loop_state = NETLOOP_SUCCESS;
+	content_length = -1;
+	wget_next = 0;
+	wget_opened = 0;
+	wget_resumes = 0;
+	packets = 0;
+	rx_ooo = 0;
+	rx_retx = 0;
+	tx_acks = 0;
+	rx_in_place = 0;
+	rx_step = 0;
+	memset(rx_park, '\0', sizeof(rx_park));
+	time_start = get_timer(0);
 
 	our_port = random_port();
 
@@ -436,5 +1111,10 @@ void wget_start(void)
 
 	memset(net_server_ethaddr, 0, 6);
 
-	wget_send(TCP_SYN, 0, 0, 0);
+	/*
+	 * With several connections, the first one asks for the start of the
+	 * file to learn its length, the others then join in
+	 */
+	wget_conn_open(wget_conns, 0,
+		       wget_nr_conns > 1 ? CONFIG_WGET_WINDOW_SIZE : 0);
 }
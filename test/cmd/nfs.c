@@ -0,0 +1,442 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Copyright (C) 2024 Intel Corporation <www.intel.com>
+ *
+ * Tests for the nfs command against a simulated NFSv3 server, whose replies
+ * take a fixed time to arrive and may be lost. Time is simulated too, so
+ * the transfer times can be compared between window sizes and between UDP
+ * and TCP.
+ */
+
+#include <common.h>
+#include <command.h>
+#include <dm.h>
+#include <env.h>
+#include <mapmem.h>
+#include <net.h>
+#include <time.h>
+#include <asm/eth.h>
+#include <linux/sizes.h>
+#include <net/tcp.h>
+#include <test/lib.h>
+#include <test/test.h>
+#include <test/ut.h>
+#include "../../net/nfs.h"
+
+#define NFS_TEST_SIZE		(SZ_256K + 0x321)
+#define NFS_TEST_PORT		2049
+#define NFS_TEST_MOUNT_PORT	635
+#define NFS_TEST_DELAY		10
+#define NFS_TEST_WIRE		256
+#define NFS_TEST_ISN		1000
+
+#define SHIFT_TO_TCPHDRLEN_FIELD(x) ((x) << 4)
+#define GET_TCP_HDR_LEN_IN_BYTES(x) ((x) >> 2)
+#define LEN_B_TO_DW(x) ((x) >> 2)
+
+/* Words of the AUTH_UNIX credential and AUTH_NONE verifier in a call */
+#define NFS_TEST_CRED		9
+
+/**
+ * struct nfs_test_pkt - a reply on its way to U-Boot
+ *
+ * @data:	Packet, including the Ethernet header
+ * @len:	Length of the packet
+ * @due:	Time at which the packet arrives
+ * @read:	The packet is (the end of) a reply to a READ request
+ */
+struct nfs_test_pkt {
+	uchar data[PKTSIZE_ALIGN];
+	int len;
+	ulong due;
+	bool read;
+};
+
+/**
+ * struct nfs_test_server - state of the simulated server
+ *
+ * @wire:	Replies on their way, in the order they arrive
+ * @nr_wire:	Number of replies in @wire
+ * @drop_every:	Lose every this many READ replies over UDP, 0 to lose none
+ * @tcp:	Offer NFS over TCP in the portmapper
+ * @reads:	Number of READ requests received
+ * @inflight:	Number of READ replies in @wire
+ * @max_inflight: Highest value of @inflight
+ * @max_count:	Largest number of bytes asked for by a READ request
+ * @conns:	Number of TCP connections made
+ * @snd_nxt:	Sequence number of the next byte sent over TCP
+ * @rcv_nxt:	Sequence number of the next byte expected over TCP
+ * @stream:	Bytes received over TCP which are not a whole record yet
+ * @stream_len:	Number of bytes in @stream
+ * @reply:	Record marker and reply sent over TCP
+ */
+static struct nfs_test_server {
+	struct nfs_test_pkt wire[NFS_TEST_WIRE];
+	int nr_wire;
+	int drop_every;
+	bool tcp;
+	int reads;
+	int inflight;
+	int max_inflight;
+	ulong max_count;
+	int conns;
+	u32 snd_nxt;
+	u32 rcv_nxt;
+	u32 stream[SZ_4K / 4];
+	u32 stream_len;
+	u32 reply[1 + 11 + NFS_TCP_READ_SIZE / 4];
+} srv;
+
+static u8 nfs_test_byte(ulong offset)
+{
+	return offset * 7 + (offset >> 10);
+}
+
+/* Fill in the reply to an RPC call, returns its length in words */
+static int nfs_test_reply(u32 *call, u32 *reply)
+{
+	u32 prog = ntohl(call[3]);
+	u32 proc = ntohl(call[5]);
+	u32 *args = call + 6;
+	u32 *data = reply + 6;
+	ulong offset, count;
+	u8 *bytes;
+	int i;
+
+	reply[0] = call[0];
+	reply[1] = htonl(MSG_REPLY);
+	reply[2] = 0;		/* rstatus */
+	reply[3] = 0;		/* verifier */
+	reply[4] = 0;
+	reply[5] = 0;		/* astatus */
+
+	switch (prog) {
+	case PROG_PORTMAP:
+		if (ntohl(args[4]) == PROG_MOUNT)
+			data[0] = htonl(NFS_TEST_MOUNT_PORT);
+		else if (ntohl(args[6]) == IPPROTO_TCP && !srv.tcp)
+			data[0] = 0;
+		else
+			data[0] = htonl(NFS_TEST_PORT);
+		return 7;
+	case PROG_MOUNT:
+		if (proc == MOUNT_UMOUNTALL)
+			return 6;
+		/* Status and directory file handle */
+		memset(data, '\0', 4 + NFS_FHSIZE);
+		data[1] = htonl(1);
+		return 7 + NFS_FHSIZE / 4;
+	case PROG_NFS:
+		args += NFS_TEST_CRED;
+		if (proc == NFS3PROC_LOOKUP) {
+			/* Status and file handle */
+			data[0] = 0;
+			data[1] = htonl(NFS_FHSIZE);
+			memset(data + 2, '\0', NFS_FHSIZE);
+			data[2] = htonl(2);
+			return 8 + NFS_FHSIZE / 4;
+		}
+
+		/* READ: skip the file handle */
+		args += 1 + ntohl(args[0]) / 4;
+		offset = ntohl(args[1]);
+		count = ntohl(args[2]);
+		if (offset >= NFS_TEST_SIZE)
+			count = 0;
+		srv.max_count = max(srv.max_count, count);
+		count = min_t(ulong, count, NFS_TEST_SIZE - offset);
+
+		data[0] = 0;		/* status */
+		data[1] = 0;		/* no attributes */
+		data[2] = htonl(count);
+		data[3] = htonl(offset + count == NFS_TEST_SIZE);
+		data[4] = htonl(count);
+		bytes = (u8 *)(data + 5);
+		for (i = 0; i < count; i++)
+			bytes[i] = nfs_test_byte(offset + i);
+		return 11 + DIV_ROUND_UP(count, 4);
+	}
+
+	return -EPROTONOSUPPORT;
+}
+
+/* Queue a TCP segment in answer to the one in @packet */
+static struct nfs_test_pkt *nfs_test_tcp_send(struct udevice *dev,
+					      void *packet, u8 flags,
+					      const void *data, int len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct ethernet_hdr *eth = packet, *eth_send;
+	struct ip_tcp_hdr *tcp = packet + ETHER_HDR_SIZE, *tcp_send;
+	struct nfs_test_pkt *pkt;
+
+	if (srv.nr_wire >= NFS_TEST_WIRE)
+		return NULL;
+
+	pkt = &srv.wire[srv.nr_wire++];
+	eth_send = (void *)pkt->data;
+	memcpy(eth_send->et_dest, eth->et_src, ARP_HLEN);
+	memcpy(eth_send->et_src, priv->fake_host_hwaddr, ARP_HLEN);
+	eth_send->et_protlen = htons(PROT_IP);
+
+	tcp_send = (void *)pkt->data + ETHER_HDR_SIZE;
+	tcp_send->tcp_src = tcp->tcp_dst;
+	tcp_send->tcp_dst = tcp->tcp_src;
+	tcp_send->tcp_seq = htonl(srv.snd_nxt);
+	tcp_send->tcp_ack = htonl(srv.rcv_nxt);
+	tcp_send->tcp_hlen = SHIFT_TO_TCPHDRLEN_FIELD(LEN_B_TO_DW(TCP_HDR_SIZE));
+	tcp_send->tcp_flags = flags;
+	tcp_send->tcp_win = htons(PKTBUFSRX * TCP_MSS >> TCP_SCALE);
+	tcp_send->tcp_xsum = 0;
+	tcp_send->tcp_ugr = 0;
+	memcpy(tcp_send + 1, data, len);
+	tcp_send->tcp_xsum = tcp_set_pseudo_header((uchar *)tcp_send,
+						   tcp->ip_src, tcp->ip_dst,
+						   TCP_HDR_SIZE + len,
+						   IP_TCP_HDR_SIZE + len);
+	net_set_ip_header((uchar *)tcp_send, tcp->ip_src, tcp->ip_dst,
+			  IP_TCP_HDR_SIZE + len, IPPROTO_TCP);
+
+	pkt->len = ETHER_HDR_SIZE + IP_TCP_HDR_SIZE + len;
+	pkt->due = get_timer(0) + NFS_TEST_DELAY;
+	pkt->read = false;
+	srv.snd_nxt += len + !!(flags & TCP_SYN);
+
+	return pkt;
+}
+
+/* Answer an RPC call received over TCP with a record split into segments */
+static void nfs_test_tcp_call(struct udevice *dev, void *packet, u32 *call)
+{
+	struct nfs_test_pkt *pkt = NULL;
+	int words, len, n;
+	uchar *p;
+
+	words = nfs_test_reply(call, srv.reply + 1);
+	if (words < 0)
+		return;
+	srv.reply[0] = htonl(0x80000000 | words * 4);
+
+	p = (uchar *)srv.reply;
+	for (len = 4 + words * 4; len; len -= n, p += n) {
+		n = min(len, TCP_MSS);
+		pkt = nfs_test_tcp_send(dev, packet, TCP_ACK, p, n);
+	}
+
+	if (pkt && ntohl(call[3]) == PROG_NFS && ntohl(call[5]) == NFS_READ) {
+		srv.reads++;
+		srv.inflight++;
+		srv.max_inflight = max(srv.max_inflight, srv.inflight);
+		pkt->read = true;
+	}
+}
+
+static void nfs_test_tcp(struct udevice *dev, void *packet)
+{
+	struct ip_tcp_hdr *tcp = packet + ETHER_HDR_SIZE;
+	int hlen = GET_TCP_HDR_LEN_IN_BYTES(tcp->tcp_hlen);
+	int len = ntohs(tcp->ip_len) - IP_HDR_SIZE - hlen;
+	uchar *stream = (uchar *)srv.stream;
+	u32 rec;
+
+	if (tcp->tcp_flags & TCP_SYN) {
+		srv.conns++;
+		srv.snd_nxt = NFS_TEST_ISN;
+		srv.rcv_nxt = ntohl(tcp->tcp_seq) + 1;
+		srv.stream_len = 0;
+		nfs_test_tcp_send(dev, packet, TCP_SYN | TCP_ACK, NULL, 0);
+		return;
+	}
+
+	/* Nothing is lost, so anything else is an ACK or the FIN */
+	if (len <= 0 || ntohl(tcp->tcp_seq) != srv.rcv_nxt ||
+	    srv.stream_len + len > sizeof(srv.stream))
+		return;
+
+	memcpy(stream + srv.stream_len, (void *)tcp + IP_HDR_SIZE + hlen, len);
+	srv.stream_len += len;
+	srv.rcv_nxt += len;
+
+	while (srv.stream_len >= 4) {
+		rec = 4 + (ntohl(srv.stream[0]) & ~0x80000000);
+		if (srv.stream_len < rec)
+			break;
+		nfs_test_tcp_call(dev, packet, srv.stream + 1);
+		srv.stream_len -= rec;
+		memmove(stream, stream + rec, srv.stream_len);
+	}
+}
+
+static int nfs_test_tx(struct udevice *dev, void *packet, unsigned int len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct ethernet_hdr *eth = packet, *eth_send;
+	struct ip_udp_hdr *ip = packet + ETHER_HDR_SIZE, *ip_send;
+	struct nfs_test_pkt *pkt;
+	int words;
+
+	if (!sandbox_eth_arp_req_to_reply(dev, packet, len))
+		return 0;
+	if (ntohs(eth->et_protlen) != PROT_IP)
+		return 0;
+	if (ip->ip_p == IPPROTO_TCP) {
+		nfs_test_tcp(dev, packet);
+		return 0;
+	}
+	if (ip->ip_p != IPPROTO_UDP || srv.nr_wire >= NFS_TEST_WIRE)
+		return 0;
+
+	pkt = &srv.wire[srv.nr_wire];
+	eth_send = (void *)pkt->data;
+	ip_send = (void *)pkt->data + ETHER_HDR_SIZE;
+	words = nfs_test_reply((u32 *)(ip + 1), (u32 *)(ip_send + 1));
+	if (words < 0)
+		return 0;
+
+	pkt->read = ntohl(((u32 *)(ip + 1))[3]) == PROG_NFS &&
+		    ntohl(((u32 *)(ip + 1))[5]) == NFS_READ;
+	if (pkt->read) {
+		srv.reads++;
+		if (srv.drop_every && !(srv.reads % srv.drop_every))
+			return 0;
+		srv.inflight++;
+		srv.max_inflight = max(srv.max_inflight, srv.inflight);
+	}
+
+	memcpy(eth_send->et_dest, eth->et_src, ARP_HLEN);
+	memcpy(eth_send->et_src, priv->fake_host_hwaddr, ARP_HLEN);
+	eth_send->et_protlen = htons(PROT_IP);
+	net_set_ip_header((uchar *)ip_send, ip->ip_src, ip->ip_dst,
+			  IP_UDP_HDR_SIZE + words * 4, IPPROTO_UDP);
+	ip_send->udp_src = ip->udp_dst;
+	ip_send->udp_dst = ip->udp_src;
+	ip_send->udp_len = htons(UDP_HDR_SIZE + words * 4);
+	ip_send->udp_xsum = 0;
+	pkt->len = ETHER_HDR_SIZE + IP_UDP_HDR_SIZE + words * 4;
+	pkt->due = get_timer(0) + NFS_TEST_DELAY;
+	srv.nr_wire++;
+
+	return 0;
+}
+
+/* Deliver the replies which have arrived, skipping ahead to the next one */
+static void nfs_test_poll(struct udevice *dev)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct nfs_test_pkt *pkt = &srv.wire[0];
+	ulong now = get_timer(0);
+
+	if (!srv.nr_wire) {
+		/* Only a timeout can happen next */
+		timer_test_add_offset(1);
+		return;
+	}
+
+	if (pkt->due > now && !priv->recv_packets)
+		timer_test_add_offset(pkt->due - now);
+
+	while (srv.nr_wire && priv->recv_packets < PKTBUFSRX &&
+	       srv.wire[0].due <= get_timer(0)) {
+		memcpy(priv->recv_packet_buffer[priv->recv_packets], pkt->data,
+		       pkt->len);
+		priv->recv_packet_length[priv->recv_packets++] = pkt->len;
+		if (pkt->read)
+			srv.inflight--;
+		memmove(pkt, pkt + 1, --srv.nr_wire * sizeof(*pkt));
+	}
+}
+
+/*
+ * Load the file with a given window size and loss rate, over TCP if @tcp and
+ * the nfs command supports it, returns the time
+ */
+static int nfs_test_load(struct unit_test_state *uts, int window, bool tcp,
+			 int drop_every, ulong *timep)
+{
+	ulong start;
+	u8 *buf;
+	int i;
+
+	memset(&srv, '\0', sizeof(srv));
+	srv.drop_every = drop_every;
+	srv.tcp = tcp;
+	env_set_ulong("nfswindowsize", window);
+
+	buf = map_sysmem(0x20000, NFS_TEST_SIZE);
+	memset(buf, '\0', NFS_TEST_SIZE);
+	start = get_timer(0);
+	ut_assertok(run_command("nfs 0x20000 192.0.2.2:/export/image", 0));
+	*timep = get_timer(start);
+
+	ut_asserteq(NFS_TEST_SIZE, env_get_hex("filesize", 0));
+	for (i = 0; i < NFS_TEST_SIZE; i++)
+		ut_asserteq(nfs_test_byte(i), buf[i]);
+	unmap_sysmem(buf);
+	printf("%s, window %d, losing 1 in %d: %lu ms, %lu KiB/s, %d in flight\n",
+	       srv.conns ? "TCP" : "UDP", window, drop_every, *timep,
+	       NFS_TEST_SIZE / 1024 * 1000 / max(*timep, 1UL),
+	       srv.max_inflight);
+
+	return 0;
+}
+
+static int net_test_nfs_window(struct unit_test_state *uts)
+{
+	ulong serial, windowed, lossy;
+
+	sandbox_eth_set_tx_handler(0, nfs_test_tx);
+	sandbox_eth_set_poll_handler(0, nfs_test_poll);
+	env_set("ethact", "eth@10002000");
+	env_set("ethrotate", "no");
+
+	ut_assertok(nfs_test_load(uts, 1, false, 0, &serial));
+	ut_asserteq(1, srv.max_inflight);
+
+	ut_assertok(nfs_test_load(uts, 8, false, 0, &windowed));
+	ut_asserteq(8, srv.max_inflight);
+	ut_assert(windowed * 4 < serial);
+
+	/* Lost replies are asked for again and the window shrinks */
+	ut_assertok(nfs_test_load(uts, 8, false, 10, &lossy));
+	ut_assert(srv.max_inflight > 1);
+	ut_assert(lossy < serial);
+
+	sandbox_eth_set_poll_handler(0, NULL);
+	sandbox_eth_set_tx_handler(0, NULL);
+	env_set("nfswindowsize", NULL);
+
+	return 0;
+}
+LIB_TEST(net_test_nfs_window, 0);
+
+static int net_test_nfs_tcp(struct unit_test_state *uts)
+{
+	ulong udp, tcp;
+
+	if (!IS_ENABLED(CONFIG_NFS_TCP))
+		return -EAGAIN;
+
+	sandbox_eth_set_tx_handler(0, nfs_test_tx);
+	sandbox_eth_set_poll_handler(0, nfs_test_poll);
+	env_set("ethact", "eth@10002000");
+	env_set("ethrotate", "no");
+
+	/* Without NFS over TCP in the portmapper, UDP is used */
+	ut_assertok(nfs_test_load(uts, 4, false, 0, &udp));
+	ut_asserteq(0, srv.conns);
+	ut_asserteq(NFS_READ_SIZE, srv.max_count);
+
+	/* Over TCP, large READ requests are pipelined on one connection */
+	ut_assertok(nfs_test_load(uts, 4, true, 0, &tcp));
+	ut_asserteq(1, srv.conns);
+	ut_asserteq(NFS_TCP_READ_SIZE, srv.max_count);
+	ut_asserteq(4, srv.max_inflight);
+	ut_assert(tcp * 4 < udp);
+
+	sandbox_eth_set_poll_handler(0, NULL);
+	sandbox_eth_set_tx_handler(0, NULL);
+	env_set("nfswindowsize", NULL);
+
+	return 0;
+}
+LIB_TEST(net_test_nfs_tcp, 0);
@@ -0,0 +1,455 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Copyright (C) 2024 Intel Corporation <www.intel.com>
+ *
+ * Tests for TFTP against a simulated server, which sends the file in windows
+ * (RFC 7440) or to a group of clients, U-Boot and virtual ones (RFC 2090), and
+ * loses some of the packets it sends.
+ */
+
+#include <common.h>
+#include <command.h>
+#include <dm.h>
+#include <env.h>
+#include <mapmem.h>
+#include <net.h>
+#include <time.h>
+#include <asm/eth.h>
+#include <linux/sizes.h>
+#include <test/lib.h>
+#include <test/test.h>
+#include <test/ut.h>
+
+#define TFTP_TEST_SIZE		(SZ_64K + 0x123)
+#define TFTP_TEST_BLKSIZE	512
+#define TFTP_TEST_BLOCKS	(TFTP_TEST_SIZE / TFTP_TEST_BLKSIZE + 1)
+#define TFTP_TEST_PORT		3456
+#define TFTP_TEST_MCAST_PORT	1758
+#define TFTP_TEST_GROUP		"239.255.0.1"
+#define TFTP_TEST_WIRE		512
+#define TFTP_TEST_CLIENTS	4
+
+#define TFTP_TEST_RRQ		1
+#define TFTP_TEST_DATA		3
+#define TFTP_TEST_ACK		4
+#define TFTP_TEST_OACK		6
+
+/**
+ * struct tftp_test_pkt - a packet on its way to U-Boot
+ *
+ * @data:	Packet, including the Ethernet header
+ * @len:	Length of the packet
+ */
+struct tftp_test_pkt {
+	uchar data[PKTSIZE_ALIGN];
+	int len;
+};
+
+/**
+ * struct tftp_test_server - state of the simulated server
+ *
+ * @wire:	Packets on their way, a ring starting at @head
+ * @head:	First packet in @wire
+ * @nr_wire:	Number of packets in @wire
+ * @drop_every:	Lose every this many data packets, 0 to lose none
+ * @burst:	Lose the data packets after this many in a window, 0 for none
+ * @asked:	Window size U-Boot asked for, 0 if none
+ * @window:	Window size agreed
+ * @other_from:	Block the virtual clients are at as U-Boot joins, 0 for none
+ * @clients:	Number of virtual clients, each losing its own blocks
+ * @got:	Blocks each virtual client has, a bit each
+ * @uboot:	Blocks delivered to U-Boot, a bit each
+ * @mcast:	U-Boot asked for multicast
+ * @master:	U-Boot is the master client
+ * @joined:	U-Boot was in the group when acknowledging a block
+ * @done:	U-Boot acknowledged the last block
+ * @sent:	Data packets sent, lost or not
+ * @lost:	Data packets lost
+ * @repairs:	Data packets sent since U-Boot became the master client
+ * @missing:	Blocks U-Boot was missing as it became the master client
+ * @relost:	Data packets lost since U-Boot became the master client
+ * @client_hwaddr: MAC address of U-Boot
+ * @client_ip:	IP address of U-Boot
+ * @client_port: UDP port of U-Boot
+ * @server_ip:	IP address of the server
+ */
+static struct tftp_test_server {
+	struct tftp_test_pkt wire[TFTP_TEST_WIRE];
+	int head;
+	int nr_wire;
+	int drop_every;
+	int burst;
+	int asked;
+	int window;
+	int other_from;
+	int clients;
+	unsigned long got[TFTP_TEST_CLIENTS][BITS_TO_LONGS(TFTP_TEST_BLOCKS + 1)];
+	unsigned long uboot[BITS_TO_LONGS(TFTP_TEST_BLOCKS + 1)];
+	bool mcast;
+	bool master;
+	bool joined;
+	bool done;
+	int sent;
+	int lost;
+	int repairs;
+	int missing;
+	int relost;
+	uchar client_hwaddr[ARP_HLEN];
+	struct in_addr client_ip;
+	int client_port;
+	struct in_addr server_ip;
+} srv;
+
+static const uchar tftp_test_group_hwaddr[ARP_HLEN] = {
+	0x01, 0x00, 0x5e, 0x7f, 0x00, 0x01
+};
+
+static bool tftp_test_has(const unsigned long *map, int block)
+{
+	return map[BIT_WORD(block)] & BIT_MASK(block);
+}
+
+static u8 tftp_test_byte(ulong offset)
+{
+	return offset * 3 + (offset >> 9);
+}
+
+/* Queue a UDP packet from the server to U-Boot or to the group */
+static void tftp_test_send(struct udevice *dev, bool group, const void *data,
+			   int len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct tftp_test_pkt *pkt;
+	struct ethernet_hdr *eth;
+	struct ip_udp_hdr *ip;
+	struct in_addr dest;
+
+	if (srv.nr_wire >= TFTP_TEST_WIRE)
+		return;
+
+	pkt = &srv.wire[(srv.head + srv.nr_wire++) % TFTP_TEST_WIRE];
+	eth = (void *)pkt->data;
+	memcpy(eth->et_dest, group ? tftp_test_group_hwaddr : srv.client_hwaddr,
+	       ARP_HLEN);
+	memcpy(eth->et_src, priv->fake_host_hwaddr, ARP_HLEN);
+	eth->et_protlen = htons(PROT_IP);
+
+	ip = (void *)pkt->data + ETHER_HDR_SIZE;
+	dest = group ? string_to_ip(TFTP_TEST_GROUP) : srv.client_ip;
+	net_set_ip_header((uchar *)ip, dest, srv.server_ip,
+			  IP_UDP_HDR_SIZE + len, IPPROTO_UDP);
+	ip->udp_src = htons(TFTP_TEST_PORT);
+	ip->udp_dst = htons(group ? TFTP_TEST_MCAST_PORT : srv.client_port);
+	ip->udp_len = htons(UDP_HDR_SIZE + len);
+	ip->udp_xsum = 0;
+	memcpy(ip + 1, data, len);
+	pkt->len = ETHER_HDR_SIZE + IP_UDP_HDR_SIZE + len;
+}
+
+/* Send a block, to the group with multicast, unless it is lost */
+static void tftp_test_data(struct udevice *dev, int block, bool lose)
+{
+	uchar data[4 + TFTP_TEST_BLKSIZE];
+	ulong offset = (block - 1) * TFTP_TEST_BLKSIZE;
+	int i, len;
+
+	srv.sent++;
+	/* Each virtual client loses a different set of blocks */
+	for (i = 0; i < srv.clients; i++) {
+		if ((srv.sent + i) % (i + 3))
+			generic_set_bit(block, srv.got[i]);
+	}
+	if (srv.master && srv.other_from)
+		srv.repairs++;
+	if (lose || (srv.drop_every && !(srv.sent % srv.drop_every))) {
+		srv.lost++;
+		if (srv.master && srv.other_from)
+			srv.relost++;
+		return;
+	}
+	generic_set_bit(block, srv.uboot);
+
+	len = min_t(int, TFTP_TEST_BLKSIZE, TFTP_TEST_SIZE - offset);
+	data[0] = 0;
+	data[1] = TFTP_TEST_DATA;
+	data[2] = block >> 8;
+	data[3] = block;
+	for (i = 0; i < len; i++)
+		data[4 + i] = tftp_test_byte(offset + i);
+	tftp_test_send(dev, srv.mcast, data, 4 + len);
+}
+
+/* Answer a read request with the options, as one client of the group */
+static void tftp_test_rrq(struct udevice *dev, const char *opt, int len)
+{
+	char oack[128];
+	int block, i, n;
+
+	oack[0] = 0;
+	oack[1] = TFTP_TEST_OACK;
+	/* The file name and the mode come first, then the options and values */
+	for (i = 0; len > 0; i++) {
+		n = strnlen(opt, len) + 1;
+		if (i >= 2 && !(i % 2)) {
+			if (!strcmp(opt, "multicast"))
+				srv.mcast = true;
+			if (!strcmp(opt, "windowsize") && n < len)
+				srv.asked = dectoul(opt + n, NULL);
+		}
+		opt += n;
+		len -= n;
+	}
+	n = 2;
+	n += sprintf(oack + n, "blksize%c%d%c", 0, TFTP_TEST_BLKSIZE, 0);
+	n += sprintf(oack + n, "tsize%c%d%c", 0, TFTP_TEST_SIZE, 0);
+	srv.window = 1;
+	if (srv.asked && !srv.mcast) {
+		srv.window = srv.asked;
+		n += sprintf(oack + n, "windowsize%c%d%c", 0, srv.window, 0);
+	}
+	if (srv.mcast)
+		n += sprintf(oack + n, "multicast%c%s,%d,%d%c", 0,
+			     TFTP_TEST_GROUP, TFTP_TEST_MCAST_PORT,
+			     !srv.other_from, 0);
+	tftp_test_send(dev, false, oack, n);
+	if (!srv.mcast || !srv.other_from)
+		return;
+
+	/* U-Boot overhears the rest of the file sent to the other clients */
+	for (block = srv.other_from; block <= TFTP_TEST_BLOCKS; block++)
+		tftp_test_data(dev, block, false);
+
+	/* Each virtual client in turn is master and asks for its gaps */
+	for (i = 0; i < srv.clients; i++) {
+		for (block = 1; block <= TFTP_TEST_BLOCKS; block++) {
+			while (!tftp_test_has(srv.got[i], block))
+				tftp_test_data(dev, block, false);
+		}
+	}
+
+	/* Then all the others are done, so U-Boot becomes the master client */
+	for (block = 1; block <= TFTP_TEST_BLOCKS; block++)
+		srv.missing += !tftp_test_has(srv.uboot, block);
+	n = 2 + sprintf(oack + 2, "multicast%c,,1%c", 0, 0);
+	tftp_test_send(dev, false, oack, n);
+	srv.master = true;
+}
+
+/* Answer an ACK with the next window, losing its end past the burst */
+static void tftp_test_ack(struct udevice *dev, int block)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	int i;
+
+	if (block == (TFTP_TEST_BLOCKS & 0xffff)) {
+		srv.done = true;
+		return;
+	}
+	if (!srv.master)
+		return;
+	if (srv.mcast && !memcmp(priv->mcast_hwaddr, tftp_test_group_hwaddr,
+				 ARP_HLEN))
+		srv.joined = true;
+
+	for (i = 1; i <= srv.window && block + i <= TFTP_TEST_BLOCKS; i++)
+		tftp_test_data(dev, block + i, srv.burst && i > srv.burst);
+}
+
+static int tftp_test_tx(struct udevice *dev, void *packet, unsigned int len)
+{
+	struct ethernet_hdr *eth = packet;
+	struct ip_udp_hdr *ip = packet + ETHER_HDR_SIZE;
+	uchar *data = (uchar *)(ip + 1);
+	int op;
+
+	if (!sandbox_eth_arp_req_to_reply(dev, packet, len))
+		return 0;
+	if (ntohs(eth->et_protlen) != PROT_IP || ip->ip_p != IPPROTO_UDP)
+		return 0;
+
+	op = data[0] << 8 | data[1];
+	if (op == TFTP_TEST_RRQ) {
+		memcpy(srv.client_hwaddr, eth->et_src, ARP_HLEN);
+		srv.client_ip = net_read_ip(&ip->ip_src);
+		srv.client_port = ntohs(ip->udp_src);
+		srv.server_ip = net_read_ip(&ip->ip_dst);
+		tftp_test_rrq(dev, (char *)data + 2,
+			      ntohs(ip->udp_len) - UDP_HDR_SIZE - 2);
+	} else if (op == TFTP_TEST_ACK &&
+		   ntohs(ip->udp_dst) == TFTP_TEST_PORT) {
+		tftp_test_ack(dev, data[2] << 8 | data[3]);
+	}
+
+	return 0;
+}
+
+/* Deliver the packets on the wire, or let time pass for a timeout */
+static void tftp_test_poll(struct udevice *dev)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct tftp_test_pkt *pkt;
+
+	if (!srv.nr_wire) {
+		timer_test_add_offset(100);
+		return;
+	}
+
+	while (srv.nr_wire && priv->recv_packets < PKTBUFSRX) {
+		pkt = &srv.wire[srv.head];
+		memcpy(priv->recv_packet_buffer[priv->recv_packets], pkt->data,
+		       pkt->len);
+		priv->recv_packet_length[priv->recv_packets++] = pkt->len;
+		srv.head = (srv.head + 1) % TFTP_TEST_WIRE;
+		srv.nr_wire--;
+	}
+}
+
+/* Load the file and check it */
+static int tftp_test_load(struct unit_test_state *uts, int other_from,
+			  int clients, int drop_every, int burst)
+{
+	struct udevice *dev;
+	struct eth_sandbox_priv *priv;
+	u8 *buf;
+	int c, i;
+
+	memset(&srv, '\0', sizeof(srv));
+	srv.master = !other_from;
+	srv.other_from = other_from;
+	srv.clients = clients;
+	/* The virtual clients have what was sent before U-Boot joined */
+	for (i = 1; i < other_from; i++) {
+		for (c = 0; c < clients; c++)
+			generic_set_bit(i, srv.got[c]);
+	}
+	srv.drop_every = drop_every;
+	srv.burst = burst;
+
+	buf = map_sysmem(0x20000, TFTP_TEST_SIZE);
+	memset(buf, '\0', TFTP_TEST_SIZE);
+	ut_assertok(run_command("tftpboot 0x20000 192.0.2.2:image", 0));
+
+	ut_asserteq(TFTP_TEST_SIZE, env_get_hex("filesize", 0));
+	for (i = 0; i < TFTP_TEST_SIZE; i++)
+		ut_asserteq(tftp_test_byte(i), buf[i]);
+	unmap_sysmem(buf);
+	ut_assert(srv.done);
+
+	/* The group is left */
+	ut_assertok(uclass_get_device_by_name(UCLASS_ETH, "eth@10002000",
+					      &dev));
+	priv = dev_get_priv(dev);
+	ut_assert(!priv->mcast_hwaddr[0]);
+
+	return 0;
+}
+
+static int net_test_tftp_mcast(struct unit_test_state *uts)
+{
+	if (!IS_ENABLED(CONFIG_TFTP_MULTICAST))
+		return -EAGAIN;
+
+	sandbox_eth_set_tx_handler(0, tftp_test_tx);
+	sandbox_eth_set_poll_handler(0, tftp_test_poll);
+	env_set("ethact", "eth@10002000");
+	env_set("ethrotate", "no");
+
+	/* As master client from the start, lost blocks are asked for again */
+	ut_assertok(tftp_test_load(uts, 0, 0, 7, 0));
+	ut_assert(srv.mcast);
+	ut_assert(srv.joined);
+	ut_assert(srv.lost);
+	ut_asserteq(TFTP_TEST_BLOCKS + srv.lost, srv.sent);
+
+	/*
+	 * Joining while the server sends the second half of the file to
+	 * another client, U-Boot keeps what it overhears and then asks only
+	 * for the blocks it is missing
+	 */
+	ut_assertok(tftp_test_load(uts, TFTP_TEST_BLOCKS / 2, 0, 5, 0));
+	ut_assert(srv.joined);
+	ut_assert(srv.lost > 1);
+	ut_asserteq(TFTP_TEST_BLOCKS + srv.lost, srv.sent);
+	ut_asserteq(TFTP_TEST_BLOCKS / 2 - 1 + srv.lost, srv.repairs);
+
+	/*
+	 * With other clients in the group from the start, each losing its
+	 * own blocks and then repairing them as master client, the server
+	 * sends the file well under twice rather than once to each of them.
+	 * U-Boot only asks for the blocks none of the others asked for.
+	 */
+	ut_assertok(tftp_test_load(uts, 1, TFTP_TEST_CLIENTS, 7, 0));
+	ut_assert(srv.joined);
+	ut_assert(srv.missing);
+	ut_asserteq(srv.missing + srv.relost, srv.repairs);
+	ut_assert(srv.sent < 2 * TFTP_TEST_BLOCKS);
+
+	/* Without multicast, the server sends to U-Boot alone */
+	env_set("tftpmulticast", "no");
+	ut_assertok(tftp_test_load(uts, 0, 0, 0, 0));
+	ut_assert(!srv.mcast);
+	ut_asserteq(TFTP_TEST_BLOCKS, srv.sent);
+	env_set("tftpmulticast", NULL);
+
+	sandbox_eth_set_poll_handler(0, NULL);
+	sandbox_eth_set_tx_handler(0, NULL);
+
+	return 0;
+}
+LIB_TEST(net_test_tftp_mcast, 0);
+
+static int net_test_tftp_window(struct unit_test_state *uts)
+{
+	ulong start;
+	int i;
+
+	if (!IS_ENABLED(CONFIG_TFTP_WINDOWSIZE_ADAPTIVE))
+		return -EAGAIN;
+
+	sandbox_eth_set_tx_handler(0, tftp_test_tx);
+	sandbox_eth_set_poll_handler(0, tftp_test_poll);
+	env_set("ethact", "eth@10002000");
+	env_set("ethrotate", "no");
+	env_set("tftpmulticast", "no");
+
+	/* Clean downloads grow the window size up to the largest */
+	for (i = 0; i < CONFIG_TFTP_WINDOWSIZE_MAX; i++) {
+		ut_assertok(tftp_test_load(uts, 0, 0, 0, 0));
+		ut_asserteq(TFTP_TEST_BLOCKS, srv.sent);
+		if (srv.asked == CONFIG_TFTP_WINDOWSIZE_MAX)
+			break;
+	}
+	ut_asserteq(CONFIG_TFTP_WINDOWSIZE_MAX, srv.asked);
+
+	/*
+	 * Past 12 blocks in a row, blocks are lost; the end of each window is
+	 * asked for again well before the TFTP timeout
+	 */
+	start = get_timer(0);
+	ut_assertok(tftp_test_load(uts, 0, 0, 0, 12));
+	ut_assert(srv.lost);
+	ut_assert(get_timer(start) < 5000);
+
+	/* So the window size is halved until no more blocks are lost */
+	ut_assertok(tftp_test_load(uts, 0, 0, 0, 12));
+	ut_asserteq(CONFIG_TFTP_WINDOWSIZE_MAX / 2, srv.asked);
+	ut_assert(srv.lost);
+	ut_assertok(tftp_test_load(uts, 0, 0, 0, 12));
+	ut_asserteq(CONFIG_TFTP_WINDOWSIZE_MAX / 4, srv.asked);
+	ut_asserteq(0, srv.lost);
+	ut_assertok(tftp_test_load(uts, 0, 0, 0, 12));
+	ut_asserteq(CONFIG_TFTP_WINDOWSIZE_MAX / 4 + 1, srv.asked);
+
+	/* A window size set in the environment is kept to */
+	env_set("tftpwindowsize", "4");
+	ut_assertok(tftp_test_load(uts, 0, 0, 0, 0));
+	ut_asserteq(4, srv.asked);
+	env_set("tftpwindowsize", NULL);
+	env_set("tftpmulticast", NULL);
+
+	sandbox_eth_set_poll_handler(0, NULL);
+	sandbox_eth_set_tx_handler(0, NULL);
+
+	return 0;
+}
+LIB_TEST(net_test_tftp_window, 0);
@@ -7,16 +7,26 @@
  */
 
 #include <common.h>
+#include <blk.h>
+#include <blkmap.h>
 #include <command.h>
 #include <dm.h>
 #include <env.h>
 #include <fdtdec.h>
+#include <gzip.h>
+#include <hash.h>
 #include <log.h>
 #include <malloc.h>
+#include <mapmem.h>
 #include <net.h>
+#include <sparse_format.h>
+#include <time.h>
+#include <linux/ctype.h>
+#include <linux/sizes.h>
 #include <net/tcp.h>
 #include <net/wget.h>
 #include <asm/eth.h>
+#include <asm/unaligned.h>
 #include <dm/test.h>
 #include <dm/device-internal.h>
 #include <dm/uclass-internal.h>
@@ -25,6 +35,7 @@
 #include <test/ut.h>
 
 #define SHIFT_TO_TCPHDRLEN_FIELD(x) ((x) << 4)
+#define GET_TCP_HDR_LEN_IN_BYTES(x) ((x) >> 2)
 #define LEN_B_TO_DW(x) ((x) >> 2)
 
 static int sb_arp_handler(struct udevice *dev, void *packet,
@@ -104,7 +115,7 @@ static int sb_ack_handler(struct udevice *dev, void *packet,
 	int pkt_len;
 	int payload_len = 0;
 	const char *payload1 = "HTTP/1.1 200 OK\r\n"
-		"Content-Length: 30\r\n\r\n\r\n"
+		"Content-Length: 32\r\n\r\n\r\n"
 		"<html><body>Hi</body></html>\r\n";
 
 	/* Don't allow the buffer to overrun */
@@ -204,3 +215,713 @@ static int net_test_wget(struct unit_test_state *uts)
 }
 
 LIB_TEST(net_test_wget, 0);
+
+#define WGET_TEST_SIZE		(SZ_1M + 0x123)
+#define WGET_TEST_WIRE		256
+#define WGET_TEST_DELAY		5
+#define WGET_TEST_RTO		200
+#define WGET_TEST_ISN		5000
+#define WGET_TEST_DROP		20
+#define WGET_TEST_SEGS		(WGET_TEST_SIZE / TCP_MSS + 2)
+#define WGET_TEST_CONNS		16
+#define WGET_TEST_ROOM		32	/* Left on the wire for the rest */
+#define WGET_TEST_DISK		0x1000000	/* Memory of the test disk */
+#define WGET_TEST_DISK_BLKS	0x1000
+
+/**
+ * struct wget_test_pkt - a segment on its way to U-Boot
+ *
+ * @data:	Packet, including the Ethernet header
+ * @len:	Length of the packet
+ * @due:	Time at which the packet arrives
+ */
+struct wget_test_pkt {
+	uchar data[PKTSIZE_ALIGN];
+	int len;
+	ulong due;
+};
+
+/**
+ * struct wget_test_conn - state of a connection to the simulated HTTP server
+ *
+ * Stream offsets count from the first byte of the HTTP reply.
+ *
+ * @req:	Headers of the last packet from U-Boot, to answer it later
+ * @hdr:	HTTP reply header
+ * @hdr_len:	Length of @hdr
+ * @first:	Offset in the file of the first byte sent
+ * @total:	Length of the HTTP reply
+ * @scale:	Window scale U-Boot asked for, -1 if none
+ * @get:	The GET request has been received
+ * @open:	Neither a FIN nor a reset came from U-Boot yet
+ * @stalled:	Nothing is sent any more
+ * @rcv_nxt:	Sequence number of the next byte expected from U-Boot
+ * @una:	Stream offset of the first byte not acknowledged
+ * @nxt:	Stream offset of the next byte never sent
+ * @win:	Receive window last offered by U-Boot
+ * @last_ack:	Acknowledgment number last received
+ * @dup_acks:	Number of times in a row @last_ack was received again
+ * @last_tx:	Time a segment was last sent
+ * @lost:	Segments whose first copy was dropped, not sent again yet
+ * @late:	The last segment sent is to be overtaken by the next one
+ * @fin:	The FIN has been sent
+ */
+struct wget_test_conn {
+	uchar req[ETHER_HDR_SIZE + IP_TCP_HDR_SIZE];
+	char hdr[120];
+	int hdr_len;
+	u32 first;
+	u32 total;
+	int scale;
+	bool get;
+	bool open;
+	bool stalled;
+	u32 rcv_nxt;
+	u32 una;
+	u32 nxt;
+	u32 win;
+	u32 last_ack;
+	int dup_acks;
+	ulong last_tx;
+	bool lost[WGET_TEST_SEGS];
+	bool late;
+	bool fin;
+};
+
+/**
+ * struct wget_test_server - state of the simulated HTTP server
+ *
+ * @wire:	Segments on their way, in the order they arrive
+ * @nr_wire:	Number of segments in @wire
+ * @conns:	Connections, in the order U-Boot opened them
+ * @ports:	Port of U-Boot for each of @conns
+ * @nr_conns:	Number of @conns
+ * @ranges:	Range requests are answered with the part asked for
+ * @stall:	The connection which is to send the byte at this offset in the
+ *		file stops sending instead, 0 for none
+ * @nr_ranges:	Number of Range requests received
+ * @range_off:	Offset in the file of the last part asked for
+ * @max_open:	Highest number of connections open at once
+ * @segs:	Data segments sent
+ * @acks:	Acknowledgments received for data
+ * @max_flight:	Highest number of bytes sent and not acknowledged
+ * @bad_sack:	SACK blocks claiming data which was never delivered
+ * @file:	File sent, NULL for the test pattern of WGET_TEST_SIZE bytes
+ * @size:	Size of @file
+ * @sink:	The file goes to storage rather than memory
+ */
+static struct wget_test_server {
+	struct wget_test_pkt wire[WGET_TEST_WIRE];
+	int nr_wire;
+	struct wget_test_conn conns[WGET_TEST_CONNS];
+	u16 ports[WGET_TEST_CONNS];
+	int nr_conns;
+	bool ranges;
+	u32 stall;
+	int nr_ranges;
+	u32 range_off;
+	int max_open;
+	int segs;
+	int acks;
+	u32 max_flight;
+	int bad_sack;
+	u8 *file;
+	ulong size;
+	bool sink;
+} srv;
+
+static u8 wget_test_pattern(ulong offset)
+{
+	return offset * 3 + (offset >> 11);
+}
+
+static u8 wget_test_byte(ulong offset)
+{
+	return srv.file ? srv.file[offset] : wget_test_pattern(offset);
+}
+
+static ulong wget_test_size(void)
+{
+	return srv.file ? srv.size : WGET_TEST_SIZE;
+}
+
+/* Some segments arrive after the next one */
+static bool wget_test_late(int seg)
+{
+	return seg % 64 == 7;
+}
+
+/* Queue a segment in answer to the last packet on @c */
+static void wget_test_send(struct udevice *dev, struct wget_test_conn *c,
+			   u8 flags, u32 off, int len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct ethernet_hdr *eth = (void *)c->req, *eth_send;
+	struct ip_tcp_hdr *tcp = (void *)c->req + ETHER_HDR_SIZE, *tcp_send;
+	int hlen = TCP_HDR_SIZE;
+	struct wget_test_pkt *pkt;
+	uchar *data;
+	int i;
+
+	if (srv.nr_wire >= WGET_TEST_WIRE)
+		return;
+
+	pkt = &srv.wire[srv.nr_wire++];
+	eth_send = (void *)pkt->data;
+	memcpy(eth_send->et_dest, eth->et_src, ARP_HLEN);
+	memcpy(eth_send->et_src, priv->fake_host_hwaddr, ARP_HLEN);
+	eth_send->et_protlen = htons(PROT_IP);
+
+	tcp_send = (void *)pkt->data + ETHER_HDR_SIZE;
+	data = (uchar *)(tcp_send + 1);
+	if (flags & TCP_SYN) {
+		/* NOP and a window scale of 0 */
+		memcpy(data, "\x01\x03\x03\x00", 4);
+		hlen += 4;
+		data += 4;
+	}
+	for (i = 0; i < len; i++) {
+		if (off + i < c->hdr_len)
+			data[i] = c->hdr[off + i];
+		else
+			data[i] = wget_test_byte(c->first + off + i -
+						 c->hdr_len);
+	}
+
+	tcp_send->tcp_src = tcp->tcp_dst;
+	tcp_send->tcp_dst = tcp->tcp_src;
+	tcp_send->tcp_seq = htonl(WGET_TEST_ISN + !(flags & TCP_SYN) + off);
+	tcp_send->tcp_ack = htonl(c->rcv_nxt);
+	tcp_send->tcp_hlen = SHIFT_TO_TCPHDRLEN_FIELD(LEN_B_TO_DW(hlen));
+	tcp_send->tcp_flags = flags;
+	tcp_send->tcp_win = htons(U16_MAX);
+	tcp_send->tcp_xsum = 0;
+	tcp_send->tcp_ugr = 0;
+	tcp_send->tcp_xsum = tcp_set_pseudo_header((uchar *)tcp_send,
+						   tcp->ip_src, tcp->ip_dst,
+						   hlen + len,
+						   IP_HDR_SIZE + hlen + len);
+	net_set_ip_header((uchar *)tcp_send, tcp->ip_src, tcp->ip_dst,
+			  IP_HDR_SIZE + hlen + len, IPPROTO_TCP);
+
+	pkt->len = ETHER_HDR_SIZE + IP_HDR_SIZE + hlen + len;
+	pkt->due = get_timer(0) + WGET_TEST_DELAY;
+	c->last_tx = get_timer(0);
+}
+
+static void wget_test_send_seg(struct udevice *dev, struct wget_test_conn *c,
+			       u32 off)
+{
+	int seg = off / TCP_MSS;
+	int len = min_t(u32, TCP_MSS, c->total - off);
+	int n = srv.nr_wire;
+
+	if (c->stalled)
+		return;
+	wget_test_send(dev, c, TCP_ACK, off, len);
+	srv.segs++;
+
+	/* A late segment is overtaken by the one sent after it */
+	if (c->late && n == srv.nr_wire - 1 && n)
+		swap(srv.wire[n - 1], srv.wire[n]);
+	c->late = wget_test_late(seg);
+}
+
+/*
+ * Send new data as far as the window allows, then the FIN. New data leaves
+ * room on the wire for segments sent again and for answers.
+ */
+static void wget_test_push(struct udevice *dev, struct wget_test_conn *c)
+{
+	int seg, len;
+
+	if (!c->get || c->stalled)
+		return;
+
+	while (c->nxt < c->total &&
+	       srv.nr_wire < WGET_TEST_WIRE - WGET_TEST_ROOM) {
+		seg = c->nxt / TCP_MSS;
+		len = min_t(u32, TCP_MSS, c->total - c->nxt);
+		if (c->nxt + len - c->una > c->win)
+			break;
+		/* The connection dies, or the network to it */
+		if (srv.stall && c->nxt >= c->hdr_len &&
+		    c->first + c->nxt - c->hdr_len >= srv.stall) {
+			srv.stall = 0;
+			c->stalled = true;
+			return;
+		}
+		if (seg == WGET_TEST_DROP)
+			c->lost[seg] = true;
+		else
+			wget_test_send_seg(dev, c, c->nxt);
+		c->nxt += len;
+		srv.max_flight = max(srv.max_flight, c->nxt - c->una);
+	}
+
+	if (c->una == c->total && !c->fin) {
+		wget_test_send(dev, c, TCP_ACK | TCP_FIN, c->total, 0);
+		c->fin = true;
+	}
+}
+
+/* Check that SACK blocks only hold data which was delivered */
+static void wget_test_sack(struct wget_test_conn *c, u8 *opt, int len)
+{
+	u32 l, r;
+	int i, seg;
+
+	while (len > 1 && opt[0] != TCP_O_END) {
+		if (opt[0] == TCP_1_NOP) {
+			opt++;
+			len--;
+			continue;
+		}
+		for (i = 2; opt[0] == TCP_V_SACK && i + 8 <= opt[1]; i += 8) {
+			l = get_unaligned_be32(opt + i) - WGET_TEST_ISN - 1;
+			r = get_unaligned_be32(opt + i + 4) - WGET_TEST_ISN - 1;
+			for (seg = l / TCP_MSS; seg * TCP_MSS < r; seg++) {
+				if (c->lost[seg])
+					srv.bad_sack++;
+			}
+		}
+		len -= opt[1];
+		opt += opt[1];
+	}
+}
+
+/* Answer the GET request in @req, with the part asked for if ranges are on */
+static void wget_test_get(struct wget_test_conn *c, char *req)
+{
+	ulong first = 0, end = wget_test_size();
+	char *range = strstr(req, "\r\nRange: bytes=");
+	char *pos;
+
+	if (range) {
+		srv.nr_ranges++;
+		first = simple_strtoul(range + 15, &pos, 10);
+		if (isdigit(pos[1]))
+			end = simple_strtoul(pos + 1, NULL, 10) + 1;
+		srv.range_off = first;
+	}
+
+	if (range && srv.ranges) {
+		c->hdr_len = snprintf(c->hdr, sizeof(c->hdr),
+				      "HTTP/1.1 206 Partial Content\r\n"
+				      "Content-Range: bytes %lu-%lu/%lu\r\n"
+				      "Content-Length: %lu\r\n\r\n",
+				      first, end - 1, wget_test_size(),
+				      end - first);
+	} else {
+		first = 0;
+		end = wget_test_size();
+		c->hdr_len = snprintf(c->hdr, sizeof(c->hdr),
+				      "HTTP/1.1 200 OK\r\nContent-Length: %lu\r\n\r\n",
+				      end);
+	}
+	c->first = first;
+	c->total = c->hdr_len + end - first;
+	c->get = true;
+}
+
+/* Find the connection on U-Boot's port in @tcp, or open it on a SYN */
+static struct wget_test_conn *wget_test_conn(struct ip_tcp_hdr *tcp)
+{
+	struct wget_test_conn *c;
+	int i, open = 0;
+
+	for (i = 0; i < srv.nr_conns; i++) {
+		if (srv.ports[i] == tcp->tcp_src)
+			return &srv.conns[i];
+	}
+	if (!(tcp->tcp_flags & TCP_SYN) || srv.nr_conns == WGET_TEST_CONNS)
+		return NULL;
+
+	srv.ports[srv.nr_conns] = tcp->tcp_src;
+	c = &srv.conns[srv.nr_conns++];
+	c->scale = -1;
+	c->open = true;
+	for (i = 0; i < srv.nr_conns; i++)
+		open += srv.conns[i].open;
+	srv.max_open = max(srv.max_open, open);
+
+	return c;
+}
+
+static int wget_test_tx(struct udevice *dev, void *packet, unsigned int len)
+{
+	struct ethernet_hdr *eth = packet;
+	struct ip_tcp_hdr *tcp = packet + ETHER_HDR_SIZE;
+	int hlen = GET_TCP_HDR_LEN_IN_BYTES(tcp->tcp_hlen);
+	int dlen = ntohs(tcp->ip_len) - IP_HDR_SIZE - hlen;
+	u8 *opt = (u8 *)(tcp + 1);
+	u32 ack = ntohl(tcp->tcp_ack) - WGET_TEST_ISN - 1;
+	struct wget_test_conn *c;
+	int i;
+
+	if (!sandbox_eth_arp_req_to_reply(dev, packet, len))
+		return 0;
+	if (ntohs(eth->et_protlen) != PROT_IP || tcp->ip_p != IPPROTO_TCP)
+		return 0;
+	c = wget_test_conn(tcp);
+	if (!c)
+		return 0;
+	if (tcp->tcp_flags & TCP_RST) {
+		c->open = false;
+		c->stalled = true;
+	}
+	if (c->stalled)
+		return 0;
+	memcpy(c->req, packet, sizeof(c->req));
+
+	if (tcp->tcp_flags & TCP_SYN) {
+		for (i = 0; i < hlen - TCP_HDR_SIZE;
+		     i += opt[i] == TCP_1_NOP ? 1 : opt[i + 1]) {
+			if (opt[i] == TCP_O_SCL)
+				c->scale = opt[i + 2];
+			if (opt[i] == TCP_O_END)
+				break;
+		}
+		c->rcv_nxt = ntohl(tcp->tcp_seq) + 1;
+		wget_test_send(dev, c, TCP_SYN | TCP_ACK, 0, 0);
+		return 0;
+	}
+
+	if (tcp->tcp_flags & TCP_FIN) {
+		c->open = false;
+		c->rcv_nxt = ntohl(tcp->tcp_seq) + 1;
+		wget_test_send(dev, c, TCP_ACK, c->total + 1, 0);
+		return 0;
+	}
+
+	c->win = ntohs(tcp->tcp_win) << max(c->scale, 0);
+	if (dlen > 0) {
+		/* The GET request, the reply starts */
+		c->rcv_nxt = ntohl(tcp->tcp_seq) + dlen;
+		((char *)opt)[hlen - TCP_HDR_SIZE + dlen] = '\0';
+		wget_test_get(c, (char *)opt + hlen - TCP_HDR_SIZE);
+	} else if (c->nxt) {
+		srv.acks++;
+		wget_test_sack(c, opt, hlen - TCP_HDR_SIZE);
+
+		/* Send a lost segment again on the first duplicate ACK */
+		if ((ack == c->last_ack || hlen > TCP_HDR_SIZE + 12) &&
+		    ack < c->nxt && c->lost[ack / TCP_MSS]) {
+			c->lost[ack / TCP_MSS] = false;
+			wget_test_send_seg(dev, c, ack);
+		}
+
+		/* Or any segment on the third one, as U-Boot may drop some */
+		c->dup_acks = ack == c->last_ack ? c->dup_acks + 1 : 0;
+		if (c->dup_acks == 3 && ack < c->nxt)
+			wget_test_send_seg(dev, c, ack);
+		if (ack > c->una && ack <= c->total)
+			c->una = ack;
+		c->last_ack = ack;
+	}
+	wget_test_push(dev, c);
+
+	return 0;
+}
+
+/* Deliver the segments which have arrived, skipping ahead to the next one */
+static void wget_test_poll(struct udevice *dev)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct wget_test_pkt *pkt = &srv.wire[0];
+	struct wget_test_conn *c;
+	ulong now = get_timer(0);
+
+	if (!srv.nr_wire) {
+		/* Nothing more is acknowledged, send the first hole again */
+		for (c = srv.conns; c < srv.conns + srv.nr_conns; c++) {
+			if (c->nxt && c->una < c->total &&
+			    get_timer(c->last_tx) > WGET_TEST_RTO) {
+				c->lost[c->una / TCP_MSS] = false;
+				wget_test_send_seg(dev, c, c->una);
+			}
+		}
+		timer_test_add_offset(1);
+		return;
+	}
+
+	if (pkt->due > now && !priv->recv_packets)
+		timer_test_add_offset(pkt->due - now);
+
+	while (srv.nr_wire && priv->recv_packets < PKTBUFSRX &&
+	       srv.wire[0].due <= get_timer(0)) {
+		memcpy(priv->recv_packet_buffer[priv->recv_packets], pkt->data,
+		       pkt->len);
+		priv->recv_packet_length[priv->recv_packets++] = pkt->len;
+		memmove(pkt, pkt + 1, --srv.nr_wire * sizeof(*pkt));
+	}
+
+	/* Room on the wire again for the connections which ran out of it */
+	for (c = srv.conns; c < srv.conns + srv.nr_conns; c++)
+		wget_test_push(dev, c);
+}
+
+/* Load the test file with wget, checking what was loaded if it succeeds */
+static int wget_test_load(struct unit_test_state *uts, int expect)
+{
+	ulong start, time;
+	u8 *buf;
+	int i;
+
+	memset(&srv.wire, '\0', sizeof(srv.wire));
+	srv.nr_wire = 0;
+	memset(&srv.conns, '\0', sizeof(srv.conns));
+	srv.nr_conns = 0;
+	srv.nr_ranges = 0;
+	srv.max_open = 0;
+	srv.segs = 0;
+	srv.acks = 0;
+	srv.max_flight = 0;
+	srv.bad_sack = 0;
+
+	sandbox_eth_set_tx_handler(0, wget_test_tx);
+	sandbox_eth_set_poll_handler(0, wget_test_poll);
+	env_set("ethact", "eth@10002000");
+	env_set("ethrotate", "no");
+
+	buf = map_sysmem(0x20000, WGET_TEST_SIZE);
+	memset(buf, '\0', WGET_TEST_SIZE);
+	start = get_timer(0);
+	ut_asserteq(expect, run_command("wget 0x20000 1.1.2.2:/image", 0));
+	time = get_timer(start);
+
+	sandbox_eth_set_poll_handler(0, NULL);
+	sandbox_eth_set_tx_handler(0, NULL);
+	if (expect)
+		return 0;
+
+	ut_asserteq(wget_test_size(), env_get_hex("filesize", 0));
+	for (i = 0; !srv.sink && i < WGET_TEST_SIZE; i++)
+		ut_asserteq(wget_test_byte(i), buf[i]);
+	unmap_sysmem(buf);
+	printf("%d segments, %d ACKs, %u bytes in flight, %d connections: %lu ms\n",
+	       srv.segs, srv.acks, srv.max_flight, srv.nr_conns, time);
+
+	return 0;
+}
+
+static int net_test_wget_window(struct unit_test_state *uts)
+{
+	memset(&srv, '\0', sizeof(srv));
+	ut_assertok(wget_test_load(uts, 0));
+
+	/* The window is scaled beyond 64 KiB and most ACKs are delayed */
+	ut_assert(srv.conns[0].scale > 0);
+	ut_asserteq(CONFIG_WGET_WINDOW_SIZE >> srv.conns[0].scale <<
+		    srv.conns[0].scale, srv.conns[0].win);
+	ut_assert(srv.max_flight > SZ_64K);
+	ut_assert(srv.acks * 4 < srv.segs * 3);
+	ut_asserteq(0, srv.bad_sack);
+
+	return 0;
+}
+
+LIB_TEST(net_test_wget_window, 0);
+
+static int net_test_wget_resume(struct unit_test_state *uts)
+{
+	memset(&srv, '\0', sizeof(srv));
+	srv.ranges = true;
+
+	/* The whole file is asked for, and the rest once the server stalls */
+	srv.stall = WGET_TEST_SIZE / 2;
+	ut_assertok(wget_test_load(uts, 0));
+	ut_asserteq(2, srv.nr_conns);
+	ut_asserteq(1, srv.nr_ranges);
+	ut_assert(srv.range_off > WGET_TEST_SIZE / 4);
+	ut_assert(srv.range_off <= WGET_TEST_SIZE / 2 + TCP_MSS);
+	ut_asserteq(0, srv.bad_sack);
+
+	/* With no ranges, the file is loaded again from the start */
+	srv.ranges = false;
+	srv.stall = WGET_TEST_SIZE / 2;
+	ut_assertok(wget_test_load(uts, 0));
+	ut_asserteq(2, srv.nr_conns);
+	ut_asserteq(1, srv.nr_ranges);
+
+	return 0;
+}
+
+LIB_TEST(net_test_wget_resume, 0);
+
+static int net_test_wget_parallel(struct unit_test_state *uts)
+{
+	char hash[40] = "md5:";
+	u8 md5[16];
+	int size;
+	int i;
+
+	if (CONFIG_PROT_TCP_CONNS < 4)
+		return -EAGAIN;
+
+	memset(&srv, '\0', sizeof(srv));
+	srv.ranges = true;
+	env_set("wgetconns", "4");
+
+	/* The first part gives the length, the others are loaded at once */
+	ut_assertok(wget_test_load(uts, 0));
+	ut_asserteq(DIV_ROUND_UP(WGET_TEST_SIZE, CONFIG_WGET_WINDOW_SIZE),
+		    srv.nr_conns);
+	ut_asserteq(srv.nr_conns, srv.nr_ranges);
+	ut_asserteq(4, srv.max_open);
+	ut_asserteq(0, srv.bad_sack);
+
+	/* A part whose connection stalls is loaded on a new one */
+	srv.stall = CONFIG_WGET_WINDOW_SIZE + CONFIG_WGET_WINDOW_SIZE / 2;
+	ut_assertok(wget_test_load(uts, 0));
+	ut_asserteq(DIV_ROUND_UP(WGET_TEST_SIZE, CONFIG_WGET_WINDOW_SIZE) + 1,
+		    srv.nr_conns);
+
+	/* The hash of the file is checked */
+	size = sizeof(md5);
+	ut_assertok(hash_block("md5", map_sysmem(0x20000, WGET_TEST_SIZE),
+			       WGET_TEST_SIZE, md5, &size));
+	for (i = 0; i < size; i++)
+		sprintf(hash + 4 + i * 2, "%02x", md5[i]);
+	env_set("wgethash", hash);
+	ut_assertok(wget_test_load(uts, 0));
+	hash[4] = hash[4] == '0' ? '1' : '0';
+	env_set("wgethash", hash);
+	ut_assertok(wget_test_load(uts, 1));
+	env_set("wgethash", NULL);
+
+	/* A server without ranges sends the whole file on one connection */
+	srv.ranges = false;
+	ut_assertok(wget_test_load(uts, 0));
+	ut_asserteq(1, srv.nr_conns);
+	env_set("wgetconns", NULL);
+
+	return 0;
+}
+
+LIB_TEST(net_test_wget_parallel, 0);
+
+/* Add a chunk header to a sparse image */
+static u8 *wget_test_chunk(u8 *pos, u16 type, u32 blks, u32 len)
+{
+	chunk_header_t *chunk = (chunk_header_t *)pos;
+
+	chunk->chunk_type = cpu_to_le16(type);
+	chunk->reserved1 = 0;
+	chunk->chunk_sz = cpu_to_le32(blks);
+	chunk->total_sz = cpu_to_le32(sizeof(*chunk) + len);
+
+	return pos + sizeof(*chunk);
+}
+
+/* Load the file into storage with @cmd, for the blkmap in @dev */
+static int wget_test_sink(struct unit_test_state *uts, const char *cmd,
+			  struct udevice *dev, int expect)
+{
+	char buf[60];
+
+	snprintf(buf, sizeof(buf), cmd, dev_seq(dev));
+	ut_assertok(run_command(buf, 0));
+	srv.sink = true;
+	ut_assertok(wget_test_load(uts, expect));
+	srv.sink = false;
+
+	return 0;
+}
+
+static int net_test_wget_sink(struct unit_test_state *uts)
+{
+	ulong size, blk_sz = 4096;
+	char hash[40] = "md5:";
+	sparse_header_t *hdr;
+	struct udevice *dev;
+	u8 *disk, *file, *pos;
+	u8 md5[16];
+	int i, len;
+
+	if (!IS_ENABLED(CONFIG_CMD_NETSINK))
+		return -EAGAIN;
+
+	memset(&srv, '\0', sizeof(srv));
+	ut_assertok(blkmap_create("wget", &dev));
+	ut_assertok(blkmap_map_pmem(dev, 0, WGET_TEST_DISK_BLKS,
+				    WGET_TEST_DISK));
+	disk = map_sysmem(WGET_TEST_DISK, WGET_TEST_DISK_BLKS * 512);
+
+	/* The file is written from block 8 on, the end of a block cleared */
+	memset(disk, 0xee, WGET_TEST_DISK_BLKS * 512);
+	ut_assertok(wget_test_sink(uts, "netsink blk blkmap %d 8", dev, 0));
+	for (i = 0; i < WGET_TEST_SIZE; i++)
+		ut_asserteq(wget_test_pattern(i), disk[8 * 512 + i]);
+	ut_asserteq(0xee, disk[8 * 512 - 1]);
+	ut_asserteq(0, disk[8 * 512 + WGET_TEST_SIZE]);
+
+	/* It is hashed on the way, and only the next file goes to storage */
+	len = sizeof(md5);
+	ut_assertok(hash_block("md5", disk + 8 * 512, WGET_TEST_SIZE, md5,
+			       &len));
+	for (i = 0; i < sizeof(md5); i++)
+		sprintf(hash + 4 + i * 2, "%02x", md5[i]);
+	env_set("wgethash", hash);
+	ut_assertok(wget_test_sink(uts, "netsink blk blkmap %d 8", dev, 0));
+	ut_assertok(wget_test_load(uts, 0));
+	hash[4] = hash[4] == '0' ? '1' : '0';
+	env_set("wgethash", hash);
+	ut_assertok(wget_test_sink(uts, "netsink blk blkmap %d 8", dev, 1));
+	env_set("wgethash", NULL);
+
+	/* A gzipped file is decompressed */
+	file = malloc(WGET_TEST_SIZE * 2);
+	ut_assertnonnull(file);
+	for (i = 0; i < WGET_TEST_SIZE; i++)
+		file[i] = wget_test_pattern(i);
+	size = WGET_TEST_SIZE;
+	ut_assertok(gzip(file + WGET_TEST_SIZE, &size, file, WGET_TEST_SIZE));
+	srv.file = file + WGET_TEST_SIZE;
+	srv.size = size;
+	memset(disk, 0xee, WGET_TEST_DISK_BLKS * 512);
+	ut_assertok(wget_test_sink(uts, "netsink gz blkmap %d", dev, 0));
+	ut_asserteq_mem(file, disk, WGET_TEST_SIZE);
+
+	/* A sparse image is unpacked: raw, fill, don't care, raw and CRC32 */
+	hdr = (sparse_header_t *)(file + WGET_TEST_SIZE);
+	hdr->magic = cpu_to_le32(SPARSE_HEADER_MAGIC);
+	hdr->major_version = cpu_to_le16(1);
+	hdr->minor_version = 0;
+	hdr->file_hdr_sz = cpu_to_le16(sizeof(*hdr));
+	hdr->chunk_hdr_sz = cpu_to_le16(sizeof(chunk_header_t));
+	hdr->blk_sz = cpu_to_le32(blk_sz);
+	hdr->total_blks = cpu_to_le32(104);
+	hdr->total_chunks = cpu_to_le32(5);
+	hdr->image_checksum = 0;
+	pos = wget_test_chunk((u8 *)(hdr + 1), CHUNK_TYPE_RAW, 64, 64 * blk_sz);
+	memcpy(pos, file, 64 * blk_sz);
+	pos = wget_test_chunk(pos + 64 * blk_sz, CHUNK_TYPE_FILL, 16, 4);
+	put_unaligned_le32(0x12345678, pos);
+	pos = wget_test_chunk(pos + 4, CHUNK_TYPE_DONT_CARE, 16, 0);
+	pos = wget_test_chunk(pos, CHUNK_TYPE_RAW, 8, 8 * blk_sz);
+	memcpy(pos, file + 64 * blk_sz, 8 * blk_sz);
+	pos = wget_test_chunk(pos + 8 * blk_sz, CHUNK_TYPE_CRC32, 0, 4);
+	srv.size = pos + 4 - (u8 *)hdr;
+	memset(disk, 0xee, WGET_TEST_DISK_BLKS * 512);
+	ut_assertok(wget_test_sink(uts, "netsink sparse blkmap %d", dev, 0));
+	ut_asserteq_mem(file, disk, 64 * blk_sz);
+	for (i = 0; i < 16 * blk_sz; i += 4)
+		ut_asserteq(0x12345678, get_unaligned_le32(disk + 64 * blk_sz + i));
+	ut_asserteq(0xee, disk[80 * blk_sz]);
+	ut_asserteq(0xee, disk[96 * blk_sz - 1]);
+	ut_asserteq_mem(file + 64 * blk_sz, disk + 96 * blk_sz, 8 * blk_sz);
+
+	/* A truncated one is not */
+	srv.size -= blk_sz;
+	ut_assertok(wget_test_sink(uts, "netsink sparse blkmap %d", dev, 1));
+
+	srv.file = NULL;
+	free(file);
+	unmap_sysmem(disk);
+	ut_assertok(blkmap_destroy(dev));
+
+	return 0;
+}
+
+LIB_TEST(net_test_wget_sink, 0);
@@ -475,6 +475,53 @@ static int compression_test_gzip(struct unit_test_state *uts)
 }
 COMPRESSION_TEST(compression_test_gzip, 0);
 
+#define GZIP_MATCHES_SIZE	4096
+#define GZIP_MATCHES_RUN	61
+
+/*
+ * Fill @buf with runs of one byte, of two alternating bytes and of a repeated
+ * phrase, so that it compresses to matches of distance 1, 2 and more than 2.
+ * The runs have an odd length, so the matches start at both odd and even
+ * offsets. inflate_fast() copies these two bytes at a time.
+ */
+static void fill_gzip_matches(uchar *buf, int size)
+{
+	static const char phrase[] = "inflate_fast() ";
+	int len = strlen(phrase);
+	int i, j, run;
+
+	for (i = 0; i < size; i++) {
+		run = i / GZIP_MATCHES_RUN;
+		j = i % GZIP_MATCHES_RUN;
+		if (run % 3 == 0)
+			buf[i] = 'a' + run % 26;
+		else if (run % 3 == 1)
+			buf[i] = j & 1 ? 'y' : 'x';
+		else
+			buf[i] = phrase[(run + j) % len];
+	}
+}
+
+static int compression_test_gzip_matches(struct unit_test_state *uts)
+{
+	static uchar orig[GZIP_MATCHES_SIZE];
+	static uchar compressed[GZIP_MATCHES_SIZE];
+	static uchar uncompressed[GZIP_MATCHES_SIZE];
+	unsigned long compressed_size = sizeof(compressed);
+	unsigned long size;
+
+	fill_gzip_matches(orig, sizeof(orig));
+	ut_assertok(gzip(compressed, &compressed_size, orig, sizeof(orig)));
+	size = compressed_size;
+	ut_assertok(gunzip(uncompressed, sizeof(uncompressed), compressed,
+			   &size));
+	ut_asserteq(sizeof(orig), size);
+	ut_asserteq_mem(orig, uncompressed, sizeof(orig));
+
+	return 0;
+}
+COMPRESSION_TEST(compression_test_gzip_matches, 0);
+
 static int compression_test_bzip2(struct unit_test_state *uts)
 {
 	return run_test(uts, "bzip2", compress_using_bzip2,
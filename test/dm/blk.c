@@ -4,15 +4,20 @@
  */
 
 #include <common.h>
+#include <blk.h>
+#include <blkmap.h>
 #include <dm.h>
+#include <malloc.h>
 #include <part.h>
 #include <sandbox_host.h>
 #include <usb.h>
 #include <asm/global_data.h>
 #include <asm/state.h>
+#include <dm/device-internal.h>
 #include <dm/test.h>
 #include <test/test.h>
 #include <test/ut.h>
+#include <u-boot/sha256.h>
 
 DECLARE_GLOBAL_DATA_PTR;
 
@@ -334,3 +339,118 @@ static int dm_test_blk_foreach(struct unit_test_state *uts)
 	return 0;
 }
 DM_TEST(dm_test_blk_foreach, UT_TESTF_SCAN_PDATA | UT_TESTF_SCAN_FDT);
+
+#define ASYNC_CHUNK	64	/* blocks */
+
+/* Test that hashing one chunk can overlap with reading the next */
+static int dm_test_blk_async(struct unit_test_state *uts)
+{
+	u8 expect[SHA256_SUM_LEN], digest[SHA256_SUM_LEN];
+	struct blk_req req[2] = {};
+	struct udevice *dev, *blk;
+	struct blk_desc *desc;
+	sha256_context ctx;
+	lbaint_t chunks, i;
+	u8 *buf, *all;
+	size_t size;
+
+	ut_assertok(host_create_device("async", true, &dev));
+	ut_assertok(host_attach_file(dev, "2MB.ext2.img"));
+	ut_assertok(blk_get_from_parent(dev, &blk));
+	ut_assertok(device_probe(blk));
+	desc = dev_get_uclass_plat(blk);
+	chunks = desc->lba / ASYNC_CHUNK;
+	size = ASYNC_CHUNK * desc->blksz;
+
+	all = malloc(chunks * size);
+	ut_assertnonnull(all);
+	ut_asserteq(chunks * ASYNC_CHUNK,
+		    blk_read(blk, 0, chunks * ASYNC_CHUNK, all));
+	sha256_csum_wd(all, chunks * size, expect, 0);
+
+	buf = malloc(2 * size);
+	ut_assertnonnull(buf);
+	sha256_starts(&ctx);
+	req[0].op = BLK_REQ_READ;
+	req[0].blkcnt = ASYNC_CHUNK;
+	req[0].buffer = buf;
+	ut_assertok(blk_submit(blk, &req[0]));
+	for (i = 0; i < chunks; i++) {
+		struct blk_req *cur = &req[i % 2], *next = &req[(i + 1) % 2];
+
+		ut_asserteq(ASYNC_CHUNK, blk_wait(blk, cur));
+		if (i + 1 < chunks) {
+			next->op = BLK_REQ_READ;
+			next->start = (i + 1) * ASYNC_CHUNK;
+			next->blkcnt = ASYNC_CHUNK;
+			next->buffer = buf + ((i + 1) % 2) * size;
+			ut_assertok(blk_submit(blk, next));
+			ut_asserteq(false, next->done);
+		}
+		sha256_update(&ctx, cur->buffer, size);
+	}
+	sha256_finish(&ctx, digest);
+	ut_asserteq_mem(expect, digest, SHA256_SUM_LEN);
+	ut_asserteq(0, blk_poll(blk));
+
+	/* write the first chunk back unchanged */
+	req[0].op = BLK_REQ_WRITE;
+	req[0].start = 0;
+	req[0].buffer = all;
+	ut_assertok(blk_submit(blk, &req[0]));
+	ut_asserteq(false, req[0].done);
+	ut_asserteq(ASYNC_CHUNK, blk_wait(blk, &req[0]));
+
+	/* a request left in the queue fails when the device goes away */
+	req[1].op = BLK_REQ_READ;
+	req[1].start = 0;
+	req[1].blkcnt = 1;
+	req[1].buffer = buf;
+	ut_assertok(blk_submit(blk, &req[1]));
+	ut_assertok(host_detach_file(dev));
+	ut_asserteq(true, req[1].done);
+	ut_asserteq(-ENODEV, req[1].result);
+	ut_assertok(device_unbind(dev));
+
+	free(buf);
+	free(all);
+
+	return 0;
+}
+DM_TEST(dm_test_blk_async, UT_TESTF_SCAN_FDT);
+
+/* Test that requests to a synchronous driver complete as submitted */
+static int dm_test_blk_async_sync(struct unit_test_state *uts)
+{
+	u8 disk[8 * 512], buf[512];
+	struct udevice *dev, *blk;
+	struct blk_req req = {};
+
+	memset(disk, '\0', sizeof(disk));
+	ut_assertok(blkmap_create("async", &dev));
+	ut_assertok(blkmap_map_mem(dev, 0, 8, disk));
+	ut_assertok(blk_get_from_parent(dev, &blk));
+
+	memset(buf, 0xa5, sizeof(buf));
+	req.op = BLK_REQ_WRITE;
+	req.start = 3;
+	req.blkcnt = 1;
+	req.buffer = buf;
+	ut_assertok(blk_submit(blk, &req));
+	ut_asserteq(true, req.done);
+	ut_asserteq(1, blk_wait(blk, &req));
+	ut_assertok(blk_flush(blk));
+	ut_asserteq_mem(buf, disk + 3 * 512, 512);
+
+	memset(buf, '\0', sizeof(buf));
+	req.op = BLK_REQ_READ;
+	ut_assertok(blk_submit(blk, &req));
+	ut_asserteq(1, blk_wait(blk, &req));
+	ut_asserteq(0xa5, buf[0]);
+	ut_asserteq(0, blk_poll(blk));
+
+	ut_assertok(blkmap_destroy(dev));
+
+	return 0;
+}
+DM_TEST(dm_test_blk_async_sync, 0);
@@ -0,0 +1,525 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Tests for the block cache
+ */
+
+#include <common.h>
+#include <blk.h>
+#include <blkmap.h>
+#include <dm.h>
+#include <malloc.h>
+#include <part.h>
+#include <time.h>
+#include <dm/device-internal.h>
+#include <dm/lists.h>
+#include <dm/root.h>
+#include <dm/test.h>
+#include <test/test.h>
+#include <test/ut.h>
+
+#define BLKSZ		0x200
+#define DISK_BLKS	0x2000
+
+struct trace_op {
+	lbaint_t start;
+	lbaint_t count;
+};
+
+/* Create a RAM-backed block device filled with a per-block pattern */
+static int setup_disk(struct unit_test_state *uts, const char *label,
+		      struct udevice **devp, struct udevice **blkp, u8 **diskp)
+{
+	u8 *disk;
+	int i;
+
+	disk = malloc(DISK_BLKS * BLKSZ);
+	ut_assertnonnull(disk);
+	for (i = 0; i < DISK_BLKS * BLKSZ; i++)
+		disk[i] = (i / BLKSZ) ^ (i % 251);
+
+	ut_assertok(blkmap_create(label, devp));
+	ut_assertok(blkmap_map_mem(*devp, 0, DISK_BLKS, disk));
+	ut_assertok(blk_get_from_parent(*devp, blkp));
+	*diskp = disk;
+
+	return 0;
+}
+
+static void restore_config(void)
+{
+	blkcache_configure(8, 128);
+	blkcache_configure_size(CONFIG_BLOCK_CACHE_SIZE);
+	blkcache_configure_readahead(CONFIG_BLOCK_CACHE_READAHEAD);
+	blkcache_configure_writeback(IS_ENABLED(CONFIG_BLOCK_CACHE_WRITEBACK));
+}
+
+/* Test that a read is served partly from the cache and partly from disk */
+static int dm_test_blkcache_partial(struct unit_test_state *uts)
+{
+	struct block_cache_dev_stats ds;
+	struct block_cache_stats stats;
+	struct udevice *dev, *blk;
+	u8 buf[16 * BLKSZ];
+	u8 *disk;
+
+	ut_assertok(setup_disk(uts, "partial", &dev, &blk, &disk));
+	blkcache_configure(8, 128);
+	blkcache_stats(&stats);
+
+	/* blocks 10-13 are cached, in the bucket covering 8-15 */
+	ut_asserteq(4, blk_read(blk, 10, 4, buf));
+	blkcache_stats(&stats);
+	ut_asserteq(0, stats.hits);
+	ut_asserteq(1, stats.misses);
+	ut_asserteq(1, stats.entries);
+
+	/* a read of 10-17 uses the cached prefix and fills the rest */
+	memset(buf, '\0', sizeof(buf));
+	ut_asserteq(8, blk_read(blk, 10, 8, buf));
+	ut_assertok(memcmp(buf, disk + 10 * BLKSZ, 8 * BLKSZ));
+	blkcache_stats(&stats);
+	ut_asserteq(1, stats.partial);
+	ut_asserteq(0, stats.misses);
+	ut_asserteq(2, stats.entries);
+
+	/* now the whole range spans two entries and is a hit */
+	memset(buf, '\0', sizeof(buf));
+	ut_asserteq(8, blk_read(blk, 10, 8, buf));
+	ut_assertok(memcmp(buf, disk + 10 * BLKSZ, 8 * BLKSZ));
+
+	/* a miss next to cached blocks merges into the same entry */
+	ut_asserteq(2, blk_read(blk, 8, 2, buf));
+	ut_asserteq(6, blk_read(blk, 8, 6, buf));
+	ut_assertok(memcmp(buf, disk + 8 * BLKSZ, 6 * BLKSZ));
+	blkcache_stats(&stats);
+	ut_asserteq(2, stats.hits);
+	ut_asserteq(1, stats.misses);
+	ut_asserteq(2, stats.entries);
+
+	ut_assertok(blkcache_dev_stats(0, &ds));
+	ut_asserteq(UCLASS_BLKMAP, ds.iftype);
+	ut_asserteq(2, ds.entries);
+	ut_asserteq(-ENOENT, blkcache_dev_stats(1, &ds));
+
+	/* writes drop the cached blocks they replace */
+	ut_asserteq(1, blk_write(blk, 100, 1, buf));
+	blkcache_stats(&stats);
+	ut_asserteq(2, stats.entries);
+	ut_asserteq(1, blk_write(blk, 12, 1, buf));
+	blkcache_stats(&stats);
+	ut_asserteq(1, stats.entries);
+
+	ut_assertok(blkmap_destroy(dev));
+	free(disk);
+	restore_config();
+
+	return 0;
+}
+DM_TEST(dm_test_blkcache_partial, 0);
+
+static u8 *blkcache_test_disk;
+static bool blkcache_test_fail;
+static bool blkcache_test_wfail;
+
+static ulong blkcache_test_read(struct udevice *dev, lbaint_t start,
+				lbaint_t blkcnt, void *buf)
+{
+	if (blkcache_test_fail)
+		return -EIO;
+	memcpy(buf, blkcache_test_disk + start * BLKSZ, blkcnt * BLKSZ);
+
+	return blkcnt;
+}
+
+static ulong blkcache_test_write(struct udevice *dev, lbaint_t start,
+				 lbaint_t blkcnt, const void *buf)
+{
+	if (blkcache_test_wfail)
+		return -EIO;
+	memcpy(blkcache_test_disk + start * BLKSZ, buf, blkcnt * BLKSZ);
+
+	return blkcnt;
+}
+
+static const struct blk_ops blkcache_test_ops = {
+	.read	= blkcache_test_read,
+	.write	= blkcache_test_write,
+};
+
+U_BOOT_DRIVER(blkcache_test_blk) = {
+	.name		= "blkcache_test_blk",
+	.id		= UCLASS_BLK,
+	.ops		= &blkcache_test_ops,
+};
+
+/* Test that a driver error after a partial hit is passed on unchanged */
+static int dm_test_blkcache_read_error(struct unit_test_state *uts)
+{
+	struct disk_part *part_data;
+	struct udevice *blk, *part;
+	u8 buf[16 * BLKSZ];
+	u8 *disk;
+	int i;
+
+	disk = malloc(DISK_BLKS * BLKSZ);
+	ut_assertnonnull(disk);
+	for (i = 0; i < DISK_BLKS * BLKSZ; i++)
+		disk[i] = (i / BLKSZ) ^ (i % 251);
+	blkcache_test_disk = disk;
+	blkcache_test_fail = false;
+
+	restore_config();
+	blkcache_configure_readahead(0);
+	ut_assertok(blk_create_devicef(dm_root(), "blkcache_test_blk", "fail",
+				       UCLASS_ROOT, -1, BLKSZ, DISK_BLKS,
+				       &blk));
+	ut_assertok(device_probe(blk));
+	ut_assertok(device_bind_driver(blk, "blk_partition", "fail:1", &part));
+	part_data = dev_get_uclass_plat(part);
+	part_data->partnum = 1;
+	part_data->gpt_part_info.start = 256;
+	part_data->gpt_part_info.size = 1024;
+	part_data->gpt_part_info.blksz = BLKSZ;
+
+	/* blocks 10-13 are cached, then the device fails */
+	ut_asserteq(4, blk_read(blk, 10, 4, buf));
+	blkcache_test_fail = true;
+	ut_asserteq(4, blk_read(blk, 10, 4, buf));
+	ut_asserteq(-EIO, blk_read(blk, 10, 8, buf));
+
+	/* the same through a partition, at blocks 266-269 of the disk */
+	blkcache_test_fail = false;
+	ut_asserteq(4, disk_blk_read(part, 10, 4, buf));
+	ut_assertok(memcmp(buf, disk + 266 * BLKSZ, 4 * BLKSZ));
+	blkcache_test_fail = true;
+	ut_asserteq(4, disk_blk_read(part, 10, 4, buf));
+	ut_asserteq(-EIO, (long)disk_blk_read(part, 10, 8, buf));
+
+	blkcache_test_fail = false;
+	ut_assertok(device_remove(blk, DM_REMOVE_NORMAL));
+	ut_assertok(device_unbind(blk));
+	free(disk);
+	restore_config();
+
+	return 0;
+}
+DM_TEST(dm_test_blkcache_read_error, 0);
+
+/* Test that the cache keeps to its memory budget */
+static int dm_test_blkcache_budget(struct unit_test_state *uts)
+{
+	struct block_cache_stats stats;
+	struct udevice *dev, *blk;
+	u8 buf[8 * BLKSZ];
+	u8 *disk;
+	int i;
+
+	ut_assertok(setup_disk(uts, "budget", &dev, &blk, &disk));
+	blkcache_configure(8, 128);
+	blkcache_configure_size(3 * 8 * BLKSZ);
+
+	for (i = 0; i < 10; i++)
+		ut_asserteq(1, blk_read(blk, i * 8, 1, buf));
+	blkcache_stats(&stats);
+	ut_asserteq(3, stats.entries);
+	ut_asserteq(3 * 8 * BLKSZ, stats.bytes);
+
+	/* only the most recently used entries are left */
+	ut_asserteq(1, blk_read(blk, 9 * 8, 1, buf));
+	ut_asserteq(1, blk_read(blk, 0, 1, buf));
+	ut_assertok(memcmp(buf, disk, BLKSZ));
+	blkcache_stats(&stats);
+	ut_asserteq(1, stats.hits);
+	ut_asserteq(1, stats.misses);
+
+	ut_assertok(blkmap_destroy(dev));
+	free(disk);
+	restore_config();
+
+	return 0;
+}
+DM_TEST(dm_test_blkcache_budget, 0);
+
+/* Test that sequential small reads are read ahead */
+static int dm_test_blkcache_readahead(struct unit_test_state *uts)
+{
+	struct block_cache_stats stats;
+	struct udevice *dev, *blk;
+	u8 buf[BLKSZ];
+	u8 *disk;
+	int i;
+
+	ut_assertok(setup_disk(uts, "readahead", &dev, &blk, &disk));
+	restore_config();
+	blkcache_configure_readahead(32);
+	blkcache_stats(&stats);
+
+	for (i = 0; i < 256; i++) {
+		ut_asserteq(1, blk_read(blk, 1000 + i, 1, buf));
+		ut_assertok(memcmp(buf, disk + (1000 + i) * BLKSZ, BLKSZ));
+	}
+	blkcache_stats(&stats);
+	ut_assert(stats.ra_blocks >= 256 - 3);
+	ut_assert(stats.hits >= 256 - 3);
+
+	/* random reads do not trigger read-ahead */
+	for (i = 0; i < 16; i++)
+		ut_asserteq(1, blk_read(blk, 3000 + i * 100, 1, buf));
+	blkcache_stats(&stats);
+	ut_asserteq(0, stats.ra_blocks);
+
+	ut_assertok(blkmap_destroy(dev));
+	free(disk);
+	restore_config();
+
+	return 0;
+}
+DM_TEST(dm_test_blkcache_readahead, 0);
+
+/* Test that dirty blocks are kept when they cannot be written back */
+static int dm_test_blkcache_writeback_error(struct unit_test_state *uts)
+{
+	struct block_cache_stats stats;
+	u8 wr[16 * BLKSZ], buf[BLKSZ];
+	struct udevice *blk;
+	u8 *disk;
+	int i;
+
+	disk = calloc(DISK_BLKS, BLKSZ);
+	ut_assertnonnull(disk);
+	blkcache_test_disk = disk;
+	blkcache_test_fail = false;
+	blkcache_test_wfail = true;
+	for (i = 0; i < sizeof(wr); i++)
+		wr[i] = i % 253;
+
+	restore_config();
+	blkcache_configure_readahead(0);
+	ut_assertok(blkcache_configure_writeback(true));
+	ut_assertok(blk_create_devicef(dm_root(), "blkcache_test_blk", "wb",
+				       UCLASS_ROOT, -1, BLKSZ, DISK_BLKS,
+				       &blk));
+	ut_assertok(device_probe(blk));
+	blkcache_stats(&stats);
+
+	ut_asserteq(1, blk_write(blk, 100, 1, wr));
+	ut_asserteq(-EIO, blk_flush(blk));
+	blkcache_stats(&stats);
+	ut_asserteq(1, stats.dirty);
+
+	/* a write which bypasses the cache must not overtake the dirty one */
+	ut_asserteq(-EIO, blk_write(blk, 96, 16, wr));
+	ut_asserteq(-EIO, blkcache_configure(16, 128));
+	ut_asserteq(-EIO, device_remove(blk, DM_REMOVE_NORMAL));
+
+	/* eviction passes over the dirty entry */
+	for (i = 0; i < 80; i++)
+		ut_asserteq(1, blk_read(blk, 1024 + i * 8, 1, buf));
+	ut_asserteq(1, blk_read(blk, 100, 1, buf));
+	ut_assertok(memcmp(buf, wr, BLKSZ));
+	blkcache_stats(&stats);
+	ut_asserteq(1, stats.dirty);
+
+	/* once the device works again the block reaches it */
+	blkcache_test_wfail = false;
+	ut_assertok(blk_flush(blk));
+	ut_assertok(memcmp(disk + 100 * BLKSZ, wr, BLKSZ));
+
+	ut_assertok(device_remove(blk, DM_REMOVE_NORMAL));
+	ut_assertok(device_unbind(blk));
+	free(disk);
+	restore_config();
+
+	return 0;
+}
+DM_TEST(dm_test_blkcache_writeback_error, 0);
+
+/* Test that small writes are merged in the cache in write-back mode */
+static int dm_test_blkcache_writeback(struct unit_test_state *uts)
+{
+	struct block_cache_stats stats;
+	struct udevice *dev, *blk;
+	u8 wr[16 * BLKSZ], buf[16 * BLKSZ], orig[BLKSZ];
+	u8 *disk;
+	int i;
+
+	ut_assertok(setup_disk(uts, "writeback", &dev, &blk, &disk));
+	restore_config();
+	ut_assertok(blkcache_configure_writeback(true));
+	blkcache_stats(&stats);
+	for (i = 0; i < sizeof(wr); i++)
+		wr[i] = i % 253;
+
+	/* the write stays in the cache and is read back from there */
+	memcpy(orig, disk + 100 * BLKSZ, BLKSZ);
+	ut_asserteq(1, blk_write(blk, 100, 1, wr));
+	ut_assertok(memcmp(disk + 100 * BLKSZ, orig, BLKSZ));
+	ut_asserteq(1, blk_read(blk, 100, 1, buf));
+	ut_assertok(memcmp(buf, wr, BLKSZ));
+
+	/* repeated and adjacent writes are merged into one request */
+	ut_asserteq(1, blk_write(blk, 101, 1, wr + BLKSZ));
+	ut_asserteq(1, blk_write(blk, 100, 1, wr));
+	ut_asserteq(2, blk_write(blk, 102, 2, wr + 2 * BLKSZ));
+	blkcache_stats(&stats);
+	ut_asserteq(4, stats.writes);
+	ut_asserteq(4, stats.dirty);
+	ut_asserteq(0, stats.flushes);
+
+	ut_assertok(blk_flush(blk));
+	ut_assertok(memcmp(disk + 100 * BLKSZ, wr, 4 * BLKSZ));
+	blkcache_stats(&stats);
+	ut_asserteq(1, stats.flushes);
+	ut_asserteq(0, stats.dirty);
+
+	/* dirty blocks in neighbouring entries are written together */
+	ut_asserteq(2, blk_write(blk, 206, 2, wr));
+	ut_asserteq(3, blk_write(blk, 208, 3, wr + 2 * BLKSZ));
+	ut_assertok(blk_flush(blk));
+	ut_assertok(memcmp(disk + 206 * BLKSZ, wr, 5 * BLKSZ));
+	blkcache_stats(&stats);
+	ut_asserteq(1, stats.flushes);
+
+	/* a read around uncached dirty blocks sees the new data */
+	ut_asserteq(1, blk_write(blk, 305, 1, wr));
+	ut_asserteq(8, blk_read(blk, 300, 8, buf));
+	ut_assertok(memcmp(buf + 5 * BLKSZ, wr, BLKSZ));
+	ut_assertok(memcmp(disk + 305 * BLKSZ, wr, BLKSZ));
+
+	/* large writes go to the device and replace cached blocks */
+	ut_asserteq(1, blk_write(blk, 400, 1, wr + BLKSZ));
+	ut_asserteq(16, blk_write(blk, 396, 16, wr));
+	ut_assertok(memcmp(disk + 396 * BLKSZ, wr, 16 * BLKSZ));
+	ut_asserteq(1, blk_read(blk, 400, 1, buf));
+	ut_assertok(memcmp(buf, wr + 4 * BLKSZ, BLKSZ));
+
+	/* disabling write-back writes everything out */
+	ut_asserteq(1, blk_write(blk, 500, 1, wr));
+	ut_assertok(blkcache_configure_writeback(false));
+	ut_assertok(memcmp(disk + 500 * BLKSZ, wr, BLKSZ));
+	blkcache_stats(&stats);
+	ut_asserteq(0, stats.dirty);
+
+	ut_assertok(blkmap_destroy(dev));
+	free(disk);
+	restore_config();
+
+	return 0;
+}
+DM_TEST(dm_test_blkcache_writeback, 0);
+
+/*
+ * Build the block trace of loading a fragmented kernel from FAT: for each
+ * cluster the FAT sector holding its entry is read, then the cluster itself.
+ */
+static int fat_trace(struct trace_op *ops)
+{
+	int i, n = 0, cluster = 2;
+
+	/* walk the root directory twice, for size and for load */
+	for (i = 0; i < 2; i++) {
+		ops[n++] = (struct trace_op){ 32, 1 };
+		ops[n++] = (struct trace_op){ 256, 4 };
+		ops[n++] = (struct trace_op){ 260, 4 };
+	}
+	for (i = 0; i < 1000; i++) {
+		/* FAT32: 128 entries per sector, FAT starts at block 32 */
+		ops[n++] = (struct trace_op){ 32 + cluster / 128, 1 };
+		ops[n++] = (struct trace_op){ 512 + cluster * 4, 4 };
+		/* fragment every 37 clusters */
+		cluster += i % 37 ? 1 : 3;
+	}
+
+	return n;
+}
+
+/*
+ * Build the block trace of loading a kernel from ext4 with 1KiB blocks: the
+ * path is resolved twice, then the extents are read with large requests.
+ */
+static int ext4_trace(struct trace_op *ops)
+{
+	int i, j, n = 0;
+
+	for (i = 0; i < 2; i++) {
+		ops[n++] = (struct trace_op){ 2, 2 };	/* superblock */
+		ops[n++] = (struct trace_op){ 4, 2 };	/* group descriptors */
+		for (j = 0; j < 3; j++) {
+			/* inode, directory extent and directory block */
+			ops[n++] = (struct trace_op){ 1024 + j * 8, 1 };
+			ops[n++] = (struct trace_op){ 1100 + j * 2, 2 };
+			ops[n++] = (struct trace_op){ 1200 + j * 16, 2 };
+		}
+	}
+	for (i = 0; i < 40; i++) {
+		/* extent index block, then the data in 64-block pieces */
+		ops[n++] = (struct trace_op){ 1300 + i / 10 * 2, 2 };
+		ops[n++] = (struct trace_op){ 2048 + i * 128, 64 };
+		ops[n++] = (struct trace_op){ 2048 + i * 128 + 64, 64 };
+	}
+
+	return n;
+}
+
+static int replay(struct unit_test_state *uts, struct udevice *blk,
+		  const struct trace_op *ops, int count, const u8 *disk,
+		  u8 *buf, ulong *usp)
+{
+	ulong start = timer_get_us();
+	int i;
+
+	for (i = 0; i < count; i++) {
+		ut_asserteq(ops[i].count,
+			    blk_read(blk, ops[i].start, ops[i].count, buf));
+		ut_assertok(memcmp(buf, disk + ops[i].start * BLKSZ,
+				   ops[i].count * BLKSZ));
+	}
+	*usp = timer_get_us() - start;
+
+	return 0;
+}
+
+/* Replay block traces of kernel loads with and without the cache */
+static int dm_test_blkcache_trace(struct unit_test_state *uts)
+{
+	struct block_cache_stats stats;
+	struct udevice *dev, *blk;
+	struct trace_op *ops;
+	ulong us_off, us_on;
+	u8 *disk, *buf;
+	int pass, count;
+
+	ut_assertok(setup_disk(uts, "trace", &dev, &blk, &disk));
+	ops = calloc(3000, sizeof(*ops));
+	ut_assertnonnull(ops);
+	buf = malloc(64 * BLKSZ);
+	ut_assertnonnull(buf);
+
+	for (pass = 0; pass < 2; pass++) {
+		count = pass ? ext4_trace(ops) : fat_trace(ops);
+
+		blkcache_configure(0, 0);
+		ut_assertok(replay(uts, blk, ops, count, disk, buf, &us_off));
+
+		restore_config();
+		blkcache_stats(&stats);
+		ut_assertok(replay(uts, blk, ops, count, disk, buf, &us_on));
+		blkcache_stats(&stats);
+
+		printf("%s: %d reads, %u hits, %u partial, %u misses, %lu us uncached, %lu us cached\n",
+		       pass ? "ext4" : "fat", count, stats.hits, stats.partial,
+		       stats.misses, us_off, us_on);
+		/* metadata reads must be served from the cache */
+		ut_assert(stats.hits > count / 4);
+		ut_assert(stats.bytes <= stats.max_bytes);
+	}
+
+	ut_assertok(blkmap_destroy(dev));
+	free(buf);
+	free(ops);
+	free(disk);
+	restore_config();
+
+	return 0;
+}
+DM_TEST(dm_test_blkcache_trace, 0);
@@ -0,0 +1,119 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Tests for the Cadence QSPI driver, with its registers and AHB window in
+ * sandbox RAM
+ */
+
+#include <common.h>
+#include <dm.h>
+#include <malloc.h>
+#include <mapmem.h>
+#include <spi.h>
+#include <spi-mem.h>
+#include <asm/io.h>
+#include <asm/test.h>
+#include <dm/device-internal.h>
+#include <dm/lists.h>
+#include <dm/root.h>
+#include <dm/test.h>
+#include <linux/sizes.h>
+#include <test/test.h>
+#include <test/ut.h>
+#include "../../drivers/spi/cadence_qspi.h"
+
+/* Addresses given to the disabled spi@8400000 node of the test tree */
+#define CQSPI_TEST_REGS		0x08400000
+#define CQSPI_TEST_REGS_SIZE	0x100
+#define CQSPI_TEST_AHB		0x08800000
+#define CQSPI_TEST_AHB_SIZE	SZ_8M
+#define CQSPI_TEST_LEN		0x1000
+#define CQSPI_TEST_TAIL		0x100
+
+/* Test that spi-mem dirmap reads come from the AHB window */
+static int dm_test_cadence_qspi_dirmap(struct unit_test_state *uts)
+{
+	struct spi_mem_dirmap_info info = {
+		.op_tmpl = SPI_MEM_OP(SPI_MEM_OP_CMD(0x0b, 1),
+				      SPI_MEM_OP_ADDR(3, 0, 1),
+				      SPI_MEM_OP_DUMMY(1, 1),
+				      SPI_MEM_OP_DATA_IN(0, NULL, 1)),
+		.length = CQSPI_TEST_AHB_SIZE,
+	};
+	struct spi_mem_dirmap_desc *desc;
+	struct spi_slave *slave;
+	struct udevice *bus;
+	u8 *regs, *ahb, *buf;
+	u32 rd_instr;
+	ofnode node;
+	int i;
+
+	sandbox_set_enable_memio(true);
+	regs = map_sysmem(CQSPI_TEST_REGS, CQSPI_TEST_REGS_SIZE);
+	ahb = map_sysmem(CQSPI_TEST_AHB, CQSPI_TEST_AHB_SIZE);
+	memset(regs, '\0', CQSPI_TEST_REGS_SIZE);
+	/* the controller is never busy */
+	writel(BIT(CQSPI_REG_CONFIG_IDLE_LSB), regs + CQSPI_REG_CONFIG);
+	for (i = 0; i < CQSPI_TEST_LEN; i++)
+		ahb[i] = i * 7 + i / 256;
+	for (i = 0; i < CQSPI_TEST_TAIL; i++)
+		ahb[CQSPI_TEST_AHB_SIZE - CQSPI_TEST_TAIL + i] = i * 3;
+
+	node = ofnode_path("/spi@8400000");
+	ut_assert(ofnode_valid(node));
+	ut_assertok(lists_bind_fdt(dm_root(), node, &bus, NULL, false));
+	ut_assertok(_spi_get_bus_and_cs(dev_seq(bus), 0, 500, 0,
+					"spi_generic_drv", "cqspi-flash", &bus,
+					&slave));
+
+	desc = spi_mem_dirmap_create(slave, &info);
+	ut_assertok_ptr(desc);
+	ut_asserteq(false, desc->nodirmap);
+
+	/*
+	 * Use a buffer which does not start on a cache line, so that the CPU
+	 * copies its ends and DMA the rest
+	 */
+	buf = malloc(CQSPI_TEST_LEN + 1);
+	ut_assertnonnull(buf);
+	memset(buf, '\0', CQSPI_TEST_LEN + 1);
+	ut_asserteq(CQSPI_TEST_LEN - 1,
+		    spi_mem_dirmap_read(desc, 1, CQSPI_TEST_LEN - 1, buf + 1));
+	ut_asserteq_mem(ahb + 1, buf + 1, CQSPI_TEST_LEN - 1);
+
+	/* the read template gives the direct read instruction */
+	rd_instr = readl(regs + CQSPI_REG_RD_INSTR);
+	ut_asserteq(0x0b, rd_instr >> CQSPI_REG_RD_INSTR_OPCODE_LSB & 0xff);
+	ut_asserteq(8, rd_instr >> CQSPI_REG_RD_INSTR_DUMMY_LSB &
+		    CQSPI_REG_RD_INSTR_DUMMY_MASK);
+
+	/* a read is cut at the end of the window, for spi-mem to go on */
+	memset(buf, '\0', CQSPI_TEST_LEN);
+	ut_asserteq(CQSPI_TEST_TAIL,
+		    spi_mem_dirmap_read(desc,
+					CQSPI_TEST_AHB_SIZE - CQSPI_TEST_TAIL,
+					CQSPI_TEST_LEN, buf));
+	ut_asserteq_mem(ahb + CQSPI_TEST_AHB_SIZE - CQSPI_TEST_TAIL, buf,
+			CQSPI_TEST_TAIL);
+	spi_mem_dirmap_destroy(desc);
+
+	/* writes are left to the indirect controller */
+	info.op_tmpl = (struct spi_mem_op)
+		SPI_MEM_OP(SPI_MEM_OP_CMD(0x02, 1),
+			   SPI_MEM_OP_ADDR(3, 0, 1),
+			   SPI_MEM_OP_NO_DUMMY,
+			   SPI_MEM_OP_DATA_OUT(0, NULL, 1));
+	desc = spi_mem_dirmap_create(slave, &info);
+	ut_assertok_ptr(desc);
+	ut_asserteq(true, desc->nodirmap);
+	spi_mem_dirmap_destroy(desc);
+
+	ut_assertok(device_remove(bus, DM_REMOVE_NORMAL));
+	ut_assertok(device_unbind(bus));
+	free(buf);
+	unmap_sysmem(ahb);
+	unmap_sysmem(regs);
+	sandbox_set_enable_memio(false);
+
+	return 0;
+}
+DM_TEST(dm_test_cadence_qspi_dirmap, UT_TESTF_SCAN_FDT);
@@ -14,6 +14,7 @@
 #include <malloc.h>
 #include <net.h>
 #include <net6.h>
+#include <net/tcp.h>
 #include <asm/eth.h>
 #include <dm/test.h>
 #include <dm/device-internal.h>
@@ -168,6 +169,55 @@ static int dm_test_ip6_make_lladdr(struct unit_test_state *uts)
 	return 0;
 }
 DM_TEST(dm_test_ip6_make_lladdr, UT_TESTF_SCAN_FDT);
+
+static int dm_test_ndisc_cache(struct unit_test_state *uts)
+{
+	uchar buf[IP6_HDR_SIZE + sizeof(struct nd_msg) + 8] = {0};
+	struct ip6_hdr *ip6 = (struct ip6_hdr *)buf;
+	struct nd_msg *msg = (struct nd_msg *)(ip6 + 1);
+	const uchar mac[6] = {0x02, 0x00, 0x11, 0x22, 0x33, 0x44};
+	struct in6_addr saved_ip6 = net_ip6, saved_gw6 = net_gateway6;
+	u32 saved_prefix = net_prefix_length;
+	struct in6_addr neigh, remote;
+	uchar enetaddr[6];
+
+	/* The advertisement we answer with goes out through net_tx_packet */
+	ut_assertok(net_init());
+	ut_assertok(string_to_ip6("2001:db8::1", 11, &net_ip6));
+	ut_assertok(string_to_ip6("2001:db8::2", 11, &neigh));
+	ut_assertok(string_to_ip6("2001:db9::2", 11, &remote));
+	net_prefix_length = 64;
+	net_gateway6 = net_null_addr_ip6;
+
+	ut_asserteq(-ENOENT, ndisc_lookup(&neigh, enetaddr));
+
+	/* A solicitation for us teaches us the address of the sender */
+	ip6->payload_len = htons(sizeof(struct nd_msg) + 8);
+	ip6->saddr = neigh;
+	msg->icmph.icmp6_type = IPV6_NDISC_NEIGHBOUR_SOLICITATION;
+	msg->target = net_ip6;
+	msg->opt[0] = ND_OPT_SOURCE_LL_ADDR;
+	msg->opt[1] = 1;
+	memcpy(&msg->opt[2], mac, 6);
+	ndisc_receive(NULL, ip6, sizeof(buf));
+
+	ut_assertok(ndisc_lookup(&neigh, enetaddr));
+	ut_asserteq_mem(mac, enetaddr, 6);
+
+	/* Off-link hosts are reached through the gateway only */
+	ut_asserteq(-ENOENT, ndisc_lookup(&remote, enetaddr));
+	net_gateway6 = neigh;
+	memset(enetaddr, '\0', 6);
+	ut_assertok(ndisc_lookup(&remote, enetaddr));
+	ut_asserteq_mem(mac, enetaddr, 6);
+
+	net_ip6 = saved_ip6;
+	net_gateway6 = saved_gw6;
+	net_prefix_length = saved_prefix;
+
+	return 0;
+}
+DM_TEST(dm_test_ndisc_cache, UT_TESTF_SCAN_FDT);
 #endif
 
 static int dm_test_eth(struct unit_test_state *uts)
@@ -609,6 +659,218 @@ static int dm_test_eth_async_ping_reply(struct unit_test_state *uts)
 
 DM_TEST(dm_test_eth_async_ping_reply, UT_TESTF_SCAN_FDT);
 
+/* A burst beyond the receive buffers is taken at once, and counted */
+static int dm_test_eth_burst(struct unit_test_state *uts)
+{
+	uchar packet[ETHER_HDR_SIZE + 46];
+	struct ethernet_hdr *eth = (void *)packet;
+	struct eth_stats stats;
+	struct udevice *dev;
+	int i;
+
+	env_set("ethact", "eth@10002000");
+	ut_assertok(eth_init());
+	dev = eth_get_dev();
+
+	/* Frames of an EtherType for local experiments, which are ignored */
+	memset(packet, '\0', sizeof(packet));
+	memcpy(eth->et_dest, eth_get_ethaddr(), ARP_HLEN);
+	eth->et_protlen = htons(0x88b5);
+	for (i = 0; i < PKTBUFSRX; i++)
+		ut_assertok(sandbox_eth_recv_packet(dev, packet,
+						    sizeof(packet)));
+	for (i = 0; i < 3; i++)
+		ut_asserteq(-EOVERFLOW,
+			    sandbox_eth_recv_packet(dev, packet,
+						    sizeof(packet)));
+
+	ut_assertok(eth_rx());
+	ut_assertok(eth_get_stats(dev, &stats));
+	ut_asserteq(PKTBUFSRX, stats.rx_packets);
+	ut_asserteq(PKTBUFSRX * sizeof(packet), stats.rx_bytes);
+	ut_asserteq(3, stats.rx_dropped);
+
+	console_record_reset_enable();
+	ut_assertok(run_command("net stats", 0));
+	ut_assert_skip_to_line("eth%d : eth@10002000", dev_seq(dev));
+	ut_assert_nextline("  rx: %d packets, %d bytes, 0 errors, 3 dropped, 0 overruns",
+			   PKTBUFSRX, PKTBUFSRX * (int)sizeof(packet));
+	ut_assert_nextline("  tx: 0 packets, 0 bytes, 0 errors");
+	eth_halt();
+
+	return 0;
+}
+
+DM_TEST(dm_test_eth_burst, UT_TESTF_SCAN_FDT | UT_TESTF_CONSOLE_REC);
+
+/* eth_rx_max() leaves what it does not take with the driver */
+static int dm_test_eth_rx_max(struct unit_test_state *uts)
+{
+	uchar packet[ETHER_HDR_SIZE + 46];
+	struct ethernet_hdr *eth = (void *)packet;
+	struct eth_stats stats;
+	struct udevice *dev;
+	int i;
+
+	env_set("ethact", "eth@10002000");
+	ut_assertok(eth_init());
+	dev = eth_get_dev();
+
+	memset(packet, '\0', sizeof(packet));
+	memcpy(eth->et_dest, eth_get_ethaddr(), ARP_HLEN);
+	eth->et_protlen = htons(0x88b5);
+	for (i = 0; i < PKTBUFSRX; i++)
+		ut_assertok(sandbox_eth_recv_packet(dev, packet,
+						    sizeof(packet)));
+
+	ut_assertok(eth_rx_max(PKTBUFSRX - 1));
+	ut_assertok(eth_get_stats(dev, &stats));
+	ut_asserteq(PKTBUFSRX - 1, stats.rx_packets);
+
+	ut_assertok(eth_rx_max(PKTBUFSRX));
+	ut_assertok(eth_get_stats(dev, &stats));
+	ut_asserteq(PKTBUFSRX, stats.rx_packets);
+	ut_asserteq(0, stats.rx_dropped);
+	eth_halt();
+
+	return 0;
+}
+
+DM_TEST(dm_test_eth_rx_max, UT_TESTF_SCAN_FDT);
+
+#if IS_ENABLED(CONFIG_IPV6) && IS_ENABLED(CONFIG_PROT_TCP)
+/* The last packet sent, which the server answers */
+static uchar tcp6_sent[PKTSIZE_ALIGN];
+static unsigned int tcp6_sent_len;
+
+static int sb_tcp6_handler(struct udevice *dev, void *packet,
+			   unsigned int len)
+{
+	memcpy(tcp6_sent, packet, len);
+	tcp6_sent_len = len;
+
+	return 0;
+}
+
+/* Act like a device which checked the packet it is about to return */
+static void sb_tcp6_csum_ok(struct udevice *dev)
+{
+	eth_rx_csum_ok(dev);
+}
+
+/* The TCP header of an IPv6 packet, after a would-be IPv4 header */
+static struct ip_tcp_hdr *tcp6_hdr(uchar *pkt)
+{
+	return (void *)pkt + ETHER_HDR_SIZE + IP6_HDR_SIZE - IP_HDR_SIZE;
+}
+
+/* Work out the checksum the TCP segment in @pkt should have */
+static u16 tcp6_csum(uchar *pkt)
+{
+	struct ip6_hdr *ip6 = (void *)pkt + ETHER_HDR_SIZE;
+	struct ip_tcp_hdr *tcp = tcp6_hdr(pkt);
+	int len = ntohs(ip6->payload_len);
+	u16 xsum = tcp->tcp_xsum;
+	u16 ret;
+
+	tcp->tcp_xsum = 0;
+	ret = csum_ipv6_magic(&ip6->saddr, &ip6->daddr, len, IPPROTO_TCP,
+			      csum_partial((uchar *)(ip6 + 1), len, 0));
+	tcp->tcp_xsum = xsum;
+
+	return ret;
+}
+
+/* Receive the SYN-ACK of the server, its checksum off by @corrupt */
+static int tcp6_recv_syn_ack(struct udevice *dev, u16 corrupt)
+{
+	uchar pkt[PKTSIZE_ALIGN];
+	struct ethernet_hdr *eth = (void *)pkt;
+	struct ip6_hdr *ip6 = (void *)pkt + ETHER_HDR_SIZE;
+	struct ip_tcp_hdr *tcp = tcp6_hdr(pkt);
+	struct in6_addr addr;
+	u16 port;
+
+	memcpy(pkt, tcp6_sent, tcp6_sent_len);
+	memcpy(eth->et_dest, eth->et_src, ARP_HLEN);
+	memcpy(eth->et_src, net_server_ethaddr, ARP_HLEN);
+	addr = ip6->saddr;
+	ip6->saddr = ip6->daddr;
+	ip6->daddr = addr;
+	port = tcp->tcp_src;
+	tcp->tcp_src = tcp->tcp_dst;
+	tcp->tcp_dst = port;
+	tcp->tcp_ack = htonl(ntohl(tcp->tcp_seq) + 1);
+	tcp->tcp_seq = htonl(1000);
+	tcp->tcp_flags = TCP_SYN | TCP_ACK;
+	tcp->tcp_xsum = tcp6_csum(pkt) + corrupt;
+
+	return sandbox_eth_recv_packet(dev, pkt, tcp6_sent_len);
+}
+
+/* TCP segments over IPv6 have their checksums filled in and checked */
+static int dm_test_eth_tcp6(struct unit_test_state *uts)
+{
+	const uchar server_mac[ARP_HLEN] = {0x02, 0x00, 0x11, 0x22, 0x33, 0x44};
+	struct in6_addr saved_ip6 = net_ip6, saved_server_ip6 = net_server_ip6;
+	struct ethernet_hdr *eth = (void *)tcp6_sent;
+	struct ip6_hdr *ip6 = (void *)tcp6_sent + ETHER_HDR_SIZE;
+	struct ip_tcp_hdr *tcp = tcp6_hdr(tcp6_sent);
+	uchar saved_server_ethaddr[ARP_HLEN];
+	bool saved_use_ip6 = use_ip6;
+	struct udevice *dev;
+
+	env_set("ethact", "eth@10002000");
+	ut_assertok(eth_init());
+	dev = eth_get_dev();
+	sandbox_eth_set_tx_handler(dev_seq(dev), sb_tcp6_handler);
+
+	memcpy(saved_server_ethaddr, net_server_ethaddr, ARP_HLEN);
+	memcpy(net_server_ethaddr, server_mac, ARP_HLEN);
+	ut_assertok(string_to_ip6("2001:db8::1", 11, &net_ip6));
+	ut_assertok(string_to_ip6("2001:db8::2", 11, &net_server_ip6));
+	use_ip6 = true;
+	tcp_set_tcp_handler(NULL);
+
+	ut_assertok(net_send_tcp_packet6(0, 80, 1234, TCP_SYN, 0, 0));
+	ut_asserteq(TCP_SYN_SENT, tcp_get_tcp_state());
+	ut_asserteq(PROT_IP6, ntohs(eth->et_protlen));
+	ut_asserteq(IPPROTO_TCP, ip6->nexthdr);
+	ut_asserteq(tcp6_csum(tcp6_sent), tcp->tcp_xsum);
+
+	/* An answer with a bad checksum is dropped, a good one is taken */
+	ut_assertok(tcp6_recv_syn_ack(dev, 1));
+	ut_assertok(eth_rx());
+	ut_asserteq(TCP_SYN_SENT, tcp_get_tcp_state());
+	ut_assertok(tcp6_recv_syn_ack(dev, 0));
+	ut_assertok(eth_rx());
+	ut_asserteq(TCP_ESTABLISHED, tcp_get_tcp_state());
+
+	/* The stack leaves checksums to a device which handles them */
+	eth_set_csum(dev, ETH_CSUM_TX | ETH_CSUM_RX);
+	sandbox_eth_set_poll_handler(dev_seq(dev), sb_tcp6_csum_ok);
+	tcp_set_tcp_handler(NULL);
+	ut_assertok(net_send_tcp_packet6(0, 80, 1234, TCP_SYN, 0, 0));
+	ut_asserteq(0, tcp->tcp_xsum);
+	ut_assertok(tcp6_recv_syn_ack(dev, 1));
+	ut_assertok(eth_rx());
+	ut_asserteq(TCP_ESTABLISHED, tcp_get_tcp_state());
+
+	eth_set_csum(dev, 0);
+	sandbox_eth_set_poll_handler(dev_seq(dev), NULL);
+	sandbox_eth_set_tx_handler(dev_seq(dev), NULL);
+	tcp_set_tcp_handler(NULL);
+	use_ip6 = saved_use_ip6;
+	net_ip6 = saved_ip6;
+	net_server_ip6 = saved_server_ip6;
+	memcpy(net_server_ethaddr, saved_server_ethaddr, ARP_HLEN);
+	eth_halt();
+
+	return 0;
+}
+DM_TEST(dm_test_eth_tcp6, UT_TESTF_SCAN_FDT);
+#endif
+
 #if IS_ENABLED(CONFIG_IPV6_ROUTER_DISCOVERY)
 
 static u8 ip6_ra_buf[] = {0x60, 0xf, 0xc5, 0x4a, 0x0, 0x38, 0x3a, 0xff, 0xfe,
@@ -0,0 +1,292 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Copyright (C) 2024 Intel Corporation <www.intel.com>
+ *
+ * Tests for the pipelined bitstream transfer to the Intel SDM mailbox
+ */
+
+#include <common.h>
+#include <dm.h>
+#include <intel_sdm_stream.h>
+#include <malloc.h>
+#include <asm/test.h>
+#include <dm/test.h>
+#include <linux/sizes.h>
+#include <test/test.h>
+#include <test/ut.h>
+#include <u-boot/crc.h>
+
+/* Not a multiple of any chunk size, so the last chunk is short */
+#define BITSTREAM_SIZE	(SZ_1M + 0x123)
+
+/**
+ * struct sdm_test_src - bitstream source which reads from memory
+ *
+ * @data:	Bitstream
+ * @offset:	Offset of the next read, reads must be in order
+ * @fail_at:	Offset at which to return @fail_ret instead of data
+ * @fail_ret:	Value to return at @fail_at
+ */
+struct sdm_test_src {
+	const u8 *data;
+	ulong offset;
+	ulong fail_at;
+	int fail_ret;
+};
+
+static int sdm_test_read(struct sdm_stream *s, void *buf, ulong offset,
+			 u32 len)
+{
+	struct sdm_test_src *src = s->src;
+
+	if (offset != src->offset)
+		return -ESPIPE;
+	if (offset >= src->fail_at)
+		return src->fail_ret;
+	len = min_t(ulong, len, src->fail_at - offset);
+	memcpy(buf, src->data + offset, len);
+	src->offset += len;
+
+	return len;
+}
+
+static u8 *sdm_test_bitstream(void)
+{
+	u8 *data;
+	int i;
+
+	data = malloc(BITSTREAM_SIZE);
+	if (data) {
+		for (i = 0; i < BITSTREAM_SIZE; i++)
+			data[i] = i * 7 + (i >> 12);
+	}
+
+	return data;
+}
+
+/* Check that the SDM got the whole bitstream with no misuse of the mailbox */
+static int sdm_test_check(struct unit_test_state *uts, const u8 *data,
+			  ulong size)
+{
+	struct sandbox_sdm_mb_stats stats;
+
+	sandbox_sdm_mb_get_stats(&stats);
+	ut_asserteq(size, stats.bytes);
+	ut_asserteq(crc32(0, data, size), stats.crc);
+	ut_asserteq(0, stats.inflight);
+	ut_asserteq(0, stats.bad_id);
+	ut_asserteq(0, stats.overflow);
+	ut_asserteq(0, stats.bad_len);
+	ut_asserteq(0, stats.overwritten);
+
+	return 0;
+}
+
+/* Send a bitstream which is already in memory */
+static int dm_test_fpga_sdm_mem(struct unit_test_state *uts)
+{
+	struct sdm_stream s = { };
+	u8 *data;
+
+	data = sdm_test_bitstream();
+	ut_assertnonnull(data);
+	s.data = data;
+	s.size = BITSTREAM_SIZE;
+
+	sandbox_sdm_mb_init(&s, 4, SZ_64K, 3, 0);
+	ut_assertok(sdm_stream_send(&s));
+	ut_assertok(sdm_test_check(uts, data, BITSTREAM_SIZE));
+	ut_asserteq(DIV_ROUND_UP(BITSTREAM_SIZE, SZ_64K), s.xfers);
+	ut_asserteq(BITSTREAM_SIZE, s.bytes);
+	ut_asserteq(4, s.max_inflight);
+	free(data);
+
+	return 0;
+}
+DM_TEST(dm_test_fpga_sdm_mem, 0);
+
+/* Stream a bitstream through a ring of buffers smaller than the pipeline */
+static int dm_test_fpga_sdm_ring(struct unit_test_state *uts)
+{
+	struct sdm_test_src src = { .fail_at = ULONG_MAX };
+	struct sandbox_sdm_mb_stats stats;
+	struct sdm_stream s = { };
+	u8 *data, *ring;
+	int i;
+
+	data = sdm_test_bitstream();
+	ut_assertnonnull(data);
+	src.data = data;
+
+	s.read = sdm_test_read;
+	s.src = &src;
+	s.size = BITSTREAM_SIZE;
+	s.chunk = SZ_16K;
+	s.nr_bufs = 3;
+	ring = malloc(s.nr_bufs * s.chunk);
+	ut_assertnonnull(ring);
+	for (i = 0; i < s.nr_bufs; i++)
+		s.buf[i] = ring + i * s.chunk;
+
+	/* The SDM takes bigger chunks and more commands than the ring holds */
+	sandbox_sdm_mb_init(&s, 4, SZ_64K, 2, 0);
+	ut_asserteq(SZ_16K, s.chunk);
+	ut_assertok(sdm_stream_send(&s));
+	ut_assertok(sdm_test_check(uts, data, BITSTREAM_SIZE));
+	ut_asserteq(BITSTREAM_SIZE, src.offset);
+	ut_asserteq(3, s.max_inflight);
+
+	sandbox_sdm_mb_get_stats(&stats);
+	ut_asserteq(DIV_ROUND_UP(BITSTREAM_SIZE, SZ_16K), stats.cmds);
+	free(ring);
+	free(data);
+
+	return 0;
+}
+DM_TEST(dm_test_fpga_sdm_ring, 0);
+
+/* Command IDs must be recycled correctly when responses come out of order */
+static int dm_test_fpga_sdm_reorder(struct unit_test_state *uts)
+{
+	struct sandbox_sdm_mb_stats stats;
+	struct sdm_stream s = { };
+	u8 *data;
+
+	data = sdm_test_bitstream();
+	ut_assertnonnull(data);
+	s.data = data;
+	s.size = BITSTREAM_SIZE;
+
+	/* Many more commands than there are IDs */
+	sandbox_sdm_mb_init(&s, SDM_STREAM_ID_MAX, SZ_4K, 2,
+			    SANDBOX_SDM_MB_REORDER);
+	ut_assertok(sdm_stream_send(&s));
+	ut_assertok(sdm_test_check(uts, data, BITSTREAM_SIZE));
+	ut_asserteq(SDM_STREAM_ID_MAX, s.max_inflight);
+
+	sandbox_sdm_mb_get_stats(&stats);
+	ut_asserteq(DIV_ROUND_UP(BITSTREAM_SIZE, SZ_4K), stats.cmds);
+	free(data);
+
+	return 0;
+}
+DM_TEST(dm_test_fpga_sdm_reorder, 0);
+
+/* ATF only says it is full once it is, and refuses anything beyond that */
+static int dm_test_fpga_sdm_smc(struct unit_test_state *uts)
+{
+	struct sdm_stream s = { };
+	u8 *data;
+
+	data = sdm_test_bitstream();
+	ut_assertnonnull(data);
+	s.data = data;
+	s.size = BITSTREAM_SIZE;
+
+	sandbox_sdm_mb_init(&s, 3, SZ_64K, 1, SANDBOX_SDM_MB_SMC);
+	ut_asserteq(SDM_STREAM_ID_MAX, s.xfer_max);
+	ut_assertok(sdm_stream_send(&s));
+	ut_assertok(sdm_test_check(uts, data, BITSTREAM_SIZE));
+	ut_asserteq(3, s.max_inflight);
+	free(data);
+
+	return 0;
+}
+DM_TEST(dm_test_fpga_sdm_smc, 0);
+
+/* An error response stops the transfer once the pipeline has drained */
+static int dm_test_fpga_sdm_fail(struct unit_test_state *uts)
+{
+	struct sandbox_sdm_mb_stats stats;
+	struct sdm_stream s = { };
+	u8 *data;
+
+	data = sdm_test_bitstream();
+	ut_assertnonnull(data);
+	s.data = data;
+	s.size = BITSTREAM_SIZE;
+
+	sandbox_sdm_mb_init(&s, 4, SZ_64K, 2, 0);
+	sandbox_sdm_mb_fail(5, 0x1234);
+	ut_asserteq(0x1234, sdm_stream_send(&s));
+
+	sandbox_sdm_mb_get_stats(&stats);
+	ut_asserteq(0, stats.inflight);
+	ut_assert(stats.cmds < DIV_ROUND_UP(BITSTREAM_SIZE, SZ_64K));
+	ut_asserteq(stats.cmds, s.xfers);
+	free(data);
+
+	return 0;
+}
+DM_TEST(dm_test_fpga_sdm_fail, 0);
+
+/* A mailbox error still waits for the commands in flight */
+static int dm_test_fpga_sdm_reap_fail(struct unit_test_state *uts)
+{
+	struct sandbox_sdm_mb_stats stats;
+	struct sdm_stream s = { };
+	u8 *data;
+
+	data = sdm_test_bitstream();
+	ut_assertnonnull(data);
+	s.data = data;
+	s.size = BITSTREAM_SIZE;
+	s.timeout_ms = 1000;
+
+	sandbox_sdm_mb_init(&s, 4, SZ_64K, 3, 0);
+	sandbox_sdm_mb_fail_reap(5, -EIO);
+	ut_asserteq(-EIO, sdm_stream_send(&s));
+
+	sandbox_sdm_mb_get_stats(&stats);
+	ut_asserteq(0, stats.inflight);
+	ut_assert(stats.cmds > 1);
+	ut_asserteq(stats.cmds, s.xfers);
+	free(data);
+
+	return 0;
+}
+DM_TEST(dm_test_fpga_sdm_reap_fail, 0);
+
+/* A read error or a short file ends the transfer */
+static int dm_test_fpga_sdm_read(struct unit_test_state *uts)
+{
+	struct sandbox_sdm_mb_stats stats;
+	struct sdm_test_src src = { };
+	struct sdm_stream s = { };
+	u8 *data, *ring;
+	int i;
+
+	data = sdm_test_bitstream();
+	ut_assertnonnull(data);
+	ring = malloc(4 * SZ_16K);
+	ut_assertnonnull(ring);
+
+	s.read = sdm_test_read;
+	s.src = &src;
+	s.chunk = SZ_16K;
+	s.nr_bufs = 4;
+	for (i = 0; i < s.nr_bufs; i++)
+		s.buf[i] = ring + i * s.chunk;
+
+	src.data = data;
+	src.fail_at = 0x9000;
+	src.fail_ret = -EIO;
+	s.size = BITSTREAM_SIZE;
+	sandbox_sdm_mb_init(&s, 4, SZ_64K, 3, 0);
+	ut_asserteq(-EIO, sdm_stream_send(&s));
+	sandbox_sdm_mb_get_stats(&stats);
+	ut_asserteq(0, stats.inflight);
+	ut_asserteq(0x9000, stats.bytes);
+
+	/* Reaching the end of the file early is not an error */
+	src.offset = 0;
+	src.fail_ret = 0;
+	sandbox_sdm_mb_init(&s, 4, SZ_64K, 3, 0);
+	ut_assertok(sdm_stream_send(&s));
+	ut_assertok(sdm_test_check(uts, data, 0x9000));
+	free(ring);
+	free(data);
+
+	return 0;
+}
+DM_TEST(dm_test_fpga_sdm_read, 0);
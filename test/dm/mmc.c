@@ -7,6 +7,7 @@
 #include <dm.h>
 #include <mmc.h>
 #include <part.h>
+#include <asm/test.h>
 #include <dm/test.h>
 #include <test/test.h>
 #include <test/ut.h>
@@ -52,3 +53,102 @@ static int dm_test_mmc_blk(struct unit_test_state *uts)
 	return 0;
 }
 DM_TEST(dm_test_mmc_blk, UT_TESTF_SCAN_PDATA | UT_TESTF_SCAN_FDT);
+
+/* Test that multiple-block reads are ended by CMD23 rather than CMD12 */
+static int dm_test_mmc_cmd23(struct unit_test_state *uts)
+{
+	struct udevice *dev;
+	struct blk_desc *dev_desc;
+	char write[8 * 512], read[8 * 512];
+	uint sbc, stop;
+	int i;
+
+	ut_assertok(uclass_get_device(UCLASS_MMC, 0, &dev));
+	ut_assertok(blk_get_device_by_str("mmc", "0", &dev_desc));
+
+	for (i = 0; i < sizeof(write); i++)
+		write[i] = i * 3;
+	ut_asserteq(8, blk_dwrite(dev_desc, 16, 8, write));
+	blkcache_invalidate(dev_desc->uclass_id, dev_desc->devnum);
+
+	sbc = sandbox_mmc_get_cmd_count(dev, MMC_CMD_SET_BLOCK_COUNT);
+	stop = sandbox_mmc_get_cmd_count(dev, MMC_CMD_STOP_TRANSMISSION);
+	ut_asserteq(8, blk_dread(dev_desc, 16, 8, read));
+	ut_asserteq_mem(write, read, sizeof(write));
+	ut_assert(sandbox_mmc_get_cmd_count(dev, MMC_CMD_SET_BLOCK_COUNT) > sbc);
+	ut_asserteq(stop,
+		    sandbox_mmc_get_cmd_count(dev, MMC_CMD_STOP_TRANSMISSION));
+
+	return 0;
+}
+DM_TEST(dm_test_mmc_cmd23, UT_TESTF_SCAN_PDATA | UT_TESTF_SCAN_FDT);
+
+/* Test that a failed CMD23 read is stopped with CMD12 */
+static int dm_test_mmc_cmd23_error(struct unit_test_state *uts)
+{
+	struct udevice *dev;
+	struct blk_desc *dev_desc;
+	char read[8 * 512];
+	uint stop;
+
+	ut_assertok(uclass_get_device(UCLASS_MMC, 0, &dev));
+	ut_assertok(blk_get_device_by_str("mmc", "0", &dev_desc));
+	blkcache_invalidate(dev_desc->uclass_id, dev_desc->devnum);
+
+	stop = sandbox_mmc_get_cmd_count(dev, MMC_CMD_STOP_TRANSMISSION);
+	sandbox_mmc_fail_read(dev, true);
+	ut_asserteq(0, blk_dread(dev_desc, 16, 8, read));
+	sandbox_mmc_fail_read(dev, false);
+	ut_asserteq(stop + 1,
+		    sandbox_mmc_get_cmd_count(dev, MMC_CMD_STOP_TRANSMISSION));
+
+	ut_asserteq(8, blk_dread(dev_desc, 16, 8, read));
+	ut_asserteq(stop + 1,
+		    sandbox_mmc_get_cmd_count(dev, MMC_CMD_STOP_TRANSMISSION));
+
+	return 0;
+}
+DM_TEST(dm_test_mmc_cmd23_error, UT_TESTF_SCAN_PDATA | UT_TESTF_SCAN_FDT);
+
+/* Test that a submitted read completes when polled, or before another read */
+static int dm_test_mmc_submit(struct unit_test_state *uts)
+{
+	struct udevice *dev;
+	struct blk_desc *dev_desc;
+	char write[8 * 512], read[8 * 512], other[512];
+	struct blk_req req;
+	int i;
+
+	ut_assertok(uclass_get_device(UCLASS_MMC, 0, &dev));
+	ut_assertok(blk_get_device_by_str("mmc", "0", &dev_desc));
+
+	for (i = 0; i < sizeof(write); i++)
+		write[i] = i * 7;
+	ut_asserteq(8, blk_dwrite(dev_desc, 32, 8, write));
+	blkcache_invalidate(dev_desc->uclass_id, dev_desc->devnum);
+
+	memset(read, '\0', sizeof(read));
+	req = (struct blk_req){
+		.op = BLK_REQ_READ,
+		.start = 32,
+		.blkcnt = 8,
+		.buffer = read,
+	};
+	ut_assertok(blk_submit(dev_desc->bdev, &req));
+	ut_asserteq(false, req.done);
+	ut_asserteq(8, blk_wait(dev_desc->bdev, &req));
+	ut_asserteq_mem(write, read, sizeof(write));
+
+	/* the card must finish the read in flight before it takes another */
+	memset(read, '\0', sizeof(read));
+	ut_assertok(blk_submit(dev_desc->bdev, &req));
+	ut_asserteq(false, req.done);
+	ut_asserteq(1, blk_dread(dev_desc, 39, 1, other));
+	ut_asserteq(true, req.done);
+	ut_asserteq(8, req.result);
+	ut_asserteq_mem(write, read, sizeof(write));
+	ut_asserteq_mem(&write[7 * 512], other, sizeof(other));
+
+	return 0;
+}
+DM_TEST(dm_test_mmc_submit, UT_TESTF_SCAN_PDATA | UT_TESTF_SCAN_FDT);
@@ -0,0 +1,85 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Tests for the NVMe driver, using the sandbox emulator
+ */
+
+#include <common.h>
+#include <blk.h>
+#include <dm.h>
+#include <malloc.h>
+#include <time.h>
+#include <asm/io.h>
+#include <asm/test.h>
+#include <dm/device-internal.h>
+#include <dm/lists.h>
+#include <dm/root.h>
+#include <dm/test.h>
+#include <test/test.h>
+#include <test/ut.h>
+
+#define NVME_TEST_BLKS	2048		/* 1 MiB, eight 128 KiB commands */
+#define NVME_LATENCY_US	20000
+
+/* Test that the driver keeps several commands in flight */
+static int dm_test_nvme_queue(struct unit_test_state *uts)
+{
+	struct udevice *dev, *blk;
+	uint cmds, max_inflight;
+	struct blk_req req;
+	u8 *buf, *chk;
+	ulong start;
+	int i;
+
+	sandbox_set_enable_memio(true);
+	ut_assertok(device_bind_driver(dm_root(), "sandbox_nvme", "nvme-sb",
+				       &dev));
+	ut_assertok(device_probe(dev));
+	ut_assertok(blk_get_from_parent(dev, &blk));
+	ut_assertok(device_probe(blk));
+
+	buf = malloc(NVME_TEST_BLKS * 512);
+	ut_assertnonnull(buf);
+	chk = malloc(NVME_TEST_BLKS * 512 + 512);
+	ut_assertnonnull(chk);
+	for (i = 0; i < NVME_TEST_BLKS * 512; i++)
+		buf[i] = i * 7 + i / 512;
+
+	ut_asserteq(NVME_TEST_BLKS, blk_write(blk, 0, NVME_TEST_BLKS, buf));
+	sandbox_nvme_get_stats(dev, &cmds, &max_inflight);
+	ut_asserteq(8, cmds);
+	ut_asserteq(8, max_inflight);
+
+	/*
+	 * With all commands in flight the read takes a little more than one
+	 * latency, where one command at a time would take eight. Use a
+	 * buffer which is not page-aligned so that the PRPs have an offset.
+	 */
+	sandbox_nvme_set_latency(dev, NVME_LATENCY_US);
+	start = timer_get_us();
+	ut_asserteq(NVME_TEST_BLKS, blk_read(blk, 0, NVME_TEST_BLKS,
+					     chk + 512));
+	ut_assert(timer_get_us() - start < 8 * NVME_LATENCY_US);
+	ut_asserteq_mem(buf, chk + 512, NVME_TEST_BLKS * 512);
+
+	/* the request completes only when polled */
+	memset(chk, '\0', NVME_TEST_BLKS * 512);
+	req = (struct blk_req){
+		.op = BLK_REQ_READ,
+		.start = 0,
+		.blkcnt = NVME_TEST_BLKS,
+		.buffer = chk,
+	};
+	ut_assertok(blk_submit(blk, &req));
+	ut_asserteq(false, req.done);
+	ut_asserteq(NVME_TEST_BLKS, blk_wait(blk, &req));
+	ut_asserteq_mem(buf, chk, NVME_TEST_BLKS * 512);
+
+	ut_assertok(device_remove(dev, DM_REMOVE_NORMAL));
+	ut_assertok(device_unbind(dev));
+	free(chk);
+	free(buf);
+	sandbox_set_enable_memio(false);
+
+	return 0;
+}
+DM_TEST(dm_test_nvme_queue, UT_TESTF_SCAN_FDT);
@@ -5,6 +5,7 @@
 
 #include <common.h>
 #include <dm.h>
+#include <env.h>
 #include <fdtdec.h>
 #include <spi.h>
 #include <spi_flash.h>
@@ -201,3 +202,108 @@ static int dm_test_spi_xfer(struct unit_test_state *uts)
 	return 0;
 }
 DM_TEST(dm_test_spi_xfer, UT_TESTF_SCAN_PDATA | UT_TESTF_SCAN_FDT);
+
+static int spi_test_set_tap(struct udevice *dev, uint tap)
+{
+	sandbox_spi_set_tap(dev_get_parent(dev), tap);
+
+	return 0;
+}
+
+static int spi_test_read_id(struct udevice *dev, u8 *buf, uint len)
+{
+	struct spi_slave *slave = dev_get_parent_priv(dev);
+	u8 dout[SPI_TAP_SCAN_MAX_LEN + 1] = {0x9f};
+	u8 din[SPI_TAP_SCAN_MAX_LEN + 1];
+	int ret;
+
+	ret = spi_xfer(slave, (len + 1) * 8, dout, din,
+		       SPI_XFER_BEGIN | SPI_XFER_END);
+	if (ret)
+		return ret;
+	memcpy(buf, din + 1, len);
+
+	return 0;
+}
+
+/* Test scanning read-capture taps and caching the result */
+static int dm_test_spi_tap_scan(struct unit_test_state *uts)
+{
+	static const u8 idcode[] = {0x20, 0x20, 0x15};
+	static const u8 other[] = {0xc2, 0x20, 0x15};
+	struct spi_tap_scan scan = {
+		.taps = 16,
+		.set_tap = spi_test_set_tap,
+		.read = spi_test_read_id,
+		.pattern = idcode,
+		.len = sizeof(idcode),
+	};
+	struct spi_slave *slave;
+	struct udevice *bus;
+	int lo, hi;
+
+	ut_assertok(spi_get_bus_and_cs(0, 0, &bus, &slave));
+	ut_assertok(spi_claim_bus(slave));
+
+	/* the middle of the only window */
+	sandbox_spi_set_tap_window(bus, true, 5, 11);
+	ut_asserteq(8, spi_scan_taps(slave->dev, &scan, &lo, &hi));
+	ut_asserteq(5, lo);
+	ut_asserteq(11, hi);
+
+	/* a window reaching the last tap */
+	sandbox_spi_set_tap_window(bus, true, 13, 15);
+	ut_asserteq(14, spi_scan_taps(slave->dev, &scan, &lo, &hi));
+	ut_asserteq(13, lo);
+	ut_asserteq(15, hi);
+
+	/* the widest of several windows, wherever it is */
+	sandbox_spi_set_tap_window(bus, true, 1, 3);
+	sandbox_spi_add_tap_window(bus, 7, 12);
+	sandbox_spi_add_tap_window(bus, 14, 15);
+	ut_asserteq(9, spi_scan_taps(slave->dev, &scan, &lo, &hi));
+	ut_asserteq(7, lo);
+	ut_asserteq(12, hi);
+
+	sandbox_spi_set_tap_window(bus, true, 0, 5);
+	sandbox_spi_add_tap_window(bus, 9, 11);
+	ut_asserteq(2, spi_scan_taps(slave->dev, &scan, &lo, &hi));
+	ut_asserteq(0, lo);
+	ut_asserteq(5, hi);
+
+	/* the first of two windows as wide as each other */
+	sandbox_spi_set_tap_window(bus, true, 2, 4);
+	sandbox_spi_add_tap_window(bus, 10, 12);
+	ut_asserteq(3, spi_scan_taps(slave->dev, &scan, &lo, &hi));
+	ut_asserteq(2, lo);
+	ut_asserteq(4, hi);
+
+	/* no window at all */
+	sandbox_spi_set_tap_window(bus, true, 16, 16);
+	ut_asserteq(-ENOENT, spi_scan_taps(slave->dev, &scan, NULL, NULL));
+
+	sandbox_spi_set_tap_window(bus, false, 0, 0);
+	spi_release_bus(slave);
+
+	/* the cached tap is only used for the same speed, cs and pattern */
+	ut_asserteq(-ENOENT, spi_tap_cache_get(bus, 50000000, 0, idcode,
+					       sizeof(idcode)));
+	spi_tap_cache_set(bus, 50000000, 0, idcode, sizeof(idcode), 8);
+	ut_asserteq_str("50000000,0,202015:8", env_get("spi0_rddelay"));
+	ut_asserteq(8, spi_tap_cache_get(bus, 50000000, 0, idcode,
+					 sizeof(idcode)));
+	ut_asserteq(-ENOENT, spi_tap_cache_get(bus, 25000000, 0, idcode,
+					       sizeof(idcode)));
+	ut_asserteq(-ENOENT, spi_tap_cache_get(bus, 50000000, 1, idcode,
+					       sizeof(idcode)));
+	ut_asserteq(-ENOENT, spi_tap_cache_get(bus, 50000000, 0, other,
+					       sizeof(other)));
+	ut_assertok(env_set("spi0_rddelay", NULL));
+
+#if CONFIG_IS_ENABLED(DM_SPI_FLASH)
+	sandbox_sf_unbind_emul(state_get_current(), 0, 0);
+#endif
+
+	return 0;
+}
+DM_TEST(dm_test_spi_tap_scan, UT_TESTF_SCAN_PDATA | UT_TESTF_SCAN_FDT);
@@ -9,7 +9,9 @@
 #include <mapmem.h>
 #include <os.h>
 #include <spl.h>
+#include <asm/unaligned.h>
 #include <test/ut.h>
+#include <u-boot/crc.h>
 
 /* Declare a new SPL test */
 #define SPL_TEST(_name, _flags)		UNIT_TEST(_name, _flags, spl_test)
@@ -89,3 +91,285 @@ static int spl_test_load(struct unit_test_state *uts)
 	return 0;
 }
 SPL_TEST(spl_test_load, 0);
+
+/* Layout of the FIT used by the streaming tests, as sandbox addresses */
+#define TEST_FIT_ADDR		0x400000
+#define TEST_FIT_DATA_POS	0x1010
+#define TEST_LOAD_ADDR		0x200000
+#define TEST_DATA_SIZE		0x2000
+#define TEST_GZIP_BLOCK		1000
+
+/**
+ * struct mem_ctx - context for reading a FIT from memory
+ *
+ * @base:	Start of the FIT
+ * @reads:	Number of reads of the image data
+ * @max_read:	Size of the largest read of the image data
+ */
+struct mem_ctx {
+	const u8 *base;
+	int reads;
+	ulong max_read;
+};
+
+static ulong read_mem_image(struct spl_load_info *load, ulong sector,
+			    ulong count, void *buf)
+{
+	struct mem_ctx *ctx = load->priv;
+	ulong offset = sector * load->bl_len;
+	ulong size = count * load->bl_len;
+
+	memcpy(buf, ctx->base + offset, size);
+	if (offset >= ALIGN_DOWN(TEST_FIT_DATA_POS, load->bl_len)) {
+		ctx->reads++;
+		ctx->max_read = max(ctx->max_read, size);
+	}
+
+	return count;
+}
+
+/*
+ * Write @size bytes from @src to @dst as a gzip file made of stored deflate
+ * blocks, returning its size. SPL has no deflate, but this is enough to
+ * exercise the gzip header, block and trailer handling while loading.
+ */
+static int spl_test_gzip(u8 *dst, const u8 *src, int size)
+{
+	static const u8 header[] = { 0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 3 };
+	u8 *ptr = dst;
+	int offset, len;
+
+	memcpy(ptr, header, sizeof(header));
+	ptr += sizeof(header);
+	for (offset = 0; offset < size; offset += len) {
+		len = min(size - offset, TEST_GZIP_BLOCK);
+		*ptr++ = offset + len == size;	/* BFINAL, BTYPE = stored */
+		put_unaligned_le16(len, ptr);
+		put_unaligned_le16(~len, ptr + 2);
+		ptr += 4;
+		memcpy(ptr, src + offset, len);
+		ptr += len;
+	}
+	put_unaligned_le32(crc32(0, src, size), ptr);
+	put_unaligned_le32(size, ptr + 4);
+	ptr += 8;
+
+	return ptr - dst;
+}
+
+/*
+ * Build a FIT at TEST_FIT_ADDR holding @data as the external data of a
+ * single firmware image, with a sha256 hash node and optionally a signature
+ * node. The hash is corrupted if @bad_hash is set.
+ */
+static int spl_test_build_fit(const u8 *data, int size, bool gzip,
+			      bool bad_hash, bool sign)
+{
+	void *fit = map_sysmem(TEST_FIT_ADDR, TEST_FIT_DATA_POS + size);
+	u8 value[FIT_MAX_HASH_LEN];
+	int value_len;
+	int ret;
+
+	ret = calculate_hash(data, size, "sha256", value, &value_len);
+	if (ret)
+		return ret;
+	if (bad_hash)
+		value[0] ^= 1;
+
+	ret = fdt_create(fit, TEST_FIT_DATA_POS);
+	ret |= fdt_finish_reservemap(fit);
+	ret |= fdt_begin_node(fit, "");
+	ret |= fdt_property_string(fit, FIT_DESC_PROP, "SPL streaming test");
+	ret |= fdt_begin_node(fit, FIT_IMAGES_PATH + 1);
+	ret |= fdt_begin_node(fit, "firmware-1");
+	ret |= fdt_property_string(fit, FIT_DESC_PROP, "Firmware");
+	ret |= fdt_property_string(fit, FIT_TYPE_PROP, "firmware");
+	ret |= fdt_property_string(fit, FIT_ARCH_PROP, "sandbox");
+	ret |= fdt_property_string(fit, FIT_OS_PROP, "efi");
+	ret |= fdt_property_string(fit, FIT_COMP_PROP, gzip ? "gzip" : "none");
+	ret |= fdt_property_u32(fit, FIT_LOAD_PROP, TEST_LOAD_ADDR);
+	ret |= fdt_property_u32(fit, FIT_DATA_POSITION_PROP, TEST_FIT_DATA_POS);
+	ret |= fdt_property_u32(fit, FIT_DATA_SIZE_PROP, size);
+	ret |= fdt_begin_node(fit, FIT_HASH_NODENAME "-1");
+	ret |= fdt_property_string(fit, FIT_ALGO_PROP, "sha256");
+	ret |= fdt_property(fit, FIT_VALUE_PROP, value, value_len);
+	ret |= fdt_end_node(fit);
+	if (sign) {
+		ret |= fdt_begin_node(fit, FIT_SIG_NODENAME "-1");
+		ret |= fdt_property_string(fit, FIT_ALGO_PROP,
+					   "sha256,rsa2048");
+		ret |= fdt_property_string(fit, FIT_KEY_HINT, "dev");
+		ret |= fdt_property(fit, FIT_VALUE_PROP, value, value_len);
+		ret |= fdt_end_node(fit);
+	}
+	ret |= fdt_end_node(fit);
+	ret |= fdt_end_node(fit);
+	ret |= fdt_begin_node(fit, FIT_CONFS_PATH + 1);
+	ret |= fdt_property_string(fit, FIT_DEFAULT_PROP, "conf-1");
+	ret |= fdt_begin_node(fit, "conf-1");
+	ret |= fdt_property_string(fit, FIT_DESC_PROP, "Streaming test");
+	ret |= fdt_property_string(fit, FIT_FIRMWARE_PROP, "firmware-1");
+	ret |= fdt_end_node(fit);
+	ret |= fdt_end_node(fit);
+	ret |= fdt_end_node(fit);
+	ret |= fdt_finish(fit);
+	if (ret)
+		return -ENOSPC;
+
+	memcpy(fit + TEST_FIT_DATA_POS, data, size);
+	unmap_sysmem(fit);
+
+	return 0;
+}
+
+/* Load the FIT built at TEST_FIT_ADDR, recording its reads in @ctx */
+static int spl_test_load_mem(struct spl_image_info *image,
+			     struct mem_ctx *ctx)
+{
+	struct spl_load_info load;
+
+	memset(&load, '\0', sizeof(load));
+	load.bl_len = 512;
+	load.read = read_mem_image;
+	load.priv = ctx;
+
+	memset(ctx, '\0', sizeof(*ctx));
+	ctx->base = map_sysmem(TEST_FIT_ADDR, 0);
+	memset(image, '\0', sizeof(*image));
+	memset(map_sysmem(TEST_LOAD_ADDR, TEST_DATA_SIZE), '\0',
+	       TEST_DATA_SIZE);
+
+	return spl_load_simple_fit(image, &load, 0, (void *)ctx->base);
+}
+
+static u8 spl_test_data[TEST_DATA_SIZE];
+static u8 spl_test_gz[TEST_DATA_SIZE + TEST_DATA_SIZE / 8];
+
+static int spl_test_stream_setup(void)
+{
+	int i;
+
+	if (!CONFIG_IS_ENABLED(LOAD_FIT_STREAM) || !IS_ENABLED(CONFIG_SPL_GZIP))
+		return -EAGAIN;
+
+	for (i = 0; i < TEST_DATA_SIZE; i++)
+		spl_test_data[i] = i * 7 + i / 251;
+
+	return 0;
+}
+
+/* Check that an uncompressed image is read a chunk at a time */
+static int spl_test_load_stream(struct unit_test_state *uts)
+{
+	struct spl_image_info image;
+	struct mem_ctx ctx;
+	int ret;
+
+	ret = spl_test_stream_setup();
+	if (ret)
+		return ret;
+
+	ut_assertok(spl_test_build_fit(spl_test_data, TEST_DATA_SIZE, false,
+				       false, false));
+	ut_assertok(spl_test_load_mem(&image, &ctx));
+	ut_asserteq(TEST_LOAD_ADDR, image.load_addr);
+	ut_asserteq(TEST_DATA_SIZE, image.size);
+	ut_asserteq_mem(spl_test_data, map_sysmem(TEST_LOAD_ADDR, 0),
+			TEST_DATA_SIZE);
+	ut_assert(ctx.reads > 1);
+	ut_assert(ctx.max_read <= CONFIG_SPL_LOAD_FIT_STREAM_BUF_SZ);
+
+	return 0;
+}
+SPL_TEST(spl_test_load_stream, 0);
+
+/* Check that a gzip image is inflated as it is read */
+static int spl_test_load_stream_gzip(struct unit_test_state *uts)
+{
+	struct spl_image_info image;
+	struct mem_ctx ctx;
+	int ret, size;
+
+	ret = spl_test_stream_setup();
+	if (ret)
+		return ret;
+
+	size = spl_test_gzip(spl_test_gz, spl_test_data, TEST_DATA_SIZE);
+	ut_assertok(spl_test_build_fit(spl_test_gz, size, true, false, false));
+	ut_assertok(spl_test_load_mem(&image, &ctx));
+	ut_asserteq(TEST_DATA_SIZE, image.size);
+	ut_asserteq_mem(spl_test_data, map_sysmem(TEST_LOAD_ADDR, 0),
+			TEST_DATA_SIZE);
+	ut_assert(ctx.reads > 1);
+	ut_assert(ctx.max_read <= CONFIG_SPL_LOAD_FIT_STREAM_BUF_SZ);
+
+	return 0;
+}
+SPL_TEST(spl_test_load_stream_gzip, 0);
+
+/* Check that a hash mismatch is only reported once all data is read */
+static int spl_test_load_stream_bad_hash(struct unit_test_state *uts)
+{
+	struct spl_image_info image;
+	struct mem_ctx ctx;
+	int ret;
+
+	ret = spl_test_stream_setup();
+	if (ret)
+		return ret;
+
+	ut_assertok(spl_test_build_fit(spl_test_data, TEST_DATA_SIZE, false,
+				       true, false));
+	ut_asserteq(-EPERM, spl_test_load_mem(&image, &ctx));
+	ut_assert(ctx.reads > 1);
+
+	return 0;
+}
+SPL_TEST(spl_test_load_stream_bad_hash, 0);
+
+/* Check that a gzip stream which stops before its last block is an error */
+static int spl_test_load_stream_truncated(struct unit_test_state *uts)
+{
+	struct spl_image_info image;
+	struct mem_ctx ctx;
+	int ret, size;
+
+	ret = spl_test_stream_setup();
+	if (ret)
+		return ret;
+
+	/* Drop the trailer and the end of the last block; the hash is good */
+	size = spl_test_gzip(spl_test_gz, spl_test_data, TEST_DATA_SIZE);
+	size -= TEST_GZIP_BLOCK / 10;
+	ut_assertok(spl_test_build_fit(spl_test_gz, size, true, false, false));
+	ut_asserteq(-EIO, spl_test_load_mem(&image, &ctx));
+
+	return 0;
+}
+SPL_TEST(spl_test_load_stream_truncated, 0);
+
+/* Check that an image with a signature node is loaded in one go instead */
+static int spl_test_load_stream_signed(struct unit_test_state *uts)
+{
+	struct spl_image_info image;
+	struct mem_ctx ctx;
+	int ret;
+
+	ret = spl_test_stream_setup();
+	if (ret)
+		return ret;
+	if (!CONFIG_IS_ENABLED(FIT_SIGNATURE))
+		return -EAGAIN;
+
+	ut_assertok(spl_test_build_fit(spl_test_data, TEST_DATA_SIZE, false,
+				       false, true));
+	ut_assertok(spl_test_load_mem(&image, &ctx));
+	ut_asserteq(TEST_DATA_SIZE, image.size);
+	ut_asserteq_mem(spl_test_data, map_sysmem(TEST_LOAD_ADDR, 0),
+			TEST_DATA_SIZE);
+	ut_asserteq(1, ctx.reads);
+	ut_assert(ctx.max_read > CONFIG_SPL_LOAD_FIT_STREAM_BUF_SZ);
+
+	return 0;
+}
+SPL_TEST(spl_test_load_stream_signed, 0);
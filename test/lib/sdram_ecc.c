@@ -0,0 +1,261 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Copyright (C) 2024 Intel Corporation <www.intel.com>
+ *
+ * Tests for splitting SDRAM between CPU cores for ECC initialisation
+ */
+
+#include <common.h>
+#include <malloc.h>
+#include <os.h>
+#include <linux/sizes.h>
+#include <test/lib.h>
+#include <test/test.h>
+#include <test/ut.h>
+#include "../../drivers/ddr/altera/sdram_soc64_ecc.h"
+
+#define ALIGN_SZ	64
+
+/*
+ * Check that the ranges, taken in slot order, cover the banks exactly once
+ * and that each core except the last got the same amount of memory
+ */
+static int check_split(struct unit_test_state *uts,
+		       const struct sdram_ecc_range *bank, int nr_banks,
+		       const struct sdram_ecc_slot *slot, int nr_cpus)
+{
+	u64 pos, share = 0;
+	int b = 0, cpu, i;
+
+	pos = bank[0].start;
+	for (cpu = 0; cpu < nr_cpus; cpu++) {
+		u64 total = 0;
+
+		for (i = 0; i < slot[cpu].nr_ranges; i++) {
+			const struct sdram_ecc_range *r = &slot[cpu].range[i];
+
+			if (pos == bank[b].start + bank[b].size) {
+				ut_assert(++b < nr_banks);
+				pos = bank[b].start;
+			}
+			ut_asserteq_64(pos, r->start);
+			ut_assert(r->size);
+			ut_assert(r->start + r->size <= bank[b].start +
+				  bank[b].size);
+			ut_asserteq(0, (r->start | r->size) & (ALIGN_SZ - 1));
+			pos += r->size;
+			total += r->size;
+		}
+		if (!cpu)
+			share = total;
+		else if (cpu < nr_cpus - 1)
+			ut_asserteq_64(share, total);
+		else
+			ut_assert(total <= share);
+	}
+	ut_asserteq(nr_banks - 1, b);
+	ut_asserteq_64(bank[b].start + bank[b].size, pos);
+
+	return 0;
+}
+
+/* Test sdram_ecc_split() with shares crossing a bank boundary */
+static int lib_test_sdram_ecc_split(struct unit_test_state *uts)
+{
+	struct sdram_ecc_range bank[] = {
+		{ 0x8000, SZ_2G - 0x8000 },
+		{ 0x100000000ULL, 0x180000000ULL },
+	};
+	struct sdram_ecc_slot slot[SDRAM_ECC_MAX_CPUS];
+	int cpu;
+
+	for (cpu = 1; cpu <= SDRAM_ECC_MAX_CPUS; cpu++) {
+		ut_asserteq(cpu, sdram_ecc_split(bank, ARRAY_SIZE(bank), slot,
+						 cpu, ALIGN_SZ));
+		ut_assertok(check_split(uts, bank, ARRAY_SIZE(bank), slot,
+					cpu));
+	}
+
+	/* The first core spills 24KiB into the second bank */
+	ut_asserteq(2, slot[0].nr_ranges);
+	ut_asserteq_64(0x100000000ULL, slot[0].range[1].start);
+	ut_asserteq_64(0x6000, slot[0].range[1].size);
+	ut_asserteq(1, slot[3].nr_ranges);
+
+	/* Too little memory to keep every core busy */
+	bank[0].size = 2 * ALIGN_SZ;
+	ut_asserteq(2, sdram_ecc_split(bank, 1, slot, 4, ALIGN_SZ));
+	ut_asserteq(0, slot[2].nr_ranges);
+	ut_assertok(check_split(uts, bank, 1, slot, 2));
+
+	bank[0].size = 0;
+	ut_asserteq(0, sdram_ecc_split(bank, 1, slot, 4, ALIGN_SZ));
+
+	/* Misaligned banks are refused */
+	bank[0].size = ALIGN_SZ + 8;
+	ut_asserteq(-EINVAL, sdram_ecc_split(bank, 1, slot, 4, ALIGN_SZ));
+
+	return 0;
+}
+LIB_TEST(lib_test_sdram_ecc_split, 0);
+
+/* Test that a core needing too many ranges is refused */
+static int lib_test_sdram_ecc_split_ranges(struct unit_test_state *uts)
+{
+	struct sdram_ecc_range bank[SDRAM_ECC_MAX_RANGES + 1];
+	struct sdram_ecc_slot slot[SDRAM_ECC_MAX_CPUS];
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(bank); i++) {
+		bank[i].start = i * SZ_1M;
+		bank[i].size = ALIGN_SZ;
+	}
+	ut_asserteq(-E2BIG, sdram_ecc_split(bank, ARRAY_SIZE(bank), slot, 1,
+					    ALIGN_SZ));
+	ut_asserteq(3, sdram_ecc_split(bank, ARRAY_SIZE(bank), slot, 3,
+				       ALIGN_SZ));
+	ut_assertok(check_split(uts, bank, ARRAY_SIZE(bank), slot, 3));
+
+	return 0;
+}
+LIB_TEST(lib_test_sdram_ecc_split_ranges, 0);
+
+static void *sdram_ecc_worker(void *arg)
+{
+	struct sdram_ecc_slot *slot = arg;
+	int i;
+
+	for (i = 0; i < slot->nr_ranges; i++)
+		memset((void *)(uintptr_t)slot->range[i].start, '\0',
+		       slot->range[i].size);
+	slot->state = SDRAM_ECC_DONE;
+
+	return NULL;
+}
+
+/* Clear memory from host threads, one per core, as the SoC64 SPL does */
+static int lib_test_sdram_ecc_threads(struct unit_test_state *uts)
+{
+	struct sdram_ecc_slot slot[SDRAM_ECC_MAX_CPUS];
+	struct sdram_ecc_range bank[3];
+	ulong tid[SDRAM_ECC_MAX_CPUS];
+	const int size = SZ_1M;
+	int cpu, nr_cpus, i;
+	char *buf;
+
+	buf = memalign(ALIGN_SZ, size);
+	ut_assertnonnull(buf);
+	memset(buf, 0xa5, size);
+
+	/* Unevenly sized banks with gaps between them */
+	bank[0].start = (uintptr_t)buf + ALIGN_SZ;
+	bank[0].size = 0x1c000;
+	bank[1].start = (uintptr_t)buf + 0x40000;
+	bank[1].size = 0x80040;
+	bank[2].start = (uintptr_t)buf + 0xe0000;
+	bank[2].size = 0x1ff80;
+
+	nr_cpus = sdram_ecc_split(bank, ARRAY_SIZE(bank), slot,
+				  SDRAM_ECC_MAX_CPUS, ALIGN_SZ);
+	ut_asserteq(SDRAM_ECC_MAX_CPUS, nr_cpus);
+	ut_assertok(check_split(uts, bank, ARRAY_SIZE(bank), slot, nr_cpus));
+
+	for (cpu = 0; cpu < nr_cpus; cpu++)
+		ut_assertok(os_thread_start(&tid[cpu], sdram_ecc_worker,
+					    &slot[cpu]));
+	for (cpu = 0; cpu < nr_cpus; cpu++) {
+		ut_assertok(os_thread_join(tid[cpu]));
+		ut_asserteq(SDRAM_ECC_DONE, slot[cpu].state);
+	}
+
+	for (i = 0; i < size; i++) {
+		uintptr_t addr = (uintptr_t)buf + i;
+		bool in_bank = false;
+		int b;
+
+		for (b = 0; b < ARRAY_SIZE(bank); b++) {
+			if (addr >= bank[b].start &&
+			    addr < bank[b].start + bank[b].size)
+				in_bank = true;
+		}
+		ut_asserteq(in_bank ? 0 : 0xa5, (u8)buf[i]);
+	}
+	free(buf);
+
+	return 0;
+}
+LIB_TEST(lib_test_sdram_ecc_threads, 0);
+
+static struct sdram_ecc_range cleared[8];
+static int nr_cleared;
+
+static void record_clear(const struct sdram_ecc_range *r)
+{
+	if (nr_cleared < ARRAY_SIZE(cleared))
+		cleared[nr_cleared] = *r;
+	nr_cleared++;
+}
+
+/* Test the lazy scrub map across banks with a partial last block */
+static int lib_test_sdram_ecc_map(struct unit_test_state *uts)
+{
+	static const struct sdram_ecc_range bank[] = {
+		{ 0, SZ_16M },
+		{ 0x100000000ULL, SZ_8M + SZ_1M },
+	};
+	struct sdram_ecc_map map;
+	struct sdram_ecc_range r;
+	ulong bits[1];
+
+	/* 8 blocks in the first bank, 5 in the second, the last 1MiB */
+	ut_asserteq(13, sdram_ecc_map_init(&map, bank, ARRAY_SIZE(bank),
+					   bits));
+	ut_asserteq(13, map.left);
+
+	sdram_ecc_map_unit(&map, 7, &r);
+	ut_asserteq_64(SZ_16M - SZ_2M, r.start);
+	ut_asserteq_64(SZ_2M, r.size);
+	sdram_ecc_map_unit(&map, 8, &r);
+	ut_asserteq_64(0x100000000ULL, r.start);
+	sdram_ecc_map_unit(&map, 12, &r);
+	ut_asserteq_64(0x100000000ULL + SZ_8M, r.start);
+	ut_asserteq_64(SZ_1M, r.size);
+
+	/* a region straddling two blocks marks both, clearing them once */
+	nr_cleared = 0;
+	ut_asserteq(2, sdram_ecc_map_mark(&map, SZ_2M - 1, 2, record_clear));
+	ut_asserteq(2, nr_cleared);
+	ut_asserteq_64(0, cleared[0].start);
+	ut_asserteq_64(SZ_2M, cleared[1].start);
+	ut_asserteq(0, sdram_ecc_map_mark(&map, 0, SZ_4M, record_clear));
+	ut_asserteq(2, nr_cleared);
+	ut_asserteq(11, map.left);
+
+	/* a region spanning the gap between banks only marks bank blocks */
+	nr_cleared = 0;
+	ut_asserteq(2, sdram_ecc_map_mark(&map, SZ_16M - SZ_2M,
+					  0x100000000ULL + SZ_2M - SZ_16M + 1,
+					  record_clear));
+	ut_asserteq_64(SZ_16M - SZ_2M, cleared[0].start);
+	ut_asserteq_64(0x100000000ULL, cleared[1].start);
+
+	/* outside every bank, or empty */
+	ut_asserteq(0, sdram_ecc_map_mark(&map, SZ_1G, SZ_1G, NULL));
+	ut_asserteq(0, sdram_ecc_map_mark(&map, SZ_4M, 0, NULL));
+
+	/* the second block of bank 1 is the first still to clear there */
+	ut_asserteq(2, sdram_ecc_map_next(&map, 0));
+	ut_asserteq(9, sdram_ecc_map_next(&map, 7));
+	ut_assert(sdram_ecc_map_set(&map, 12));
+	ut_assert(!sdram_ecc_map_set(&map, 12));
+	ut_asserteq(13, sdram_ecc_map_next(&map, 12));
+	ut_asserteq(8, map.left);
+
+	/* the end of the last, partial block */
+	ut_assert(sdram_ecc_map_test(&map, 12));
+	ut_asserteq(0, sdram_ecc_map_mark(&map, 0x100000000ULL + SZ_8M,
+					  SZ_1M, NULL));
+
+	return 0;
+}
+LIB_TEST(lib_test_sdram_ecc_map, 0);
@@ -0,0 +1,79 @@
+# SPDX-License-Identifier: GPL-2.0+
+# Copyright (C) 2024 Intel Corporation <www.intel.com>
+
+"""
+Read contiguous and fragmented files from a FAT filesystem and report how
+long each load takes, to check and benchmark the cluster-chain cache.
+"""
+
+import os
+import re
+import pytest
+from tests import fs_helper
+
+FILE_SIZE = 0x400000
+PAD_SIZE = 0x4000
+PAD_COUNT = 128
+SRC_ADDR = 0x1000000
+DST_ADDR = 0x2000000
+
+def load_timed(cons, name, what):
+    """Load a file from the filesystem and compare it with the source data"""
+    output = cons.run_command('time fatload host 0:0 %x %s' %
+                              (DST_ADDR, name))
+    assert '%d bytes read' % FILE_SIZE in output
+    match = re.search(r'time: (.*)', output)
+    cons.log.info('%s: %s' % (what, match.group(1) if match else '?'))
+
+    output = cons.run_command('cmp.b %x %x %x' %
+                              (SRC_ADDR, DST_ADDR, FILE_SIZE))
+    assert 'Total of %d byte(s) were the same' % FILE_SIZE in output
+
+@pytest.mark.boardspec('sandbox')
+@pytest.mark.buildconfigspec('cmd_fat')
+@pytest.mark.buildconfigspec('fat_write')
+@pytest.mark.buildconfigspec('cmd_time')
+@pytest.mark.requiredtool('mkfs.vfat')
+@pytest.mark.slow
+def test_fat_frag(u_boot_console):
+    """Test reading files whose clusters are and are not consecutive"""
+    cons = u_boot_console
+    fs_img = fs_helper.mk_fs(cons.config, 'fat32', 0x4000000, 'frag')
+    data = os.path.join(cons.config.persistent_data_dir, 'frag.bin')
+    with open(data, 'wb') as fd:
+        fd.write(os.urandom(FILE_SIZE))
+
+    cons.run_command_list([
+        'host bind 0 %s' % fs_img,
+        'host load hostfs - %x %s' % (SRC_ADDR, data)])
+
+    with cons.log.section('Contiguous file'):
+        cons.run_command('fatwrite host 0:0 %x contig %x' %
+                         (SRC_ADDR, FILE_SIZE))
+        load_timed(cons, 'contig', 'contiguous, first load')
+        load_timed(cons, 'contig', 'contiguous, second load')
+
+    with cons.log.section('Fragmented file'):
+        # Leave holes between small files for the next file to fill
+        for i in range(PAD_COUNT):
+            cons.run_command('fatwrite host 0:0 %x pad%d %x' %
+                             (SRC_ADDR, i, PAD_SIZE))
+        for i in range(0, PAD_COUNT, 2):
+            cons.run_command('fatrm host 0:0 pad%d' % i)
+        cons.run_command('fatwrite host 0:0 %x frag %x' %
+                         (SRC_ADDR, FILE_SIZE))
+        load_timed(cons, 'frag', 'fragmented, first load')
+        load_timed(cons, 'frag', 'fragmented, second load')
+
+    with cons.log.section('Rewritten file'):
+        # The chain cached for the old file must not be used for the new one
+        cons.run_command('fatrm host 0:0 frag')
+        for i in range(1, PAD_COUNT, 2):
+            cons.run_command('fatrm host 0:0 pad%d' % i)
+        cons.run_command('fatwrite host 0:0 %x frag %x' %
+                         (SRC_ADDR, FILE_SIZE))
+        load_timed(cons, 'frag', 'rewritten')
+
+    cons.run_command('host unbind 0')
+    os.remove(data)
+    os.remove(fs_img)
@@ -0,0 +1,93 @@
+# SPDX-License-Identifier: GPL-2.0+
+# Copyright (C) 2024 Intel Corporation <www.intel.com>
+
+"""
+Load small files from a deep directory tree in a SquashFS image several times
+and report how long each load takes, to check and benchmark the metadata and
+fragment block cache.
+"""
+
+import hashlib
+import os
+import re
+import shutil
+import subprocess
+import pytest
+
+DEPTH = 8
+FILES = 64
+FILE_SIZE = 3000
+ADDR = 0x1000000
+
+def mk_tree(path, seed, count):
+    """Create a directory tree whose files are packed into fragment blocks
+
+    Returns:
+        dict of file path in the image to MD5 digest
+    """
+    digests = {}
+    shutil.rmtree(path, ignore_errors=True)
+    subdir = '/'.join('d%d' % i for i in range(DEPTH))
+    os.makedirs(os.path.join(path, subdir))
+    for i in range(count):
+        name = '%s/f%d' % (subdir, i)
+        data = bytes((seed + i * 7 + j) & 0xff for j in range(FILE_SIZE))
+        with open(os.path.join(path, name), 'wb') as fd:
+            fd.write(data)
+        digests[name] = hashlib.md5(data).hexdigest()
+
+    return digests
+
+def mk_image(cons, name, seed, count):
+    """Create a SquashFS image, returns its path and the digests of its files"""
+    src = os.path.join(cons.config.persistent_data_dir, name)
+    img = src + '.img'
+    digests = mk_tree(src, seed, count)
+    if os.path.exists(img):
+        os.remove(img)
+    subprocess.run(['mksquashfs', src, img, '-noappend', '-no-xattrs'],
+                   check=True, capture_output=True)
+    shutil.rmtree(src)
+
+    return img, digests
+
+def load_all(cons, digests, what):
+    """Load every file, check its contents and log the time taken"""
+    total = 0.0
+    for name, digest in digests.items():
+        output = cons.run_command('time sqfsload host 0 %x %s' % (ADDR, name))
+        assert '%d bytes read' % FILE_SIZE in output
+        match = re.search(r'time: (\d+)\.(\d+) seconds', output)
+        if match:
+            total += float('%s.%s' % match.groups())
+
+        output = cons.run_command('md5sum %x %x' % (ADDR, FILE_SIZE))
+        assert output.split()[-1] == digest
+    cons.log.info('%s: %d files in %.3f seconds' % (what, len(digests), total))
+
+@pytest.mark.boardspec('sandbox')
+@pytest.mark.buildconfigspec('cmd_squashfs')
+@pytest.mark.buildconfigspec('cmd_time')
+@pytest.mark.buildconfigspec('cmd_md5sum')
+@pytest.mark.requiredtool('mksquashfs')
+@pytest.mark.slow
+def test_sqfs_cache(u_boot_console):
+    """Test repeated lookups and reads, and binding another image"""
+    cons = u_boot_console
+    img1, digests1 = mk_image(cons, 'sqfs_cache1', 1, FILES)
+    # One more file, so the superblocks differ even if made in the same second
+    img2, digests2 = mk_image(cons, 'sqfs_cache2', 2, FILES + 1)
+
+    with cons.log.section('Same image'):
+        cons.run_command('host bind 0 %s' % img1)
+        load_all(cons, digests1, 'first pass')
+        load_all(cons, digests1, 'second pass')
+
+    with cons.log.section('Other image'):
+        # Same names but different contents, nothing cached may be used
+        cons.run_command('host bind 0 %s' % img2)
+        load_all(cons, digests2, 'other image')
+
+    cons.run_command('host unbind 0')
+    os.remove(img1)
+    os.remove(img2)
@@ -0,0 +1,88 @@
+# SPDX-License-Identifier: GPL-2.0+
+# Copyright (C) 2024 Intel Corporation <www.intel.com>
+
+"""
+Read a large file from a SquashFS image, whole and in parts at an offset, and
+report how long a whole load takes, to check and benchmark batched data block
+reads.
+"""
+
+import hashlib
+import os
+import re
+import shutil
+import subprocess
+import pytest
+
+BLOCK_SIZE = 0x20000
+ADDR = 0x1000000
+
+def mk_data():
+    """Data with compressed, uncompressed and sparse blocks, and a fragment"""
+    data = b''
+    for i in range(8):
+        data += bytes((i * 13 + j // 64) & 0xff for j in range(BLOCK_SIZE))
+    data += os.urandom(4 * BLOCK_SIZE)
+    data += bytes(2 * BLOCK_SIZE)
+    data += bytes((j * 5) & 0xff for j in range(3 * BLOCK_SIZE))
+    data += os.urandom(0x1234)
+
+    return data
+
+def load_part(cons, data, offset, size):
+    """Load part of the file and compare it with the source data"""
+    output = cons.run_command('time load host 0 %x big %x %x' %
+                              (ADDR, size, offset))
+    assert '%d bytes read' % size in output
+    output = cons.run_command('md5sum %x %x' % (ADDR, size))
+    assert output.split()[-1] == \
+        hashlib.md5(data[offset:offset + size]).hexdigest()
+
+@pytest.mark.boardspec('sandbox')
+@pytest.mark.buildconfigspec('cmd_squashfs')
+@pytest.mark.buildconfigspec('cmd_fs_generic')
+@pytest.mark.buildconfigspec('cmd_time')
+@pytest.mark.buildconfigspec('cmd_md5sum')
+@pytest.mark.requiredtool('mksquashfs')
+def test_sqfs_read(u_boot_console):
+    """Test reading a file whole and at an offset"""
+    cons = u_boot_console
+    src = os.path.join(cons.config.persistent_data_dir, 'sqfs_read')
+    img = src + '.img'
+    shutil.rmtree(src, ignore_errors=True)
+    os.makedirs(src)
+    data = mk_data()
+    with open(os.path.join(src, 'big'), 'wb') as fd:
+        fd.write(data)
+    if os.path.exists(img):
+        os.remove(img)
+    subprocess.run(['mksquashfs', src, img, '-noappend', '-no-xattrs',
+                    '-b', str(BLOCK_SIZE)], check=True, capture_output=True)
+    shutil.rmtree(src)
+
+    cons.run_command('host bind 0 %s' % img)
+    with cons.log.section('Whole file'):
+        output = cons.run_command('time sqfsload host 0 %x big' % ADDR)
+        assert '%d bytes read' % len(data) in output
+        match = re.search(r'time: (.*)', output)
+        cons.log.info('%d bytes: %s' % (len(data),
+                                        match.group(1) if match else '?'))
+        output = cons.run_command('md5sum %x %x' % (ADDR, len(data)))
+        assert output.split()[-1] == hashlib.md5(data).hexdigest()
+
+    with cons.log.section('Parts'):
+        # Inside a block, across blocks of each kind and into the fragment
+        for offset, size in ((0x100, 0x200), (BLOCK_SIZE - 0x10, 0x20),
+                             (3 * BLOCK_SIZE + 1, 6 * BLOCK_SIZE),
+                             (13 * BLOCK_SIZE - 7, 3 * BLOCK_SIZE),
+                             (17 * BLOCK_SIZE - 0x10, 0x1000),
+                             (len(data) - 0x1000, 0x1000)):
+            load_part(cons, data, offset, size)
+
+        # Past the end of the file
+        output = cons.run_command('load host 0 %x big 0x10 %x' %
+                                  (ADDR, len(data)))
+        assert 'bytes read' not in output
+
+    cons.run_command('host unbind 0')
+    os.remove(img)